@@ -74,13 +74,18 @@ int aac_encode_frame(codec_handle handle, unsigned char *input_buf, unsigned lon
     return ret_len;
 }
 
-void acc_encode_deinit(codec_handle handle)
+void aac_encode_deinit(codec_handle handle)
 {
     if (handle != NULL)
     {
         faacEncClose(handle);
     }
 }
+
+void acc_encode_deinit(codec_handle handle)
+{
+    aac_encode_deinit(handle);
+}
 #endif
 
 #if 1 //  aac解码器
@@ -161,7 +166,7 @@ int aac_decode_frame(codec_handle handle, audio_param_t audio_param, unsigned ch
     if (frame_info.error > 0)
     {
         fprintf(stderr, "%s\n", NeAACDecGetErrorMessage(frame_info.error));
-        return -1;
+        return AUDIO_CODEC_ERR(AUDIO_CODEC_ERROR_INVALID_PACKET);
     }
     
     pcm_len = frame_info.samples * frame_info.channels;
@@ -170,7 +175,7 @@ int aac_decode_frame(codec_handle handle, audio_param_t audio_param, unsigned ch
         if (pcm_len >= output_buf_size)
         {
             fprintf(stderr, "[%s]output_buf len is not enough\n", __func__);
-            return -1;
+            return AUDIO_CODEC_ERR(AUDIO_CODEC_ERROR_BUFFER_TOO_SMALL);
         }
         memcpy(output_buf, pcm_data, pcm_len);
         return pcm_len;
@@ -181,7 +186,7 @@ int aac_decode_frame(codec_handle handle, audio_param_t audio_param, unsigned ch
         if (i * 2 >= output_buf_size)
         {
             fprintf(stderr, "[%s]output_buf len is not enough\n", __func__);
-            return -1;
+            return AUDIO_CODEC_ERR(AUDIO_CODEC_ERROR_BUFFER_TOO_SMALL);
         }
         memcpy(output_buf + i * 2, pcm_data + i * 4, audio_param.bit_depth / sizeof(unsigned char));
         /* code */
@@ -190,7 +195,7 @@ int aac_decode_frame(codec_handle handle, audio_param_t audio_param, unsigned ch
     return pcm_len / 2;
 }
 
-void acc_decode_deinit(codec_handle handle)
+void aac_decode_deinit(codec_handle handle)
 {
     if (handle != NULL)
     {
@@ -198,4 +203,130 @@ void acc_decode_deinit(codec_handle handle)
     }
 }
 
-#endif
\ No newline at end of file
+void acc_decode_deinit(codec_handle handle)
+{
+    aac_decode_deinit(handle);
+}
+
+#endif
+
+#if 1 //  统一的编解码接口
+#define AAC_FRAME_SAMPLES 1024      // aac lc每帧每声道的采样数
+#define AAC_PCM_FRAME_MAX 8192      // 解码一帧最多输出的pcm字节数
+
+//  ADTS头里sampling_frequency_index对应的采样率
+static const int adts_samplerates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+
+static int aac_codec_init(audio_codec_t *codec)
+{
+    unsigned long input_len = 0;
+    unsigned long output_len_max = 0;
+
+    if (codec->mode == AUDIO_CODEC_DECODER)
+    {
+        //  解码器要用第一帧初始化, 第一次decode时再打开
+        codec->handle = NULL;
+        codec->frame_size = AAC_PCM_FRAME_MAX;
+        return 0;
+    }
+
+    codec->handle = aac_encode_init(codec->audio_param, &input_len, &output_len_max);
+    if (codec->handle == NULL)
+    {
+        return -1;
+    }
+    codec->frame_size = input_len * sizeof(short); // bit_depth=16, so use short
+    codec->packet_size_max = output_len_max;
+    return 0;
+}
+
+static int aac_codec_encode(audio_codec_t *codec, unsigned char *pcm, int pcm_len, unsigned char *out, int out_size)
+{
+    //  不足一帧的尾巴(文件结束时)也送进去, faac按实际采样数补零编成一帧; flush只取出faac里已经缓存的帧
+    if (pcm_len <= 0)
+    {
+        return 0;
+    }
+    //  输出直接写进调用者的缓存; faac每帧还会在库里malloc/free MDCT的临时缓存, 没有接口换掉
+    return aac_encode_frame(codec->handle, pcm, pcm_len / sizeof(short), out, out_size);
+}
+
+static int aac_codec_decode(audio_codec_t *codec, unsigned char *in, int in_len, unsigned char *pcm, int pcm_size)
+{
+    int index = 0;
+
+    if (codec->handle == NULL)
+    {
+        codec->handle = aac_decode_init(codec->audio_param, in, in_len);
+        if (codec->handle == NULL)
+        {
+            return -1;
+        }
+        //  输出的是ADTS头里的采样率, 和参数不同时改成流的采样率, 由调用者重采样
+        if (in_len >= 7 && in[0] == 0xff && (in[1] & 0xf0) == 0xf0)
+        {
+            index = (in[2] >> 2) & 0x0f;
+            if (index < sizeof(adts_samplerates) / sizeof(adts_samplerates[0]) &&
+                adts_samplerates[index] != codec->audio_param.samplerate)
+            {
+                fprintf(stderr, "[%s] stream samplerate is %d, not %d\n", __func__, adts_samplerates[index], codec->audio_param.samplerate);
+                codec->audio_param.samplerate = adts_samplerates[index];
+            }
+        }
+    }
+    return aac_decode_frame(codec->handle, codec->audio_param, in, in_len, pcm, pcm_size);
+}
+
+static int aac_codec_flush(audio_codec_t *codec, unsigned char *out, int out_size)
+{
+    if (codec->mode != AUDIO_CODEC_ENCODER)
+    {
+        return 0;
+    }
+    //  输入为空时faac输出缓存的帧
+    return aac_encode_frame(codec->handle, NULL, 0, out, out_size);
+}
+
+static void aac_codec_deinit(audio_codec_t *codec)
+{
+    if (codec->mode == AUDIO_CODEC_ENCODER)
+    {
+        aac_encode_deinit(codec->handle);
+    }
+    else
+    {
+        aac_decode_deinit(codec->handle);
+    }
+    codec->handle = NULL;
+}
+
+static int aac_codec_reset(audio_codec_t *codec)
+{
+    //  faac/faad都没有重置接口, 重新打开
+    aac_codec_deinit(codec);
+    return aac_codec_init(codec);
+}
+
+static int aac_codec_get_frame_size(audio_codec_t *codec)
+{
+    return codec->frame_size;
+}
+
+static int aac_codec_get_delay(audio_codec_t *codec)
+{
+    return codec->mode == AUDIO_CODEC_ENCODER ? AAC_FRAME_SAMPLES : 0;
+}
+
+const audio_codec_ops_t aac_codec_ops = {
+    .name = "aac",
+    .format = AENC_FORMAT_AAC,
+    .init = aac_codec_init,
+    .encode = aac_codec_encode,
+    .decode = aac_codec_decode,
+    .flush = aac_codec_flush,
+    .reset = aac_codec_reset,
+    .get_frame_size = aac_codec_get_frame_size,
+    .get_delay = aac_codec_get_delay,
+    .deinit = aac_codec_deinit,
+};
+#endif
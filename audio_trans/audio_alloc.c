@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "audio_alloc.h"
+
+static int alloc_guard_enabled = 0;
+static __thread int alloc_steady_flag = 0;
+static __thread unsigned long long alloc_thread_count = 0;
+
+void audio_alloc_guard(int enable)
+{
+    __atomic_store_n(&alloc_guard_enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+void audio_alloc_steady(int steady)
+{
+    alloc_steady_flag = steady;
+}
+
+unsigned long long audio_alloc_count(void)
+{
+    return alloc_thread_count;
+}
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+/*
+ * 稳态里的分配: 打开检查时报出大小后abort, 用core里的调用栈定位.
+ * 这里不能再分配内存, 只用栈上的缓存和write
+ */
+static void alloc_check(const char *func, size_t size)
+{
+    int len = 0;
+    char msg[128];
+
+    alloc_thread_count++;
+    if (!alloc_steady_flag || !__atomic_load_n(&alloc_guard_enabled, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    len = snprintf(msg, sizeof(msg), "[%s] %zu bytes allocated in steady state, abort\n", func, size);
+    if (len > 0)
+    {
+        write(STDERR_FILENO, msg, len < (int)sizeof(msg) ? len : (int)sizeof(msg) - 1);
+    }
+    abort();
+}
+
+/*
+ * 只计数和检查, 实际分配交给glibc; free不用替换
+ */
+void *malloc(size_t size)
+{
+    alloc_check(__func__, size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    alloc_check(__func__, nmemb * size);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    alloc_check(__func__, size);
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr = NULL;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+    alloc_check(__func__, size);
+    ptr = __libc_memalign(alignment, size);
+    if (ptr == NULL)
+    {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    //  和glibc一样, 对齐不是2的幂时失败
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    alloc_check(__func__, size);
+    return __libc_memalign(alignment, size);
+}
+#endif
@@ -0,0 +1,38 @@
+#ifndef __AUDIO_ALLOC_H__
+#define __AUDIO_ALLOC_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * 调试用, 不在库里: make ALLOC_GUARD=1时定义AUDIO_ALLOC_GUARD并链接audio_alloc.c,
+ * 替换malloc/calloc/realloc/posix_memalign/aligned_alloc, 按线程计数. 依赖glibc的__libc_malloc等, 其他libc下只有计数接口.
+ * 线程初始化完进入稳态后调用audio_alloc_steady(1), 打开audio_alloc_guard时稳态里的分配直接abort, 用来发现热路径上的分配.
+ * 正常编译和ASan/TSan编译不替换malloc, 下面的调用都是空操作, audio_alloc_count返回0
+ */
+#ifdef AUDIO_ALLOC_GUARD
+/*
+ * 稳态里分配时abort, 默认关闭
+ */
+void audio_alloc_guard(int enable);
+/*
+ * 标记当前线程进入(1)或退出(0)稳态
+ */
+void audio_alloc_steady(int steady);
+/*
+ * 当前线程累计的分配次数, 不替换malloc的平台返回0
+ */
+unsigned long long audio_alloc_count(void);
+#else
+#define audio_alloc_guard(enable) ((void)(enable))
+#define audio_alloc_steady(steady) ((void)(steady))
+#define audio_alloc_count() 0ULL
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "audio_trans.h"
+
+#define SLAB_SLOT_ALIGN 64                  // 每个槽按cache line对齐
+#define SLAB_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+struct audio_slab
+{
+    unsigned char *base;    // 连续的一整块内存
+    size_t map_size;
+    int slot_size;
+    int slot_count;
+    int bump;               // 从未分配过的第一个槽
+    int used;
+    void *free_list;        // 释放回来的槽, 槽的头部存下一个空闲槽
+    int hugepage;
+    pthread_mutex_t lock;
+};
+
+#if 1   //  内存池
+audio_slab_t *audio_slab_create(int slot_size, int slot_count)
+{
+    audio_slab_t *slab = NULL;
+    size_t map_size = 0;
+
+    if (slot_size <= 0 || slot_count <= 0)
+    {
+        fprintf(stderr, "[%s] slot_size=%d, slot_count=%d, err param\n", __func__, slot_size, slot_count);
+        return NULL;
+    }
+
+    slab = (audio_slab_t *)calloc(1, sizeof(audio_slab_t));
+    if (slab == NULL)
+    {
+        return NULL;
+    }
+
+    slab->slot_size = (slot_size + SLAB_SLOT_ALIGN - 1) & ~(SLAB_SLOT_ALIGN - 1);
+    slab->slot_count = slot_count;
+    map_size = (size_t)slab->slot_size * slot_count;
+    map_size = (map_size + SLAB_HUGEPAGE_SIZE - 1) & ~((size_t)SLAB_HUGEPAGE_SIZE - 1);
+
+    //  优先用大页, 系统没有预留大页时退回普通页并建议内核合并成透明大页
+    slab->base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (slab->base != MAP_FAILED)
+    {
+        slab->hugepage = 1;
+    }
+    else
+    {
+        slab->base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab->base == MAP_FAILED)
+        {
+            fprintf(stderr, "[%s] cannot map %zu bytes\n", __func__, map_size);
+            free(slab);
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(slab->base, map_size, MADV_HUGEPAGE);
+#endif
+    }
+    slab->map_size = map_size;
+    pthread_mutex_init(&slab->lock, NULL);
+
+    return slab;
+}
+
+void *audio_slab_alloc(audio_slab_t *slab)
+{
+    void *slot = NULL;
+
+    if (slab == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&slab->lock);
+    if (slab->free_list != NULL)
+    {
+        slot = slab->free_list;
+        slab->free_list = *(void **)slot;
+    }
+    else if (slab->bump < slab->slot_count)
+    {
+        slot = slab->base + (size_t)slab->bump * slab->slot_size;
+        slab->bump++;
+    }
+    if (slot != NULL)
+    {
+        slab->used++;
+    }
+    pthread_mutex_unlock(&slab->lock);
+
+    return slot;
+}
+
+void audio_slab_free(audio_slab_t *slab, void *ptr)
+{
+    unsigned char *p = (unsigned char *)ptr;
+
+    if (slab == NULL || p == NULL)
+    {
+        return;
+    }
+    if (p < slab->base || p >= slab->base + (size_t)slab->slot_size * slab->slot_count ||
+        (p - slab->base) % slab->slot_size != 0)
+    {
+        fprintf(stderr, "[%s] %p is not a slot of this slab\n", __func__, ptr);
+        return;
+    }
+
+    pthread_mutex_lock(&slab->lock);
+    *(void **)p = slab->free_list;
+    slab->free_list = p;
+    slab->used--;
+    pthread_mutex_unlock(&slab->lock);
+}
+
+int audio_slab_slot_size(audio_slab_t *slab)
+{
+    return slab != NULL ? slab->slot_size : 0;
+}
+
+int audio_slab_used(audio_slab_t *slab)
+{
+    int used = 0;
+
+    if (slab == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&slab->lock);
+    used = slab->used;
+    pthread_mutex_unlock(&slab->lock);
+
+    return used;
+}
+
+void audio_slab_destroy(audio_slab_t *slab)
+{
+    if (slab == NULL)
+    {
+        return;
+    }
+    munmap(slab->base, slab->map_size);
+    pthread_mutex_destroy(&slab->lock);
+    free(slab);
+}
+#endif
+
+#if 1   //  线性内存区
+#define ARENA_ALIGN 64
+
+struct audio_arena
+{
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    size_t peak;
+};
+
+audio_arena_t *audio_arena_create(size_t size)
+{
+    audio_arena_t *arena = NULL;
+
+    if (size == 0)
+    {
+        fprintf(stderr, "[%s] size=0, err param\n", __func__);
+        return NULL;
+    }
+    //  头和数据一次分配, 数据从下一个对齐位置开始
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (posix_memalign((void **)&arena, ARENA_ALIGN, ARENA_ALIGN + size) != 0)
+    {
+        return NULL;
+    }
+    arena->base = (unsigned char *)arena + ARENA_ALIGN;
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+
+    return arena;
+}
+
+void *audio_arena_alloc(audio_arena_t *arena, size_t size)
+{
+    size_t offset = 0;
+
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+    offset = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (offset > arena->size || size > arena->size - offset)
+    {
+        return NULL;
+    }
+    arena->used = offset + size;
+    if (arena->used > arena->peak)
+    {
+        arena->peak = arena->used;
+    }
+
+    return arena->base + offset;
+}
+
+size_t audio_arena_mark(audio_arena_t *arena)
+{
+    return arena != NULL ? arena->used : 0;
+}
+
+void audio_arena_release(audio_arena_t *arena, size_t mark)
+{
+    if (arena != NULL && mark <= arena->used)
+    {
+        arena->used = mark;
+    }
+}
+
+size_t audio_arena_peak(audio_arena_t *arena)
+{
+    return arena != NULL ? arena->peak : 0;
+}
+
+void audio_arena_destroy(audio_arena_t *arena)
+{
+    free(arena);
+}
+#endif
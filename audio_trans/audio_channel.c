@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHANNEL_HAVE_AVX2 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CHANNEL_HAVE_NEON 1
+#endif
+
+#include "audio_trans.h"
+
+#define CHANNEL_MINUS_3DB 0.70710678f
+
+static short channel_saturate(float v)
+{
+    if (v >= 32767.0f)
+    {
+        return 32767;
+    }
+    if (v <= -32768.0f)
+    {
+        return -32768;
+    }
+    return (short)lrintf(v);
+}
+
+#if 1   //  双声道的快速路径
+#ifdef CHANNEL_HAVE_AVX2
+static int channel_have_avx2(void)
+{
+    static int have = -1;
+
+    if (have < 0)
+    {
+        __builtin_cpu_init();
+        have = __builtin_cpu_supports("avx2");
+    }
+    return have;
+}
+
+/*
+ * 每32位是一对LR, 左移再算术右移取L, 直接算术右移取R; 两组再饱和打包回16位, 打包是按128位分别做的, 要重排
+ */
+__attribute__((target("avx2"))) static int stereo_to_mono_avx2(const short *in, int frames, short *out)
+{
+    int i = 0;
+    __m256i a, b, suma, sumb;
+    const __m256i one = _mm256_set1_epi32(1);
+
+    for (i = 0; i + 16 <= frames; i += 16)
+    {
+        a = _mm256_loadu_si256((const __m256i *)(in + i * 2));
+        b = _mm256_loadu_si256((const __m256i *)(in + i * 2 + 16));
+        suma = _mm256_add_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(a, 16));
+        sumb = _mm256_add_epi32(_mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16), _mm256_srai_epi32(b, 16));
+        suma = _mm256_srai_epi32(_mm256_add_epi32(suma, one), 1);
+        sumb = _mm256_srai_epi32(_mm256_add_epi32(sumb, one), 1);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(suma, sumb), 0xD8));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static int stereo_split_avx2(const short *in, int frames, short *left, short *right)
+{
+    int i = 0;
+    __m256i a, b;
+
+    for (i = 0; i + 16 <= frames; i += 16)
+    {
+        a = _mm256_loadu_si256((const __m256i *)(in + i * 2));
+        b = _mm256_loadu_si256((const __m256i *)(in + i * 2 + 16));
+        _mm256_storeu_si256((__m256i *)(left + i), _mm256_permute4x64_epi64(
+                                _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16),
+                                                   _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16)), 0xD8));
+        _mm256_storeu_si256((__m256i *)(right + i), _mm256_permute4x64_epi64(
+                                 _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16)), 0xD8));
+    }
+    return i;
+}
+
+/*
+ * unpack也是按128位做的, 两半交换后才是连续的LR
+ */
+__attribute__((target("avx2"))) static int stereo_merge_avx2(const short *left, const short *right, int frames, short *out)
+{
+    int i = 0;
+    __m256i l, r, lo, hi;
+
+    for (i = 0; i + 16 <= frames; i += 16)
+    {
+        l = _mm256_loadu_si256((const __m256i *)(left + i));
+        r = _mm256_loadu_si256((const __m256i *)(right + i));
+        lo = _mm256_unpacklo_epi16(l, r);
+        hi = _mm256_unpackhi_epi16(l, r);
+        _mm256_storeu_si256((__m256i *)(out + i * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + i * 2 + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return i;
+}
+#endif
+
+static int stereo_to_mono(const short *in, int frames, short *out)
+{
+    int i = 0;
+
+#ifdef CHANNEL_HAVE_AVX2
+    if (channel_have_avx2())
+    {
+        i = stereo_to_mono_avx2(in, frames, out);
+    }
+#elif defined(CHANNEL_HAVE_NEON)
+    for (; i + 8 <= frames; i += 8)
+    {
+        int16x8x2_t lr = vld2q_s16(in + i * 2);
+        vst1q_s16(out + i, vrhaddq_s16(lr.val[0], lr.val[1]));
+    }
+#endif
+    for (; i < frames; i++)
+    {
+        out[i] = (short)((in[i * 2] + in[i * 2 + 1] + 1) >> 1);
+    }
+    return frames;
+}
+
+static int stereo_split(const short *in, int frames, short *left, short *right)
+{
+    int i = 0;
+
+#ifdef CHANNEL_HAVE_AVX2
+    if (channel_have_avx2())
+    {
+        i = stereo_split_avx2(in, frames, left, right);
+    }
+#elif defined(CHANNEL_HAVE_NEON)
+    for (; i + 8 <= frames; i += 8)
+    {
+        int16x8x2_t lr = vld2q_s16(in + i * 2);
+        vst1q_s16(left + i, lr.val[0]);
+        vst1q_s16(right + i, lr.val[1]);
+    }
+#endif
+    for (; i < frames; i++)
+    {
+        left[i] = in[i * 2];
+        right[i] = in[i * 2 + 1];
+    }
+    return frames;
+}
+
+static int stereo_merge(const short *left, const short *right, int frames, short *out)
+{
+    int i = 0;
+
+#ifdef CHANNEL_HAVE_AVX2
+    if (channel_have_avx2())
+    {
+        i = stereo_merge_avx2(left, right, frames, out);
+    }
+#elif defined(CHANNEL_HAVE_NEON)
+    for (; i + 8 <= frames; i += 8)
+    {
+        int16x8x2_t lr;
+        lr.val[0] = vld1q_s16(left + i);
+        lr.val[1] = vld1q_s16(right + i);
+        vst2q_s16(out + i * 2, lr);
+    }
+#endif
+    for (; i < frames; i++)
+    {
+        out[i * 2] = left[i];
+        out[i * 2 + 1] = right[i];
+    }
+    return frames;
+}
+#endif
+
+#if 1   //  声道转换
+int audio_channel_matrix_default(int in_channels, int out_channels, float *matrix)
+{
+    int i = 0;
+    int o = 0;
+    int count = 0;
+    float stereo[2][6] = {
+        //  L     R     C                  LFE   Ls                 Rs
+        {1.0f, 0.0f, CHANNEL_MINUS_3DB, 0.0f, CHANNEL_MINUS_3DB, 0.0f},
+        {0.0f, 1.0f, CHANNEL_MINUS_3DB, 0.0f, 0.0f, CHANNEL_MINUS_3DB},
+    };
+    float norm = 1.0f / (1.0f + 2 * CHANNEL_MINUS_3DB);
+
+    if (in_channels <= 0 || in_channels > AUDIO_CHANNELS_MAX || out_channels <= 0 || out_channels > AUDIO_CHANNELS_MAX || matrix == NULL)
+    {
+        fprintf(stderr, "[%s] in_channels=%d, out_channels=%d, err param\n", __func__, in_channels, out_channels);
+        return -1;
+    }
+    memset(matrix, 0, sizeof(float) * in_channels * out_channels);
+
+    //  5.1(L R C LFE Ls Rs)按ITU-R BS.775下混, 丢掉LFE, 整体缩放到不会削波
+    if (in_channels == 6 && out_channels <= 2)
+    {
+        for (o = 0; o < out_channels; o++)
+        {
+            for (i = 0; i < 6; i++)
+            {
+                matrix[o * 6 + i] = out_channels == 2 ? stereo[o][i] * norm : (stereo[0][i] + stereo[1][i]) * norm / 2;
+            }
+        }
+        return 0;
+    }
+
+    //  单声道输出取所有声道的平均; 其余情况声道一一对应,
+    //  多出来的输入声道平均到同余的输出声道, 多出来的输出声道循环复制输入声道
+    for (o = 0; o < out_channels; o++)
+    {
+        if (out_channels == 1)
+        {
+            for (i = 0; i < in_channels; i++)
+            {
+                matrix[i] = 1.0f / in_channels;
+            }
+            break;
+        }
+        if (o >= in_channels)
+        {
+            matrix[o * in_channels + o % in_channels] = 1.0f;
+            continue;
+        }
+        count = 0;
+        for (i = o; i < in_channels; i += out_channels)
+        {
+            count++;
+        }
+        for (i = o; i < in_channels; i += out_channels)
+        {
+            matrix[o * in_channels + i] = 1.0f / count;
+        }
+    }
+
+    return 0;
+}
+
+int audio_channel_mix(const short *in, int in_channels, int frames, const float *matrix, int out_channels, short *out)
+{
+    int f = 0;
+    int i = 0;
+    int o = 0;
+    float acc = 0;
+    const float *row = NULL;
+
+    if (in == NULL || out == NULL || matrix == NULL || frames < 0 ||
+        in_channels <= 0 || in_channels > AUDIO_CHANNELS_MAX || out_channels <= 0 || out_channels > AUDIO_CHANNELS_MAX)
+    {
+        fprintf(stderr, "[%s] err param\n", __func__);
+        return -1;
+    }
+
+    //  常用的两种转换走整数快速路径, 和按矩阵计算只在.5时舍入方向不同
+    if (in_channels == 2 && out_channels == 1 && matrix[0] == 0.5f && matrix[1] == 0.5f)
+    {
+        return stereo_to_mono(in, frames, out);
+    }
+    if (in_channels == 1 && out_channels == 2 && matrix[0] == 1.0f && matrix[1] == 1.0f)
+    {
+        return stereo_merge(in, in, frames, out);
+    }
+
+    for (f = 0; f < frames; f++)
+    {
+        for (o = 0; o < out_channels; o++)
+        {
+            row = matrix + o * in_channels;
+            acc = 0;
+            for (i = 0; i < in_channels; i++)
+            {
+                acc += row[i] * in[i];
+            }
+            out[o] = channel_saturate(acc);
+        }
+        in += in_channels;
+        out += out_channels;
+    }
+
+    return frames;
+}
+
+int audio_channel_deinterleave(const short *in, int channels, int frames, short *const *planar)
+{
+    int f = 0;
+    int c = 0;
+
+    if (in == NULL || planar == NULL || channels <= 0 || channels > AUDIO_CHANNELS_MAX || frames < 0)
+    {
+        fprintf(stderr, "[%s] err param\n", __func__);
+        return -1;
+    }
+    if (channels == 2)
+    {
+        return stereo_split(in, frames, planar[0], planar[1]);
+    }
+
+    for (f = 0; f < frames; f++)
+    {
+        for (c = 0; c < channels; c++)
+        {
+            planar[c][f] = in[f * channels + c];
+        }
+    }
+    return frames;
+}
+
+int audio_channel_interleave(const short *const *planar, int channels, int frames, short *out)
+{
+    int f = 0;
+    int c = 0;
+
+    if (out == NULL || planar == NULL || channels <= 0 || channels > AUDIO_CHANNELS_MAX || frames < 0)
+    {
+        fprintf(stderr, "[%s] err param\n", __func__);
+        return -1;
+    }
+    if (channels == 2)
+    {
+        return stereo_merge(planar[0], planar[1], frames, out);
+    }
+
+    for (f = 0; f < frames; f++)
+    {
+        for (c = 0; c < channels; c++)
+        {
+            out[f * channels + c] = planar[c][f];
+        }
+    }
+    return frames;
+}
+
+int audio_channel_extract(const short *in, int channels, int frames, int index, short *out)
+{
+    int f = 0;
+
+    if (in == NULL || out == NULL || channels <= 0 || channels > AUDIO_CHANNELS_MAX || index < 0 || index >= channels || frames < 0)
+    {
+        fprintf(stderr, "[%s] err param\n", __func__);
+        return -1;
+    }
+
+    for (f = 0; f < frames; f++)
+    {
+        out[f] = in[f * channels + index];
+    }
+    return frames;
+}
+#endif
@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "audio_trans.h"
+
+#define PCM_FRAME_MS 20
+
+static const audio_codec_ops_t *codec_registry[AENC_FORMAT_MAX] = {
+    [AENC_FORMAT_PCM] = &pcm_codec_ops,
+    [AENC_FORMAT_AAC] = &aac_codec_ops,
+    [AENC_FORMAT_G711A] = &g711a_codec_ops,
+    [AENC_FORMAT_OPUS] = &opus_codec_ops,
+};
+
+//  全局计数器, 按格式和编码/解码
+static audio_codec_counters_t codec_counters[AENC_FORMAT_MAX][2];
+
+static const char *codec_error_names[AUDIO_CODEC_ERROR_MAX] = {"failed", "buffer_too_small", "internal", "invalid_packet"};
+
+#if 1   //  pcm直通
+static int pcm_codec_init(audio_codec_t *codec)
+{
+    int fps = codec->audio_param.fps > 0 ? codec->audio_param.fps : 1000 / PCM_FRAME_MS;
+
+    codec->frame_size = codec->audio_param.samplerate / fps * codec->audio_param.channels * (codec->audio_param.bit_depth / 8);
+    codec->packet_size_max = codec->frame_size;
+    return codec->frame_size > 0 ? 0 : -1;
+}
+
+static int pcm_codec_copy(audio_codec_t *codec, unsigned char *in, int in_len, unsigned char *out, int out_size)
+{
+    if (in_len > out_size)
+    {
+        fprintf(stderr, "[%s]output_buf len is not enough\n", __func__);
+        return AUDIO_CODEC_ERR(AUDIO_CODEC_ERROR_BUFFER_TOO_SMALL);
+    }
+    memcpy(out, in, in_len);
+    return in_len;
+}
+
+static int pcm_codec_get_frame_size(audio_codec_t *codec)
+{
+    return codec->frame_size;
+}
+
+const audio_codec_ops_t pcm_codec_ops = {
+    .name = "pcm",
+    .format = AENC_FORMAT_PCM,
+    .init = pcm_codec_init,
+    .encode = pcm_codec_copy,
+    .decode = pcm_codec_copy,
+    .get_frame_size = pcm_codec_get_frame_size,
+};
+#endif
+
+#if 1   //  计数器
+#define CODEC_COUNT(codec, field, n) codec_count((codec), offsetof(audio_codec_counters_t, field), (n))
+
+//  句柄和全局的同一个计数器一起加
+static void codec_count(audio_codec_t *codec, size_t offset, unsigned long long n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    __atomic_fetch_add((unsigned long long *)((char *)&codec->counters + offset), n, __ATOMIC_RELAXED);
+    __atomic_fetch_add((unsigned long long *)((char *)&codec_counters[codec->ops->format][codec->mode] + offset), n, __ATOMIC_RELAXED);
+}
+
+//  按返回值归类, 不认识的错误码算FAILED
+static void codec_count_error(audio_codec_t *codec, int ret)
+{
+    int type = -1 - ret;
+
+    if (type < 0 || type >= AUDIO_CODEC_ERROR_MAX)
+    {
+        type = AUDIO_CODEC_ERROR_FAILED;
+    }
+    codec_count(codec, offsetof(audio_codec_counters_t, errors) + type * sizeof(unsigned long long), 1);
+}
+
+//  记一次调用的输出
+static void codec_count_output(audio_codec_t *codec, int ret)
+{
+    if (ret < 0)
+    {
+        codec_count_error(codec, ret);
+    }
+    else if (ret > 0)
+    {
+        CODEC_COUNT(codec, frames_out, 1);
+        CODEC_COUNT(codec, bytes_out, ret);
+    }
+}
+
+static void codec_counters_load(audio_codec_counters_t *dst, audio_codec_counters_t *src)
+{
+    size_t i = 0;
+    unsigned long long *d = (unsigned long long *)dst;
+    unsigned long long *v = (unsigned long long *)src;
+
+    for (i = 0; i < sizeof(audio_codec_counters_t) / sizeof(unsigned long long); i++)
+    {
+        d[i] = __atomic_load_n(&v[i], __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * 清零也逐个字段原子写, 和读线程的codec_counters_load配对
+ */
+static void codec_counters_clear(audio_codec_counters_t *counters)
+{
+    size_t i = 0;
+    unsigned long long *v = (unsigned long long *)counters;
+
+    for (i = 0; i < sizeof(audio_codec_counters_t) / sizeof(unsigned long long); i++)
+    {
+        __atomic_store_n(&v[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+int audio_codec_get_counters(audio_codec_t *codec, audio_codec_counters_t *counters)
+{
+    if (codec == NULL || counters == NULL)
+    {
+        return -1;
+    }
+    codec_counters_load(counters, &codec->counters);
+    return 0;
+}
+
+int audio_codec_get_global_counters(aenc_format_e format, audio_codec_mode_e mode, audio_codec_counters_t *counters)
+{
+    if (format < 0 || format >= AENC_FORMAT_MAX || (mode != AUDIO_CODEC_ENCODER && mode != AUDIO_CODEC_DECODER) || counters == NULL)
+    {
+        return -1;
+    }
+    codec_counters_load(counters, &codec_counters[format][mode]);
+    return 0;
+}
+
+const char *audio_codec_error_name(audio_codec_error_e error)
+{
+    return (unsigned)error < AUDIO_CODEC_ERROR_MAX ? codec_error_names[error] : "unknown";
+}
+
+void audio_codec_dump_counters(FILE *fp, int json)
+{
+    int i = 0;
+    int mode = 0;
+    int format = 0;
+    int first = 1;
+    const char *name = NULL;
+    const char *mode_name = NULL;
+    audio_codec_counters_t c;
+
+    if (fp == NULL)
+    {
+        return;
+    }
+    if (json)
+    {
+        fprintf(fp, "{\"counters\": [");
+    }
+    for (format = 0; format < AENC_FORMAT_MAX; format++)
+    {
+        for (mode = AUDIO_CODEC_ENCODER; mode <= AUDIO_CODEC_DECODER; mode++)
+        {
+            audio_codec_get_global_counters(format, mode, &c);
+            //  没有调用过的不输出, 只出过错的也要输出
+            if (c.frames_in == 0 && c.frames_out == 0 && c.concealed == 0 &&
+                c.errors[AUDIO_CODEC_ERROR_FAILED] + c.errors[AUDIO_CODEC_ERROR_BUFFER_TOO_SMALL] +
+                c.errors[AUDIO_CODEC_ERROR_INTERNAL] + c.errors[AUDIO_CODEC_ERROR_INVALID_PACKET] == 0)
+            {
+                continue;
+            }
+            name = codec_registry[format] != NULL ? codec_registry[format]->name : "unknown";
+            mode_name = mode == AUDIO_CODEC_ENCODER ? "encode" : "decode";
+            if (json)
+            {
+                fprintf(fp, "%s\n  {\"codec\": \"%s\", \"mode\": \"%s\", \"frames_in\": %llu, \"frames_out\": %llu, "
+                            "\"bytes_in\": %llu, \"bytes_out\": %llu, \"concealed\": %llu, \"errors\": {",
+                        first ? "" : ",", name, mode_name, c.frames_in, c.frames_out, c.bytes_in, c.bytes_out, c.concealed);
+                for (i = 0; i < AUDIO_CODEC_ERROR_MAX; i++)
+                {
+                    fprintf(fp, "%s\"%s\": %llu", i == 0 ? "" : ", ", codec_error_names[i], c.errors[i]);
+                }
+                fprintf(fp, "}}");
+            }
+            else
+            {
+                fprintf(fp, "%s.%s.frames_in %llu\n%s.%s.frames_out %llu\n%s.%s.bytes_in %llu\n%s.%s.bytes_out %llu\n%s.%s.concealed %llu\n",
+                        name, mode_name, c.frames_in, name, mode_name, c.frames_out, name, mode_name, c.bytes_in,
+                        name, mode_name, c.bytes_out, name, mode_name, c.concealed);
+                for (i = 0; i < AUDIO_CODEC_ERROR_MAX; i++)
+                {
+                    fprintf(fp, "%s.%s.errors.%s %llu\n", name, mode_name, codec_error_names[i], c.errors[i]);
+                }
+            }
+            first = 0;
+        }
+    }
+    if (json)
+    {
+        fprintf(fp, "\n]}\n");
+    }
+    fflush(fp);
+}
+#endif
+
+#if 1   //  统一的编解码接口
+int audio_codec_register(const audio_codec_ops_t *ops)
+{
+    if (ops == NULL || ops->format < 0 || ops->format >= AENC_FORMAT_MAX || ops->init == NULL)
+    {
+        fprintf(stderr, "[%s] err param\n", __func__);
+        return -1;
+    }
+    codec_registry[ops->format] = ops;
+    return 0;
+}
+
+const audio_codec_ops_t *audio_codec_find(aenc_format_e format)
+{
+    if (format < 0 || format >= AENC_FORMAT_MAX)
+    {
+        return NULL;
+    }
+    return codec_registry[format];
+}
+
+audio_codec_t *audio_codec_open(aenc_format_e format, audio_codec_mode_e mode, audio_param_t audio_param)
+{
+    const audio_codec_ops_t *ops = NULL;
+    audio_codec_t *codec = NULL;
+
+    ops = audio_codec_find(format);
+    if (ops == NULL)
+    {
+        fprintf(stderr, "[%s] format=%d is not registered\n", __func__, format);
+        return NULL;
+    }
+
+    codec = (audio_codec_t *)calloc(1, sizeof(audio_codec_t));
+    if (codec == NULL)
+    {
+        return NULL;
+    }
+    codec->ops = ops;
+    codec->mode = mode;
+    codec->audio_param = audio_param;
+    codec->audio_param.format = format;
+
+    if (ops->init(codec) != 0)
+    {
+        fprintf(stderr, "[%s] cannot open %s %s\n", __func__, ops->name, mode == AUDIO_CODEC_ENCODER ? "encoder" : "decoder");
+        audio_arena_destroy(codec->scratch);
+        free(codec);
+        return NULL;
+    }
+
+    return codec;
+}
+
+int audio_codec_encode(audio_codec_t *codec, unsigned char *pcm, int pcm_len, unsigned char *out, int out_size)
+{
+    int ret = 0;
+    unsigned long long start = 0;
+
+    if (codec == NULL || codec->ops->encode == NULL || codec->mode != AUDIO_CODEC_ENCODER)
+    {
+        return -1;
+    }
+    start = AUDIO_TRACE_START();
+    ret = codec->ops->encode(codec, pcm, pcm_len, out, out_size);
+    AUDIO_TRACE_STOP(AUDIO_TRACE_ENCODE, codec->ops->format, start, 1);
+    if (ret >= 0)
+    {
+        CODEC_COUNT(codec, frames_in, 1);
+        CODEC_COUNT(codec, bytes_in, pcm_len);
+    }
+    codec_count_output(codec, ret);
+    return ret;
+}
+
+int audio_codec_encode_batch(audio_codec_t *codec, unsigned char *pcm, int frame_count, unsigned char *out, int out_size, int *packet_len)
+{
+    int i = 0;
+    int ret = 0;
+    int offset = 0;
+    unsigned long long start = 0;
+
+    if (codec == NULL || codec->mode != AUDIO_CODEC_ENCODER || packet_len == NULL)
+    {
+        return -1;
+    }
+    if (codec->ops->encode_batch != NULL)
+    {
+        //  一批只能测总时间, 按平均每帧记
+        start = AUDIO_TRACE_START();
+        ret = codec->ops->encode_batch(codec, pcm, frame_count, out, out_size, packet_len);
+        AUDIO_TRACE_STOP(AUDIO_TRACE_ENCODE, codec->ops->format, start, frame_count);
+        if (ret < 0)
+        {
+            codec_count_error(codec, ret);
+            return ret;
+        }
+        CODEC_COUNT(codec, frames_in, frame_count);
+        CODEC_COUNT(codec, bytes_in, (unsigned long long)frame_count * codec->frame_size);
+        for (i = 0; i < frame_count; i++)
+        {
+            codec_count_output(codec, packet_len[i]);
+        }
+        return ret;
+    }
+
+    for (i = 0; i < frame_count; i++)
+    {
+        ret = audio_codec_encode(codec, pcm + (size_t)i * codec->frame_size, codec->frame_size, out + offset, out_size - offset);
+        if (ret < 0)
+        {
+            return -1;
+        }
+        packet_len[i] = ret;
+        offset += ret;
+    }
+    return offset;
+}
+
+int audio_codec_decode(audio_codec_t *codec, unsigned char *in, int in_len, unsigned char *pcm, int pcm_size)
+{
+    int ret = 0;
+    unsigned long long start = 0;
+
+    if (codec == NULL || codec->ops->decode == NULL || codec->mode != AUDIO_CODEC_DECODER)
+    {
+        return -1;
+    }
+    start = AUDIO_TRACE_START();
+    ret = codec->ops->decode(codec, in, in_len, pcm, pcm_size);
+    AUDIO_TRACE_STOP(AUDIO_TRACE_DECODE, codec->ops->format, start, 1);
+    CODEC_COUNT(codec, frames_in, 1);
+    CODEC_COUNT(codec, bytes_in, in_len);
+    codec_count_output(codec, ret);
+    return ret;
+}
+
+int audio_codec_conceal(audio_codec_t *codec, unsigned char *pcm, int pcm_size)
+{
+    int ret = 0;
+    unsigned long long start = 0;
+
+    if (codec == NULL || codec->ops->conceal == NULL || codec->mode != AUDIO_CODEC_DECODER)
+    {
+        return -1;
+    }
+    start = AUDIO_TRACE_START();
+    ret = codec->ops->conceal(codec, pcm, pcm_size);
+    AUDIO_TRACE_STOP(AUDIO_TRACE_DECODE, codec->ops->format, start, 1);
+    if (ret > 0)
+    {
+        CODEC_COUNT(codec, concealed, 1);
+    }
+    codec_count_output(codec, ret);
+    return ret;
+}
+
+int audio_codec_flush(audio_codec_t *codec, unsigned char *out, int out_size)
+{
+    int ret = 0;
+
+    if (codec == NULL)
+    {
+        return -1;
+    }
+    if (codec->ops->flush == NULL)
+    {
+        return 0;
+    }
+    ret = codec->ops->flush(codec, out, out_size);
+    codec_count_output(codec, ret);
+    return ret;
+}
+
+int audio_codec_reset(audio_codec_t *codec)
+{
+    if (codec == NULL)
+    {
+        return -1;
+    }
+    codec_counters_clear(&codec->counters);
+    if (codec->ops->reset == NULL)
+    {
+        return 0;
+    }
+    return codec->ops->reset(codec);
+}
+
+int audio_codec_get_frame_size(audio_codec_t *codec)
+{
+    if (codec == NULL)
+    {
+        return -1;
+    }
+    if (codec->ops->get_frame_size == NULL)
+    {
+        return codec->frame_size;
+    }
+    return codec->ops->get_frame_size(codec);
+}
+
+int audio_codec_get_delay(audio_codec_t *codec)
+{
+    if (codec == NULL)
+    {
+        return -1;
+    }
+    if (codec->ops->get_delay == NULL)
+    {
+        return 0;
+    }
+    return codec->ops->get_delay(codec);
+}
+
+void audio_codec_close(audio_codec_t *codec)
+{
+    if (codec == NULL)
+    {
+        return;
+    }
+    if (codec->ops->deinit != NULL)
+    {
+        codec->ops->deinit(codec);
+    }
+    audio_arena_destroy(codec->scratch);
+    free(codec);
+}
+#endif
@@ -0,0 +1,740 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "audio_trans.h"
+
+#define DAEMON_EVENTS 64
+#define DAEMON_POOL_MAX 64                      // 空闲句柄最多保留这么多个, 多了关掉最久没用的
+#define DAEMON_OUT_HIGH (1024 * 1024)           // 待发送的数据超过这么多就不再读这个连接
+#define DAEMON_OUT_LOW (256 * 1024)             // 降到这么多以下再继续读
+#define DAEMON_READ_SIZE (64 * 1024)
+
+typedef struct
+{
+    aenc_format_e from;
+    aenc_format_e to;
+    audio_param_t audio_param;
+    audio_codec_t *decoder;
+    audio_codec_t *encoder;
+    pcm_fifo_t *fifo;
+    int frame_bytes;                // 编码器每帧的pcm字节数
+    unsigned char *pcm_buf;         // 解码输出
+    int pcm_size;
+    unsigned char *frame_buf;       // 从队列取出的一帧
+    unsigned char *packet_buf;      // 编码输出
+    audio_arena_t *arena;           // 上面三块缓存, 按帧长一次分配
+} daemon_session_t;
+
+typedef struct
+{
+    int fd;
+    int reading;                    // 是否在等可读事件, 反压时关掉
+    unsigned char *in_buf;          // 一条完整的消息
+    int in_len;
+    unsigned char *out_buf;         // 待发送的消息
+    size_t out_len;
+    size_t out_sent;
+    size_t out_size;
+    daemon_session_t *session;      // 没有OPEN时为NULL
+} daemon_conn_t;
+
+typedef struct
+{
+    audio_codec_t *codec;
+    aenc_format_e format;
+    unsigned long last_used;
+} daemon_pool_entry_t;
+
+static volatile sig_atomic_t daemon_stop = 0;
+static daemon_pool_entry_t daemon_pool[DAEMON_POOL_MAX];
+static unsigned long daemon_clock = 0;
+static unsigned long daemon_pool_hits = 0;
+static unsigned long daemon_pool_misses = 0;
+
+static unsigned int daemon_be32(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+static void daemon_put_be32(unsigned char *p, unsigned int v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+#if 1   //  句柄池
+static int daemon_param_equal(audio_param_t a, audio_param_t b)
+{
+    return a.samplerate == b.samplerate && a.channels == b.channels && a.bit_depth == b.bit_depth && a.fps == b.fps;
+}
+
+/*
+ * 取一个参数相同的空闲句柄reset后复用, 没有再打开新的
+ */
+static audio_codec_t *daemon_pool_get(aenc_format_e format, audio_codec_mode_e mode, audio_param_t audio_param)
+{
+    int i = 0;
+    audio_codec_t *codec = NULL;
+
+    for (i = 0; i < DAEMON_POOL_MAX; i++)
+    {
+        codec = daemon_pool[i].codec;
+        if (codec != NULL && daemon_pool[i].format == format && codec->mode == mode && daemon_param_equal(codec->audio_param, audio_param))
+        {
+            daemon_pool[i].codec = NULL;
+            if (audio_codec_reset(codec) == 0)
+            {
+                daemon_pool_hits++;
+                return codec;
+            }
+            audio_codec_close(codec);
+        }
+    }
+
+    daemon_pool_misses++;
+    return audio_codec_open(format, mode, audio_param);
+}
+
+static void daemon_pool_put(audio_codec_t *codec, aenc_format_e format)
+{
+    int i = 0;
+    int slot = 0;
+
+    if (codec == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < DAEMON_POOL_MAX; i++)
+    {
+        if (daemon_pool[i].codec == NULL)
+        {
+            slot = i;
+            break;
+        }
+        if (daemon_pool[i].last_used < daemon_pool[slot].last_used)
+        {
+            slot = i;
+        }
+    }
+    audio_codec_close(daemon_pool[slot].codec);
+    daemon_pool[slot].codec = codec;
+    daemon_pool[slot].format = format;
+    daemon_pool[slot].last_used = ++daemon_clock;
+}
+
+static void daemon_pool_clear(void)
+{
+    int i = 0;
+
+    for (i = 0; i < DAEMON_POOL_MAX; i++)
+    {
+        audio_codec_close(daemon_pool[i].codec);
+        daemon_pool[i].codec = NULL;
+    }
+}
+#endif
+
+#if 1   //  连接的发送队列
+static int daemon_queue(daemon_conn_t *conn, audio_daemon_msg_e type, const unsigned char *payload, int len)
+{
+    size_t size = 0;
+    unsigned char *buf = NULL;
+
+    //  已发送的部分先挪走, 还不够再扩容
+    if (conn->out_sent > 0 && conn->out_len + AUDIO_DAEMON_HEADER_SIZE + len > conn->out_size)
+    {
+        memmove(conn->out_buf, conn->out_buf + conn->out_sent, conn->out_len - conn->out_sent);
+        conn->out_len -= conn->out_sent;
+        conn->out_sent = 0;
+    }
+    if (conn->out_len + AUDIO_DAEMON_HEADER_SIZE + len > conn->out_size)
+    {
+        size = conn->out_size > 0 ? conn->out_size : DAEMON_READ_SIZE;
+        while (size < conn->out_len + AUDIO_DAEMON_HEADER_SIZE + len)
+        {
+            size *= 2;
+        }
+        buf = (unsigned char *)realloc(conn->out_buf, size);
+        if (buf == NULL)
+        {
+            return -1;
+        }
+        conn->out_buf = buf;
+        conn->out_size = size;
+    }
+
+    audio_daemon_header(conn->out_buf + conn->out_len, type, len);
+    if (len > 0)
+    {
+        memcpy(conn->out_buf + conn->out_len + AUDIO_DAEMON_HEADER_SIZE, payload, len);
+    }
+    conn->out_len += AUDIO_DAEMON_HEADER_SIZE + len;
+    return 0;
+}
+
+static int daemon_queue_error(daemon_conn_t *conn, const char *msg)
+{
+    return daemon_queue(conn, AUDIO_DAEMON_MSG_ERROR, (const unsigned char *)msg, strlen(msg));
+}
+
+static int daemon_flush(daemon_conn_t *conn)
+{
+    ssize_t ret = 0;
+
+    while (conn->out_sent < conn->out_len)
+    {
+        ret = send(conn->fd, conn->out_buf + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        if (ret <= 0)
+        {
+            return -1;
+        }
+        conn->out_sent += ret;
+    }
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    return 0;
+}
+#endif
+
+#if 1   //  会话
+static void daemon_session_close(daemon_session_t *session)
+{
+    if (session == NULL)
+    {
+        return;
+    }
+    //  句柄放回池里, 中途断开的会话留下的状态在下次取出时reset
+    daemon_pool_put(session->decoder, session->from);
+    daemon_pool_put(session->encoder, session->to);
+    pcm_fifo_destroy(session->fifo);
+    audio_arena_destroy(session->arena);
+    free(session);
+}
+
+static daemon_session_t *daemon_session_open(const unsigned char *payload, int len, char *err, int err_size)
+{
+    daemon_session_t *session = NULL;
+    audio_param_t audio_param;
+    int from = 0;
+    int to = 0;
+
+    if (len < AUDIO_DAEMON_OPEN_SIZE)
+    {
+        snprintf(err, err_size, "open payload %d bytes, need %d", len, AUDIO_DAEMON_OPEN_SIZE);
+        return NULL;
+    }
+    from = payload[0];
+    to = payload[1];
+    memset(&audio_param, 0, sizeof(audio_param_t));
+    audio_param.format = from;
+    audio_param.channels = payload[2];
+    audio_param.bit_depth = payload[3];
+    audio_param.samplerate = daemon_be32(payload + 4);
+    audio_param.fps = (payload[8] << 8) | payload[9];
+    if (from >= AENC_FORMAT_MAX || to >= AENC_FORMAT_MAX || audio_param.channels <= 0 || audio_param.channels > AUDIO_CHANNELS_MAX ||
+        audio_param.bit_depth != 16 || audio_param.samplerate <= 0 || audio_param.fps <= 0 || audio_param.samplerate % audio_param.fps != 0)
+    {
+        snprintf(err, err_size, "bad open param: from=%d, to=%d, channels=%d, bit_depth=%d, samplerate=%d, fps=%d",
+                 from, to, audio_param.channels, audio_param.bit_depth, audio_param.samplerate, audio_param.fps);
+        return NULL;
+    }
+
+    session = (daemon_session_t *)calloc(1, sizeof(daemon_session_t));
+    if (session == NULL)
+    {
+        snprintf(err, err_size, "out of memory");
+        return NULL;
+    }
+    session->from = from;
+    session->to = to;
+    session->audio_param = audio_param;
+
+    //  pcm源直接进队列, 不需要解码器
+    if (from != AENC_FORMAT_PCM)
+    {
+        session->decoder = daemon_pool_get(from, AUDIO_CODEC_DECODER, audio_param);
+    }
+    session->encoder = daemon_pool_get(to, AUDIO_CODEC_ENCODER, audio_param);
+    if ((from != AENC_FORMAT_PCM && session->decoder == NULL) || session->encoder == NULL)
+    {
+        snprintf(err, err_size, "cannot open codec %d -> %d", from, to);
+        goto ERR;
+    }
+    session->frame_bytes = audio_codec_get_frame_size(session->encoder);
+    session->pcm_size = AUDIO_DAEMON_PAYLOAD_MAX * 2;
+    if (session->decoder != NULL && audio_codec_get_frame_size(session->decoder) > session->pcm_size)
+    {
+        session->pcm_size = audio_codec_get_frame_size(session->decoder);
+    }
+    session->fifo = pcm_fifo_create(session->frame_bytes * 4);
+    //  每块按64字节对齐, 各多留64字节
+    session->arena = audio_arena_create((size_t)session->pcm_size + session->frame_bytes + session->encoder->packet_size_max + 64 * 3);
+    if (session->fifo == NULL || session->arena == NULL)
+    {
+        snprintf(err, err_size, "out of memory");
+        goto ERR;
+    }
+    session->pcm_buf = (unsigned char *)audio_arena_alloc(session->arena, session->pcm_size);
+    session->frame_buf = (unsigned char *)audio_arena_alloc(session->arena, session->frame_bytes);
+    session->packet_buf = (unsigned char *)audio_arena_alloc(session->arena, session->encoder->packet_size_max);
+
+    return session;
+
+ERR:
+    daemon_session_close(session);
+    return NULL;
+}
+
+static int daemon_session_encode(daemon_conn_t *conn, unsigned char *pcm, int pcm_len)
+{
+    int ret = 0;
+    daemon_session_t *session = conn->session;
+
+    ret = audio_codec_encode(session->encoder, pcm, pcm_len, session->packet_buf, session->encoder->packet_size_max);
+    if (ret > 0)
+    {
+        return daemon_queue(conn, AUDIO_DAEMON_MSG_DATA, session->packet_buf, ret);
+    }
+    return ret;
+}
+
+/*
+ * pcm写入队列, 凑够一帧就编码发出去
+ */
+static int daemon_session_push(daemon_conn_t *conn, unsigned char *pcm, int pcm_len)
+{
+    int written = 0;
+    daemon_session_t *session = conn->session;
+
+    while (pcm_len > 0)
+    {
+        written = pcm_fifo_write(session->fifo, pcm, pcm_len);
+        if (written < 0)
+        {
+            return -1;
+        }
+        pcm += written;
+        pcm_len -= written;
+        while (pcm_fifo_size(session->fifo) >= session->frame_bytes)
+        {
+            pcm_fifo_read(session->fifo, session->frame_buf, session->frame_bytes);
+            if (daemon_session_encode(conn, session->frame_buf, session->frame_bytes) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int daemon_session_data(daemon_conn_t *conn, unsigned char *payload, int len)
+{
+    int n = 0;
+    int pcm_len = 0;
+    daemon_session_t *session = conn->session;
+
+    if (session->from == AENC_FORMAT_PCM)
+    {
+        return daemon_session_push(conn, payload, len);
+    }
+
+    //  g711a一字节解出两字节, 按输出缓存的一半分块; 其他格式一条消息就是一包
+    while (len > 0)
+    {
+        n = session->from == AENC_FORMAT_G711A && len > session->pcm_size / 2 ? session->pcm_size / 2 : len;
+        pcm_len = audio_codec_decode(session->decoder, payload, n, session->pcm_buf, session->pcm_size);
+        if (pcm_len < 0)
+        {
+            return -1;
+        }
+        //  aac按ADTS头里的采样率解码, 和会话参数不同时编码器的参数就不对了
+        if (session->decoder->audio_param.samplerate != session->audio_param.samplerate)
+        {
+            return -2;
+        }
+        if (daemon_session_push(conn, session->pcm_buf, pcm_len) != 0)
+        {
+            return -1;
+        }
+        payload += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * 源数据结束: 不足一帧的尾巴和编码器缓存的数据都发出去, 再回一个END
+ */
+static int daemon_session_end(daemon_conn_t *conn)
+{
+    int ret = 0;
+    int tail_len = 0;
+    daemon_session_t *session = conn->session;
+
+    tail_len = pcm_fifo_size(session->fifo);
+    if (tail_len > 0)
+    {
+        pcm_fifo_read(session->fifo, session->frame_buf, tail_len);
+        if (daemon_session_encode(conn, session->frame_buf, tail_len) < 0)
+        {
+            return -1;
+        }
+    }
+    while ((ret = audio_codec_flush(session->encoder, session->packet_buf, session->encoder->packet_size_max)) > 0)
+    {
+        if (daemon_queue(conn, AUDIO_DAEMON_MSG_DATA, session->packet_buf, ret) != 0)
+        {
+            return -1;
+        }
+    }
+    if (ret < 0)
+    {
+        return -1;
+    }
+    return daemon_queue(conn, AUDIO_DAEMON_MSG_END, NULL, 0);
+}
+#endif
+
+#if 1   //  连接
+static daemon_conn_t *daemon_conn_create(int fd)
+{
+    daemon_conn_t *conn = (daemon_conn_t *)calloc(1, sizeof(daemon_conn_t));
+
+    if (conn == NULL)
+    {
+        return NULL;
+    }
+    conn->in_buf = (unsigned char *)malloc(AUDIO_DAEMON_HEADER_SIZE + AUDIO_DAEMON_PAYLOAD_MAX);
+    if (conn->in_buf == NULL)
+    {
+        free(conn);
+        return NULL;
+    }
+    conn->fd = fd;
+    conn->reading = 1;
+    return conn;
+}
+
+static void daemon_conn_destroy(daemon_conn_t *conn)
+{
+    daemon_session_close(conn->session);
+    close(conn->fd);
+    free(conn->in_buf);
+    free(conn->out_buf);
+    free(conn);
+}
+
+/*
+ * 处理一条完整的消息; 会话出错时回ERROR并关闭会话, 连接保留
+ */
+static int daemon_conn_message(daemon_conn_t *conn, audio_daemon_msg_e type, unsigned char *payload, int len)
+{
+    int ret = 0;
+    char err[256];
+
+    switch (type)
+    {
+    case AUDIO_DAEMON_MSG_OPEN:
+        daemon_session_close(conn->session);
+        conn->session = daemon_session_open(payload, len, err, sizeof(err));
+        return conn->session == NULL ? daemon_queue_error(conn, err) : 0;
+    case AUDIO_DAEMON_MSG_DATA:
+        if (conn->session == NULL)
+        {
+            return daemon_queue_error(conn, "data without open");
+        }
+        ret = daemon_session_data(conn, payload, len);
+        break;
+    case AUDIO_DAEMON_MSG_END:
+        if (conn->session == NULL)
+        {
+            return daemon_queue_error(conn, "end without open");
+        }
+        ret = daemon_session_end(conn);
+        daemon_session_close(conn->session);
+        conn->session = NULL;
+        break;
+
+    default:
+        snprintf(err, sizeof(err), "unknown message type %d", type);
+        return daemon_queue_error(conn, err);
+    }
+
+    if (ret != 0)
+    {
+        daemon_session_close(conn->session);
+        conn->session = NULL;
+        return daemon_queue_error(conn, ret == -2 ? "stream samplerate differs from open param" : "transcode failed");
+    }
+    return 0;
+}
+
+/*
+ * 读到不能再读为止, 每凑齐一条消息就处理. 返回-1时关闭连接
+ */
+static int daemon_conn_read(daemon_conn_t *conn)
+{
+    ssize_t ret = 0;
+    int need = 0;
+    unsigned int len = 0;
+
+    while (1)
+    {
+        //  先读头, 知道长度后再读负载, 一条消息只存一次
+        need = AUDIO_DAEMON_HEADER_SIZE;
+        if (conn->in_len >= AUDIO_DAEMON_HEADER_SIZE)
+        {
+            len = daemon_be32(conn->in_buf + 4);
+            if (len > AUDIO_DAEMON_PAYLOAD_MAX)
+            {
+                daemon_queue_error(conn, "message too large");
+                return -1;
+            }
+            need += len;
+        }
+        if (conn->in_len == need)
+        {
+            if (daemon_conn_message(conn, conn->in_buf[0], conn->in_buf + AUDIO_DAEMON_HEADER_SIZE, need - AUDIO_DAEMON_HEADER_SIZE) != 0)
+            {
+                return -1;
+            }
+            conn->in_len = 0;
+            continue;
+        }
+        //  回复积压太多时先不读, 已经读全的消息上面都处理完了
+        if (conn->out_len - conn->out_sent >= DAEMON_OUT_HIGH)
+        {
+            return 0;
+        }
+
+        ret = recv(conn->fd, conn->in_buf + conn->in_len, need - conn->in_len, 0);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        if (ret <= 0)
+        {
+            return -1;
+        }
+        conn->in_len += ret;
+    }
+}
+
+/*
+ * 待发送的数据多了就不读这个连接(反压到客户端), 发得差不多了再恢复
+ */
+static int daemon_conn_update(int epfd, daemon_conn_t *conn)
+{
+    struct epoll_event ev;
+    size_t pending = conn->out_len - conn->out_sent;
+
+    if (conn->reading && pending >= DAEMON_OUT_HIGH)
+    {
+        conn->reading = 0;
+    }
+    else if (!conn->reading && pending <= DAEMON_OUT_LOW)
+    {
+        conn->reading = 1;
+    }
+    ev.events = (conn->reading ? EPOLLIN : 0) | (pending > 0 ? EPOLLOUT : 0) | EPOLLRDHUP;
+    ev.data.ptr = conn;
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+#endif
+
+#if 1   //  守护进程
+void audio_daemon_header(unsigned char *buf, audio_daemon_msg_e type, int len)
+{
+    buf[0] = type;
+    buf[1] = 0;
+    buf[2] = 0;
+    buf[3] = 0;
+    daemon_put_be32(buf + 4, len);
+}
+
+int audio_daemon_open_payload(unsigned char *buf, audio_param_t audio_param, aenc_format_e to_format)
+{
+    memset(buf, 0, AUDIO_DAEMON_OPEN_SIZE);
+    buf[0] = audio_param.format;
+    buf[1] = to_format;
+    buf[2] = audio_param.channels;
+    buf[3] = audio_param.bit_depth;
+    daemon_put_be32(buf + 4, audio_param.samplerate);
+    buf[8] = (audio_param.fps >> 8) & 0xFF;
+    buf[9] = audio_param.fps & 0xFF;
+    return AUDIO_DAEMON_OPEN_SIZE;
+}
+
+void audio_daemon_stop(void)
+{
+    daemon_stop = 1;
+}
+
+int audio_daemon_run(const char *socket_path, int max_conns)
+{
+    int i = 0;
+    int n = 0;
+    int fd = -1;
+    int epfd = -1;
+    int listen_fd = -1;
+    int conns = 0;
+    int ret = -1;
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    struct epoll_event events[DAEMON_EVENTS];
+    daemon_conn_t *conn = NULL;
+    daemon_conn_t **all = NULL;
+
+    if (socket_path == NULL || strlen(socket_path) >= sizeof(addr.sun_path) || max_conns <= 0)
+    {
+        fprintf(stderr, "[%s] socket_path=%s, max_conns=%d, err param\n", __func__, socket_path, max_conns);
+        return -1;
+    }
+    all = (daemon_conn_t **)calloc(max_conns, sizeof(daemon_conn_t *));
+    if (all == NULL)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "[%s] listen on %s failed: %s\n", __func__, socket_path, strerror(errno));
+        goto END;
+    }
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) != 0)
+    {
+        goto END;
+    }
+
+    daemon_stop = 0;
+    while (!daemon_stop)
+    {
+        n = epoll_wait(epfd, events, DAEMON_EVENTS, -1);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            fprintf(stderr, "[%s] epoll_wait failed: %s\n", __func__, strerror(errno));
+            goto END;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            //  新连接, 超过上限的直接关掉
+            if (events[i].data.ptr == NULL)
+            {
+                while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+                {
+                    conn = conns < max_conns ? daemon_conn_create(fd) : NULL;
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.ptr = conn;
+                    if (conn == NULL || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+                    {
+                        fprintf(stderr, "[%s] reject connection, %d active\n", __func__, conns);
+                        if (conn != NULL)
+                        {
+                            daemon_conn_destroy(conn);
+                        }
+                        else
+                        {
+                            close(fd);
+                        }
+                        continue;
+                    }
+                    for (fd = 0; all[fd] != NULL; fd++)
+                    {
+                    }
+                    all[fd] = conn;
+                    conns++;
+                }
+                continue;
+            }
+
+            conn = (daemon_conn_t *)events[i].data.ptr;
+            ret = 0;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                ret = daemon_conn_read(conn);
+            }
+            if (ret == 0 || conn->out_len > conn->out_sent)
+            {
+                //  出错前排队的ERROR尽量发出去
+                if (daemon_flush(conn) != 0)
+                {
+                    ret = -1;
+                }
+            }
+            if (ret == 0 && daemon_conn_update(epfd, conn) != 0)
+            {
+                ret = -1;
+            }
+            if (ret != 0)
+            {
+                for (fd = 0; fd < max_conns && all[fd] != conn; fd++)
+                {
+                }
+                all[fd] = NULL;
+                conns--;
+                epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+                daemon_conn_destroy(conn);
+            }
+        }
+    }
+    fprintf(stderr, "[%s] stopped, codec pool hits=%lu, misses=%lu\n", __func__, daemon_pool_hits, daemon_pool_misses);
+    ret = 0;
+
+END:
+    for (i = 0; i < max_conns; i++)
+    {
+        if (all[i] != NULL)
+        {
+            daemon_conn_destroy(all[i]);
+        }
+    }
+    free(all);
+    daemon_pool_clear();
+    if (epfd >= 0)
+    {
+        close(epfd);
+    }
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    return ret;
+}
+#endif
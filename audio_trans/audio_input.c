@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "audio_trans.h"
+
+#define INPUT_WINDOW_DEFAULT (64 * 1024)        // read方式的默认窗口
+#define INPUT_RELEASE_STEP (1024 * 1024)        // mmap方式每处理这么多数据就释放一次已读的页
+#define INPUT_READAHEAD (4 * 1024 * 1024)       // mmap方式提前预读的长度
+
+struct audio_input
+{
+    int fd;
+    int own_fd;                 // fd是audio_input_open打开的, close时关闭
+    audio_input_mode_e mode;    // 实际使用的方式, MMAP或READ
+    long long file_size;        // 不是普通文件时为-1
+    unsigned char *buf;         // mmap: 整个文件的映射; read: 窗口
+    size_t buf_size;
+    size_t len;                 // buf里有效数据的长度
+    size_t offset;              // 下一个未处理的字节
+    size_t released;            // mmap: 已经还给内核的位置
+    long page_size;
+    int eof;
+};
+
+static int audio_input_map(audio_input_t *input)
+{
+    if (input->file_size == 0)
+    {
+        input->eof = 1;
+        return 0;
+    }
+
+    input->buf = mmap(NULL, input->file_size, PROT_READ, MAP_PRIVATE, input->fd, 0);
+    if (input->buf == MAP_FAILED)
+    {
+        input->buf = NULL;
+        return -1;
+    }
+    input->buf_size = input->file_size;
+    input->len = input->file_size;
+    input->eof = 1;
+
+    //  顺序读: 内核加大预读, 读过的页优先回收
+    madvise(input->buf, input->buf_size, MADV_SEQUENTIAL);
+    posix_fadvise(input->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(input->fd, 0, INPUT_READAHEAD, POSIX_FADV_WILLNEED);
+
+    return 0;
+}
+
+#if 1   //  输入
+audio_input_t *audio_input_open_fd(int fd, audio_input_mode_e mode, int window_size)
+{
+    audio_input_t *input = NULL;
+    struct stat st;
+
+    if (fd < 0 || mode < AUDIO_INPUT_AUTO || mode > AUDIO_INPUT_READ || window_size < 0)
+    {
+        fprintf(stderr, "[%s] fd=%d, mode=%d, window_size=%d, err param\n", __func__, fd, mode, window_size);
+        return NULL;
+    }
+
+    input = (audio_input_t *)calloc(1, sizeof(audio_input_t));
+    if (input == NULL)
+    {
+        return NULL;
+    }
+    input->fd = fd;
+    input->file_size = -1;
+    input->page_size = sysconf(_SC_PAGESIZE);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        input->file_size = st.st_size;
+    }
+
+    //  管道/socket只能read; 普通文件默认mmap, 映射失败时退回read
+    if (mode == AUDIO_INPUT_MMAP && input->file_size < 0)
+    {
+        fprintf(stderr, "[%s] fd=%d is not a regular file, cannot mmap\n", __func__, fd);
+        goto ERR;
+    }
+    if (mode != AUDIO_INPUT_READ && input->file_size >= 0)
+    {
+        if (audio_input_map(input) == 0)
+        {
+            input->mode = AUDIO_INPUT_MMAP;
+            return input;
+        }
+        if (mode == AUDIO_INPUT_MMAP)
+        {
+            fprintf(stderr, "[%s] mmap failed: %s\n", __func__, strerror(errno));
+            goto ERR;
+        }
+    }
+
+    input->mode = AUDIO_INPUT_READ;
+    input->buf_size = window_size > 0 ? window_size : INPUT_WINDOW_DEFAULT;
+    input->buf = (unsigned char *)malloc(input->buf_size);
+    if (input->buf == NULL)
+    {
+        goto ERR;
+    }
+    if (input->file_size >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    return input;
+
+ERR:
+    free(input);
+    return NULL;
+}
+
+audio_input_t *audio_input_open(const char *path, audio_input_mode_e mode, int window_size)
+{
+    int fd = -1;
+    audio_input_t *input = NULL;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Cannot open %s!\n", path);
+        return NULL;
+    }
+
+    input = audio_input_open_fd(fd, mode, window_size);
+    if (input == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    input->own_fd = 1;
+
+    return input;
+}
+
+ssize_t audio_input_peek(audio_input_t *input, size_t need, unsigned char **data)
+{
+    ssize_t ret = 0;
+
+    if (input == NULL || data == NULL)
+    {
+        return -1;
+    }
+
+    //  mmap时整个文件都在视图里, 只有read方式需要补数据
+    if (input->len - input->offset < need && !input->eof)
+    {
+        if (need > input->buf_size)
+        {
+            need = input->buf_size;
+        }
+        if (input->offset > 0)
+        {
+            memmove(input->buf, input->buf + input->offset, input->len - input->offset);
+            input->len -= input->offset;
+            input->offset = 0;
+        }
+        //  每次read都尽量填满窗口, 但管道里已有的数据够了就返回, 不等满
+        while (input->len < need && !input->eof)
+        {
+            ret = read(input->fd, input->buf + input->len, input->buf_size - input->len);
+            if (ret < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (ret < 0)
+            {
+                fprintf(stderr, "[%s] read failed: %s\n", __func__, strerror(errno));
+            }
+            if (ret <= 0)
+            {
+                input->eof = 1;
+                break;
+            }
+            input->len += ret;
+        }
+    }
+
+    *data = input->buf + input->offset;
+    return input->len - input->offset;
+}
+
+void audio_input_consume(audio_input_t *input, size_t len)
+{
+    size_t release_end = 0;
+
+    if (input == NULL)
+    {
+        return;
+    }
+    if (len > input->len - input->offset)
+    {
+        len = input->len - input->offset;
+    }
+    input->offset += len;
+
+    if (input->mode != AUDIO_INPUT_MMAP || input->offset - input->released < 2 * INPUT_RELEASE_STEP)
+    {
+        return;
+    }
+
+    //  读过的页从进程里解除映射(page cache还在), 大文件的RSS只有预读窗口那么大.
+    //  少释放一段, 调用者手里刚取到的包不会被解除映射
+    release_end = (input->offset - INPUT_RELEASE_STEP) & ~((size_t)input->page_size - 1);
+    madvise(input->buf + input->released, release_end - input->released, MADV_DONTNEED);
+    input->released = release_end;
+    posix_fadvise(input->fd, input->offset, INPUT_READAHEAD, POSIX_FADV_WILLNEED);
+}
+
+long long audio_input_size(audio_input_t *input)
+{
+    return input == NULL ? -1 : input->file_size;
+}
+
+audio_input_mode_e audio_input_get_mode(audio_input_t *input)
+{
+    return input == NULL ? AUDIO_INPUT_AUTO : input->mode;
+}
+
+void audio_input_close(audio_input_t *input)
+{
+    if (input == NULL)
+    {
+        return;
+    }
+
+    if (input->mode == AUDIO_INPUT_MMAP)
+    {
+        if (input->buf != NULL)
+        {
+            munmap(input->buf, input->buf_size);
+        }
+    }
+    else
+    {
+        free(input->buf);
+    }
+    if (input->own_fd)
+    {
+        close(input->fd);
+    }
+    free(input);
+}
+#endif
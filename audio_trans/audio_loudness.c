@@ -0,0 +1,808 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOUDNESS_HAVE_AVX2 1
+#endif
+
+#include "audio_trans.h"
+
+#define LOUDNESS_STEPS_MOMENTARY 4      // 400ms的块, 每100ms一个, 重叠75%
+#define LOUDNESS_STEPS_SHORT 30         // 3s的短期响度
+#define LOUDNESS_GATE_REL -10.0         // 整体响度的相对门限
+#define LOUDNESS_LRA_GATE_REL -20.0     // 响度范围的相对门限(EBU Tech 3342)
+#define LOUDNESS_HIST_STEP 0.1          // 直方图每格0.1LU, 从绝对门限-70到+10
+#define LOUDNESS_HIST_BINS 800
+#define LOUDNESS_CHUNK 256              // s16接口每次转成浮点的帧数
+#define LOUDNESS_TINY 1e-30             // 滤波器状态小于它时清0, 避免静音时出现非规格化数
+
+#define AGC_BLOCK_MS 1                  // 限幅器按1ms的块算峰值和增益
+#define AGC_LOOKAHEAD 5                 // 前瞻的块数, 输出延迟5ms
+#define AGC_RELEASE_MS 100.0            // 限幅器增益恢复的时间常数
+#define AGC_RATE_UP 3.0                 // AGC增益每秒最多升高的dB, 慢一些不会把停顿里的底噪拉起来
+#define AGC_RATE_DOWN 10.0              // 每秒最多降低的dB, 突然变响时跟得快一些, 剩下的交给限幅器
+#define AGC_LEVEL_SECONDS 3.0           // 电平是400ms响度按dB平滑的, 短促的大声只挪动一点, 交给限幅器
+
+/*
+ * 两级双二阶滤波器的系数: b0 b1 b2 a1 a2, 第一级是模拟头部的高架, 第二级是RLB高通
+ */
+typedef struct
+{
+    double b[3];
+    double a[2];
+} loudness_biquad_t;
+
+struct audio_loudness
+{
+    int samplerate;
+    int channels;
+    int step_frames;                            // 100ms的帧数
+    int step_pos;                               // 当前100ms里已经处理的帧数
+    loudness_biquad_t filter[2];
+    double weight[AUDIO_CHANNELS_MAX];          // 声道权重, LFE为0, 环绕声道1.41
+    double state[2][2][AUDIO_CHANNELS_MAX];     // [级][s1/s2][声道], 转置直接II型
+    double sum[AUDIO_CHANNELS_MAX];             // 当前100ms每声道滤波后的平方和
+    double steps[LOUDNESS_STEPS_SHORT];         // 最近30个100ms的加权均方, 环
+    unsigned long long step_count;
+    double momentary;                           // 能量, 不是dB
+    double short_term;
+    double max_momentary;
+    double max_short_term;
+    float peak;
+    unsigned long long frames;
+    unsigned int hist_count[LOUDNESS_HIST_BINS];   // 超过绝对门限的400ms块, 按响度分格
+    double hist_energy[LOUDNESS_HIST_BINS];
+    unsigned int lra_count[LOUDNESS_HIST_BINS];    // 超过绝对门限的3s块
+    double lra_energy[LOUDNESS_HIST_BINS];
+};
+
+struct audio_agc
+{
+    int samplerate;
+    int channels;
+    audio_agc_param_t param;
+    int block;                      // 一块的帧数
+    float *buf;                     // 还没输出的帧(浮点), 最多AGC_LOOKAHEAD + 2块
+    int buf_frames;
+    int buf_blocks;                 // buf开头已经分析过的完整块数
+    float peak[AGC_LOOKAHEAD + 2];  // 每块乘上AGC增益后的峰值
+    float gain_end[AGC_LOOKAHEAD + 2]; // 每块结束时的AGC增益
+    double gain_db;                 // 最新分析的块结束时的AGC增益
+    double level;                   // 超过门限的400ms响度的平滑值LUFS
+    int level_valid;
+    unsigned long long steps;       // 已经计入电平的100ms数
+    float gain;                     // 已输出的最后一块结束时的AGC增益
+    float limit;                    // 已输出的最后一块结束时的限幅增益
+    float release;                  // 限幅增益每块恢复的比例
+    float ceiling;
+    audio_loudness_t *meter;        // 输入的响度, AGC按它的短期响度调增益
+};
+
+static double loudness_db(double energy)
+{
+    return energy > 0 ? -0.691 + 10.0 * log10(energy) : -HUGE_VAL;
+}
+
+static double loudness_floor(double lufs)
+{
+    return lufs > AUDIO_LOUDNESS_FLOOR ? lufs : AUDIO_LOUDNESS_FLOOR;
+}
+
+static int loudness_bin(double lufs)
+{
+    int bin = (int)((lufs - AUDIO_LOUDNESS_FLOOR) / LOUDNESS_HIST_STEP);
+
+    return bin < 0 ? 0 : (bin >= LOUDNESS_HIST_BINS ? LOUDNESS_HIST_BINS - 1 : bin);
+}
+
+#if 1   //  K加权滤波
+/*
+ * ITU-R BS.1770的两级滤波器按采样率双线性变换, 48k时和标准里给的系数一致
+ */
+static void loudness_init_filter(audio_loudness_t *meter)
+{
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / meter->samplerate);
+    double vh = pow(10.0, gain / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+
+    meter->filter[0].b[0] = (vh + vb * k / q + k * k) / a0;
+    meter->filter[0].b[1] = 2.0 * (k * k - vh) / a0;
+    meter->filter[0].b[2] = (vh - vb * k / q + k * k) / a0;
+    meter->filter[0].a[0] = 2.0 * (k * k - 1.0) / a0;
+    meter->filter[0].a[1] = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / meter->samplerate);
+    a0 = 1.0 + k / q + k * k;
+    meter->filter[1].b[0] = 1.0;
+    meter->filter[1].b[1] = -2.0;
+    meter->filter[1].b[2] = 1.0;
+    meter->filter[1].a[0] = 2.0 * (k * k - 1.0) / a0;
+    meter->filter[1].a[1] = (1.0 - k / q + k * k) / a0;
+}
+
+#ifdef LOUDNESS_HAVE_AVX2
+static int loudness_have_avx2(void)
+{
+    static int have = -1;
+
+    if (have < 0)
+    {
+        __builtin_cpu_init();
+        have = __builtin_cpu_supports("avx2");
+    }
+    return have;
+}
+
+/*
+ * IIR在时间上有依赖, 按声道并行: 每4个声道一个向量, 交织的一帧用掩码读出来, 不够4个的高位不读
+ */
+__attribute__((target("avx2"))) static void loudness_filter_avx2(audio_loudness_t *meter, const float *in, int frames)
+{
+    int f = 0;
+    int g = 0;
+    int lanes = 0;
+    int channels = meter->channels;
+    const loudness_biquad_t *h = meter->filter;
+    __m128i mask;
+    __m256d x, y, s1a, s2a, s1b, s2b, acc;
+    const __m256d b0a = _mm256_set1_pd(h[0].b[0]), b1a = _mm256_set1_pd(h[0].b[1]), b2a = _mm256_set1_pd(h[0].b[2]);
+    const __m256d a1a = _mm256_set1_pd(h[0].a[0]), a2a = _mm256_set1_pd(h[0].a[1]);
+    const __m256d a1b = _mm256_set1_pd(h[1].a[0]), a2b = _mm256_set1_pd(h[1].a[1]);
+    const __m256d two = _mm256_set1_pd(2.0);
+
+    for (g = 0; g < channels; g += 4)
+    {
+        lanes = channels - g < 4 ? channels - g : 4;
+        mask = _mm_cmpgt_epi32(_mm_set1_epi32(lanes), _mm_setr_epi32(0, 1, 2, 3));
+        s1a = _mm256_loadu_pd(meter->state[0][0] + g);
+        s2a = _mm256_loadu_pd(meter->state[0][1] + g);
+        s1b = _mm256_loadu_pd(meter->state[1][0] + g);
+        s2b = _mm256_loadu_pd(meter->state[1][1] + g);
+        acc = _mm256_setzero_pd();
+        for (f = 0; f < frames; f++)
+        {
+            x = _mm256_cvtps_pd(_mm_maskload_ps(in + f * channels + g, mask));
+            //  高架
+            y = _mm256_add_pd(_mm256_mul_pd(b0a, x), s1a);
+            s1a = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(b1a, x), s2a), _mm256_mul_pd(a1a, y));
+            s2a = _mm256_sub_pd(_mm256_mul_pd(b2a, x), _mm256_mul_pd(a2a, y));
+            //  高通, b为1 -2 1
+            x = y;
+            y = _mm256_add_pd(x, s1b);
+            s1b = _mm256_sub_pd(_mm256_sub_pd(s2b, _mm256_mul_pd(two, x)), _mm256_mul_pd(a1b, y));
+            s2b = _mm256_sub_pd(x, _mm256_mul_pd(a2b, y));
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(y, y));
+        }
+        _mm256_storeu_pd(meter->state[0][0] + g, s1a);
+        _mm256_storeu_pd(meter->state[0][1] + g, s2a);
+        _mm256_storeu_pd(meter->state[1][0] + g, s1b);
+        _mm256_storeu_pd(meter->state[1][1] + g, s2b);
+        _mm256_storeu_pd(meter->sum + g, _mm256_add_pd(_mm256_loadu_pd(meter->sum + g), acc));
+    }
+}
+#endif
+
+static void loudness_filter(audio_loudness_t *meter, const float *in, int frames)
+{
+    int f = 0;
+    int c = 0;
+    int s = 0;
+    double x = 0;
+    double y = 0;
+    double *s1 = NULL;
+    double *s2 = NULL;
+    const loudness_biquad_t *h = NULL;
+
+#ifdef LOUDNESS_HAVE_AVX2
+    //  状态和和数组的下标到AUDIO_CHANNELS_MAX, 4个一组不会越界; 单声道标量更快
+    if (meter->channels > 1 && loudness_have_avx2())
+    {
+        loudness_filter_avx2(meter, in, frames);
+        return;
+    }
+#endif
+    for (c = 0; c < meter->channels; c++)
+    {
+        for (f = 0; f < frames; f++)
+        {
+            x = in[f * meter->channels + c];
+            for (s = 0; s < 2; s++)
+            {
+                h = &meter->filter[s];
+                s1 = &meter->state[s][0][c];
+                s2 = &meter->state[s][1][c];
+                y = h->b[0] * x + *s1;
+                *s1 = h->b[1] * x - h->a[0] * y + *s2;
+                *s2 = h->b[2] * x - h->a[1] * y;
+                x = y;
+            }
+            meter->sum[c] += y * y;
+        }
+    }
+}
+#endif
+
+#if 1   //  门限和直方图
+/*
+ * 满100ms: 算出这一段的加权均方, 更新400ms和3s的块, 超过绝对门限的块进直方图
+ */
+static void loudness_step(audio_loudness_t *meter)
+{
+    int c = 0;
+    int i = 0;
+    int n = 0;
+    int s = 0;
+    double energy = 0;
+    double *state = &meter->state[0][0][0];
+
+    for (c = 0; c < meter->channels; c++)
+    {
+        energy += meter->weight[c] * meter->sum[c] / meter->step_pos;
+        meter->sum[c] = 0;
+    }
+    for (s = 0; s < 2 * 2 * AUDIO_CHANNELS_MAX; s++)
+    {
+        if (fabs(state[s]) < LOUDNESS_TINY)
+        {
+            state[s] = 0;
+        }
+    }
+    meter->steps[meter->step_count % LOUDNESS_STEPS_SHORT] = energy;
+    meter->step_count++;
+    meter->step_pos = 0;
+
+    n = meter->step_count < LOUDNESS_STEPS_MOMENTARY ? (int)meter->step_count : LOUDNESS_STEPS_MOMENTARY;
+    for (i = 0, energy = 0; i < n; i++)
+    {
+        energy += meter->steps[(meter->step_count - 1 - i) % LOUDNESS_STEPS_SHORT];
+    }
+    meter->momentary = energy / n;
+    if (meter->step_count >= LOUDNESS_STEPS_MOMENTARY)
+    {
+        if (meter->momentary > meter->max_momentary)
+        {
+            meter->max_momentary = meter->momentary;
+        }
+        if (loudness_db(meter->momentary) >= AUDIO_LOUDNESS_FLOOR)
+        {
+            meter->hist_count[loudness_bin(loudness_db(meter->momentary))]++;
+            meter->hist_energy[loudness_bin(loudness_db(meter->momentary))] += meter->momentary;
+        }
+    }
+
+    n = meter->step_count < LOUDNESS_STEPS_SHORT ? (int)meter->step_count : LOUDNESS_STEPS_SHORT;
+    for (i = 0, energy = 0; i < n; i++)
+    {
+        energy += meter->steps[i];
+    }
+    meter->short_term = energy / n;
+    if (meter->step_count >= LOUDNESS_STEPS_SHORT)
+    {
+        if (meter->short_term > meter->max_short_term)
+        {
+            meter->max_short_term = meter->short_term;
+        }
+        if (loudness_db(meter->short_term) >= AUDIO_LOUDNESS_FLOOR)
+        {
+            meter->lra_count[loudness_bin(loudness_db(meter->short_term))]++;
+            meter->lra_energy[loudness_bin(loudness_db(meter->short_term))] += meter->short_term;
+        }
+    }
+}
+
+/*
+ * 超过绝对门限的块的平均响度减去rel_gate作为相对门限, 返回相对门限所在的格, 没有块时返回-1
+ */
+static int loudness_gate(const unsigned int *count, const double *energy, double rel_gate)
+{
+    int i = 0;
+    unsigned long long n = 0;
+    double sum = 0;
+
+    for (i = 0; i < LOUDNESS_HIST_BINS; i++)
+    {
+        n += count[i];
+        sum += energy[i];
+    }
+    if (n == 0)
+    {
+        return -1;
+    }
+    return loudness_bin(loudness_db(sum / n) + rel_gate);
+}
+
+static double loudness_integrated(audio_loudness_t *meter)
+{
+    int i = 0;
+    int gate = loudness_gate(meter->hist_count, meter->hist_energy, LOUDNESS_GATE_REL);
+    unsigned long long n = 0;
+    double sum = 0;
+
+    for (i = gate; gate >= 0 && i < LOUDNESS_HIST_BINS; i++)
+    {
+        n += meter->hist_count[i];
+        sum += meter->hist_energy[i];
+    }
+    return n > 0 ? loudness_floor(loudness_db(sum / n)) : AUDIO_LOUDNESS_FLOOR;
+}
+
+/*
+ * 相对门限以上的3s块里, 响度分布10%到95%之间的差
+ */
+static double loudness_range(audio_loudness_t *meter)
+{
+    int i = 0;
+    int gate = loudness_gate(meter->lra_count, meter->lra_energy, LOUDNESS_LRA_GATE_REL);
+    int low = -1;
+    int high = -1;
+    unsigned long long n = 0;
+    unsigned long long seen = 0;
+
+    for (i = gate; gate >= 0 && i < LOUDNESS_HIST_BINS; i++)
+    {
+        n += meter->lra_count[i];
+    }
+    for (i = gate; n > 0 && i < LOUDNESS_HIST_BINS; i++)
+    {
+        seen += meter->lra_count[i];
+        if (low < 0 && seen > (n - 1) / 10)
+        {
+            low = i;
+        }
+        if (seen > (n - 1) * 95 / 100)
+        {
+            high = i;
+            break;
+        }
+    }
+    return n > 0 ? (high - low) * LOUDNESS_HIST_STEP : 0;
+}
+#endif
+
+#if 1   //  响度表
+static audio_loudness_t *loudness_create(int samplerate, int channels)
+{
+    int c = 0;
+    audio_loudness_t *meter = NULL;
+
+    meter = (audio_loudness_t *)calloc(1, sizeof(audio_loudness_t));
+    if (meter == NULL)
+    {
+        return NULL;
+    }
+    meter->samplerate = samplerate;
+    meter->channels = channels;
+    meter->step_frames = samplerate / 10;
+    loudness_init_filter(meter);
+    //  按audio_channel_matrix_default的5.1顺序: L R C LFE Ls Rs, 之后的也算环绕
+    for (c = 0; c < channels; c++)
+    {
+        meter->weight[c] = channels < 6 || c < 3 ? 1.0 : (c == 3 ? 0.0 : 1.41);
+    }
+    return meter;
+}
+
+static float loudness_peak(const float *in, int samples);
+
+/*
+ * 按100ms分段送进滤波器, 段内不用判断边界
+ */
+static void loudness_process_f32(audio_loudness_t *meter, const float *in, int frames)
+{
+    int n = 0;
+    float peak = loudness_peak(in, frames * meter->channels);
+
+    if (peak > meter->peak)
+    {
+        meter->peak = peak;
+    }
+    meter->frames += frames;
+    while (frames > 0)
+    {
+        n = meter->step_frames - meter->step_pos;
+        n = frames < n ? frames : n;
+        loudness_filter(meter, in, n);
+        meter->step_pos += n;
+        if (meter->step_pos == meter->step_frames)
+        {
+            loudness_step(meter);
+        }
+        in += n * meter->channels;
+        frames -= n;
+    }
+}
+
+audio_loudness_t *audio_loudness_create(int samplerate, int channels)
+{
+    if (samplerate < 8000 || channels <= 0 || channels > AUDIO_CHANNELS_MAX)
+    {
+        fprintf(stderr, "[%s] samplerate=%d, channels=%d, err param\n", __func__, samplerate, channels);
+        return NULL;
+    }
+    return loudness_create(samplerate, channels);
+}
+
+int audio_loudness_process(audio_loudness_t *meter, const short *pcm, int frames)
+{
+    int n = 0;
+    float buf[LOUDNESS_CHUNK * AUDIO_CHANNELS_MAX];
+
+    if (meter == NULL || (pcm == NULL && frames > 0) || frames < 0)
+    {
+        fprintf(stderr, "[%s] meter=%p, pcm=%p, frames=%d, err param\n", __func__, meter, pcm, frames);
+        return -1;
+    }
+    while (frames > 0)
+    {
+        n = frames < LOUDNESS_CHUNK ? frames : LOUDNESS_CHUNK;
+        audio_sample_convert(pcm, AUDIO_SAMPLE_S16, buf, AUDIO_SAMPLE_F32, n * meter->channels, NULL);
+        loudness_process_f32(meter, buf, n);
+        pcm += n * meter->channels;
+        frames -= n;
+    }
+    return 0;
+}
+
+int audio_loudness_get(audio_loudness_t *meter, audio_loudness_info_t *info)
+{
+    if (meter == NULL || info == NULL)
+    {
+        fprintf(stderr, "[%s] meter=%p, info=%p, err param\n", __func__, meter, info);
+        return -1;
+    }
+    info->integrated = loudness_integrated(meter);
+    info->range = loudness_range(meter);
+    info->momentary = loudness_floor(loudness_db(meter->momentary));
+    info->short_term = loudness_floor(loudness_db(meter->short_term));
+    info->max_momentary = loudness_floor(loudness_db(meter->max_momentary));
+    info->max_short_term = loudness_floor(loudness_db(meter->max_short_term));
+    info->peak = meter->peak > 1e-6f ? 20.0 * log10(meter->peak) : -120.0;
+    info->seconds = (double)meter->frames / meter->samplerate;
+    return 0;
+}
+
+void audio_loudness_reset(audio_loudness_t *meter)
+{
+    if (meter == NULL)
+    {
+        return;
+    }
+    //  滤波器系数和声道权重之后的都清掉
+    memset(meter->state, 0, sizeof(audio_loudness_t) - offsetof(audio_loudness_t, state));
+    meter->step_pos = 0;
+}
+
+void audio_loudness_destroy(audio_loudness_t *meter)
+{
+    free(meter);
+}
+#endif
+
+#if 1   //  块峰值和增益斜坡
+#ifdef LOUDNESS_HAVE_AVX2
+__attribute__((target("avx2"))) static int loudness_peak_avx2(const float *in, int samples, float *peak)
+{
+    int i = 0;
+    float lanes[8];
+    __m256 acc = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        acc = _mm256_max_ps(acc, _mm256_andnot_ps(sign, _mm256_loadu_ps(in + i)));
+    }
+    _mm256_storeu_ps(lanes, acc);
+    *peak = fmaxf(fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3])), fmaxf(fmaxf(lanes[4], lanes[5]), fmaxf(lanes[6], lanes[7])));
+    return i;
+}
+
+/*
+ * x[i] *= (g0 + gstep * (i + 1)) * (l0 + lstep * (i + 1)), 两个线性斜坡相乘
+ */
+__attribute__((target("avx2"))) static int agc_apply_avx2(float *x, int samples, float g0, float gstep, float l0, float lstep)
+{
+    int i = 0;
+    __m256 n, g, l;
+    const __m256 eight = _mm256_set1_ps(8.0f);
+
+    n = _mm256_setr_ps(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f);
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        g = _mm256_add_ps(_mm256_set1_ps(g0), _mm256_mul_ps(_mm256_set1_ps(gstep), n));
+        l = _mm256_add_ps(_mm256_set1_ps(l0), _mm256_mul_ps(_mm256_set1_ps(lstep), n));
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(g, l)));
+        n = _mm256_add_ps(n, eight);
+    }
+    return i;
+}
+#endif
+
+static float loudness_peak(const float *in, int samples)
+{
+    int i = 0;
+    float peak = 0;
+
+#ifdef LOUDNESS_HAVE_AVX2
+    if (loudness_have_avx2())
+    {
+        i = loudness_peak_avx2(in, samples, &peak);
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        peak = fabsf(in[i]) > peak ? fabsf(in[i]) : peak;
+    }
+    return peak;
+}
+
+static void agc_apply(float *x, int samples, float g0, float g1, float l0, float l1)
+{
+    int i = 0;
+    float gstep = (g1 - g0) / samples;
+    float lstep = (l1 - l0) / samples;
+
+#ifdef LOUDNESS_HAVE_AVX2
+    if (loudness_have_avx2())
+    {
+        i = agc_apply_avx2(x, samples, g0, gstep, l0, lstep);
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        x[i] *= (g0 + gstep * (i + 1)) * (l0 + lstep * (i + 1));
+    }
+}
+#endif
+
+#if 1   //  AGC和限幅
+void audio_agc_param_default(audio_agc_param_t *param)
+{
+    param->adaptive = 1;
+    param->target = -23.0;
+    param->gain = 0;
+    param->max_gain = 20.0;
+    param->gate = -50.0;
+    param->ceiling = -1.0;
+}
+
+/*
+ * 新的完整块(或flush时最后不足一块的帧): 量响度, 按电平把增益向目标移动, 算乘上增益后的峰值
+ */
+static void agc_analyze(audio_agc_t *agc, int frames)
+{
+    int b = agc->buf_blocks;
+    float *x = agc->buf + (size_t)b * agc->block * agc->channels;
+    double seconds = (double)frames / agc->samplerate;
+    double level = 0;
+    double delta = 0;
+    float start = b > 0 ? agc->gain_end[b - 1] : agc->gain;
+
+    loudness_process_f32(agc->meter, x, frames);
+    //  每100ms更新一次电平, 低于门限的是停顿或静音, 不计入, 增益保持
+    if (agc->meter->step_count != agc->steps)
+    {
+        agc->steps = agc->meter->step_count;
+        level = loudness_db(agc->meter->momentary);
+        if (level > agc->param.gate)
+        {
+            agc->level = agc->level_valid ? agc->level + (level - agc->level) * (0.1 / AGC_LEVEL_SECONDS) : level;
+            agc->level_valid = 1;
+        }
+    }
+    if (agc->param.adaptive && agc->level_valid)
+    {
+        delta = agc->param.target - agc->level;
+        delta = delta > agc->param.max_gain ? agc->param.max_gain : (delta < -agc->param.max_gain ? -agc->param.max_gain : delta);
+        delta -= agc->gain_db;
+        if (delta > AGC_RATE_UP * seconds)
+        {
+            delta = AGC_RATE_UP * seconds;
+        }
+        if (delta < -AGC_RATE_DOWN * seconds)
+        {
+            delta = -AGC_RATE_DOWN * seconds;
+        }
+        agc->gain_db += delta;
+    }
+    agc->gain_end[b] = (float)pow(10.0, agc->gain_db / 20.0);
+    agc->peak[b] = loudness_peak(x, frames * agc->channels) * (start > agc->gain_end[b] ? start : agc->gain_end[b]);
+    agc->buf_blocks++;
+}
+
+/*
+ * 输出buf开头的一块: 限幅增益取前瞻的windows块里要求的最小值, 下降在本块内完成, 上升按release慢慢恢复.
+ * 峰值块之前的块已经降到位了, 峰值块里两个增益都不超过它要求的值
+ */
+static void agc_output(audio_agc_t *agc, int frames, int window, short *out)
+{
+    int b = 0;
+    float target = 1.0f;
+    float limit = 0;
+    float *x = agc->buf;
+    int samples = frames * agc->channels;
+
+    for (b = 0; b < window; b++)
+    {
+        if (agc->peak[b] > agc->ceiling && agc->ceiling / agc->peak[b] < target)
+        {
+            target = agc->ceiling / agc->peak[b];
+        }
+    }
+    limit = target < agc->limit ? target : agc->limit + (1.0f - agc->limit) * agc->release;
+    limit = limit < target ? limit : target;
+
+    agc_apply(x, samples, agc->gain, agc->gain_end[0], agc->limit, limit);
+    audio_sample_convert(x, AUDIO_SAMPLE_F32, out, AUDIO_SAMPLE_S16, samples, NULL);
+    agc->gain = agc->gain_end[0];
+    agc->limit = limit;
+
+    //  块很小, 直接挪到开头
+    agc->buf_frames -= frames;
+    agc->buf_blocks--;
+    memmove(agc->buf, agc->buf + samples, sizeof(float) * agc->buf_frames * agc->channels);
+    memmove(agc->peak, agc->peak + 1, sizeof(float) * agc->buf_blocks);
+    memmove(agc->gain_end, agc->gain_end + 1, sizeof(float) * agc->buf_blocks);
+}
+
+audio_agc_t *audio_agc_create(int samplerate, int channels, const audio_agc_param_t *param)
+{
+    audio_agc_t *agc = NULL;
+
+    if (samplerate < 8000 || channels <= 0 || channels > AUDIO_CHANNELS_MAX || param == NULL ||
+        param->max_gain < 0 || param->ceiling > 0)
+    {
+        fprintf(stderr, "[%s] samplerate=%d, channels=%d, param=%p, err param\n", __func__, samplerate, channels, param);
+        return NULL;
+    }
+
+    agc = (audio_agc_t *)calloc(1, sizeof(audio_agc_t));
+    if (agc == NULL)
+    {
+        return NULL;
+    }
+    agc->samplerate = samplerate;
+    agc->channels = channels;
+    agc->param = *param;
+    agc->block = samplerate * AGC_BLOCK_MS / 1000;
+    agc->release = (float)(1.0 - exp(-AGC_BLOCK_MS / AGC_RELEASE_MS));
+    agc->ceiling = (float)pow(10.0, param->ceiling / 20.0);
+    agc->buf = (float *)malloc(sizeof(float) * agc->block * (AGC_LOOKAHEAD + 2) * channels);
+    agc->meter = loudness_create(samplerate, channels);
+    if (agc->buf == NULL || agc->meter == NULL)
+    {
+        audio_agc_destroy(agc);
+        return NULL;
+    }
+    audio_agc_reset(agc);
+
+    return agc;
+}
+
+int audio_agc_get_out_size(audio_agc_t *agc, int in_frames)
+{
+    return agc != NULL ? in_frames + agc->block * (AGC_LOOKAHEAD + 1) : -1;
+}
+
+int audio_agc_process(audio_agc_t *agc, const short *in, int frames, short *out, int out_frames_max)
+{
+    int n = 0;
+    int done = 0;
+    int capacity = 0;
+
+    if (agc == NULL || (in == NULL && frames > 0) || frames < 0 || out == NULL || out_frames_max < audio_agc_get_out_size(agc, frames))
+    {
+        fprintf(stderr, "[%s] agc=%p, in=%p, frames=%d, out=%p, out_frames_max=%d, err param\n",
+                __func__, agc, in, frames, out, out_frames_max);
+        return -1;
+    }
+
+    capacity = agc->block * (AGC_LOOKAHEAD + 2);
+    while (frames > 0)
+    {
+        n = capacity - agc->buf_frames;
+        n = frames < n ? frames : n;
+        audio_sample_convert(in, AUDIO_SAMPLE_S16, agc->buf + (size_t)agc->buf_frames * agc->channels, AUDIO_SAMPLE_F32,
+                             n * agc->channels, NULL);
+        agc->buf_frames += n;
+        in += n * agc->channels;
+        frames -= n;
+
+        while ((agc->buf_blocks + 1) * agc->block <= agc->buf_frames)
+        {
+            agc_analyze(agc, agc->block);
+        }
+        //  后面有AGC_LOOKAHEAD块时才能决定第一块的限幅增益
+        while (agc->buf_blocks > AGC_LOOKAHEAD)
+        {
+            agc_output(agc, agc->block, AGC_LOOKAHEAD + 1, out + (size_t)done * agc->channels);
+            done += agc->block;
+        }
+    }
+
+    return done;
+}
+
+int audio_agc_flush(audio_agc_t *agc, short *out, int out_frames_max)
+{
+    int n = 0;
+    int done = 0;
+
+    if (agc == NULL || out == NULL || out_frames_max < audio_agc_get_out_size(agc, 0))
+    {
+        fprintf(stderr, "[%s] agc=%p, out=%p, out_frames_max=%d, err param\n", __func__, agc, out, out_frames_max);
+        return -1;
+    }
+
+    n = agc->buf_frames - agc->buf_blocks * agc->block;
+    if (n > 0)
+    {
+        agc_analyze(agc, n);
+    }
+    while (agc->buf_frames > 0)
+    {
+        n = agc->buf_frames < agc->block ? agc->buf_frames : agc->block;
+        agc_output(agc, n, agc->buf_blocks, out + (size_t)done * agc->channels);
+        done += n;
+    }
+
+    return done;
+}
+
+int audio_agc_set_gain(audio_agc_t *agc, double gain_db)
+{
+    if (agc == NULL)
+    {
+        fprintf(stderr, "[%s] agc=%p, err param\n", __func__, agc);
+        return -1;
+    }
+    //  在开始输出前设置, 不用斜坡过渡
+    agc->gain_db = gain_db;
+    agc->gain = (float)pow(10.0, gain_db / 20.0);
+    return 0;
+}
+
+int audio_agc_get_loudness(audio_agc_t *agc, audio_loudness_info_t *info)
+{
+    if (agc == NULL)
+    {
+        fprintf(stderr, "[%s] agc=%p, err param\n", __func__, agc);
+        return -1;
+    }
+    return audio_loudness_get(agc->meter, info);
+}
+
+void audio_agc_reset(audio_agc_t *agc)
+{
+    if (agc == NULL)
+    {
+        return;
+    }
+    agc->buf_frames = 0;
+    agc->buf_blocks = 0;
+    agc->limit = 1.0f;
+    agc->level_valid = 0;
+    agc->steps = 0;
+    audio_agc_set_gain(agc, agc->param.gain);
+    audio_loudness_reset(agc->meter);
+}
+
+void audio_agc_destroy(audio_agc_t *agc)
+{
+    if (agc == NULL)
+    {
+        return;
+    }
+    free(agc->buf);
+    audio_loudness_destroy(agc->meter);
+    free(agc);
+}
+#endif
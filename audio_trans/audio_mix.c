@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIX_HAVE_AVX2 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MIX_HAVE_NEON 1
+#endif
+
+#include "audio_trans.h"
+
+#define MIX_KNEE 0.75f              // 软削波从满幅的3/4开始压缩
+#define MIX_S16_SCALE 32768.0f
+#define MIX_LEVEL_DECAY 0.9f        // 能量下降时每帧的平滑系数, 20ms一帧时约200ms
+#define MIX_LEVEL_FLOOR 1e-7f       // 约-70dBFS, 低于这个的不算在说话
+#define MIX_HOLD_GAIN 2.0f          // 上一帧已经混入的输入排序时的加成(3dB), 避免在两个人之间来回切换
+
+struct audio_mixer
+{
+    int inputs_max;
+    int samples_max;
+    int speakers_max;           // 每帧最多混入的输入数, 0为全部
+    audio_mix_clip_e clip;
+    int *total;                 // s16输入的和, 32位不会溢出
+    float *total_f;             // f32输入的和
+    float *level;               // 每个输入平滑后的均方能量(满幅为1)
+    unsigned char *active;      // 本帧是否混入
+    int *speakers;              // 本帧混入的输入下标, 按能量从大到小
+    int speaker_count;
+};
+
+/*
+ * 超过MIX_KNEE后按u/(1+u)压缩, 在拐点处斜率为1, 趋近但达不到满幅
+ */
+static float mix_soft_clip(float x)
+{
+    float a = fabsf(x);
+    float u = 0;
+
+    if (a <= MIX_KNEE)
+    {
+        return x;
+    }
+    u = (a - MIX_KNEE) / (1.0f - MIX_KNEE);
+    a = MIX_KNEE + (1.0f - MIX_KNEE) * (u / (1.0f + u));
+    return x < 0 ? -a : a;
+}
+
+static short mix_saturate(int v)
+{
+    if (v > 32767)
+    {
+        return 32767;
+    }
+    if (v < -32768)
+    {
+        return -32768;
+    }
+    return (short)v;
+}
+
+#if 1   //  向量实现
+#ifdef MIX_HAVE_AVX2
+static int mix_have_avx2(void)
+{
+    static int have = -1;
+
+    if (have < 0)
+    {
+        __builtin_cpu_init();
+        have = __builtin_cpu_supports("avx2");
+    }
+    return have;
+}
+
+__attribute__((target("avx2"))) static int mix_energy_s16_avx2(const short *in, int samples, float *sum)
+{
+    int i = 0;
+    float lanes[8];
+    __m256 x, acc = _mm256_setzero_ps();
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i))));
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(x, x));
+    }
+    _mm256_storeu_ps(lanes, acc);
+    *sum = lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    return i;
+}
+
+__attribute__((target("avx2"))) static int mix_energy_f32_avx2(const float *in, int samples, float *sum)
+{
+    int i = 0;
+    float lanes[8];
+    __m256 x, acc = _mm256_setzero_ps();
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        x = _mm256_loadu_ps(in + i);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(x, x));
+    }
+    _mm256_storeu_ps(lanes, acc);
+    *sum = lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    return i;
+}
+
+/*
+ * first为1时total = in, 否则total += in; 16bit符号扩展到32位再加
+ */
+__attribute__((target("avx2"))) static int mix_add_s16_avx2(int *total, const short *in, int samples, int first)
+{
+    int i = 0;
+    __m256i lo, hi;
+    __m256i x;
+
+    for (i = 0; i + 16 <= samples; i += 16)
+    {
+        x = _mm256_loadu_si256((const __m256i *)(in + i));
+        lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+        hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+        if (!first)
+        {
+            lo = _mm256_add_epi32(lo, _mm256_loadu_si256((const __m256i *)(total + i)));
+            hi = _mm256_add_epi32(hi, _mm256_loadu_si256((const __m256i *)(total + i + 8)));
+        }
+        _mm256_storeu_si256((__m256i *)(total + i), lo);
+        _mm256_storeu_si256((__m256i *)(total + i + 8), hi);
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static int mix_add_f32_avx2(float *total, const float *in, int samples, int first)
+{
+    int i = 0;
+    __m256 x;
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        x = _mm256_loadu_ps(in + i);
+        if (!first)
+        {
+            x = _mm256_add_ps(x, _mm256_loadu_ps(total + i));
+        }
+        _mm256_storeu_ps(total + i, x);
+    }
+    return i;
+}
+
+/*
+ * 绝对值压缩后再放回符号位: min(a, knee) + (1 - knee) * u / (1 + u), a不超过knee时u为0
+ */
+__attribute__((target("avx2"))) static __m256 mix_soft_clip_avx2(__m256 x)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 knee = _mm256_set1_ps(MIX_KNEE);
+    const __m256 range = _mm256_set1_ps(1.0f - MIX_KNEE);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 a = _mm256_andnot_ps(sign, x);
+    __m256 u = _mm256_div_ps(_mm256_max_ps(_mm256_sub_ps(a, knee), _mm256_setzero_ps()), range);
+
+    a = _mm256_add_ps(_mm256_min_ps(a, knee), _mm256_mul_ps(range, _mm256_div_ps(u, _mm256_add_ps(one, u))));
+    return _mm256_or_ps(a, _mm256_and_ps(sign, x));
+}
+
+/*
+ * out = total - own(own为NULL时不减), 饱和打包回16bit, 打包按128位做的要重排
+ */
+__attribute__((target("avx2"))) static int mix_out_s16_avx2(const int *total, const short *own, int samples, short *out)
+{
+    int i = 0;
+    __m256i lo, hi, x;
+
+    for (i = 0; i + 16 <= samples; i += 16)
+    {
+        lo = _mm256_loadu_si256((const __m256i *)(total + i));
+        hi = _mm256_loadu_si256((const __m256i *)(total + i + 8));
+        if (own != NULL)
+        {
+            x = _mm256_loadu_si256((const __m256i *)(own + i));
+            lo = _mm256_sub_epi32(lo, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+            hi = _mm256_sub_epi32(hi, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+        }
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static int mix_out_s16_soft_avx2(const int *total, const short *own, int samples, short *out)
+{
+    int i = 0;
+    __m256i lo, hi, x;
+    const __m256 scale = _mm256_set1_ps(1.0f / MIX_S16_SCALE);
+    const __m256 unscale = _mm256_set1_ps(MIX_S16_SCALE);
+
+    for (i = 0; i + 16 <= samples; i += 16)
+    {
+        lo = _mm256_loadu_si256((const __m256i *)(total + i));
+        hi = _mm256_loadu_si256((const __m256i *)(total + i + 8));
+        if (own != NULL)
+        {
+            x = _mm256_loadu_si256((const __m256i *)(own + i));
+            lo = _mm256_sub_epi32(lo, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+            hi = _mm256_sub_epi32(hi, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+        }
+        lo = _mm256_cvtps_epi32(_mm256_mul_ps(mix_soft_clip_avx2(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale)), unscale));
+        hi = _mm256_cvtps_epi32(_mm256_mul_ps(mix_soft_clip_avx2(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale)), unscale));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static int mix_out_f32_avx2(const float *total, const float *own, int samples, int soft, float *out)
+{
+    int i = 0;
+    __m256 x;
+    const __m256 lo = _mm256_set1_ps(-1.0f);
+    const __m256 hi = _mm256_set1_ps(1.0f);
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        x = _mm256_loadu_ps(total + i);
+        if (own != NULL)
+        {
+            x = _mm256_sub_ps(x, _mm256_loadu_ps(own + i));
+        }
+        x = soft ? mix_soft_clip_avx2(x) : _mm256_min_ps(_mm256_max_ps(x, lo), hi);
+        _mm256_storeu_ps(out + i, x);
+    }
+    return i;
+}
+#endif
+
+static float mix_energy_s16(const short *in, int samples)
+{
+    int i = 0;
+    float sum = 0;
+
+#ifdef MIX_HAVE_AVX2
+    if (mix_have_avx2())
+    {
+        i = mix_energy_s16_avx2(in, samples, &sum);
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        sum += (float)in[i] * in[i];
+    }
+    return sum / (MIX_S16_SCALE * MIX_S16_SCALE) / samples;
+}
+
+static float mix_energy_f32(const float *in, int samples)
+{
+    int i = 0;
+    float sum = 0;
+
+#ifdef MIX_HAVE_AVX2
+    if (mix_have_avx2())
+    {
+        i = mix_energy_f32_avx2(in, samples, &sum);
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        sum += in[i] * in[i];
+    }
+    return sum / samples;
+}
+
+static void mix_add_s16(int *total, const short *in, int samples, int first)
+{
+    int i = 0;
+
+#ifdef MIX_HAVE_AVX2
+    if (mix_have_avx2())
+    {
+        i = mix_add_s16_avx2(total, in, samples, first);
+    }
+#elif defined(MIX_HAVE_NEON)
+    for (; i + 8 <= samples; i += 8)
+    {
+        int16x8_t x = vld1q_s16(in + i);
+        int32x4_t lo = vmovl_s16(vget_low_s16(x));
+        int32x4_t hi = vmovl_s16(vget_high_s16(x));
+        if (!first)
+        {
+            lo = vaddq_s32(lo, vld1q_s32(total + i));
+            hi = vaddq_s32(hi, vld1q_s32(total + i + 4));
+        }
+        vst1q_s32(total + i, lo);
+        vst1q_s32(total + i + 4, hi);
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        total[i] = first ? in[i] : total[i] + in[i];
+    }
+}
+
+static void mix_add_f32(float *total, const float *in, int samples, int first)
+{
+    int i = 0;
+
+#ifdef MIX_HAVE_AVX2
+    if (mix_have_avx2())
+    {
+        i = mix_add_f32_avx2(total, in, samples, first);
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        total[i] = first ? in[i] : total[i] + in[i];
+    }
+}
+
+static void mix_out_s16(const int *total, const short *own, int samples, audio_mix_clip_e clip, short *out)
+{
+    int i = 0;
+    int v = 0;
+
+#ifdef MIX_HAVE_AVX2
+    if (mix_have_avx2())
+    {
+        i = clip == AUDIO_MIX_SOFT_CLIP ? mix_out_s16_soft_avx2(total, own, samples, out) : mix_out_s16_avx2(total, own, samples, out);
+    }
+#elif defined(MIX_HAVE_NEON)
+    for (; clip == AUDIO_MIX_SATURATE && i + 8 <= samples; i += 8)
+    {
+        int32x4_t lo = vld1q_s32(total + i);
+        int32x4_t hi = vld1q_s32(total + i + 4);
+        if (own != NULL)
+        {
+            int16x8_t x = vld1q_s16(own + i);
+            lo = vsubq_s32(lo, vmovl_s16(vget_low_s16(x)));
+            hi = vsubq_s32(hi, vmovl_s16(vget_high_s16(x)));
+        }
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        v = own != NULL ? total[i] - own[i] : total[i];
+        if (clip == AUDIO_MIX_SOFT_CLIP)
+        {
+            v = (int)lrintf(mix_soft_clip(v / MIX_S16_SCALE) * MIX_S16_SCALE);
+        }
+        out[i] = mix_saturate(v);
+    }
+}
+
+static void mix_out_f32(const float *total, const float *own, int samples, audio_mix_clip_e clip, float *out)
+{
+    int i = 0;
+    float v = 0;
+
+#ifdef MIX_HAVE_AVX2
+    if (mix_have_avx2())
+    {
+        i = mix_out_f32_avx2(total, own, samples, clip == AUDIO_MIX_SOFT_CLIP, out);
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        v = own != NULL ? total[i] - own[i] : total[i];
+        if (clip == AUDIO_MIX_SOFT_CLIP)
+        {
+            v = mix_soft_clip(v);
+        }
+        out[i] = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+    }
+}
+#endif
+
+#if 1   //  选择说话人
+/*
+ * 能量上升立即跟上, 下降时平滑; 没有输入(NULL)的按静音衰减
+ */
+static void mix_update_level(audio_mixer_t *mixer, int index, float energy)
+{
+    float level = mixer->level[index];
+
+    mixer->level[index] = energy >= level ? energy : level * MIX_LEVEL_DECAY + energy * (1.0f - MIX_LEVEL_DECAY);
+}
+
+/*
+ * 按平滑后的能量取前speakers_max个, 上一帧混入的有加成; 人数不多时插入排序就够了
+ */
+static void mix_select(audio_mixer_t *mixer, const void *const *in, int inputs)
+{
+    int i = 0;
+    int j = 0;
+    int count = 0;
+    int limit = mixer->speakers_max > 0 ? mixer->speakers_max : inputs;
+    float score = 0;
+    float scores[AUDIO_MIX_INPUTS_MAX];
+
+    for (i = 0; i < inputs; i++)
+    {
+        score = mixer->level[i] * (mixer->active[i] ? MIX_HOLD_GAIN : 1.0f);
+        mixer->active[i] = 0;
+        if (in[i] == NULL || (mixer->speakers_max > 0 && mixer->level[i] < MIX_LEVEL_FLOOR))
+        {
+            continue;
+        }
+        if (count == limit && score <= scores[count - 1])
+        {
+            continue;
+        }
+        j = count < limit ? count++ : count - 1;
+        for (; j > 0 && scores[j - 1] < score; j--)
+        {
+            scores[j] = scores[j - 1];
+            mixer->speakers[j] = mixer->speakers[j - 1];
+        }
+        scores[j] = score;
+        mixer->speakers[j] = i;
+    }
+    for (i = 0; i < count; i++)
+    {
+        mixer->active[mixer->speakers[i]] = 1;
+    }
+    for (i = inputs; i < mixer->inputs_max; i++)
+    {
+        mixer->active[i] = 0;
+        mixer->level[i] = 0;
+    }
+    mixer->speaker_count = count;
+}
+#endif
+
+audio_mixer_t *audio_mixer_create(int inputs_max, int samples_max, int speakers_max, audio_mix_clip_e clip)
+{
+    audio_mixer_t *mixer = NULL;
+
+    if (inputs_max <= 0 || inputs_max > AUDIO_MIX_INPUTS_MAX || samples_max <= 0 || speakers_max < 0 ||
+        (clip != AUDIO_MIX_SATURATE && clip != AUDIO_MIX_SOFT_CLIP))
+    {
+        fprintf(stderr, "[%s] inputs_max=%d, samples_max=%d, speakers_max=%d, clip=%d, err param\n",
+                __func__, inputs_max, samples_max, speakers_max, clip);
+        return NULL;
+    }
+
+    mixer = (audio_mixer_t *)calloc(1, sizeof(audio_mixer_t));
+    if (mixer == NULL)
+    {
+        return NULL;
+    }
+    mixer->inputs_max = inputs_max;
+    mixer->samples_max = samples_max;
+    mixer->speakers_max = speakers_max >= inputs_max ? 0 : speakers_max;
+    mixer->clip = clip;
+    mixer->total = (int *)malloc(sizeof(int) * samples_max);
+    mixer->total_f = (float *)malloc(sizeof(float) * samples_max);
+    mixer->level = (float *)calloc(inputs_max, sizeof(float));
+    mixer->active = (unsigned char *)calloc(inputs_max, sizeof(unsigned char));
+    mixer->speakers = (int *)calloc(inputs_max, sizeof(int));
+    if (mixer->total == NULL || mixer->total_f == NULL || mixer->level == NULL || mixer->active == NULL || mixer->speakers == NULL)
+    {
+        audio_mixer_destroy(mixer);
+        return NULL;
+    }
+
+    return mixer;
+}
+
+int audio_mixer_mix(audio_mixer_t *mixer, const short *const *in, int inputs, int samples, short *mix, short *const *minus)
+{
+    int i = 0;
+
+    if (mixer == NULL || in == NULL || inputs <= 0 || inputs > mixer->inputs_max || samples <= 0 || samples > mixer->samples_max || mix == NULL)
+    {
+        fprintf(stderr, "[%s] mixer=%p, in=%p, inputs=%d, samples=%d, mix=%p, err param\n",
+                __func__, mixer, in, inputs, samples, mix);
+        return -1;
+    }
+
+    //  全部混入时能量只用来报告说话人, 也照样算, 比混音本身便宜
+    for (i = 0; i < inputs; i++)
+    {
+        mix_update_level(mixer, i, in[i] != NULL ? mix_energy_s16(in[i], samples) : 0);
+    }
+    mix_select(mixer, (const void *const *)in, inputs);
+
+    if (mixer->speaker_count == 0)
+    {
+        memset(mixer->total, 0, sizeof(int) * samples);
+    }
+    for (i = 0; i < mixer->speaker_count; i++)
+    {
+        mix_add_s16(mixer->total, in[mixer->speakers[i]], samples, i == 0);
+    }
+
+    //  混入的减去自己, 没混入的听到的就是完整的混音
+    mix_out_s16(mixer->total, NULL, samples, mixer->clip, mix);
+    for (i = 0; minus != NULL && i < inputs; i++)
+    {
+        if (minus[i] == NULL)
+        {
+            continue;
+        }
+        if (mixer->active[i])
+        {
+            mix_out_s16(mixer->total, in[i], samples, mixer->clip, minus[i]);
+        }
+        else
+        {
+            memcpy(minus[i], mix, sizeof(short) * samples);
+        }
+    }
+
+    return mixer->speaker_count;
+}
+
+int audio_mixer_mix_float(audio_mixer_t *mixer, const float *const *in, int inputs, int samples, float *mix, float *const *minus)
+{
+    int i = 0;
+
+    if (mixer == NULL || in == NULL || inputs <= 0 || inputs > mixer->inputs_max || samples <= 0 || samples > mixer->samples_max || mix == NULL)
+    {
+        fprintf(stderr, "[%s] mixer=%p, in=%p, inputs=%d, samples=%d, mix=%p, err param\n",
+                __func__, mixer, in, inputs, samples, mix);
+        return -1;
+    }
+
+    for (i = 0; i < inputs; i++)
+    {
+        mix_update_level(mixer, i, in[i] != NULL ? mix_energy_f32(in[i], samples) : 0);
+    }
+    mix_select(mixer, (const void *const *)in, inputs);
+
+    if (mixer->speaker_count == 0)
+    {
+        memset(mixer->total_f, 0, sizeof(float) * samples);
+    }
+    for (i = 0; i < mixer->speaker_count; i++)
+    {
+        mix_add_f32(mixer->total_f, in[mixer->speakers[i]], samples, i == 0);
+    }
+
+    mix_out_f32(mixer->total_f, NULL, samples, mixer->clip, mix);
+    for (i = 0; minus != NULL && i < inputs; i++)
+    {
+        if (minus[i] == NULL)
+        {
+            continue;
+        }
+        if (mixer->active[i])
+        {
+            mix_out_f32(mixer->total_f, in[i], samples, mixer->clip, minus[i]);
+        }
+        else
+        {
+            memcpy(minus[i], mix, sizeof(float) * samples);
+        }
+    }
+
+    return mixer->speaker_count;
+}
+
+int audio_mixer_get_speakers(audio_mixer_t *mixer, int *index, int max)
+{
+    int count = 0;
+
+    if (mixer == NULL || index == NULL || max < 0)
+    {
+        fprintf(stderr, "[%s] mixer=%p, index=%p, max=%d, err param\n", __func__, mixer, index, max);
+        return -1;
+    }
+    count = mixer->speaker_count < max ? mixer->speaker_count : max;
+    memcpy(index, mixer->speakers, sizeof(int) * count);
+    return count;
+}
+
+int audio_mixer_is_speaker(audio_mixer_t *mixer, int index)
+{
+    if (mixer == NULL || index < 0 || index >= mixer->inputs_max)
+    {
+        return 0;
+    }
+    return mixer->active[index];
+}
+
+void audio_mixer_reset(audio_mixer_t *mixer)
+{
+    if (mixer == NULL)
+    {
+        return;
+    }
+    memset(mixer->level, 0, sizeof(float) * mixer->inputs_max);
+    memset(mixer->active, 0, sizeof(unsigned char) * mixer->inputs_max);
+    mixer->speaker_count = 0;
+}
+
+void audio_mixer_destroy(audio_mixer_t *mixer)
+{
+    if (mixer == NULL)
+    {
+        return;
+    }
+    free(mixer->total);
+    free(mixer->total_f);
+    free(mixer->level);
+    free(mixer->active);
+    free(mixer->speakers);
+    free(mixer);
+}
@@ -0,0 +1,630 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+#include "audio_trans.h"
+
+#define OUTPUT_BUFFER_DEFAULT (1024 * 1024)     // io_uring方式每个缓存的默认大小
+#define OUTPUT_BUFFERS 4                        // 同时在写的缓存数, 都在写时编码才会等
+#define OUTPUT_ALIGN 4096                       // O_DIRECT要求缓存、长度和偏移都按块对齐
+
+typedef struct
+{
+    unsigned char *data;
+    size_t len;                 // 提交的长度
+    long long offset;           // 提交的文件偏移
+    int busy;                   // 已提交, 还没完成
+} output_buffer_t;
+
+struct audio_output
+{
+    int fd;
+    int own_fd;                 // fd是audio_output_open打开的, close时关闭
+    audio_output_mode_e mode;   // 实际使用的方式, STDIO/URING/DIRECT
+    int seekable;
+    int fd_flags;               // 打开时fd的标志, O_DIRECT是这里加的, 关闭时恢复
+    long long start;            // 打开时fd的位置, tell/pwrite的偏移都相对它
+    int error;                  // 第一个失败的errno
+
+    //  stdio
+    FILE *fp;
+
+    //  io_uring
+    int ring_fd;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    output_buffer_t buffers[OUTPUT_BUFFERS];
+    size_t buffer_size;
+    int current;                // 正在填的缓存, -1为没有
+    size_t fill;                // 正在填的缓存里的数据量
+    long long offset;           // 下一次提交的文件偏移
+    int inflight;
+};
+
+static int uring_setup(audio_output_t *out)
+{
+    struct io_uring_params params;
+    struct io_uring_probe *probe = NULL;
+    size_t probe_len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    int supported = 0;
+
+    memset(&params, 0, sizeof(params));
+    out->ring_fd = syscall(__NR_io_uring_setup, OUTPUT_BUFFERS, &params);
+    if (out->ring_fd < 0)
+    {
+        return -1;
+    }
+
+    //  IORING_OP_WRITE要5.6以上的内核
+    probe = (struct io_uring_probe *)calloc(1, probe_len);
+    if (probe != NULL && syscall(__NR_io_uring_register, out->ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+    {
+        supported = probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    if (!supported)
+    {
+        return -1;
+    }
+
+    out->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    out->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        out->sq_len = out->sq_len > out->cq_len ? out->sq_len : out->cq_len;
+    }
+    out->sq_ptr = mmap(NULL, out->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out->ring_fd, IORING_OFF_SQ_RING);
+    if (out->sq_ptr == MAP_FAILED)
+    {
+        out->sq_ptr = NULL;
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        out->cq_ptr = out->sq_ptr;
+    }
+    else
+    {
+        out->cq_ptr = mmap(NULL, out->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out->ring_fd, IORING_OFF_CQ_RING);
+        if (out->cq_ptr == MAP_FAILED)
+        {
+            out->cq_ptr = NULL;
+            return -1;
+        }
+    }
+    out->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    out->sqes = mmap(NULL, out->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out->ring_fd, IORING_OFF_SQES);
+    if (out->sqes == MAP_FAILED)
+    {
+        out->sqes = NULL;
+        return -1;
+    }
+
+    out->sq_head = (unsigned int *)((char *)out->sq_ptr + params.sq_off.head);
+    out->sq_tail = (unsigned int *)((char *)out->sq_ptr + params.sq_off.tail);
+    out->sq_mask = (unsigned int *)((char *)out->sq_ptr + params.sq_off.ring_mask);
+    out->sq_array = (unsigned int *)((char *)out->sq_ptr + params.sq_off.array);
+    out->cq_head = (unsigned int *)((char *)out->cq_ptr + params.cq_off.head);
+    out->cq_tail = (unsigned int *)((char *)out->cq_ptr + params.cq_off.tail);
+    out->cq_mask = (unsigned int *)((char *)out->cq_ptr + params.cq_off.ring_mask);
+    out->cqes = (struct io_uring_cqe *)((char *)out->cq_ptr + params.cq_off.cqes);
+
+    return 0;
+}
+
+static void uring_release(audio_output_t *out)
+{
+    int i = 0;
+
+    if (out->sqes != NULL)
+    {
+        munmap(out->sqes, out->sqes_len);
+    }
+    if (out->cq_ptr != NULL && out->cq_ptr != out->sq_ptr)
+    {
+        munmap(out->cq_ptr, out->cq_len);
+    }
+    if (out->sq_ptr != NULL)
+    {
+        munmap(out->sq_ptr, out->sq_len);
+    }
+    if (out->ring_fd >= 0)
+    {
+        close(out->ring_fd);
+    }
+    for (i = 0; i < OUTPUT_BUFFERS; i++)
+    {
+        free(out->buffers[i].data);
+        out->buffers[i].data = NULL;
+    }
+    out->sqes = NULL;
+    out->cq_ptr = NULL;
+    out->sq_ptr = NULL;
+    out->ring_fd = -1;
+}
+
+/*
+ * 同步写完, 用于短写的剩余部分和O_DIRECT关掉后的尾巴
+ */
+static int output_pwrite_all(int fd, const unsigned char *buf, size_t len, long long offset)
+{
+    ssize_t ret = 0;
+
+    while (len > 0)
+    {
+        ret = pwrite(fd, buf, len, offset);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret <= 0)
+        {
+            return ret < 0 ? -errno : -EIO;
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+
+    return 0;
+}
+
+/*
+ * 收完成队列, 缓存标为空闲. 短写在这里同步补齐, 出错只记下第一个
+ */
+static void uring_reap(audio_output_t *out)
+{
+    int err = 0;
+    unsigned int head = *out->cq_head;
+    struct io_uring_cqe *cqe = NULL;
+    output_buffer_t *buffer = NULL;
+
+    while (head != __atomic_load_n(out->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        cqe = &out->cqes[head & *out->cq_mask];
+        buffer = &out->buffers[cqe->user_data];
+        err = 0;
+        if (cqe->res < 0)
+        {
+            err = -cqe->res;
+        }
+        else if ((size_t)cqe->res < buffer->len)
+        {
+            err = -output_pwrite_all(out->fd, buffer->data + cqe->res, buffer->len - cqe->res, buffer->offset + cqe->res);
+        }
+        if (err != 0 && out->error == 0)
+        {
+            out->error = err;
+        }
+        buffer->busy = 0;
+        out->inflight--;
+        head++;
+    }
+    __atomic_store_n(out->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int uring_wait(audio_output_t *out)
+{
+    int ret = 0;
+
+    do
+    {
+        ret = syscall(__NR_io_uring_enter, out->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+    {
+        if (out->error == 0)
+        {
+            out->error = errno;
+        }
+        return -1;
+    }
+    uring_reap(out);
+
+    return 0;
+}
+
+static int uring_submit(audio_output_t *out, int index, size_t len)
+{
+    int ret = 0;
+    unsigned int tail = *out->sq_tail;
+    unsigned int slot = tail & *out->sq_mask;
+    struct io_uring_sqe *sqe = &out->sqes[slot];
+    output_buffer_t *buffer = &out->buffers[index];
+
+    buffer->len = len;
+    buffer->offset = out->offset;
+    buffer->busy = 1;
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = out->fd;
+    sqe->addr = (unsigned long)buffer->data;
+    sqe->len = len;
+    sqe->off = out->offset;
+    sqe->user_data = index;
+    out->sq_array[slot] = slot;
+    __atomic_store_n(out->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    do
+    {
+        ret = syscall(__NR_io_uring_enter, out->ring_fd, 1, 0, 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret != 1)
+    {
+        if (out->error == 0)
+        {
+            out->error = ret < 0 ? errno : EIO;
+        }
+        buffer->busy = 0;
+        return -1;
+    }
+    out->inflight++;
+    out->offset += len;
+
+    return 0;
+}
+
+/*
+ * 取一个空闲缓存来填, 都在写时等最早的一个完成
+ */
+static int uring_next_buffer(audio_output_t *out)
+{
+    int i = 0;
+
+    uring_reap(out);
+    while (1)
+    {
+        for (i = 0; i < OUTPUT_BUFFERS; i++)
+        {
+            if (!out->buffers[i].busy)
+            {
+                break;
+            }
+        }
+        if (i < OUTPUT_BUFFERS)
+        {
+            break;
+        }
+        if (uring_wait(out) != 0)
+        {
+            return -1;
+        }
+    }
+
+    out->current = i;
+    out->fill = 0;
+
+    return 0;
+}
+
+/*
+ * 打开时把缓存都分配好, 之后写多大的文件都不再分配; 没写到的页不占物理内存
+ */
+static int uring_alloc_buffers(audio_output_t *out)
+{
+    int i = 0;
+
+    for (i = 0; i < OUTPUT_BUFFERS; i++)
+    {
+        if (posix_memalign((void **)&out->buffers[i].data, OUTPUT_ALIGN, out->buffer_size) != 0)
+        {
+            out->buffers[i].data = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int uring_drain(audio_output_t *out)
+{
+    while (out->inflight > 0)
+    {
+        if (uring_wait(out) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return out->error == 0 ? 0 : -1;
+}
+
+/*
+ * 关掉O_DIRECT, 之后可以写不对齐的内容; 要在没有在写的缓存时调用
+ */
+static void output_clear_direct(audio_output_t *out)
+{
+    if (out->mode == AUDIO_OUTPUT_DIRECT)
+    {
+        fcntl(out->fd, F_SETFL, out->fd_flags);
+        out->mode = AUDIO_OUTPUT_URING;
+    }
+}
+
+/*
+ * O_DIRECT只能写整块, 不足一块的尾巴等前面的都写完后关掉O_DIRECT同步写
+ */
+static int uring_finish(audio_output_t *out)
+{
+    int ret = 0;
+    size_t aligned = 0;
+    output_buffer_t *buffer = NULL;
+
+    if (out->current >= 0 && out->fill > 0)
+    {
+        buffer = &out->buffers[out->current];
+        aligned = out->mode == AUDIO_OUTPUT_DIRECT ? out->fill / OUTPUT_ALIGN * OUTPUT_ALIGN : out->fill;
+        if (aligned > 0 && uring_submit(out, out->current, aligned) != 0)
+        {
+            return -1;
+        }
+        if (uring_drain(out) != 0)
+        {
+            return -1;
+        }
+        if (aligned < out->fill)
+        {
+            output_clear_direct(out);
+            ret = output_pwrite_all(out->fd, buffer->data + aligned, out->fill - aligned, out->offset);
+            if (ret != 0)
+            {
+                out->error = -ret;
+                return -1;
+            }
+            out->offset += out->fill - aligned;
+        }
+        out->current = -1;
+        out->fill = 0;
+    }
+
+    return uring_drain(out);
+}
+
+#if 1   //  输出
+audio_output_t *audio_output_open_fd(int fd, audio_output_mode_e mode, int buffer_size)
+{
+    int flags = 0;
+    audio_output_t *out = NULL;
+    struct stat st;
+
+    if (fd < 0 || mode < AUDIO_OUTPUT_AUTO || mode > AUDIO_OUTPUT_DIRECT || buffer_size < 0)
+    {
+        fprintf(stderr, "[%s] fd=%d, mode=%d, buffer_size=%d, err param\n", __func__, fd, mode, buffer_size);
+        return NULL;
+    }
+
+    out = (audio_output_t *)calloc(1, sizeof(audio_output_t));
+    if (out == NULL)
+    {
+        return NULL;
+    }
+    out->fd = fd;
+    out->ring_fd = -1;
+    out->current = -1;
+    flags = fcntl(fd, F_GETFL);
+    out->fd_flags = flags;
+    out->seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && !(flags & O_APPEND);
+    out->start = out->seekable ? lseek(fd, 0, SEEK_CUR) : 0;
+    out->offset = out->start;
+
+    //  io_uring按偏移写, 多个缓存同时在写; 管道/socket没有偏移, 只能按顺序写
+    if (mode != AUDIO_OUTPUT_STDIO && out->seekable)
+    {
+        out->buffer_size = buffer_size > 0 ? buffer_size : OUTPUT_BUFFER_DEFAULT;
+        out->buffer_size = (out->buffer_size + OUTPUT_ALIGN - 1) / OUTPUT_ALIGN * OUTPUT_ALIGN;
+        if (uring_setup(out) == 0 && uring_alloc_buffers(out) == 0)
+        {
+            out->mode = AUDIO_OUTPUT_URING;
+            if (mode == AUDIO_OUTPUT_DIRECT && out->start % OUTPUT_ALIGN == 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0)
+            {
+                out->mode = AUDIO_OUTPUT_DIRECT;
+            }
+            else if (mode == AUDIO_OUTPUT_DIRECT)
+            {
+                fprintf(stderr, "[%s] O_DIRECT not supported, use io_uring\n", __func__);
+            }
+            return out;
+        }
+        uring_release(out);
+    }
+    if (mode != AUDIO_OUTPUT_AUTO && mode != AUDIO_OUTPUT_STDIO)
+    {
+        fprintf(stderr, "[%s] io_uring not available for fd=%d, use stdio\n", __func__, fd);
+    }
+
+    out->mode = AUDIO_OUTPUT_STDIO;
+    out->fp = fd == STDOUT_FILENO ? stdout : fdopen(dup(fd), "w");
+    if (out->fp == NULL)
+    {
+        free(out);
+        return NULL;
+    }
+    //  大缓存提高吞吐
+    if (buffer_size > 0 && setvbuf(out->fp, NULL, _IOFBF, buffer_size) != 0)
+    {
+        fprintf(stderr, "[%s] setvbuf %d failed\n", __func__, buffer_size);
+    }
+
+    return out;
+}
+
+audio_output_t *audio_output_open(const char *path, audio_output_mode_e mode, int buffer_size)
+{
+    int fd = -1;
+    audio_output_t *out = NULL;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return NULL;
+    }
+
+    out = audio_output_open_fd(fd, mode, buffer_size);
+    if (out == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    out->own_fd = 1;
+
+    return out;
+}
+
+int audio_output_write(audio_output_t *out, const void *buf, size_t len)
+{
+    size_t n = 0;
+    const unsigned char *data = (const unsigned char *)buf;
+
+    if (out->mode == AUDIO_OUTPUT_STDIO)
+    {
+        return fwrite(buf, 1, len, out->fp) == len ? 0 : -1;
+    }
+
+    while (len > 0)
+    {
+        if (out->current < 0 && uring_next_buffer(out) != 0)
+        {
+            return -1;
+        }
+        n = out->buffer_size - out->fill;
+        n = n < len ? n : len;
+        memcpy(out->buffers[out->current].data + out->fill, data, n);
+        out->fill += n;
+        data += n;
+        len -= n;
+
+        //  满一个缓存就交给内核, 不等它写完
+        if (out->fill == out->buffer_size)
+        {
+            if (uring_submit(out, out->current, out->fill) != 0)
+            {
+                return -1;
+            }
+            out->current = -1;
+        }
+    }
+
+    return out->error == 0 ? 0 : -1;
+}
+
+int audio_output_flush(audio_output_t *out)
+{
+    size_t aligned = 0;
+
+    if (out->mode == AUDIO_OUTPUT_STDIO)
+    {
+        return fflush(out->fp);
+    }
+    if (out->current < 0 || out->fill == 0)
+    {
+        return out->error == 0 ? 0 : -1;
+    }
+
+    //  O_DIRECT只提交整块, 尾巴留到下一次
+    aligned = out->mode == AUDIO_OUTPUT_DIRECT ? out->fill / OUTPUT_ALIGN * OUTPUT_ALIGN : out->fill;
+    if (aligned < out->fill)
+    {
+        return 0;
+    }
+    if (uring_submit(out, out->current, aligned) != 0)
+    {
+        return -1;
+    }
+    out->current = -1;
+
+    return 0;
+}
+
+long long audio_output_tell(audio_output_t *out)
+{
+    if (!out->seekable)
+    {
+        return -1;
+    }
+    if (out->mode == AUDIO_OUTPUT_STDIO)
+    {
+        return ftello(out->fp) - out->start;
+    }
+
+    return out->offset + out->fill - out->start;
+}
+
+int audio_output_pwrite(audio_output_t *out, const void *buf, size_t len, long long offset)
+{
+    if (!out->seekable)
+    {
+        return -1;
+    }
+    //  先把之前的都写下去, 否则后提交的缓存会盖掉这次写的内容
+    if (out->mode == AUDIO_OUTPUT_STDIO ? fflush(out->fp) != 0 : uring_finish(out) != 0)
+    {
+        return -1;
+    }
+    output_clear_direct(out);
+
+    return output_pwrite_all(out->fd, buf, len, out->start + offset) == 0 ? 0 : -1;
+}
+
+audio_output_mode_e audio_output_get_mode(audio_output_t *out)
+{
+    return out == NULL ? AUDIO_OUTPUT_AUTO : out->mode;
+}
+
+int audio_output_close(audio_output_t *out)
+{
+    int ret = 0;
+
+    if (out == NULL)
+    {
+        return 0;
+    }
+
+    if (out->mode == AUDIO_OUTPUT_STDIO)
+    {
+        ret = out->fp == stdout ? fflush(out->fp) : fclose(out->fp);
+    }
+    else
+    {
+        ret = uring_finish(out);
+        output_clear_direct(out);
+        //  fd的位置和按偏移写入的内容保持一致, 调用者可以接着写
+        lseek(out->fd, out->offset, SEEK_SET);
+        uring_release(out);
+    }
+    if (ret != 0 || out->error != 0)
+    {
+        fprintf(stderr, "[%s] write failed: %s\n", __func__, strerror(out->error != 0 ? out->error : errno));
+        ret = -1;
+    }
+    if (out->own_fd && close(out->fd) != 0)
+    {
+        ret = -1;
+    }
+    free(out);
+
+    return ret;
+}
+#endif
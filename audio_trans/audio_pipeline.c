@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "audio_trans.h"
+
+#define RING_CACHE_LINE 64
+#define RING_SPIN 256           // 满/空时先自旋这么多次再睡眠, 流水线稳定后基本不会睡
+
+//  生产者和消费者各自改写的字段放在不同的缓存行, 避免伪共享
+struct audio_ring
+{
+    //  生产者
+    unsigned int head __attribute__((aligned(RING_CACHE_LINE)));
+    unsigned int tail_cache;            // 上次看到的tail, 不满时不用读消费者的缓存行
+    unsigned long long full_waits;
+    unsigned long long full_wait_ns;
+    unsigned long long occupancy_sum;
+    int occupancy_max;
+
+    //  消费者
+    unsigned int tail __attribute__((aligned(RING_CACHE_LINE)));
+    unsigned int head_cache;
+    unsigned long long empty_waits;
+    unsigned long long empty_wait_ns;
+
+    //  只在阻塞时用到; 两端各有自己的标志, 一端醒来时不能清掉另一端的
+    int waiting[2] __attribute__((aligned(RING_CACHE_LINE))); // 0: 消费者, 1: 生产者
+    int closed;
+    int aborted;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    unsigned int slots;                 // 2的幂
+    int slot_size;
+    int stride;                         // 按缓存行对齐的槽间距
+    int *len;
+    unsigned int *tag;
+    unsigned char *data;
+};
+
+typedef struct
+{
+    char name[32];
+    audio_stage_func func;
+    void *arg;
+    audio_ring_t *in;
+    audio_ring_t *out;
+    pthread_t thread;
+    int started;
+    int ret;
+    double seconds;
+    audio_pipeline_t *pipeline;
+} pipeline_stage_t;
+
+struct audio_pipeline
+{
+    pipeline_stage_t stages[AUDIO_PIPELINE_STAGES_MAX];
+    int count;
+    int ret;                            // 最先失败的级的返回值, 其他级是被叫停的
+};
+
+static inline void ring_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static unsigned long long ring_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int ring_can_push(audio_ring_t *ring)
+{
+    ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return ring->head - ring->tail_cache < ring->slots;
+}
+
+static int ring_can_pop(audio_ring_t *ring)
+{
+    ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return ring->head_cache != ring->tail;
+}
+
+static int ring_stopped(audio_ring_t *ring, int producer)
+{
+    return __atomic_load_n(&ring->aborted, __ATOMIC_ACQUIRE) ||
+           (!producer && __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * 等到可写/可读或者环被关闭. 先自旋, 再在条件变量上睡;
+ * 睡之前置自己的waiting, 对方改完下标后看到它才去唤醒, 两边都有全屏障, 不会漏唤醒
+ */
+static void ring_wait(audio_ring_t *ring, int producer)
+{
+    int i = 0;
+    unsigned long long start = 0;
+    int (*ready)(audio_ring_t *) = producer ? ring_can_push : ring_can_pop;
+
+    for (i = 0; i < RING_SPIN; i++)
+    {
+        if (ready(ring) || ring_stopped(ring, producer))
+        {
+            return;
+        }
+        ring_relax();
+    }
+
+    start = ring_now_ns();
+    pthread_mutex_lock(&ring->lock);
+    while (1)
+    {
+        __atomic_store_n(&ring->waiting[producer], 1, __ATOMIC_SEQ_CST);
+        if (ready(ring) || ring_stopped(ring, producer))
+        {
+            break;
+        }
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    }
+    __atomic_store_n(&ring->waiting[producer], 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&ring->lock);
+
+    if (producer)
+    {
+        ring->full_waits++;
+        ring->full_wait_ns += ring_now_ns() - start;
+    }
+    else
+    {
+        ring->empty_waits++;
+        ring->empty_wait_ns += ring_now_ns() - start;
+    }
+}
+
+static void ring_wake(audio_ring_t *ring, int producer)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->waiting[producer], __ATOMIC_RELAXED))
+    {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+static void ring_wake_all(audio_ring_t *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+#if 1   //  流水线
+audio_ring_t *audio_ring_create(int slots, int slot_size)
+{
+    unsigned int count = 1;
+    audio_ring_t *ring = NULL;
+
+    if (slots <= 0 || slot_size <= 0)
+    {
+        fprintf(stderr, "[%s] slots=%d, slot_size=%d, err param\n", __func__, slots, slot_size);
+        return NULL;
+    }
+    while (count < (unsigned int)slots)
+    {
+        count <<= 1;
+    }
+
+    if (posix_memalign((void **)&ring, RING_CACHE_LINE, sizeof(audio_ring_t)) != 0)
+    {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(audio_ring_t));
+    ring->slots = count;
+    ring->slot_size = slot_size;
+    ring->stride = (slot_size + RING_CACHE_LINE - 1) / RING_CACHE_LINE * RING_CACHE_LINE;
+    ring->len = (int *)calloc(count, sizeof(int));
+    ring->tag = (unsigned int *)calloc(count, sizeof(unsigned int));
+    if (ring->len == NULL || ring->tag == NULL ||
+        posix_memalign((void **)&ring->data, RING_CACHE_LINE, (size_t)ring->stride * count) != 0)
+    {
+        free(ring->len);
+        free(ring->tag);
+        free(ring);
+        return NULL;
+    }
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+
+    return ring;
+}
+
+int audio_ring_slot_size(audio_ring_t *ring)
+{
+    return ring->slot_size;
+}
+
+unsigned char *audio_ring_acquire(audio_ring_t *ring)
+{
+    while (ring->head - ring->tail_cache >= ring->slots && !ring_can_push(ring))
+    {
+        if (ring_stopped(ring, 1))
+        {
+            return NULL;
+        }
+        ring_wait(ring, 1);
+    }
+    if (__atomic_load_n(&ring->aborted, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+
+    return ring->data + (size_t)(ring->head & (ring->slots - 1)) * ring->stride;
+}
+
+void audio_ring_commit(audio_ring_t *ring, int len, unsigned int tag)
+{
+    unsigned int index = ring->head & (ring->slots - 1);
+    int occupancy = 0;
+
+    ring->len[index] = len;
+    ring->tag[index] = tag;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+
+    //  放入后的占用, tail读旧了只会偏大一点
+    occupancy = (int)(ring->head - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED));
+    ring->occupancy_sum += occupancy;
+    if (occupancy > ring->occupancy_max)
+    {
+        ring->occupancy_max = occupancy;
+    }
+    ring_wake(ring, 0);
+}
+
+int audio_ring_peek(audio_ring_t *ring, unsigned char **data, unsigned int *tag)
+{
+    unsigned int index = 0;
+
+    while (ring->head_cache == ring->tail && !ring_can_pop(ring))
+    {
+        if (__atomic_load_n(&ring->aborted, __ATOMIC_ACQUIRE))
+        {
+            return -2;
+        }
+        //  先看到closed再读一次head, 关闭前提交的最后一个槽不会漏掉
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+        {
+            if (ring_can_pop(ring))
+            {
+                break;
+            }
+            return -1;
+        }
+        ring_wait(ring, 0);
+    }
+
+    index = ring->tail & (ring->slots - 1);
+    *data = ring->data + (size_t)index * ring->stride;
+    if (tag != NULL)
+    {
+        *tag = ring->tag[index];
+    }
+    return ring->len[index];
+}
+
+void audio_ring_release(audio_ring_t *ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    ring_wake(ring, 1);
+}
+
+void audio_ring_close(audio_ring_t *ring)
+{
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+    ring_wake_all(ring);
+}
+
+void audio_ring_abort(audio_ring_t *ring)
+{
+    __atomic_store_n(&ring->aborted, 1, __ATOMIC_RELEASE);
+    ring_wake_all(ring);
+}
+
+void audio_ring_get_stats(audio_ring_t *ring, audio_ring_stats_t *stats)
+{
+    unsigned long long pushed = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    memset(stats, 0, sizeof(audio_ring_stats_t));
+    stats->slots = ring->slots;
+    stats->slot_size = ring->slot_size;
+    stats->pushed = pushed;
+    stats->full_waits = ring->full_waits;
+    stats->full_wait_seconds = ring->full_wait_ns / 1e9;
+    stats->empty_waits = ring->empty_waits;
+    stats->empty_wait_seconds = ring->empty_wait_ns / 1e9;
+    stats->occupancy_max = ring->occupancy_max;
+    stats->occupancy_avg = pushed > 0 ? (double)ring->occupancy_sum / pushed : 0;
+}
+
+void audio_ring_destroy(audio_ring_t *ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->cond);
+    free(ring->len);
+    free(ring->tag);
+    free(ring->data);
+    free(ring);
+}
+
+audio_pipeline_t *audio_pipeline_create(void)
+{
+    return (audio_pipeline_t *)calloc(1, sizeof(audio_pipeline_t));
+}
+
+int audio_pipeline_add_stage(audio_pipeline_t *pipeline, const char *name, audio_stage_func func, void *arg,
+                             int out_slots, int out_slot_size)
+{
+    pipeline_stage_t *stage = NULL;
+
+    if (pipeline == NULL || func == NULL || pipeline->count >= AUDIO_PIPELINE_STAGES_MAX ||
+        (pipeline->count > 0 && pipeline->stages[pipeline->count - 1].out == NULL))
+    {
+        fprintf(stderr, "[%s] stage=%s, err param\n", __func__, name != NULL ? name : "");
+        return -1;
+    }
+
+    stage = &pipeline->stages[pipeline->count];
+    snprintf(stage->name, sizeof(stage->name), "%s", name != NULL ? name : "");
+    stage->func = func;
+    stage->arg = arg;
+    stage->pipeline = pipeline;
+    stage->in = pipeline->count > 0 ? pipeline->stages[pipeline->count - 1].out : NULL;
+    if (out_slots > 0)
+    {
+        stage->out = audio_ring_create(out_slots, out_slot_size);
+        if (stage->out == NULL)
+        {
+            return -1;
+        }
+    }
+    pipeline->count++;
+
+    return 0;
+}
+
+static void pipeline_abort(audio_pipeline_t *pipeline)
+{
+    int i = 0;
+
+    for (i = 0; i < pipeline->count; i++)
+    {
+        if (pipeline->stages[i].out != NULL)
+        {
+            audio_ring_abort(pipeline->stages[i].out);
+        }
+    }
+}
+
+static void *pipeline_stage_thread(void *arg)
+{
+    int expected = 0;
+    pipeline_stage_t *stage = (pipeline_stage_t *)arg;
+    unsigned long long start = ring_now_ns();
+
+    stage->ret = stage->func(stage->arg, stage->in, stage->out);
+    stage->seconds = (ring_now_ns() - start) / 1e9;
+
+    //  出错时叫停所有环, 上下游阻塞的线程都会返回
+    if (stage->ret != 0)
+    {
+        __atomic_compare_exchange_n(&stage->pipeline->ret, &expected, stage->ret, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        pipeline_abort(stage->pipeline);
+    }
+    else if (stage->out != NULL)
+    {
+        audio_ring_close(stage->out);
+    }
+
+    return NULL;
+}
+
+int audio_pipeline_run(audio_pipeline_t *pipeline)
+{
+    int i = 0;
+    int ret = 0;
+
+    if (pipeline == NULL || pipeline->count == 0)
+    {
+        return -1;
+    }
+    pipeline->ret = 0;
+
+    for (i = 0; i < pipeline->count; i++)
+    {
+        if (pthread_create(&pipeline->stages[i].thread, NULL, pipeline_stage_thread, &pipeline->stages[i]) != 0)
+        {
+            fprintf(stderr, "[%s] create thread for %s failed\n", __func__, pipeline->stages[i].name);
+            pipeline_abort(pipeline);
+            ret = -1;
+            break;
+        }
+        pipeline->stages[i].started = 1;
+    }
+
+    for (i = 0; i < pipeline->count; i++)
+    {
+        if (!pipeline->stages[i].started)
+        {
+            continue;
+        }
+        pthread_join(pipeline->stages[i].thread, NULL);
+        pipeline->stages[i].started = 0;
+    }
+
+    return ret != 0 ? ret : pipeline->ret;
+}
+
+int audio_pipeline_get_stats(audio_pipeline_t *pipeline, audio_stage_stats_t *stats, int count)
+{
+    int i = 0;
+    pipeline_stage_t *stage = NULL;
+    audio_ring_stats_t ring;
+
+    for (i = 0; i < pipeline->count && i < count; i++)
+    {
+        stage = &pipeline->stages[i];
+        memset(&stats[i], 0, sizeof(audio_stage_stats_t));
+        stats[i].name = stage->name;
+        stats[i].seconds = stage->seconds;
+        if (stage->in != NULL)
+        {
+            audio_ring_get_stats(stage->in, &ring);
+            stats[i].wait_in_seconds = ring.empty_wait_seconds;
+        }
+        if (stage->out != NULL)
+        {
+            audio_ring_get_stats(stage->out, &stats[i].out);
+            stats[i].wait_out_seconds = stats[i].out.full_wait_seconds;
+        }
+    }
+
+    return i;
+}
+
+void audio_pipeline_destroy(audio_pipeline_t *pipeline)
+{
+    int i = 0;
+
+    if (pipeline == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < pipeline->count; i++)
+    {
+        audio_ring_destroy(pipeline->stages[i].out);
+    }
+    free(pipeline);
+}
+#endif
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_trans.h"
+
+#define PROBE_IMI_PACKETS 3         // IMI至少连续校验几个包头
+#define PROBE_IMI_PACKET_MAX 4000   // opus单包最大长度
+
+static unsigned int probe_be32(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+/*
+ * ADTS: 12位同步字0xFFF, layer为0, 帧长至少7字节头;
+ * 帧长之后还有数据时下一帧也必须以同步字开头
+ */
+static int probe_adts(const unsigned char *buf, int len)
+{
+    int frame_len = 0;
+
+    if (len < 7 || buf[0] != 0xff || (buf[1] & 0xf6) != 0xf0)
+    {
+        return 0;
+    }
+    frame_len = ((buf[3] & 0x03) << 11) | (buf[4] << 3) | ((buf[5] & 0xe0) >> 5);
+    if (frame_len < 7)
+    {
+        return 0;
+    }
+    if (frame_len + 2 <= len)
+    {
+        return buf[frame_len] == 0xff && (buf[frame_len + 1] & 0xf6) == 0xf0;
+    }
+    return 1;
+}
+
+/*
+ * IMI: 4字节大端包长 + 4字节时间戳 + opus包, 没有魔数,
+ * 只能沿着包长走几个包, 包长合理且时间戳不减才认为是IMI
+ */
+static int probe_imi(const unsigned char *buf, int len)
+{
+    int i = 0;
+    int offset = 0;
+    unsigned int packet_len = 0;
+    unsigned int timestamp = 0;
+    unsigned int last_timestamp = 0;
+
+    for (i = 0; i < PROBE_IMI_PACKETS; i++)
+    {
+        if (offset + 8 > len)
+        {
+            //  探测数据读完了, 至少要有一个完整的包
+            return i > 0;
+        }
+        packet_len = probe_be32(buf + offset);
+        timestamp = probe_be32(buf + offset + 4);
+        if (packet_len == 0 || packet_len > PROBE_IMI_PACKET_MAX || (i > 0 && timestamp != 0 && timestamp < last_timestamp))
+        {
+            return 0;
+        }
+        last_timestamp = timestamp;
+        offset += 8 + packet_len;
+    }
+
+    return 1;
+}
+
+#if 1   //  格式探测
+int audio_probe(const unsigned char *buf, int len, aenc_format_e *format, audio_container_e *container)
+{
+    aenc_format_e probe_format = AENC_FORMAT_NONE;
+    audio_container_e probe_container = AUDIO_CONTAINER_UNKNOWN;
+
+    if (buf == NULL || len <= 0)
+    {
+        return -1;
+    }
+
+    //  wav的编码格式要看fmt块, 这里只按pcm报告
+    if (len >= 12 && (memcmp(buf, "RIFF", 4) == 0 || memcmp(buf, "RF64", 4) == 0 || memcmp(buf, "BW64", 4) == 0) &&
+        memcmp(buf + 8, "WAVE", 4) == 0)
+    {
+        probe_format = AENC_FORMAT_PCM;
+        probe_container = AUDIO_CONTAINER_WAV;
+    }
+    else if (len >= 4 && memcmp(buf, "OggS", 4) == 0)
+    {
+        probe_format = AENC_FORMAT_OPUS;
+        probe_container = AUDIO_CONTAINER_OGG;
+    }
+    else if (probe_adts(buf, len))
+    {
+        probe_format = AENC_FORMAT_AAC;
+        probe_container = AUDIO_CONTAINER_ADTS;
+    }
+    else if (probe_imi(buf, len))
+    {
+        probe_format = AENC_FORMAT_OPUS;
+        probe_container = AUDIO_CONTAINER_IMI;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (format != NULL)
+    {
+        *format = probe_format;
+    }
+    if (container != NULL)
+    {
+        *container = probe_container;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLE_HAVE_AVX2 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLE_HAVE_NEON 1
+#endif
+
+#include "audio_trans.h"
+
+#define RESAMPLE_BLOCK 1024             // 每次处理的输入帧数
+#define RESAMPLE_PHASE_MAX 1024         // 化简后的插值倍数上限, 44.1k<->48k为160
+#define RESAMPLE_CHANNELS_MAX 8
+#define RESAMPLE_BANK_CACHE 32          // 全局缓存的滤波器组数量
+#define RESAMPLE_ALIGN 32
+
+typedef float (*resample_dot_f)(const float *coef, const float *x, int taps);
+
+/*
+ * 各质量档位的原型滤波器: 每相抽头数(8的倍数), kaiser窗的beta, 截止频率相对奈奎斯特的比例
+ */
+static const struct
+{
+    int taps;
+    double beta;
+    double rolloff;
+} resample_presets[] = {
+    [AUDIO_RESAMPLE_FAST] = {16, 5.0, 0.85},
+    [AUDIO_RESAMPLE_MEDIUM] = {32, 7.0, 0.91},
+    [AUDIO_RESAMPLE_HIGH] = {64, 9.0, 0.95},
+};
+
+/*
+ * 滤波器组只和变换比例、质量有关, 同样的参数所有句柄共用一份, 第一次用到时计算
+ */
+typedef struct
+{
+    int up;
+    int down;
+    audio_resample_quality_e quality;
+    float *coef;
+} resample_bank_t;
+
+static resample_bank_t bank_cache[RESAMPLE_BANK_CACHE];
+static int bank_cache_count = 0;
+static pthread_mutex_t bank_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct audio_resampler
+{
+    int in_rate;
+    int out_rate;
+    int channels;
+    int up;                     // 插值倍数L, 也是相位数
+    int down;                   // 抽取倍数M
+    int taps;                   // 每相抽头数
+    const float *bank;          // up行taps列, 每行按输入时间顺序排列
+    float *own_bank;            // 缓存满时自己持有的滤波器组
+    resample_dot_f dot;
+    float *buf;                 // 每个声道一段: taps-1个历史采样 + 一个块的输入
+    int buf_stride;
+    int buf_len;
+    int base;                   // 下一个输出对应的最新输入采样在buf中的下标
+    int phase;
+    int skip;                   // 滤波器延时对应的输出数, 开头丢掉使输出和输入对齐
+    int skip_init;
+    unsigned long long in_total;
+    unsigned long long out_total;
+};
+
+static int gcd(int a, int b)
+{
+    while (b != 0)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double bessel_i0(double x)
+{
+    int k = 0;
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (k = 1; k < 50; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+/*
+ * kaiser窗的sinc原型滤波器, 长度up*taps, 按相拆开. 每相单独归一化, 直流增益都为1
+ */
+static float *resample_design(int up, int down, audio_resample_quality_e quality)
+{
+    int p = 0;
+    int j = 0;
+    int taps = resample_presets[quality].taps;
+    int len = up * taps;
+    double fc = 0.5 * resample_presets[quality].rolloff / (up > down ? up : down);
+    double beta = resample_presets[quality].beta;
+    double center = (len - 1) / 2.0;
+    double i0_beta = bessel_i0(beta);
+    double sum = 0;
+    double t = 0;
+    double r = 0;
+    double *h = NULL;
+    float *coef = NULL;
+
+    h = (double *)malloc(sizeof(double) * len);
+    if (h == NULL || posix_memalign((void **)&coef, RESAMPLE_ALIGN, sizeof(float) * len) != 0)
+    {
+        free(h);
+        return NULL;
+    }
+
+    for (j = 0; j < len; j++)
+    {
+        t = j - center;
+        r = t / (center + 1);
+        h[j] = (t == 0 ? 2 * fc : sin(2 * M_PI * fc * t) / (M_PI * t)) * bessel_i0(beta * sqrt(1 - r * r)) / i0_beta;
+    }
+
+    //  输出k在插值后的位置u=k*down=base*up+phase, 输入base-j离它phase+j*up,
+    //  所以第phase相的第j个系数是h[phase+j*up]; 反过来存放, 和输入按时间顺序做点积
+    for (p = 0; p < up; p++)
+    {
+        sum = 0;
+        for (j = 0; j < taps; j++)
+        {
+            sum += h[p + j * up];
+        }
+        for (j = 0; j < taps; j++)
+        {
+            coef[p * taps + (taps - 1 - j)] = (float)(h[p + j * up] / sum);
+        }
+    }
+
+    free(h);
+    return coef;
+}
+
+static const float *resample_get_bank(int up, int down, audio_resample_quality_e quality, float **own_bank)
+{
+    int i = 0;
+    float *coef = NULL;
+
+    *own_bank = NULL;
+    pthread_mutex_lock(&bank_cache_lock);
+    for (i = 0; i < bank_cache_count; i++)
+    {
+        if (bank_cache[i].up == up && bank_cache[i].down == down && bank_cache[i].quality == quality)
+        {
+            coef = bank_cache[i].coef;
+            pthread_mutex_unlock(&bank_cache_lock);
+            return coef;
+        }
+    }
+
+    coef = resample_design(up, down, quality);
+    if (coef != NULL && bank_cache_count < RESAMPLE_BANK_CACHE)
+    {
+        bank_cache[bank_cache_count].up = up;
+        bank_cache[bank_cache_count].down = down;
+        bank_cache[bank_cache_count].quality = quality;
+        bank_cache[bank_cache_count].coef = coef;
+        bank_cache_count++;
+    }
+    else
+    {
+        *own_bank = coef;
+    }
+    pthread_mutex_unlock(&bank_cache_lock);
+
+    return coef;
+}
+
+#if 1   //  点积, 重采样的热点
+static float resample_dot_c(const float *coef, const float *x, int taps)
+{
+    int i = 0;
+    float acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+
+    for (i = 0; i < taps; i += 4)
+    {
+        acc0 += coef[i] * x[i];
+        acc1 += coef[i + 1] * x[i + 1];
+        acc2 += coef[i + 2] * x[i + 2];
+        acc3 += coef[i + 3] * x[i + 3];
+    }
+    return (acc0 + acc1) + (acc2 + acc3);
+}
+
+#ifdef RESAMPLE_HAVE_AVX2
+__attribute__((target("avx2,fma"))) static float resample_dot_avx2(const float *coef, const float *x, int taps)
+{
+    int i = 0;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m128 sum;
+
+    //  系数按32字节对齐, 输入的起点随相位变化, 用非对齐读
+    for (i = 0; i + 16 <= taps; i += 16)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_load_ps(coef + i), _mm256_loadu_ps(x + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_load_ps(coef + i + 8), _mm256_loadu_ps(x + i + 8), acc1);
+    }
+    if (i < taps)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_load_ps(coef + i), _mm256_loadu_ps(x + i), acc0);
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+    sum = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+#endif
+
+#ifdef RESAMPLE_HAVE_NEON
+static float resample_dot_neon(const float *coef, const float *x, int taps)
+{
+    int i = 0;
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+
+    for (i = 0; i < taps; i += 8)
+    {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(coef + i), vld1q_f32(x + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(coef + i + 4), vld1q_f32(x + i + 4));
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+#if defined(__aarch64__)
+    return vaddvq_f32(acc0);
+#else
+    return vgetq_lane_f32(acc0, 0) + vgetq_lane_f32(acc0, 1) + vgetq_lane_f32(acc0, 2) + vgetq_lane_f32(acc0, 3);
+#endif
+}
+#endif
+
+static resample_dot_f resample_select_dot(void)
+{
+#ifdef RESAMPLE_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return resample_dot_avx2;
+    }
+#endif
+#ifdef RESAMPLE_HAVE_NEON
+    return resample_dot_neon;
+#endif
+    return resample_dot_c;
+}
+#endif
+
+static short resample_saturate(float v)
+{
+    if (v >= 32767.0f)
+    {
+        return 32767;
+    }
+    if (v <= -32768.0f)
+    {
+        return -32768;
+    }
+    return (short)lrintf(v);
+}
+
+/*
+ * 处理一块输入, in为NULL时输入n个0(冲刷尾巴). n不超过RESAMPLE_BLOCK
+ */
+static int resample_block(audio_resampler_t *rs, const short *in, int n, short *out)
+{
+    int i = 0;
+    int ch = 0;
+    int count = 0;
+    int shift = 0;
+    float v = 0;
+    float *x = NULL;
+    const float *coef = NULL;
+
+    for (ch = 0; ch < rs->channels; ch++)
+    {
+        x = rs->buf + ch * rs->buf_stride + rs->buf_len;
+        for (i = 0; i < n; i++)
+        {
+            x[i] = in != NULL ? in[i * rs->channels + ch] : 0;
+        }
+    }
+    rs->buf_len += n;
+
+    while (rs->base < rs->buf_len)
+    {
+        coef = rs->bank + rs->phase * rs->taps;
+        for (ch = 0; ch < rs->channels; ch++)
+        {
+            v = rs->dot(coef, rs->buf + ch * rs->buf_stride + rs->base - rs->taps + 1, rs->taps);
+            if (rs->skip == 0)
+            {
+                out[count * rs->channels + ch] = resample_saturate(v);
+            }
+        }
+        if (rs->skip > 0)
+        {
+            rs->skip--;
+        }
+        else
+        {
+            count++;
+        }
+        rs->phase += rs->down;
+        rs->base += rs->phase / rs->up;
+        rs->phase %= rs->up;
+    }
+
+    //  只留下一次需要的taps-1个历史采样
+    shift = rs->buf_len - (rs->taps - 1);
+    if (shift > 0)
+    {
+        for (ch = 0; ch < rs->channels; ch++)
+        {
+            x = rs->buf + ch * rs->buf_stride;
+            memmove(x, x + shift, sizeof(float) * (rs->taps - 1));
+        }
+        rs->buf_len -= shift;
+        rs->base -= shift;
+    }
+
+    return count;
+}
+
+#if 1   //  重采样
+audio_resampler_t *audio_resampler_create(int in_rate, int out_rate, int channels, audio_resample_quality_e quality)
+{
+    int div = 0;
+    audio_resampler_t *rs = NULL;
+
+    if (in_rate <= 0 || out_rate <= 0 || channels <= 0 || channels > RESAMPLE_CHANNELS_MAX ||
+        quality < AUDIO_RESAMPLE_FAST || quality > AUDIO_RESAMPLE_HIGH)
+    {
+        fprintf(stderr, "[%s] in_rate=%d, out_rate=%d, channels=%d, quality=%d, err param\n",
+                __func__, in_rate, out_rate, channels, quality);
+        return NULL;
+    }
+
+    rs = (audio_resampler_t *)calloc(1, sizeof(audio_resampler_t));
+    if (rs == NULL)
+    {
+        return NULL;
+    }
+    div = gcd(in_rate, out_rate);
+    rs->in_rate = in_rate;
+    rs->out_rate = out_rate;
+    rs->channels = channels;
+    rs->up = out_rate / div;
+    rs->down = in_rate / div;
+    rs->taps = resample_presets[quality].taps;
+    if (rs->up > RESAMPLE_PHASE_MAX)
+    {
+        fprintf(stderr, "[%s] %d -> %d needs %d phases, not supported\n", __func__, in_rate, out_rate, rs->up);
+        goto ERR;
+    }
+
+    rs->bank = resample_get_bank(rs->up, rs->down, quality, &rs->own_bank);
+    if (rs->bank == NULL)
+    {
+        goto ERR;
+    }
+    rs->dot = resample_select_dot();
+
+    rs->buf_stride = rs->taps - 1 + RESAMPLE_BLOCK;
+    rs->buf = (float *)malloc(sizeof(float) * rs->buf_stride * channels);
+    if (rs->buf == NULL)
+    {
+        goto ERR;
+    }
+    //  原型滤波器中心在(up*taps-1)/2, 换算成输出采样数
+    rs->skip_init = (int)((rs->up * rs->taps - 1) / (2.0 * rs->down) + 0.5);
+    audio_resampler_reset(rs);
+
+    return rs;
+
+ERR:
+    audio_resampler_destroy(rs);
+    return NULL;
+}
+
+int audio_resampler_get_out_size(audio_resampler_t *rs, int in_frames)
+{
+    if (rs == NULL || in_frames < 0)
+    {
+        return -1;
+    }
+    return (int)(((long long)in_frames * rs->up + rs->down - 1) / rs->down) + 2;
+}
+
+int audio_resampler_process(audio_resampler_t *rs, const short *in, int in_frames, short *out, int out_frames_max)
+{
+    int n = 0;
+    int count = 0;
+
+    if (rs == NULL || (in == NULL && in_frames > 0) || out == NULL)
+    {
+        fprintf(stderr, "[%s] err param\n", __func__);
+        return -1;
+    }
+    if (out_frames_max < audio_resampler_get_out_size(rs, in_frames))
+    {
+        fprintf(stderr, "[%s] out_frames_max=%d, need %d\n", __func__, out_frames_max, audio_resampler_get_out_size(rs, in_frames));
+        return -1;
+    }
+
+    while (in_frames > 0)
+    {
+        n = in_frames < RESAMPLE_BLOCK ? in_frames : RESAMPLE_BLOCK;
+        count += resample_block(rs, in, n, out + count * rs->channels);
+        in += n * rs->channels;
+        in_frames -= n;
+        rs->in_total += n;
+    }
+    rs->out_total += count;
+
+    return count;
+}
+
+int audio_resampler_flush(audio_resampler_t *rs, short *out, int out_frames_max)
+{
+    int count = 0;
+    unsigned long long expect = 0;
+
+    if (rs == NULL || out == NULL || out_frames_max < audio_resampler_get_out_size(rs, rs->taps))
+    {
+        fprintf(stderr, "[%s] err param\n", __func__);
+        return -1;
+    }
+
+    //  补taps个0把滤波器里的采样推出来, 输出总数和输入时长对齐
+    count = resample_block(rs, NULL, rs->taps, out);
+    expect = (rs->in_total * rs->up + rs->down - 1) / rs->down;
+    if (rs->out_total + count > expect)
+    {
+        count = expect > rs->out_total ? (int)(expect - rs->out_total) : 0;
+    }
+    rs->out_total += count;
+
+    return count;
+}
+
+void audio_resampler_reset(audio_resampler_t *rs)
+{
+    if (rs == NULL)
+    {
+        return;
+    }
+    memset(rs->buf, 0, sizeof(float) * rs->buf_stride * rs->channels);
+    rs->buf_len = rs->taps - 1;
+    rs->base = rs->taps - 1;
+    rs->phase = 0;
+    rs->skip = rs->skip_init;
+    rs->in_total = 0;
+    rs->out_total = 0;
+}
+
+void audio_resampler_destroy(audio_resampler_t *rs)
+{
+    if (rs == NULL)
+    {
+        return;
+    }
+    free(rs->own_bank);
+    free(rs->buf);
+    free(rs);
+}
+#endif
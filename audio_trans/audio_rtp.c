@@ -0,0 +1,660 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_trans.h"
+
+#define RTP_VERSION 2
+#define RTP_AAC_FRAME_SAMPLES 1024      // aac lc每个AU每声道的采样数
+#define RTP_AU_HEADER_SIZE 2            // AAC-hbr: 13位AU长度 + 3位AU序号
+#define RTP_AU_SIZE_MAX 8191
+
+//  AudioSpecificConfig里samplingFrequencyIndex对应的采样率
+static const int rtp_aac_rates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+
+static const char *rtp_payload_names[AUDIO_RTP_PAYLOAD_MAX] = {"pcma", "opus", "aac-hbr", "aac-latm"};
+
+static void rtp_put16(unsigned char *p, unsigned int v)
+{
+    p[0] = (v >> 8) & 0xff;
+    p[1] = v & 0xff;
+}
+
+static void rtp_put32(unsigned char *p, unsigned int v)
+{
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static unsigned int rtp_get16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static unsigned int rtp_get32(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int rtp_aac_rate_index(int samplerate)
+{
+    int i = 0;
+
+    for (i = 0; i < sizeof(rtp_aac_rates) / sizeof(rtp_aac_rates[0]); i++)
+    {
+        if (rtp_aac_rates[i] == samplerate)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *audio_rtp_payload_name(audio_rtp_payload_e payload)
+{
+    return (unsigned)payload < AUDIO_RTP_PAYLOAD_MAX ? rtp_payload_names[payload] : "unknown";
+}
+
+int audio_rtp_init(audio_rtp_t *rtp, audio_rtp_payload_e payload, int payload_type, audio_param_t audio_param,
+                   unsigned int ssrc, int mtu)
+{
+    if (rtp == NULL || (unsigned)payload >= AUDIO_RTP_PAYLOAD_MAX || payload_type > 127 || audio_param.samplerate <= 0 ||
+        audio_param.channels <= 0 || audio_param.channels > AUDIO_CHANNELS_MAX)
+    {
+        fprintf(stderr, "[%s] payload=%d, payload_type=%d, samplerate=%d, channels=%d, err param\n", __func__,
+                payload, payload_type, audio_param.samplerate, audio_param.channels);
+        return -1;
+    }
+    if ((payload == AUDIO_RTP_AAC_HBR || payload == AUDIO_RTP_AAC_LATM) && rtp_aac_rate_index(audio_param.samplerate) < 0)
+    {
+        fprintf(stderr, "[%s] aac samplerate=%d, err param\n", __func__, audio_param.samplerate);
+        return -1;
+    }
+
+    memset(rtp, 0, offsetof(audio_rtp_t, frag));
+    rtp->payload = payload;
+    rtp->samplerate = audio_param.samplerate;
+    rtp->channels = audio_param.channels;
+    rtp->clock_rate = payload == AUDIO_RTP_OPUS ? 48000 : audio_param.samplerate;
+    rtp->mtu = mtu > 0 ? mtu : AUDIO_RTP_MTU_DEFAULT;
+    rtp->ssrc = ssrc;
+    rtp->talkspurt = 1;
+    if (payload_type >= 0)
+    {
+        rtp->payload_type = payload_type;
+    }
+    else
+    {
+        rtp->payload_type = payload == AUDIO_RTP_PCMA && rtp->clock_rate == 8000 && rtp->channels == 1 ? 8 : 96;
+    }
+    //  分片至少要能放下一个字节
+    if (rtp->mtu <= AUDIO_RTP_HEADER_MAX)
+    {
+        fprintf(stderr, "[%s] mtu=%d, err param\n", __func__, mtu);
+        return -1;
+    }
+
+    return 0;
+}
+
+#if 1   //  打包
+static unsigned int rtp_timestamp(audio_rtp_t *rtp)
+{
+    return rtp->timestamp_base + (unsigned int)(rtp->samples * rtp->clock_rate / rtp->samplerate);
+}
+
+/*
+ * 写RTP头和负载头, 负载指向调用者的数据
+ */
+static void rtp_packet(audio_rtp_t *rtp, audio_rtp_packet_t *packet, int marker, unsigned int timestamp,
+                       const unsigned char *extra, int extra_len, const unsigned char *data, int len)
+{
+    unsigned char *p = packet->header;
+
+    p[0] = RTP_VERSION << 6;
+    p[1] = (marker ? 0x80 : 0) | rtp->payload_type;
+    rtp_put16(p + 2, rtp->seq++);
+    rtp_put32(p + 4, timestamp);
+    rtp_put32(p + 8, rtp->ssrc);
+    if (extra_len > 0)
+    {
+        memcpy(p + AUDIO_RTP_HEADER_SIZE, extra, extra_len);
+    }
+    packet->iov[0].iov_base = packet->header;
+    packet->iov[0].iov_len = AUDIO_RTP_HEADER_SIZE + extra_len;
+    packet->iov[1].iov_base = (void *)data;
+    packet->iov[1].iov_len = len;
+    packet->iov_count = len > 0 ? 2 : 1;
+    packet->len = AUDIO_RTP_HEADER_SIZE + extra_len + len;
+}
+
+/*
+ * 编码器输出的aac带ADTS头, RTP里只要AU
+ */
+static int rtp_adts_header_len(const unsigned char *frame, int len)
+{
+    if (len >= 7 && frame[0] == 0xff && (frame[1] & 0xf6) == 0xf0)
+    {
+        return (frame[1] & 0x01) ? 7 : 9;
+    }
+    return 0;
+}
+
+static int rtp_pack_pcma(audio_rtp_t *rtp, const unsigned char *frame, int len, audio_rtp_packet_t *packets, int max)
+{
+    int count = 0;
+    int chunk = 0;
+    int chunk_max = (rtp->mtu - AUDIO_RTP_HEADER_SIZE) / rtp->channels * rtp->channels;
+
+    //  一个字节一个采样, 按整采样切
+    while (len > 0)
+    {
+        if (count >= max)
+        {
+            return -1;
+        }
+        chunk = len < chunk_max ? len : chunk_max;
+        rtp_packet(rtp, &packets[count++], rtp->talkspurt, rtp_timestamp(rtp), NULL, 0, frame, chunk);
+        rtp->talkspurt = 0;
+        rtp->samples += chunk / rtp->channels;
+        frame += chunk;
+        len -= chunk;
+    }
+    return count;
+}
+
+static int rtp_pack_aac_hbr(audio_rtp_t *rtp, const unsigned char *frame, int len, audio_rtp_packet_t *packets, int max)
+{
+    int count = 0;
+    int chunk = 0;
+    int chunk_max = rtp->mtu - AUDIO_RTP_HEADER_SIZE - 2 - RTP_AU_HEADER_SIZE;
+    unsigned int timestamp = rtp_timestamp(rtp);
+    unsigned char au[2 + RTP_AU_HEADER_SIZE];
+
+    if (len > RTP_AU_SIZE_MAX)
+    {
+        return -1;
+    }
+    //  AU-headers-length按位计; 分片时每片的AU头都是整个AU的长度, 最后一片置marker
+    rtp_put16(au, RTP_AU_HEADER_SIZE * 8);
+    rtp_put16(au + 2, len << 3);
+    do
+    {
+        if (count >= max)
+        {
+            return -1;
+        }
+        chunk = len < chunk_max ? len : chunk_max;
+        rtp_packet(rtp, &packets[count++], chunk == len, timestamp, au, sizeof(au), frame, chunk);
+        frame += chunk;
+        len -= chunk;
+    } while (len > 0);
+    return count;
+}
+
+static int rtp_pack_aac_latm(audio_rtp_t *rtp, const unsigned char *frame, int len, audio_rtp_packet_t *packets, int max)
+{
+    int i = 0;
+    int count = 0;
+    int chunk = 0;
+    int info_len = len / 255 + 1;
+    unsigned int timestamp = rtp_timestamp(rtp);
+    unsigned char info[AUDIO_RTP_HEADER_MAX - AUDIO_RTP_HEADER_SIZE];
+
+    //  PayloadLengthInfo: 每255一个0xff, 最后是余数; 只在第一片里
+    if (info_len > sizeof(info))
+    {
+        return -1;
+    }
+    for (i = 0; i < info_len - 1; i++)
+    {
+        info[i] = 0xff;
+    }
+    info[i] = len % 255;
+
+    do
+    {
+        if (count >= max)
+        {
+            return -1;
+        }
+        chunk = rtp->mtu - AUDIO_RTP_HEADER_SIZE - (count == 0 ? info_len : 0);
+        chunk = len < chunk ? len : chunk;
+        rtp_packet(rtp, &packets[count], chunk == len, timestamp, info, count == 0 ? info_len : 0, frame, chunk);
+        count++;
+        frame += chunk;
+        len -= chunk;
+    } while (len > 0);
+    return count;
+}
+
+int audio_rtp_packetize(audio_rtp_t *rtp, const unsigned char *frame, int len, int samples, audio_rtp_packet_t *packets, int max)
+{
+    int ret = 0;
+    int skip = 0;
+
+    if (rtp == NULL || frame == NULL || len <= 0 || samples < 0 || packets == NULL || max <= 0)
+    {
+        fprintf(stderr, "[%s] len=%d, samples=%d, max=%d, err param\n", __func__, len, samples, max);
+        return -1;
+    }
+
+    switch (rtp->payload)
+    {
+    case AUDIO_RTP_PCMA:
+        return rtp_pack_pcma(rtp, frame, len, packets, max);
+    case AUDIO_RTP_OPUS:
+        //  RFC 7587不允许分片
+        if (AUDIO_RTP_HEADER_SIZE + len > rtp->mtu)
+        {
+            fprintf(stderr, "[%s] opus packet %d bytes larger than mtu %d\n", __func__, len, rtp->mtu);
+            return -1;
+        }
+        rtp_packet(rtp, &packets[0], rtp->talkspurt, rtp_timestamp(rtp), NULL, 0, frame, len);
+        rtp->talkspurt = 0;
+        ret = 1;
+        break;
+    case AUDIO_RTP_AAC_HBR:
+    case AUDIO_RTP_AAC_LATM:
+        skip = rtp_adts_header_len(frame, len);
+        if (len <= skip)
+        {
+            return 0;
+        }
+        ret = rtp->payload == AUDIO_RTP_AAC_HBR ? rtp_pack_aac_hbr(rtp, frame + skip, len - skip, packets, max)
+                                                 : rtp_pack_aac_latm(rtp, frame + skip, len - skip, packets, max);
+        break;
+    default:
+        return -1;
+    }
+
+    if (ret > 0)
+    {
+        rtp->samples += samples;
+    }
+    return ret;
+}
+
+void audio_rtp_skip(audio_rtp_t *rtp, int samples)
+{
+    if (rtp == NULL || samples <= 0)
+    {
+        return;
+    }
+    rtp->samples += samples;
+    rtp->talkspurt = 1;
+}
+#endif
+
+#if 1   //  解包
+/*
+ * 把分片接到frag后面, 时间戳变了是新的一帧. 丢过分片(frag_len为-1)的帧一直丢到它的最后一片
+ * @retval
+ *      1               帧拼完了, 在rtp->frag里
+ *      0               还没拼完或者丢掉了
+ */
+static int rtp_frag_append(audio_rtp_t *rtp, const unsigned char *data, int len, int size, unsigned int timestamp, int marker)
+{
+    if (rtp->frag_len != 0 && timestamp != rtp->frag_timestamp)
+    {
+        rtp->frag_len = 0;
+    }
+    if (rtp->frag_len == 0)
+    {
+        rtp->frag_timestamp = timestamp;
+        rtp->frag_size = size;
+    }
+    if (rtp->frag_len >= 0 && rtp->frag_len + len <= AUDIO_RTP_FRAG_MAX)
+    {
+        memcpy(rtp->frag + rtp->frag_len, data, len);
+        rtp->frag_len += len;
+    }
+    else
+    {
+        rtp->frag_len = -1;
+    }
+    if (!marker)
+    {
+        return 0;
+    }
+    if (rtp->frag_len < 0 || (rtp->frag_size >= 0 && rtp->frag_len != rtp->frag_size))
+    {
+        rtp->frag_len = 0;
+        return 0;
+    }
+    return 1;
+}
+
+static int rtp_unpack_aac_hbr(audio_rtp_t *rtp, const unsigned char *data, int len, unsigned int timestamp, int marker,
+                              audio_rtp_frame_t *frames, int max)
+{
+    int i = 0;
+    int count = 0;
+    int au_count = 0;
+    int au_size = 0;
+    int header_bytes = 0;
+    const unsigned char *au = NULL;
+
+    if (len < 2)
+    {
+        return -1;
+    }
+    //  只支持AAC-hbr: 每个AU头16位
+    header_bytes = (rtp_get16(data) + 7) / 8;
+    au_count = header_bytes / RTP_AU_HEADER_SIZE;
+    if (au_count == 0 || 2 + header_bytes > len)
+    {
+        return -1;
+    }
+    au = data + 2 + header_bytes;
+    len -= 2 + header_bytes;
+
+    //  一个AU放不下时分片, 每片的AU头里都是整个AU的长度
+    au_size = rtp_get16(data + 2) >> 3;
+    if (au_count == 1 && (au_size > len || (rtp->frag_len != 0 && timestamp == rtp->frag_timestamp)))
+    {
+        if (rtp_frag_append(rtp, au, len, au_size, timestamp, marker) == 0)
+        {
+            return 0;
+        }
+        frames[0].data = rtp->frag;
+        frames[0].len = rtp->frag_len;
+        frames[0].timestamp = timestamp;
+        frames[0].marker = 1;
+        rtp->frag_len = 0;
+        return 1;
+    }
+    rtp->frag_len = 0;
+
+    for (i = 0; i < au_count && count < max; i++)
+    {
+        au_size = rtp_get16(data + 2 + i * RTP_AU_HEADER_SIZE) >> 3;
+        if (au_size > len)
+        {
+            return -1;
+        }
+        frames[count].data = au;
+        frames[count].len = au_size;
+        frames[count].timestamp = timestamp + i * RTP_AAC_FRAME_SAMPLES;
+        frames[count].marker = marker;
+        count++;
+        au += au_size;
+        len -= au_size;
+    }
+    return count;
+}
+
+/*
+ * 一串audioMuxElement, 每个是PayloadLengthInfo + PayloadMux, 长度对不上时整包不要
+ */
+static int rtp_latm_elements(const unsigned char *data, int len, unsigned int timestamp, audio_rtp_frame_t *frames, int max)
+{
+    int count = 0;
+    int size = 0;
+    int pos = 0;
+
+    while (pos < len && count < max)
+    {
+        size = 0;
+        while (pos < len && data[pos] == 0xff)
+        {
+            size += 255;
+            pos++;
+        }
+        if (pos >= len)
+        {
+            return -1;
+        }
+        size += data[pos++];
+        if (size > len - pos)
+        {
+            return -1;
+        }
+        frames[count].data = data + pos;
+        frames[count].len = size;
+        frames[count].timestamp = timestamp + count * RTP_AAC_FRAME_SAMPLES;
+        frames[count].marker = 1;
+        count++;
+        pos += size;
+    }
+    return count;
+}
+
+static int rtp_unpack_aac_latm(audio_rtp_t *rtp, const unsigned char *data, int len, unsigned int timestamp, int marker,
+                               audio_rtp_frame_t *frames, int max)
+{
+    int ret = 0;
+
+    //  marker为0的包和同一帧的最后一片要拼, 完整的包直接在收包缓存里解
+    if (!marker || (rtp->frag_len != 0 && timestamp == rtp->frag_timestamp))
+    {
+        if (rtp_frag_append(rtp, data, len, -1, timestamp, marker) == 0)
+        {
+            return 0;
+        }
+        ret = rtp_latm_elements(rtp->frag, rtp->frag_len, timestamp, frames, max);
+        rtp->frag_len = 0;
+        return ret;
+    }
+    rtp->frag_len = 0;
+    return rtp_latm_elements(data, len, timestamp, frames, max);
+}
+
+int audio_rtp_depacketize(audio_rtp_t *rtp, const unsigned char *packet, int len, audio_rtp_frame_t *frames, int max)
+{
+    int ret = 0;
+    int offset = AUDIO_RTP_HEADER_SIZE;
+    int marker = 0;
+    unsigned short seq = 0;
+    unsigned short gap = 0;
+    unsigned int timestamp = 0;
+    unsigned int ssrc = 0;
+
+    if (rtp == NULL || packet == NULL || frames == NULL || max <= 0)
+    {
+        return -1;
+    }
+    if (len < AUDIO_RTP_HEADER_SIZE || (packet[0] >> 6) != RTP_VERSION || (packet[1] & 0x7f) != rtp->payload_type)
+    {
+        goto DROP;
+    }
+    marker = packet[1] >> 7;
+    seq = rtp_get16(packet + 2);
+    timestamp = rtp_get32(packet + 4);
+    ssrc = rtp_get32(packet + 8);
+    if (rtp->ssrc == 0)
+    {
+        rtp->ssrc = ssrc;
+    }
+    else if (ssrc != rtp->ssrc)
+    {
+        goto DROP;
+    }
+
+    //  CSRC, 扩展头, 末尾的填充
+    offset += (packet[0] & 0x0f) * 4;
+    if (packet[0] & 0x10)
+    {
+        //  X位置了但放不下扩展头, 不能把头当负载
+        if (offset + 4 > len)
+        {
+            goto DROP;
+        }
+        offset += 4 + rtp_get16(packet + offset + 2) * 4;
+    }
+    if (packet[0] & 0x20)
+    {
+        len -= packet[len - 1];
+    }
+    if (offset > len)
+    {
+        goto DROP;
+    }
+
+    //  序号跳了算丢包, 拼了一半的帧作废; 旧包和重复包丢掉
+    if (rtp->started)
+    {
+        gap = seq - rtp->expect_seq;
+        if (gap >= 0x8000)
+        {
+            goto DROP;
+        }
+        if (gap > 0)
+        {
+            rtp->lost += gap;
+            if (rtp->frag_len != 0)
+            {
+                rtp->frag_len = -1;
+            }
+        }
+    }
+    rtp->started = 1;
+    rtp->expect_seq = seq + 1;
+    rtp->received++;
+
+    packet += offset;
+    len -= offset;
+    if (len == 0)
+    {
+        return 0;
+    }
+    switch (rtp->payload)
+    {
+    case AUDIO_RTP_PCMA:
+    case AUDIO_RTP_OPUS:
+        frames[0].data = packet;
+        frames[0].len = len;
+        frames[0].timestamp = timestamp;
+        frames[0].marker = marker;
+        return 1;
+    case AUDIO_RTP_AAC_HBR:
+        ret = rtp_unpack_aac_hbr(rtp, packet, len, timestamp, marker, frames, max);
+        break;
+    case AUDIO_RTP_AAC_LATM:
+        ret = rtp_unpack_aac_latm(rtp, packet, len, timestamp, marker, frames, max);
+        break;
+    default:
+        return -1;
+    }
+    if (ret < 0)
+    {
+        rtp->dropped++;
+    }
+    return ret;
+
+DROP:
+    rtp->dropped++;
+    return -1;
+}
+#endif
+
+#if 1   //  SDP
+typedef struct
+{
+    unsigned char *buf;
+    int bits;
+} rtp_bit_writer_t;
+
+static void rtp_put_bits(rtp_bit_writer_t *w, unsigned int value, int bits)
+{
+    int i = 0;
+
+    for (i = bits - 1; i >= 0; i--, w->bits++)
+    {
+        if (value & (1u << i))
+        {
+            w->buf[w->bits / 8] |= 0x80 >> (w->bits % 8);
+        }
+    }
+}
+
+/*
+ * AudioSpecificConfig: AAC LC, 采样率序号, 声道配置, 1024点帧
+ */
+static void rtp_put_asc(rtp_bit_writer_t *w, audio_rtp_t *rtp)
+{
+    rtp_put_bits(w, 2, 5);
+    rtp_put_bits(w, rtp_aac_rate_index(rtp->samplerate), 4);
+    rtp_put_bits(w, rtp->channels == 8 ? 7 : rtp->channels, 4);
+    rtp_put_bits(w, 0, 3);
+}
+
+static int rtp_hex(char *out, const unsigned char *buf, int len)
+{
+    int i = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        sprintf(out + i * 2, "%02x", buf[i]);
+    }
+    return len * 2;
+}
+
+int audio_rtp_sdp(audio_rtp_t *rtp, int port, char *buf, int size)
+{
+    int ret = 0;
+    int pt = 0;
+    char config[32];
+    unsigned char bits[8];
+    rtp_bit_writer_t w;
+
+    if (rtp == NULL || buf == NULL || size <= 0)
+    {
+        return -1;
+    }
+    pt = rtp->payload_type;
+    memset(bits, 0, sizeof(bits));
+    w.buf = bits;
+    w.bits = 0;
+
+    switch (rtp->payload)
+    {
+    case AUDIO_RTP_PCMA:
+        if (rtp->channels > 1)
+        {
+            ret = snprintf(buf, size, "m=audio %d RTP/AVP %d\r\na=rtpmap:%d PCMA/%d/%d\r\n", port, pt, pt, rtp->clock_rate, rtp->channels);
+        }
+        else
+        {
+            ret = snprintf(buf, size, "m=audio %d RTP/AVP %d\r\na=rtpmap:%d PCMA/%d\r\n", port, pt, pt, rtp->clock_rate);
+        }
+        break;
+    case AUDIO_RTP_OPUS:
+        //  rtpmap里opus固定写2声道, 实际声道数放在stereo参数里
+        ret = snprintf(buf, size, "m=audio %d RTP/AVP %d\r\na=rtpmap:%d opus/48000/2\r\na=fmtp:%d stereo=%d;sprop-stereo=%d\r\n",
+                       port, pt, pt, pt, rtp->channels > 1, rtp->channels > 1);
+        break;
+    case AUDIO_RTP_AAC_HBR:
+        rtp_put_asc(&w, rtp);
+        rtp_hex(config, bits, 2);
+        ret = snprintf(buf, size, "m=audio %d RTP/AVP %d\r\na=rtpmap:%d mpeg4-generic/%d/%d\r\n"
+                                  "a=fmtp:%d streamtype=5;profile-level-id=1;mode=AAC-hbr;sizelength=13;indexlength=3;"
+                                  "indexdeltalength=3;config=%s\r\n",
+                       port, pt, pt, rtp->clock_rate, rtp->channels, pt, config);
+        break;
+    case AUDIO_RTP_AAC_LATM:
+        //  StreamMuxConfig: audioMuxVersion 0, allStreamsSameTimeFraming 1, 一个子帧一个节目一层,
+        //  AudioSpecificConfig, frameLengthType 0, latmBufferFullness 0xff, 无otherData和crc
+        rtp_put_bits(&w, 0, 1);
+        rtp_put_bits(&w, 1, 1);
+        rtp_put_bits(&w, 0, 6);
+        rtp_put_bits(&w, 0, 4);
+        rtp_put_bits(&w, 0, 3);
+        rtp_put_asc(&w, rtp);
+        rtp_put_bits(&w, 0, 3);
+        rtp_put_bits(&w, 0xff, 8);
+        rtp_put_bits(&w, 0, 1);
+        rtp_put_bits(&w, 0, 1);
+        rtp_hex(config, bits, (w.bits + 7) / 8);
+        ret = snprintf(buf, size, "m=audio %d RTP/AVP %d\r\na=rtpmap:%d MP4A-LATM/%d/%d\r\n"
+                                  "a=fmtp:%d profile-level-id=1;object=2;cpresent=0;config=%s\r\n",
+                       port, pt, pt, rtp->clock_rate, rtp->channels, pt, config);
+        break;
+    default:
+        return -1;
+    }
+
+    return ret < size ? ret : -1;
+}
+#endif
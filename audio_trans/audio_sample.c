@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SAMPLE_HAVE_AVX2 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SAMPLE_HAVE_NEON 1
+#endif
+
+#include "audio_trans.h"
+
+#define SAMPLE_BLOCK 256                    // 经过s32中转时每块的采样数
+#define SAMPLE_F32_SCALE 2147483648.0f      // s32满幅对应的浮点数1.0
+
+static const int sample_sizes[AUDIO_SAMPLE_FORMAT_MAX] = {
+    [AUDIO_SAMPLE_S16] = 2,
+    [AUDIO_SAMPLE_S24] = 3,
+    [AUDIO_SAMPLE_S24_32] = 4,
+    [AUDIO_SAMPLE_S32] = 4,
+    [AUDIO_SAMPLE_F32] = 4,
+};
+
+/*
+ * xorshift32, 每个采样两个均匀分布相加得到三角分布(TPDF)的抖动
+ */
+static uint32_t sample_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/*
+ * s32降到高bits位: 四舍五入或加抖动, 饱和
+ */
+static int32_t sample_reduce(int32_t v, int shift, uint32_t *dither)
+{
+    int64_t x = v;
+    int64_t max = ((int64_t)1 << (31 - shift)) - 1;
+    uint32_t mask = ((uint32_t)1 << shift) - 1;
+
+    if (dither != NULL)
+    {
+        //  两个[0, 1)LSB的均匀分布相加再减1LSB, 分布在(-1, 1)LSB
+        x += (int64_t)(sample_rand(dither) & mask) + (sample_rand(dither) & mask) - ((int64_t)1 << shift);
+    }
+    x = (x + ((int64_t)1 << (shift - 1))) >> shift;
+    if (x > max)
+    {
+        return (int32_t)max;
+    }
+    if (x < -max - 1)
+    {
+        return (int32_t)(-max - 1);
+    }
+    return (int32_t)x;
+}
+
+static int32_t sample_from_float(float f)
+{
+    float x = f * SAMPLE_F32_SCALE;
+
+    if (x >= SAMPLE_F32_SCALE)
+    {
+        return INT32_MAX;
+    }
+    if (x <= -SAMPLE_F32_SCALE)
+    {
+        return INT32_MIN;
+    }
+    //  NaN按0处理
+    return x == x ? (int32_t)x : 0;
+}
+
+#if 1   //  SIMD直接转换, 不经过s32中转
+#ifdef SAMPLE_HAVE_AVX2
+static int sample_have_avx2(void)
+{
+    static int have = -1;
+
+    if (have < 0)
+    {
+        __builtin_cpu_init();
+        have = __builtin_cpu_supports("avx2");
+    }
+    return have;
+}
+
+__attribute__((target("avx2"))) static int s16_to_f32_avx2(const short *in, float *out, int samples)
+{
+    int i = 0;
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    return i;
+}
+
+/*
+ * NaN先清成0, 再夹到[-32768, 32767]转整数, packs不会再饱和; cvtps按当前舍入模式(最近偶数)
+ */
+__attribute__((target("avx2"))) static int f32_to_s16_avx2(const float *in, short *out, int samples)
+{
+    int i = 0;
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 lo = _mm256_set1_ps(-32768.0f);
+    const __m256 hi = _mm256_set1_ps(32767.0f);
+    __m256 x, y;
+    __m256i a, b;
+
+    for (i = 0; i + 16 <= samples; i += 16)
+    {
+        x = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+        y = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale);
+        x = _mm256_and_ps(x, _mm256_cmp_ps(x, x, _CMP_ORD_Q));
+        y = _mm256_and_ps(y, _mm256_cmp_ps(y, y, _CMP_ORD_Q));
+        a = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(x, lo), hi));
+        b = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(y, lo), hi));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static int s16_to_s32_avx2(const short *in, int32_t *out, int samples)
+{
+    int i = 0;
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_slli_epi32(v, 16));
+    }
+    return i;
+}
+
+/*
+ * 四舍五入: 高16位加上低16位+0x8000的进位, 进位后只有32767+1会溢出, packs饱和掉
+ */
+__attribute__((target("avx2"))) static int s32_to_s16_avx2(const int32_t *in, short *out, int samples)
+{
+    int i = 0;
+    const __m256i half = _mm256_set1_epi32(0x8000);
+    const __m256i low = _mm256_set1_epi32(0xFFFF);
+    __m256i a, b;
+
+    for (i = 0; i + 16 <= samples; i += 16)
+    {
+        a = _mm256_loadu_si256((const __m256i *)(in + i));
+        b = _mm256_loadu_si256((const __m256i *)(in + i + 8));
+        a = _mm256_add_epi32(_mm256_srai_epi32(a, 16), _mm256_srli_epi32(_mm256_add_epi32(_mm256_and_si256(a, low), half), 16));
+        b = _mm256_add_epi32(_mm256_srai_epi32(b, 16), _mm256_srli_epi32(_mm256_add_epi32(_mm256_and_si256(b, low), half), 16));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+    }
+    return i;
+}
+#endif
+
+static int s16_to_f32(const short *in, float *out, int samples)
+{
+    int i = 0;
+
+#ifdef SAMPLE_HAVE_AVX2
+    if (sample_have_avx2())
+    {
+        i = s16_to_f32_avx2(in, out, samples);
+    }
+#elif defined(SAMPLE_HAVE_NEON)
+    for (; i + 4 <= samples; i += 4)
+    {
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vld1_s16(in + i))), 1.0f / 32768.0f));
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        out[i] = in[i] * (1.0f / 32768.0f);
+    }
+    return samples;
+}
+
+static int f32_to_s16(const float *in, short *out, int samples)
+{
+    int i = 0;
+    float x = 0;
+
+#ifdef SAMPLE_HAVE_AVX2
+    if (sample_have_avx2())
+    {
+        i = f32_to_s16_avx2(in, out, samples);
+    }
+#elif defined(SAMPLE_HAVE_NEON) && defined(__aarch64__)
+    for (; i + 8 <= samples; i += 8)
+    {
+        int32x4_t a = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(in + i), 32768.0f));
+        int32x4_t b = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(in + i + 4), 32768.0f));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        x = in[i] * 32768.0f;
+        if (x != x)
+        {
+            out[i] = 0;
+            continue;
+        }
+        out[i] = x >= 32767.0f ? 32767 : (x <= -32768.0f ? -32768 : (short)__builtin_rintf(x));
+    }
+    return samples;
+}
+
+static int s16_to_s32(const short *in, int32_t *out, int samples)
+{
+    int i = 0;
+
+#ifdef SAMPLE_HAVE_AVX2
+    if (sample_have_avx2())
+    {
+        i = s16_to_s32_avx2(in, out, samples);
+    }
+#elif defined(SAMPLE_HAVE_NEON)
+    for (; i + 4 <= samples; i += 4)
+    {
+        vst1q_s32(out + i, vshll_n_s16(vld1_s16(in + i), 16));
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        out[i] = (int32_t)((uint32_t)(int32_t)in[i] << 16);
+    }
+    return samples;
+}
+
+static int s32_to_s16(const int32_t *in, short *out, int samples)
+{
+    int i = 0;
+
+#ifdef SAMPLE_HAVE_AVX2
+    if (sample_have_avx2())
+    {
+        i = s32_to_s16_avx2(in, out, samples);
+    }
+#elif defined(SAMPLE_HAVE_NEON)
+    for (; i + 4 <= samples; i += 4)
+    {
+        vst1_s16(out + i, vqrshrn_n_s32(vld1q_s32(in + i), 16));
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        out[i] = (short)sample_reduce(in[i], 16, NULL);
+    }
+    return samples;
+}
+#endif
+
+#if 1   //  经过s32中转的通用转换
+static void sample_to_s32(const unsigned char *in, audio_sample_format_e format, int32_t *out, int samples)
+{
+    int i = 0;
+    const unsigned char *p = NULL;
+
+    switch (format)
+    {
+    case AUDIO_SAMPLE_S16:
+        s16_to_s32((const short *)in, out, samples);
+        break;
+    case AUDIO_SAMPLE_S24:
+        for (i = 0, p = in; i < samples; i++, p += 3)
+        {
+            out[i] = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+        }
+        break;
+    case AUDIO_SAMPLE_S24_32:
+        for (i = 0; i < samples; i++)
+        {
+            out[i] = (int32_t)((uint32_t)((const int32_t *)in)[i] << 8);
+        }
+        break;
+    case AUDIO_SAMPLE_S32:
+        memcpy(out, in, sizeof(int32_t) * samples);
+        break;
+
+    default:
+        for (i = 0; i < samples; i++)
+        {
+            out[i] = sample_from_float(((const float *)in)[i]);
+        }
+        break;
+    }
+}
+
+static void sample_from_s32(const int32_t *in, unsigned char *out, audio_sample_format_e format, int samples, uint32_t *dither)
+{
+    int i = 0;
+    int32_t v = 0;
+    unsigned char *p = NULL;
+
+    switch (format)
+    {
+    case AUDIO_SAMPLE_S16:
+        if (dither == NULL)
+        {
+            s32_to_s16(in, (short *)out, samples);
+            break;
+        }
+        for (i = 0; i < samples; i++)
+        {
+            ((short *)out)[i] = (short)sample_reduce(in[i], 16, dither);
+        }
+        break;
+    case AUDIO_SAMPLE_S24:
+        for (i = 0, p = out; i < samples; i++, p += 3)
+        {
+            v = sample_reduce(in[i], 8, dither);
+            p[0] = v & 0xFF;
+            p[1] = (v >> 8) & 0xFF;
+            p[2] = (v >> 16) & 0xFF;
+        }
+        break;
+    case AUDIO_SAMPLE_S24_32:
+        for (i = 0; i < samples; i++)
+        {
+            ((int32_t *)out)[i] = sample_reduce(in[i], 8, dither);
+        }
+        break;
+    case AUDIO_SAMPLE_S32:
+        memcpy(out, in, sizeof(int32_t) * samples);
+        break;
+
+    default:
+        for (i = 0; i < samples; i++)
+        {
+            ((float *)out)[i] = in[i] / SAMPLE_F32_SCALE;
+        }
+        break;
+    }
+}
+#endif
+
+#if 1   //  采样格式转换
+int audio_sample_size(audio_sample_format_e format)
+{
+    if (format < AUDIO_SAMPLE_S16 || format >= AUDIO_SAMPLE_FORMAT_MAX)
+    {
+        return -1;
+    }
+    return sample_sizes[format];
+}
+
+int audio_sample_convert(const void *in, audio_sample_format_e in_format, void *out, audio_sample_format_e out_format,
+                         int samples, unsigned int *dither)
+{
+    int n = 0;
+    int done = 0;
+    int32_t block[SAMPLE_BLOCK];
+    const unsigned char *src = (const unsigned char *)in;
+    unsigned char *dst = (unsigned char *)out;
+
+    if (in == NULL || out == NULL || samples < 0 || audio_sample_size(in_format) < 0 || audio_sample_size(out_format) < 0)
+    {
+        fprintf(stderr, "[%s] in_format=%d, out_format=%d, samples=%d, err param\n", __func__, in_format, out_format, samples);
+        return -1;
+    }
+
+    //  位数不降的转换不需要抖动, 常用的几种直接转换
+    if (in_format == out_format)
+    {
+        memmove(out, in, (size_t)samples * sample_sizes[in_format]);
+        return samples;
+    }
+    if (in_format == AUDIO_SAMPLE_S16 && out_format == AUDIO_SAMPLE_F32)
+    {
+        return s16_to_f32((const short *)in, (float *)out, samples);
+    }
+    if (in_format == AUDIO_SAMPLE_S16 && out_format == AUDIO_SAMPLE_S32)
+    {
+        return s16_to_s32((const short *)in, (int32_t *)out, samples);
+    }
+    if (in_format == AUDIO_SAMPLE_F32 && out_format == AUDIO_SAMPLE_S16 && dither == NULL)
+    {
+        return f32_to_s16((const float *)in, (short *)out, samples);
+    }
+
+    for (done = 0; done < samples; done += n)
+    {
+        n = samples - done < SAMPLE_BLOCK ? samples - done : SAMPLE_BLOCK;
+        sample_to_s32(src + (size_t)done * sample_sizes[in_format], in_format, block, n);
+        //  抖动只在降位数时加; 浮点输出精度够, 不加
+        sample_from_s32(block, dst + (size_t)done * sample_sizes[out_format], out_format, n,
+                        sample_sizes[out_format] < sample_sizes[in_format] || in_format == AUDIO_SAMPLE_F32 ? dither : NULL);
+    }
+
+    return samples;
+}
+#endif
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio_trans.h"
+
+//  对数线性分桶: 小于TRACE_SUB的值每个一桶, 之后每个2的幂分TRACE_SUB档
+#define TRACE_SUB_BITS 5
+#define TRACE_SUB (1 << TRACE_SUB_BITS)
+#define TRACE_BUCKETS ((64 - TRACE_SUB_BITS + 1) * TRACE_SUB)
+
+typedef struct
+{
+    unsigned long long sum_ns;
+    unsigned long long min_ns;      // 0为还没有记录
+    unsigned long long max_ns;
+    unsigned long long buckets[TRACE_BUCKETS];
+} trace_hist_t;
+
+int audio_trace_enabled = 0;
+
+static trace_hist_t trace_hists[AUDIO_TRACE_STAGE_MAX][AENC_FORMAT_MAX];
+
+static const char *trace_stage_names[AUDIO_TRACE_STAGE_MAX] = {"encode", "decode", "parse", "write"};
+
+static int trace_bucket(unsigned long long ns)
+{
+    int msb = 0;
+
+    if (ns < TRACE_SUB)
+    {
+        return (int)ns;
+    }
+    msb = 63 - __builtin_clzll(ns);
+    return (msb - TRACE_SUB_BITS + 1) * TRACE_SUB + (int)((ns >> (msb - TRACE_SUB_BITS)) & (TRACE_SUB - 1));
+}
+
+//  桶的上界, 分位数按这个报, 宁可偏大
+static unsigned long long trace_bucket_max(int bucket)
+{
+    int shift = 0;
+
+    if (bucket < TRACE_SUB)
+    {
+        return bucket;
+    }
+    shift = bucket / TRACE_SUB - 1;
+    return (((unsigned long long)(TRACE_SUB + bucket % TRACE_SUB) + 1) << shift) - 1;
+}
+
+unsigned long long audio_trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void audio_trace_enable(int enable)
+{
+    __atomic_store_n(&audio_trace_enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+void audio_trace_record(audio_trace_stage_e stage, aenc_format_e format, unsigned long long ns, int count)
+{
+    trace_hist_t *hist = NULL;
+    unsigned long long old = 0;
+
+    if ((unsigned)stage >= AUDIO_TRACE_STAGE_MAX || (unsigned)format >= AENC_FORMAT_MAX || count <= 0)
+    {
+        return;
+    }
+    hist = &trace_hists[stage][format];
+    //  0留给"没有记录"
+    ns = ns == 0 ? 1 : ns;
+
+    __atomic_fetch_add(&hist->buckets[trace_bucket(ns)], count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum_ns, ns * count, __ATOMIC_RELAXED);
+
+    old = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+    while (ns > old && !__atomic_compare_exchange_n(&hist->max_ns, &old, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+    old = __atomic_load_n(&hist->min_ns, __ATOMIC_RELAXED);
+    while ((old == 0 || ns < old) && !__atomic_compare_exchange_n(&hist->min_ns, &old, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+void audio_trace_stop(audio_trace_stage_e stage, aenc_format_e format, unsigned long long start, int count)
+{
+    if (start == 0 || count <= 0)
+    {
+        return;
+    }
+    audio_trace_record(stage, format, (audio_trace_now() - start) / count, count);
+}
+
+int audio_trace_get(audio_trace_stage_e stage, aenc_format_e format, audio_trace_summary_t *summary)
+{
+    int i = 0;
+    int q = 0;
+    unsigned long long seen = 0;
+    unsigned long long count = 0;
+    unsigned long long value = 0;
+    unsigned long long target[4];
+    unsigned long long *result[4];
+    trace_hist_t *hist = NULL;
+
+    if ((unsigned)stage >= AUDIO_TRACE_STAGE_MAX || (unsigned)format >= AENC_FORMAT_MAX || summary == NULL)
+    {
+        return -1;
+    }
+    hist = &trace_hists[stage][format];
+    memset(summary, 0, sizeof(audio_trace_summary_t));
+
+    //  记录可能还在进行, 以桶里的总数为准, 分位数才自洽
+    for (i = 0; i < TRACE_BUCKETS; i++)
+    {
+        count += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    }
+    if (count == 0)
+    {
+        return 0;
+    }
+    summary->count = count;
+    summary->min_ns = __atomic_load_n(&hist->min_ns, __ATOMIC_RELAXED);
+    summary->max_ns = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+    summary->mean_ns = (double)__atomic_load_n(&hist->sum_ns, __ATOMIC_RELAXED) / count;
+
+    target[0] = (count * 500 + 999) / 1000;
+    target[1] = (count * 900 + 999) / 1000;
+    target[2] = (count * 990 + 999) / 1000;
+    target[3] = (count * 999 + 999) / 1000;
+    result[0] = &summary->p50_ns;
+    result[1] = &summary->p90_ns;
+    result[2] = &summary->p99_ns;
+    result[3] = &summary->p999_ns;
+    for (i = 0; i < TRACE_BUCKETS && q < 4; i++)
+    {
+        seen += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        while (q < 4 && seen >= target[q])
+        {
+            value = trace_bucket_max(i);
+            //  桶的上界不会超过真实的最大值
+            *result[q++] = value > summary->max_ns && summary->max_ns != 0 ? summary->max_ns : value;
+        }
+    }
+
+    return 0;
+}
+
+const char *audio_trace_stage_name(audio_trace_stage_e stage)
+{
+    return (unsigned)stage < AUDIO_TRACE_STAGE_MAX ? trace_stage_names[stage] : "unknown";
+}
+
+void audio_trace_dump(FILE *fp, int json)
+{
+    int stage = 0;
+    int format = 0;
+    int first = 1;
+    const char *name = NULL;
+    const audio_codec_ops_t *ops = NULL;
+    audio_trace_summary_t summary;
+
+    if (fp == NULL)
+    {
+        return;
+    }
+    if (json)
+    {
+        fprintf(fp, "{\"traces\": [");
+    }
+    else
+    {
+        fprintf(fp, "%-7s %-6s %10s %10s %10s %10s %10s %10s %10s (us)\n",
+                "stage", "codec", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    }
+
+    for (stage = 0; stage < AUDIO_TRACE_STAGE_MAX; stage++)
+    {
+        for (format = 0; format < AENC_FORMAT_MAX; format++)
+        {
+            if (audio_trace_get(stage, format, &summary) != 0 || summary.count == 0)
+            {
+                continue;
+            }
+            ops = audio_codec_find(format);
+            name = ops != NULL ? ops->name : "unknown";
+            if (json)
+            {
+                fprintf(fp, "%s\n  {\"stage\": \"%s\", \"codec\": \"%s\", \"count\": %llu, \"min_ns\": %llu, \"mean_ns\": %.0f, "
+                            "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                        first ? "" : ",", trace_stage_names[stage], name, summary.count, summary.min_ns, summary.mean_ns,
+                        summary.p50_ns, summary.p90_ns, summary.p99_ns, summary.p999_ns, summary.max_ns);
+            }
+            else
+            {
+                fprintf(fp, "%-7s %-6s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                        trace_stage_names[stage], name, summary.count, summary.mean_ns / 1000,
+                        summary.p50_ns / 1000.0, summary.p90_ns / 1000.0, summary.p99_ns / 1000.0,
+                        summary.p999_ns / 1000.0, summary.max_ns / 1000.0);
+            }
+            first = 0;
+        }
+    }
+
+    if (json)
+    {
+        fprintf(fp, "\n]}\n");
+    }
+    fflush(fp);
+}
+
+void audio_trace_reset(void)
+{
+    int stage = 0;
+    int format = 0;
+    int i = 0;
+    trace_hist_t *hist = NULL;
+
+    for (stage = 0; stage < AUDIO_TRACE_STAGE_MAX; stage++)
+    {
+        for (format = 0; format < AENC_FORMAT_MAX; format++)
+        {
+            hist = &trace_hists[stage][format];
+            for (i = 0; i < TRACE_BUCKETS; i++)
+            {
+                __atomic_store_n(&hist->buckets[i], 0, __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&hist->sum_ns, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&hist->min_ns, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&hist->max_ns, 0, __ATOMIC_RELAXED);
+        }
+    }
+}
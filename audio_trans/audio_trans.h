@@ -1,12 +1,32 @@
 #ifndef __AUDIO_TRANS_H__
 #define __AUDIO_TRANS_H__
 
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+#define AUDIO_CHANNELS_MAX 8
+#define AUDIO_WAV_HEADER_MAX 128
+#define AUDIO_PIPELINE_STAGES_MAX 8
+
 typedef void *codec_handle;
+typedef struct audio_slab audio_slab_t;
+typedef struct audio_arena audio_arena_t;
+typedef struct pcm_fifo pcm_fifo_t;
+typedef struct audio_input audio_input_t;
+typedef struct audio_output audio_output_t;
+typedef struct audio_resampler audio_resampler_t;
+typedef struct audio_mixer audio_mixer_t;
+typedef struct audio_loudness audio_loudness_t;
+typedef struct audio_agc audio_agc_t;
+typedef struct audio_ring audio_ring_t;
+typedef struct audio_pipeline audio_pipeline_t;
 
 typedef enum  
 {
@@ -14,17 +34,64 @@ typedef enum
 	AENC_FORMAT_PCM = AENC_FORMAT_NONE,
 	AENC_FORMAT_AAC = 1,
 	AENC_FORMAT_G711A,
-	AENC_FORMAT_OPUS
+	AENC_FORMAT_OPUS,
+	AENC_FORMAT_MAX
 } aenc_format_e;
 
+typedef enum
+{
+    AUDIO_CONTAINER_UNKNOWN = 0,    // 裸数据, pcm/g711a
+    AUDIO_CONTAINER_ADTS,           // aac
+    AUDIO_CONTAINER_IMI,            // opus, 每包8字节头
+    AUDIO_CONTAINER_OGG,            // opus
+    AUDIO_CONTAINER_WAV             // pcm
+} audio_container_e;
+
+typedef enum
+{
+    AUDIO_INPUT_AUTO = 0,           // 普通文件mmap, 其他read
+    AUDIO_INPUT_MMAP,
+    AUDIO_INPUT_READ                // 固定窗口分块read
+} audio_input_mode_e;
+
+typedef enum
+{
+    AUDIO_OUTPUT_AUTO = 0,          // 普通文件io_uring, 其他stdio
+    AUDIO_OUTPUT_STDIO,             // 带缓存的fwrite
+    AUDIO_OUTPUT_URING,             // 攒成大缓存用io_uring异步写
+    AUDIO_OUTPUT_DIRECT             // io_uring + O_DIRECT, 不经过页缓存
+} audio_output_mode_e;
+
 typedef enum
 {
     AUDIO_SAMPLERATE_8000   = 8000,
+    AUDIO_SAMPLERATE_11025  = 11025,
+    AUDIO_SAMPLERATE_12000  = 12000,
     AUDIO_SAMPLERATE_16000  = 16000,
+    AUDIO_SAMPLERATE_22050  = 22050,
+    AUDIO_SAMPLERATE_24000  = 24000,
     AUDIO_SAMPLERATE_32000  = 32000,
+    AUDIO_SAMPLERATE_44100  = 44100,
     AUDIO_SAMPLERATE_48000  = 48000
 } audio_samplerate_e;
 
+typedef enum
+{
+    AUDIO_RESAMPLE_FAST = 0,        // 每相16抽头
+    AUDIO_RESAMPLE_MEDIUM,          // 每相32抽头
+    AUDIO_RESAMPLE_HIGH             // 每相64抽头
+} audio_resample_quality_e;
+
+typedef enum
+{
+    AUDIO_SAMPLE_S16 = 0,           // 编解码器使用的格式
+    AUDIO_SAMPLE_S24,               // 3字节小端
+    AUDIO_SAMPLE_S24_32,            // 4字节, 低24位有效
+    AUDIO_SAMPLE_S32,
+    AUDIO_SAMPLE_F32,               // [-1.0, 1.0)
+    AUDIO_SAMPLE_FORMAT_MAX
+} audio_sample_format_e;
+
 typedef struct
 {
     audio_samplerate_e samplerate;
@@ -34,172 +101,1632 @@ typedef struct
     aenc_format_e format;
 } audio_param_t;
 
-#if 1   //  aac编码器 
+#if 1   //  内存池
 /*
- * 初始化aac编码器
+ * 创建定长槽的内存池, 所有槽在一整块连续内存里(优先大页)
  * @param[in]
- *      audio_param     音频参数
- * @param[out]
- *      input_len       编码时需要输入的数据量
- *      output_len_max  编码后输出的最大数据量
+ *      slot_size       每个槽的大小, 向上对齐到64字节
+ *      slot_count      槽的数量
  * @retval
- *      codec_handle    解码器句柄
+ *      audio_slab_t    内存池
  *      NULL            失败
  */
-codec_handle aac_encode_init(audio_param_t audio_param, unsigned long *input_len, unsigned long *output_len_max);
+audio_slab_t *audio_slab_create(int slot_size, int slot_count);
 /*
- * pcm编码为aac
+ * 从内存池取一个槽
  * @param[in]
- *      handle          解码器句柄
- *      input_buf       输入的buff
- *      input_len       aac_encode_init获取到的input_len
-*       output_buf_size 输出buff的大小
- * @param[out]
- *      output_buf      编码后的buff
+ *      slab            内存池
  * @retval
- *      >0              编码后的长度
- *      <=0             失败
+ *      槽的地址, 内存池满时返回NULL
  */
-int aac_encode_frame(codec_handle handle, unsigned char *input_buf, unsigned long input_len, unsigned char *output_buf, int output_buf_size);
+void *audio_slab_alloc(audio_slab_t *slab);
 /*
- * 关闭aac编码器
+ * 把槽还给内存池
  * @param[in]
- *      handle          编码器句柄
+ *      slab            内存池
+ *      ptr             audio_slab_alloc得到的槽
  */
-void acc_encode_deinit(codec_handle handle);
+void audio_slab_free(audio_slab_t *slab, void *ptr);
+/*
+ * 获取每个槽的实际大小
+ * @param[in]
+ *      slab            内存池
+ */
+int audio_slab_slot_size(audio_slab_t *slab);
+/*
+ * 获取已分配的槽的数量
+ * @param[in]
+ *      slab            内存池
+ */
+int audio_slab_used(audio_slab_t *slab);
+/*
+ * 销毁内存池, 池里的句柄都不能再用
+ * @param[in]
+ *      slab            内存池
+ */
+void audio_slab_destroy(audio_slab_t *slab);
+
+/*
+ * 创建线性分配的内存区, 一次分配好, 之后从里面切, 不再调用malloc. 一个会话的缓存按帧的大小算好总量后一起分配
+ * @param[in]
+ *      size            总大小
+ * @retval
+ *      audio_arena_t   内存区
+ *      NULL            失败
+ */
+audio_arena_t *audio_arena_create(size_t size);
+/*
+ * 从内存区切一块, 64字节对齐, 内容不清零
+ * @param[in]
+ *      arena           内存区
+ *      size            大小
+ * @retval
+ *      地址, 剩余空间不够时返回NULL
+ */
+void *audio_arena_alloc(audio_arena_t *arena, size_t size);
+/*
+ * 记下当前位置, audio_arena_release回到这里, 之后切出的块全部作废
+ */
+size_t audio_arena_mark(audio_arena_t *arena);
+void audio_arena_release(audio_arena_t *arena, size_t mark);
+/*
+ * 用过的最大字节数, 用来核对按帧算出的大小
+ */
+size_t audio_arena_peak(audio_arena_t *arena);
+void audio_arena_destroy(audio_arena_t *arena);
 #endif
 
-#if 1   //  aac解码器
+#if 1   //  输入
 /*
- * 初始化aac解码器
+ * 打开输入文件, 解析器通过audio_input_peek直接访问数据, 不拷贝
  * @param[in]
- *      audio_param     音频参数
- *      frame           aac一帧数据
- *      frame_len       数据长度
+ *      path            文件路径
+ *      mode            AUDIO_INPUT_AUTO: 普通文件mmap, 其他read
+ *      window_size     read方式的窗口大小, 一次peek最多这么多数据, 0为默认64KB
  * @retval
- *      codec_handle    解码器句柄
+ *      audio_input_t   输入
  *      NULL            失败
  */
-codec_handle aac_decode_init(audio_param_t audio_param, unsigned char *frame, unsigned long frame_len);
+audio_input_t *audio_input_open(const char *path, audio_input_mode_e mode, int window_size);
 /*
- * aac解码为pcm
+ * 用已经打开的fd创建输入, 例如stdin或socket, close时不关闭fd
+ */
+audio_input_t *audio_input_open_fd(int fd, audio_input_mode_e mode, int window_size);
+/*
+ * 查看未处理的数据, 不移动读位置. read方式不够need字节时会从fd补数据
  * @param[in]
- *      handle          解码器句柄
- *      audio_param     音频参数
- *      input_buf       输入的帧信息
- *      input_len       输入的帧长度
- *      output_buf_size 解码后的buff的大小
+ *      input           输入
+ *      need            至少需要的字节数, read方式最多为窗口大小
  * @param[out]
- *      output_buf      解码后的buff
+ *      data            指向未处理数据的只读视图, 下一次peek之前有效
  * @retval
- *      >0              解码后的长度
- *      <=0             失败
+ *      >=0             可用的字节数, 小于need说明输入已结束
+ *      <0              失败
  */
-int aac_decode_frame(codec_handle handle, audio_param_t audio_param, unsigned char *input_buf, unsigned long input_len, unsigned char *output_buf, int output_buf_size);
+ssize_t audio_input_peek(audio_input_t *input, size_t need, unsigned char **data);
 /*
- * 关闭aac解码器
+ * 标记len字节已处理, mmap方式会定期把处理过的页还给内核
+ */
+void audio_input_consume(audio_input_t *input, size_t len);
+/*
+ * 获取文件大小, 不是普通文件时返回-1
+ */
+long long audio_input_size(audio_input_t *input);
+/*
+ * 获取实际使用的方式, AUDIO_INPUT_MMAP或AUDIO_INPUT_READ
+ */
+audio_input_mode_e audio_input_get_mode(audio_input_t *input);
+/*
+ * 关闭输入
+ */
+void audio_input_close(audio_input_t *input);
+#endif
+
+#if 1   //  输出
+/*
+ * 创建或截断输出文件. io_uring方式把数据攒进几个对齐的大缓存, 写满一个就异步提交,
+ * 所有缓存都在写时才等待; 内核不支持io_uring或者不是普通文件时用stdio
  * @param[in]
- *      handle          解码器句柄
+ *      path            文件路径
+ *      mode            AUDIO_OUTPUT_AUTO: 普通文件io_uring, 其他stdio
+ *      buffer_size     io_uring方式每个缓存的大小, 0为默认1MB; stdio方式的缓存大小, 0为默认
+ * @retval
+ *      audio_output_t  输出
+ *      NULL            失败
  */
-void acc_decode_deinit(codec_handle handle);
+audio_output_t *audio_output_open(const char *path, audio_output_mode_e mode, int buffer_size);
+/*
+ * 用已经打开的fd创建输出, 例如stdout, 从fd当前的位置开始写, close时不关闭fd
+ */
+audio_output_t *audio_output_open_fd(int fd, audio_output_mode_e mode, int buffer_size);
+/*
+ * 写入数据, 拷进缓存后就返回
+ * @param[in]
+ *      out             输出
+ *      buf             数据
+ *      len             长度
+ * @retval
+ *      0               成功
+ *      <0              失败, 包括之前提交的异步写失败
+ */
+int audio_output_write(audio_output_t *out, const void *buf, size_t len);
+/*
+ * 把缓存里的数据交给内核, 实时流每帧调用; O_DIRECT方式只提交整块
+ */
+int audio_output_flush(audio_output_t *out);
+/*
+ * 获取已写入的长度, 不能seek的输出返回-1
+ */
+long long audio_output_tell(audio_output_t *out);
+/*
+ * 改写已经写过的内容, 例如回填文件头. 先等之前的数据都写完, O_DIRECT方式之后改为普通写
+ * @param[in]
+ *      out             输出
+ *      buf             数据
+ *      len             长度
+ *      offset          相对打开时位置的偏移
+ * @retval
+ *      0               成功
+ *      <0              失败, 或者输出不能seek
+ */
+int audio_output_pwrite(audio_output_t *out, const void *buf, size_t len, long long offset);
+/*
+ * 获取实际使用的方式, AUDIO_OUTPUT_STDIO/URING/DIRECT
+ */
+audio_output_mode_e audio_output_get_mode(audio_output_t *out);
+/*
+ * 写完所有数据并关闭输出
+ * @retval
+ *      0               成功
+ *      <0              有数据没有写成功
+ */
+int audio_output_close(audio_output_t *out);
+#endif
 
+#if 1   //  重采样
+/*
+ * 创建多相滤波重采样器, 输入输出都是交织的16bit pcm.
+ * 采样率之比化简为L/M(48k->16k为1/3, 44.1k->48k为160/147), 滤波器组按比例和质量缓存, 所有句柄共用
+ * @param[in]
+ *      in_rate         输入采样率
+ *      out_rate        输出采样率
+ *      channels        声道数, 最多8
+ *      quality         质量档位
+ * @retval
+ *      audio_resampler_t   重采样器
+ *      NULL                失败, L超过1024时不支持
+ */
+audio_resampler_t *audio_resampler_create(int in_rate, int out_rate, int channels, audio_resample_quality_e quality);
+/*
+ * 获取输入in_frames帧(每声道采样数)时最多输出的帧数
+ */
+int audio_resampler_get_out_size(audio_resampler_t *rs, int in_frames);
+/*
+ * 重采样, 输入长度任意, 滤波器延时已经补偿, 输出和输入在时间上对齐
+ * @param[in]
+ *      rs              重采样器
+ *      in              输入pcm
+ *      in_frames       输入帧数
+ *      out_frames_max  out能放下的帧数, 不能小于audio_resampler_get_out_size
+ * @param[out]
+ *      out             输出pcm
+ * @retval
+ *      >=0             输出帧数
+ *      <0              失败
+ */
+int audio_resampler_process(audio_resampler_t *rs, const short *in, int in_frames, short *out, int out_frames_max);
+/*
+ * 输入结束时取出滤波器里剩余的输出, 总输出帧数为输入帧数*out_rate/in_rate(向上取整)
+ * 之后要继续使用需先audio_resampler_reset
+ * @param[in]
+ *      out_frames_max  不能小于audio_resampler_get_out_size(rs, 64)
+ * @retval
+ *      >=0             输出帧数
+ *      <0              失败
+ */
+int audio_resampler_flush(audio_resampler_t *rs, short *out, int out_frames_max);
+/*
+ * 清空历史, 开始新的流
+ */
+void audio_resampler_reset(audio_resampler_t *rs);
+/*
+ * 销毁重采样器
+ */
+void audio_resampler_destroy(audio_resampler_t *rs);
 #endif
 
-#if 1   //  g711a编码
+#if 1   //  声道转换
 /*
- * pcm编码为g711a
+ * 生成默认的声道转换矩阵: 立体声->单声道取平均, 单声道->多声道复制,
+ * 5.1(L R C LFE Ls Rs)->立体声/单声道按ITU-R BS.775下混
  * @param[in]
- *      pcm_data        输入的buff
- *      pcm_len         buff的长度
- *      g711a_len       输出buff的大小
+ *      in_channels     输入声道数, 最多AUDIO_CHANNELS_MAX
+ *      out_channels    输出声道数, 最多AUDIO_CHANNELS_MAX
  * @param[out]
- *      g711a_data      编码后的buff
+ *      matrix          out_channels行in_channels列, 输出声道o = sum(matrix[o * in_channels + i] * 输入声道i)
  * @retval
- *      >0              编码后的长度
- *      <=0             失败
+ *      0               成功
+ *      <0              失败
  */
-int g711a_encode(char *pcm_data, int pcm_len, char *g711a_data, int g711a_len);
+int audio_channel_matrix_default(int in_channels, int out_channels, float *matrix);
+/*
+ * 按矩阵转换交织的16bit pcm, 结果饱和到16bit. 立体声->单声道平均和单声道->立体声复制有SIMD实现
+ * @param[in]
+ *      in              输入pcm, frames * in_channels个采样
+ *      in_channels     输入声道数
+ *      frames          帧数(每声道采样数)
+ *      matrix          转换矩阵, 见audio_channel_matrix_default
+ *      out_channels    输出声道数
+ * @param[out]
+ *      out             输出pcm, frames * out_channels个采样, 不能和in重叠
+ * @retval
+ *      >=0             帧数
+ *      <0              失败
+ */
+int audio_channel_mix(const short *in, int in_channels, int frames, const float *matrix, int out_channels, short *out);
+/*
+ * 交织转平面, planar[c]放第c个声道的frames个采样
+ */
+int audio_channel_deinterleave(const short *in, int channels, int frames, short *const *planar);
+/*
+ * 平面转交织
+ */
+int audio_channel_interleave(const short *const *planar, int channels, int frames, short *out);
+/*
+ * 从交织的pcm里取出第index个声道
+ */
+int audio_channel_extract(const short *in, int channels, int frames, int index, short *out);
 #endif
 
-#if 1   //  g711a解码
+#if 1   //  采样格式转换
 /*
- * aac解码为g711a
+ * 获取一个采样的字节数
+ * @retval
+ *      >0              字节数
+ *      <0              格式不对
+ */
+int audio_sample_size(audio_sample_format_e format);
+/*
+ * 转换采样格式, 超出范围的饱和. s16<->f32, s16->s32, s32->s16有SIMD实现
  * @param[in]
- *      g711a_data      输入的buff
- *      g711a_len       输入的buff长度
- *      pcm_len         输出buff的大小
+ *      in              输入, samples个采样(所有声道的采样数之和)
+ *      in_format       输入格式
+ *      out_format      输出格式
+ *      samples         采样数
+ *      dither          NULL: 降位数时四舍五入; 否则降位数时加TPDF抖动, 指向随机数状态(非0), 会被更新
  * @param[out]
- *      pcm_buf         解码后的buff
+ *      out             输出, 不能和in重叠
  * @retval
- *      >0              解码后的长度
- *      <=0             失败
+ *      >=0             采样数
+ *      <0              失败
  */
-int g711a_decode(char *g711a_data, int g711a_len, char *pcm_buf, int pcm_len);
+int audio_sample_convert(const void *in, audio_sample_format_e in_format, void *out, audio_sample_format_e out_format,
+                         int samples, unsigned int *dither);
 #endif
 
-#if 1   //  opus编码
+#if 1   //  混音
 /*
- * 初始化opus编码器
+ * 多方会议混音: 所有输入加到一个总和里, 每个参与者听到的"减一"混音是总和减去自己, 不用每人各加一遍N-1路.
+ * 输入是同样采样率、声道数和帧长的pcm(交织的直接按采样数算), 一般是各路解码后的一帧, 输出再各自编码
+ */
+#define AUDIO_MIX_INPUTS_MAX 256
+
+typedef enum
+{
+    AUDIO_MIX_SATURATE = 0,         // 超出满幅的饱和
+    AUDIO_MIX_SOFT_CLIP             // 满幅的3/4以上平滑压缩, 不削顶
+} audio_mix_clip_e;
+
+/*
+ * 创建混音器
  * @param[in]
- *      audio_param     音频参数
+ *      inputs_max      最多的输入数, 不超过AUDIO_MIX_INPUTS_MAX
+ *      samples_max     一帧最多的采样数(所有声道)
+ *      speakers_max    每帧最多混入的输入数, 按平滑后的能量选当前说话的人, 大会议室里只混几个人减少底噪; 0为全部混入
+ *      clip            超出满幅的处理
  * @retval
- *      codec_handle    编码器句柄
+ *      audio_mixer_t   混音器
  *      NULL            失败
  */
-codec_handle opus_encode_init(audio_param_t audio_param);
+audio_mixer_t *audio_mixer_create(int inputs_max, int samples_max, int speakers_max, audio_mix_clip_e clip);
 /*
- * pcm编码为opus
+ * 混一帧16bit pcm, 求和、减去自己和饱和打包有SIMD实现
  * @param[in]
- *      handle          解码器句柄
- *      input_buf       输入的buff
- *      input_len       输入的buff长度
- *      output_buf_size 输出buff的大小
+ *      mixer           混音器
+ *      in              inputs个输入, 下标就是参与者的编号, NULL为这一帧没有数据(丢包, DTX), 不混入
+ *      inputs          输入数, 不超过inputs_max
+ *      samples         每个输入的采样数
  * @param[out]
- *      output_buf      编码后的buff
+ *      mix             所有混入的输入之和
+ *      minus           NULL或inputs个输出, 第i个为mix减去输入i; minus[i]为NULL时不输出.
+ *                      没有混入的输入的输出和mix一样, 可以用audio_mixer_is_speaker判断, 对它们只编码一次mix
  * @retval
- *      >0              编码后的长度
- *      <=0             失败
+ *      >=0             这一帧混入的输入数
+ *      <0              失败
  */
-int opus_encode_frame(codec_handle handle, unsigned char *input_buf, unsigned long input_len, unsigned char *output_buf, int output_buf_size);
+int audio_mixer_mix(audio_mixer_t *mixer, const short *const *in, int inputs, int samples, short *mix, short *const *minus);
 /*
- * 关闭opus解码器
- * @param[in]
- *      handle          解码器句柄
+ * 同audio_mixer_mix, 输入输出是[-1.0, 1.0]的浮点, 饱和时限制在这个范围
  */
-void opus_encode_deinit(codec_handle handle);
+int audio_mixer_mix_float(audio_mixer_t *mixer, const float *const *in, int inputs, int samples, float *mix, float *const *minus);
+/*
+ * 获取上一帧混入的输入下标, 按能量从大到小
+ * @retval
+ *      >=0             个数, 最多max个
+ *      <0              失败
+ */
+int audio_mixer_get_speakers(audio_mixer_t *mixer, int *index, int max);
+/*
+ * 上一帧输入index是否混入
+ */
+int audio_mixer_is_speaker(audio_mixer_t *mixer, int index);
+/*
+ * 清空能量和说话人状态, 开始新的会议
+ */
+void audio_mixer_reset(audio_mixer_t *mixer);
+/*
+ * 销毁混音器
+ */
+void audio_mixer_destroy(audio_mixer_t *mixer);
 #endif
 
-#if 1   //  opus解码
-#include "opus/opus_types.h"
+#if 1   //  响度
 /*
- * 初始化opus解码器
+ * EBU R128 / ITU-R BS.1770响度表: K加权滤波, 400ms块(每100ms一个)的绝对门限-70LUFS和相对门限-10LU,
+ * 3s块算响度范围(LRA). 块按0.1LU分格统计, 内存和时长无关. 多声道的滤波按声道并行有SIMD实现
+ */
+#define AUDIO_LOUDNESS_FLOOR -70.0      // 绝对门限, 更小的响度(静音)都报这个值
+
+typedef struct
+{
+    double integrated;      // 整体响度LUFS
+    double range;           // 响度范围LU
+    double momentary;       // 最近400ms的响度LUFS
+    double short_term;      // 最近3s的响度LUFS
+    double max_momentary;
+    double max_short_term;
+    double peak;            // 采样峰值dBFS, 静音为-120
+    double seconds;         // 量过的时长
+} audio_loudness_info_t;
+
+/*
+ * 创建响度表, 5.1按audio_channel_matrix_default的声道顺序, LFE不计, 环绕声道权重1.41
  * @param[in]
- *      audio_param     音频参数
+ *      samplerate      采样率, 不小于8000
+ *      channels        声道数, 最多AUDIO_CHANNELS_MAX
  * @retval
- *      codec_handle    解码器句柄
+ *      audio_loudness_t    响度表
+ *      NULL                失败
+ */
+audio_loudness_t *audio_loudness_create(int samplerate, int channels);
+/*
+ * 送入交织的16bit pcm, 长度任意, 不分配内存
+ * @retval
+ *      0               成功
+ *      <0              失败
+ */
+int audio_loudness_process(audio_loudness_t *meter, const short *pcm, int frames);
+/*
+ * 获取到目前为止的响度
+ */
+int audio_loudness_get(audio_loudness_t *meter, audio_loudness_info_t *info);
+/*
+ * 清空统计, 开始新的流
+ */
+void audio_loudness_reset(audio_loudness_t *meter);
+/*
+ * 销毁响度表
+ */
+void audio_loudness_destroy(audio_loudness_t *meter);
+
+/*
+ * 一遍的AGC和限幅: 输入的400ms响度按dB平滑(约3s)作为电平, 增益按它慢慢调到目标响度, 再用前瞻5ms的限幅器把采样峰值压在ceiling以下.
+ * 固定增益时就是两遍归一化的第二遍: 第一遍用响度表量出整体响度, 增益为目标减整体响度.
+ * 峰值和增益按1ms的块计算, 增益在块内线性过渡, 乘增益有SIMD实现
+ */
+typedef struct
+{
+    int adaptive;           // 1: 按电平自动调整增益; 0: 固定增益, 只限幅
+    double target;          // 目标响度LUFS
+    double gain;            // 初始增益dB, 固定增益时一直用它
+    double max_gain;        // 自动调整时增益的范围(±dB)
+    double gate;            // 400ms响度低于它(LUFS)时不计入电平, 保持增益, 不把停顿里的底噪拉起来
+    double ceiling;         // 输出采样峰值的上限dBFS, 不大于0
+} audio_agc_param_t;
+
+/*
+ * 默认参数: 自动调整, 目标-23LUFS(EBU R128), 增益±20dB, 门限-50LUFS, 峰值上限-1dBFS
+ */
+void audio_agc_param_default(audio_agc_param_t *param);
+/*
+ * 创建AGC
+ * @param[in]
+ *      samplerate      采样率, 不小于8000
+ *      channels        声道数, 所有声道用同一个增益
+ *      param           参数
+ * @retval
+ *      audio_agc_t     AGC
  *      NULL            失败
  */
-codec_handle opus_decode_init(audio_param_t audio_param);
+audio_agc_t *audio_agc_create(int samplerate, int channels, const audio_agc_param_t *param);
 /*
- * opus解码为pcm
+ * 获取输入in_frames帧时最多输出的帧数, 也够flush用
+ */
+int audio_agc_get_out_size(audio_agc_t *agc, int in_frames);
+/*
+ * 处理交织的16bit pcm, 输出比输入晚前瞻的5ms, 结束时用audio_agc_flush取出剩下的, 总输出帧数和输入相同. 不分配内存
  * @param[in]
- *      handle          解码器句柄
- *      input_buf       输入的帧信息
- *      input_len       输入的帧长度
- *      output_buf_size 解码后buff的大小
+ *      agc             AGC
+ *      in              输入pcm
+ *      frames          输入帧数
+ *      out_frames_max  out能放下的帧数, 不能小于audio_agc_get_out_size
  * @param[out]
- *      output_buf      解码后的buff
+ *      out             输出pcm, 不能和in重叠
  * @retval
- *      >0              解码后的长度
- *      <=0             失败
+ *      >=0             输出帧数
+ *      <0              失败
  */
-int opus_decode_frame(codec_handle handle, unsigned char *input_buf, unsigned long input_len, opus_int16 *output_buf, int output_buf_size);
+int audio_agc_process(audio_agc_t *agc, const short *in, int frames, short *out, int out_frames_max);
 /*
- * 关闭opus解码器
- * @param[in]
- *      handle          解码器句柄
+ * 输入结束时取出剩下的帧, 之后要继续使用需先audio_agc_reset
  */
-void opus_decode_deinit(codec_handle handle);
+int audio_agc_flush(audio_agc_t *agc, short *out, int out_frames_max);
+/*
+ * 设置当前增益dB, 在处理之前调用, 固定增益时用第一遍量出的值
+ */
+int audio_agc_set_gain(audio_agc_t *agc, double gain_db);
+/*
+ * 获取输入(乘增益之前)的响度
+ */
+int audio_agc_get_loudness(audio_agc_t *agc, audio_loudness_info_t *info);
+/*
+ * 清空缓存和响度, 增益回到param里的初始值, 开始新的流
+ */
+void audio_agc_reset(audio_agc_t *agc);
+/*
+ * 销毁AGC
+ */
+void audio_agc_destroy(audio_agc_t *agc);
+#endif
+
+#if 1   //  格式探测
+/*
+ * 根据文件开头的数据判断格式: ADTS同步字, "OggS", "RIFF"/"RF64" + "WAVE", IMI包头
+ * 裸pcm和g711a没有特征, 探测不出来
+ * @param[in]
+ *      buf             文件开头的数据, 建议至少4KB
+ *      len             数据长度
+ * @param[out]
+ *      format          编码格式, 可以为NULL
+ *      container       封装格式, 可以为NULL
+ * @retval
+ *      0               探测成功
+ *      <0              无法识别
+ */
+int audio_probe(const unsigned char *buf, int len, aenc_format_e *format, audio_container_e *container);
+#endif
+
+#if 1   //  wav封装
+typedef struct
+{
+    audio_param_t audio_param;          // format为PCM或G711A, 不填fps
+    audio_sample_format_e sample_format;// format为PCM时的采样格式
+    int block_align;                    // 一帧的字节数
+    unsigned int channel_mask;          // EXTENSIBLE的声道位置, 0为没有指定
+    long long data_offset;              // 采样数据在文件里的偏移
+    long long data_size;                // 采样数据的长度, -1为没有回填(流式写入), 一直读到文件结束
+} audio_wav_info_t;
+
+typedef struct
+{
+    long long offset;                   // 已经解析过的字节数, 即当前位置在文件里的偏移
+    long long skip;                     // 正在跳过的块还剩的字节数
+    long long ds64_data_size;
+    int rf64;
+    int have_fmt;
+} audio_wav_parser_t;
+
+/*
+ * 解析wav头, 支持PCM(16/24/32bit)、IEEE float、A-law, WAVE_FORMAT_EXTENSIBLE, 以及超过4GB的RF64.
+ * 只解析到data块开头, 采样数据由调用者直接从输入视图里取, 不拷贝
+ * @param[in]
+ *      buf             文件开头的数据
+ *      len             数据长度
+ * @param[out]
+ *      info            wav参数
+ * @retval
+ *      0               成功
+ *      >0              头不完整, 至少需要这么多字节
+ *      <0              不是wav或不支持
+ */
+int audio_wav_parse(const unsigned char *buf, size_t len, audio_wav_info_t *info);
+/*
+ * 增量解析wav头, 给只能顺序读的输入(stdin, 固定窗口read)用: 不解析的块(LIST, bext, JUNK等)边读边跳过,
+ * 视图里只要放得下当前的块头或者整个fmt/ds64块, data块之前的内容再长也不受窗口大小限制
+ * @param[in]
+ *      parser          解析状态, 第一次调用前清零
+ *      buf             上一次consumed之后的数据
+ *      len             数据长度
+ * @param[out]
+ *      consumed        已经解析完可以丢掉的字节数, 成功时到data块开头为止
+ *      info            wav参数, data_offset是从文件开头算的
+ * @retval
+ *      0               成功
+ *      >0              下一次buf至少需要这么多字节
+ *      <0              不是wav或不支持
+ */
+int audio_wav_parse_next(audio_wav_parser_t *parser, const unsigned char *buf, size_t len, size_t *consumed, audio_wav_info_t *info);
+/*
+ * 生成wav头, 长度只和格式有关: 开始时按data_size=-1写入占位, 结束时用真实长度原地回填.
+ * 超过4GB时生成RF64头(预留的JUNK块改写成ds64)
+ * @param[in]
+ *      size            buf的大小, 至少AUDIO_WAV_HEADER_MAX
+ *      audio_param     samplerate, channels, format(PCM或G711A)
+ *      sample_format   format为PCM时的采样格式, 不支持s24_32
+ *      data_size       采样数据的长度, -1为未知(流式输出)
+ * @param[out]
+ *      buf             wav头
+ * @retval
+ *      >0              头的长度
+ *      <0              失败
+ */
+int audio_wav_header(unsigned char *buf, int size, audio_param_t audio_param, audio_sample_format_e sample_format, long long data_size);
+#endif
+
+#if 1   //  pcm重组帧队列
+/*
+ * 创建有界的pcm队列, 用于解码器和编码器帧长不一致时重新分帧
+ * 例如aac每帧1024个采样, opus每帧20ms
+ * @param[in]
+ *      capacity        最多缓存的字节数
+ * @retval
+ *      pcm_fifo_t      队列
+ *      NULL            失败
+ */
+pcm_fifo_t *pcm_fifo_create(int capacity);
+/*
+ * 写入pcm
+ * @param[in]
+ *      fifo            队列
+ *      buf             pcm数据
+ *      len             数据长度
+ * @retval
+ *      >=0             实际写入的长度, 队列满时小于len
+ *      <0              失败
+ */
+int pcm_fifo_write(pcm_fifo_t *fifo, const unsigned char *buf, int len);
+/*
+ * 取出一整块pcm
+ * @param[in]
+ *      fifo            队列
+ *      len             要取的长度
+ * @param[out]
+ *      buf             取出的数据
+ * @retval
+ *      len             成功
+ *      0               数据不够len
+ *      <0              失败
+ */
+int pcm_fifo_read(pcm_fifo_t *fifo, unsigned char *buf, int len);
+/*
+ * 获取队列中的数据量
+ * @param[in]
+ *      fifo            队列
+ */
+int pcm_fifo_size(pcm_fifo_t *fifo);
+/*
+ * 获取队列的剩余空间
+ * @param[in]
+ *      fifo            队列
+ */
+int pcm_fifo_space(pcm_fifo_t *fifo);
+/*
+ * 清空队列
+ * @param[in]
+ *      fifo            队列
+ */
+void pcm_fifo_reset(pcm_fifo_t *fifo);
+/*
+ * 销毁队列
+ * @param[in]
+ *      fifo            队列
+ */
+void pcm_fifo_destroy(pcm_fifo_t *fifo);
+#endif
+
+#if 1   //  aac编码器 
+/*
+ * 初始化aac编码器
+ * @param[in]
+ *      audio_param     音频参数
+ * @param[out]
+ *      input_len       编码时需要输入的数据量
+ *      output_len_max  编码后输出的最大数据量
+ * @retval
+ *      codec_handle    解码器句柄
+ *      NULL            失败
+ */
+codec_handle aac_encode_init(audio_param_t audio_param, unsigned long *input_len, unsigned long *output_len_max);
+/*
+ * pcm编码为aac
+ * @param[in]
+ *      handle          解码器句柄
+ *      input_buf       输入的buff
+ *      input_len       aac_encode_init获取到的input_len
+*       output_buf_size 输出buff的大小
+ * @param[out]
+ *      output_buf      编码后的buff
+ * @retval
+ *      >0              编码后的长度
+ *      <=0             失败
+ */
+int aac_encode_frame(codec_handle handle, unsigned char *input_buf, unsigned long input_len, unsigned char *output_buf, int output_buf_size);
+/*
+ * 关闭aac编码器
+ * @param[in]
+ *      handle          编码器句柄
+ */
+void aac_encode_deinit(codec_handle handle);
+//  旧名字, 同aac_encode_deinit
+void acc_encode_deinit(codec_handle handle);
+#endif
+
+#if 1   //  aac解码器
+/*
+ * 初始化aac解码器
+ * @param[in]
+ *      audio_param     音频参数
+ *      frame           aac一帧数据
+ *      frame_len       数据长度
+ * @retval
+ *      codec_handle    解码器句柄
+ *      NULL            失败
+ */
+codec_handle aac_decode_init(audio_param_t audio_param, unsigned char *frame, unsigned long frame_len);
+/*
+ * aac解码为pcm
+ * @param[in]
+ *      handle          解码器句柄
+ *      audio_param     音频参数
+ *      input_buf       输入的帧信息
+ *      input_len       输入的帧长度
+ *      output_buf_size 解码后的buff的大小
+ * @param[out]
+ *      output_buf      解码后的buff
+ * @retval
+ *      >0              解码后的长度
+ *      <=0             失败, 见audio_codec_error_e
+ */
+int aac_decode_frame(codec_handle handle, audio_param_t audio_param, unsigned char *input_buf, unsigned long input_len, unsigned char *output_buf, int output_buf_size);
+/*
+ * 关闭aac解码器
+ * @param[in]
+ *      handle          解码器句柄
+ */
+void aac_decode_deinit(codec_handle handle);
+//  旧名字, 同aac_decode_deinit
+void acc_decode_deinit(codec_handle handle);
+
+#endif
+
+#if 1   //  g711a编码
+/*
+ * pcm编码为g711a
+ * @param[in]
+ *      pcm_data        输入的buff
+ *      pcm_len         buff的长度
+ *      g711a_len       输出buff的大小
+ * @param[out]
+ *      g711a_data      编码后的buff
+ * @retval
+ *      >0              编码后的长度
+ *      <=0             失败, 见audio_codec_error_e
+ */
+int g711a_encode(char *pcm_data, int pcm_len, char *g711a_data, int g711a_len);
+#endif
+
+#if 1   //  g711a解码
+/*
+ * aac解码为g711a
+ * @param[in]
+ *      g711a_data      输入的buff
+ *      g711a_len       输入的buff长度
+ *      pcm_len         输出buff的大小
+ * @param[out]
+ *      pcm_buf         解码后的buff
+ * @retval
+ *      >0              解码后的长度
+ *      <=0             失败, 见audio_codec_error_e
+ */
+int g711a_decode(char *g711a_data, int g711a_len, char *pcm_buf, int pcm_len);
+#endif
+
+#if 1   //  opus编码
+/*
+ * 初始化opus编码器
+ * @param[in]
+ *      audio_param     音频参数
+ * @retval
+ *      codec_handle    编码器句柄
+ *      NULL            失败
+ */
+codec_handle opus_encode_init(audio_param_t audio_param);
+/*
+ * 获取opus编码器句柄需要的内存大小
+ * @param[in]
+ *      audio_param     音频参数
+ * @retval
+ *      >0              字节数
+ *      <=0             失败
+ */
+int opus_encode_get_size(audio_param_t audio_param);
+/*
+ * 在调用者提供的内存上初始化opus编码器, 不申请堆内存
+ * opus_encode_deinit不会释放buf, buf由调用者释放
+ * @param[in]
+ *      audio_param     音频参数
+ *      buf             内存, 至少opus_encode_get_size字节, 16字节对齐
+ *      buf_size        内存大小
+ * @retval
+ *      codec_handle    编码器句柄, 地址即buf
+ *      NULL            失败
+ */
+codec_handle opus_encode_init_buf(audio_param_t audio_param, void *buf, int buf_size);
+/*
+ * 从内存池取一个槽初始化opus编码器, opus_encode_deinit时还给内存池
+ * @param[in]
+ *      audio_param     音频参数
+ *      slab            槽大小至少opus_encode_get_size的内存池
+ * @retval
+ *      codec_handle    编码器句柄
+ *      NULL            失败
+ */
+codec_handle opus_encode_init_slab(audio_param_t audio_param, audio_slab_t *slab);
+/*
+ * pcm编码为opus
+ * @param[in]
+ *      handle          解码器句柄
+ *      input_buf       输入的buff
+ *      input_len       输入的buff长度(字节), 必须是一帧: samplerate / fps * channels * 2
+ *      output_buf_size 输出buff的大小
+ * @param[out]
+ *      output_buf      编码后的buff
+ * @retval
+ *      >0              编码后的长度
+ *      <=0             失败, 见audio_codec_error_e
+ */
+int opus_encode_frame(codec_handle handle, unsigned char *input_buf, unsigned long input_len, unsigned char *output_buf, int output_buf_size);
+/*
+ * 一次编码多帧pcm为opus, 帧参数只检查一次
+ * @param[in]
+ *      handle          编码器句柄
+ *      input_buf       输入的buff, frame_count帧首尾相连
+ *      input_len       输入的buff长度(字节), 必须是frame_count帧
+ *      frame_count     帧数
+ *      output_buf_size 输出buff的大小
+ * @param[out]
+ *      output_buf      编码后的包, 首尾相连
+ *      packet_len      每个包的长度, 至少frame_count个元素
+ * @retval
+ *      >=0             编码后的总长度
+ *      <0              失败
+ */
+int opus_encode_frames(codec_handle handle, unsigned char *input_buf, unsigned long input_len, int frame_count,
+                       unsigned char *output_buf, int output_buf_size, int *packet_len);
+typedef struct
+{
+    unsigned long packets;      // 编码输出的包数
+    unsigned long dtx_packets;  // 其中DTX包(1~2字节)的数量
+    unsigned long long bytes;   // 编码输出的总字节数
+} opus_encode_stats_t;
+/*
+ * 开关opus的DTX(不连续传输), 默认关闭
+ * 打开后静音段只输出1~2字节的包, 可以用opus_packet_is_dtx判断后丢弃
+ * @param[in]
+ *      handle          编码器句柄
+ *      enable          0关, 1开
+ * @retval
+ *      0               成功
+ *      <0              失败
+ */
+int opus_encode_set_dtx(codec_handle handle, int enable);
+/*
+ * 获取编码统计
+ * @param[in]
+ *      handle          编码器句柄
+ * @param[out]
+ *      stats           统计信息
+ * @retval
+ *      0               成功
+ *      <0              失败
+ */
+int opus_encode_get_stats(codec_handle handle, opus_encode_stats_t *stats);
+/*
+ * 判断编码输出的包是否是DTX包
+ * @param[in]
+ *      packet_len      包长度
+ * @retval
+ *      1               是
+ *      0               否
+ */
+int opus_packet_is_dtx(int packet_len);
+/*
+ * 关闭opus解码器
+ * @param[in]
+ *      handle          解码器句柄
+ */
+void opus_encode_deinit(codec_handle handle);
+#endif
+
+#if 1   //  opus解码
+#include "opus/opus_types.h"
+/*
+ * 初始化opus解码器
+ * @param[in]
+ *      audio_param     音频参数
+ * @retval
+ *      codec_handle    解码器句柄
+ *      NULL            失败
+ */
+codec_handle opus_decode_init(audio_param_t audio_param);
+/*
+ * 获取opus解码器句柄需要的内存大小
+ * @param[in]
+ *      audio_param     音频参数
+ * @retval
+ *      >0              字节数
+ *      <=0             失败
+ */
+int opus_decode_get_size(audio_param_t audio_param);
+/*
+ * 在调用者提供的内存上初始化opus解码器, 不申请堆内存
+ * @param[in]
+ *      audio_param     音频参数
+ *      buf             内存, 至少opus_decode_get_size字节, 16字节对齐
+ *      buf_size        内存大小
+ * @retval
+ *      codec_handle    解码器句柄, 地址即buf
+ *      NULL            失败
+ */
+codec_handle opus_decode_init_buf(audio_param_t audio_param, void *buf, int buf_size);
+/*
+ * 从内存池取一个槽初始化opus解码器, opus_decode_deinit时还给内存池
+ * @param[in]
+ *      audio_param     音频参数
+ *      slab            槽大小至少opus_decode_get_size的内存池
+ * @retval
+ *      codec_handle    解码器句柄
+ *      NULL            失败
+ */
+codec_handle opus_decode_init_slab(audio_param_t audio_param, audio_slab_t *slab);
+/*
+ * opus解码为pcm
+ * @param[in]
+ *      handle          解码器句柄
+ *      input_buf       输入的帧信息
+ *      input_len       输入的帧长度
+ *      output_buf_size 解码后buff的大小
+ * @param[out]
+ *      output_buf      解码后的buff
+ * @retval
+ *      >0              解码后的长度
+ *      <=0             失败
+ */
+int opus_decode_frame(codec_handle handle, unsigned char *input_buf, unsigned long input_len, opus_int16 *output_buf, int output_buf_size);
+/*
+ * 一次解码多个opus包为pcm
+ * @param[in]
+ *      handle          解码器句柄
+ *      input_buf       输入的包, 首尾相连
+ *      packet_len      每个包的长度
+ *      frame_count     包的数量
+ *      output_buf_size 解码后buff能放下的每声道采样数, 至少frame_count帧
+ * @param[out]
+ *      output_buf      解码后的buff
+ *      sample_count    每包解出的每声道采样数, 可以为NULL
+ * @retval
+ *      >=0             解出的每声道采样总数
+ *      <0              失败
+ */
+int opus_decode_frames(codec_handle handle, unsigned char *input_buf, int *packet_len, int frame_count,
+                       opus_int16 *output_buf, int output_buf_size, int *sample_count);
+/*
+ * 包丢失(或DTX期间被丢弃)时生成一帧补偿数据
+ * @param[in]
+ *      handle          解码器句柄
+ *      output_buf_size 解码后buff能放下的每声道采样数, 至少一帧
+ * @param[out]
+ *      output_buf      补偿的pcm
+ * @retval
+ *      >0              每声道采样数
+ *      <=0             失败
+ */
+int opus_decode_lost(codec_handle handle, opus_int16 *output_buf, int output_buf_size);
+/*
+ * 关闭opus解码器
+ * @param[in]
+ *      handle          解码器句柄
+ */
+void opus_decode_deinit(codec_handle handle);
+#endif
+
+#if 1   //  opus分段并行编码
+typedef struct
+{
+    unsigned char *data;    // 所有包首尾相连
+    size_t data_len;        // data的总长度
+    int *packet_len;        // 每个包的长度
+    int packet_count;       // 包的数量
+} opus_packets_t;
+/*
+ * 把整段pcm切成threads段, 每段一个编码器并行编码, 结果拼成一条连续的opus流
+ * 每段编码器先用前一段末尾的lookahead加几帧数据预热, 预热的输出丢弃
+ * @param[in]
+ *      audio_param     音频参数
+ *      pcm_buf         输入的pcm
+ *      pcm_len         pcm的字节数, 最后不足一帧的部分补零
+ *      threads         线程数(即分段数)
+ * @param[out]
+ *      packets         编码后的包, 用opus_packets_free释放
+ * @retval
+ *      >=0             包的数量
+ *      <0              失败
+ */
+int opus_encode_parallel(audio_param_t audio_param, unsigned char *pcm_buf, unsigned long pcm_len, int threads, opus_packets_t *packets);
+/*
+ * 解码端连续性检查: 用一个解码器顺序解码全部包, 每包都必须解出恰好一帧
+ * @param[in]
+ *      audio_param     音频参数
+ *      packets         opus_encode_parallel的输出
+ * @retval
+ *      0               检查通过
+ *      >0              不合格的包数量
+ *      <0              失败
+ */
+int opus_packets_check(audio_param_t audio_param, opus_packets_t *packets);
+/*
+ * 释放opus_encode_parallel的输出
+ * @param[in]
+ *      packets         包列表
+ */
+void opus_packets_free(opus_packets_t *packets);
+#endif
+
+#if 1   //  统一的编解码接口
+typedef enum
+{
+    AUDIO_CODEC_ENCODER = 0,
+    AUDIO_CODEC_DECODER
+} audio_codec_mode_e;
+
+typedef struct audio_codec audio_codec_t;
+
+/*
+ * 编解码失败的类型, 失败时返回AUDIO_CODEC_ERR(类型), 取值和opus的错误码一致, opus的返回值可以直接透传
+ */
+typedef enum
+{
+    AUDIO_CODEC_ERROR_FAILED = 0,           // 其他错误, 包括参数错误
+    AUDIO_CODEC_ERROR_BUFFER_TOO_SMALL,     // 输出缓存不够
+    AUDIO_CODEC_ERROR_INTERNAL,             // 编解码库内部错误
+    AUDIO_CODEC_ERROR_INVALID_PACKET,       // 包损坏, 无法解码
+    AUDIO_CODEC_ERROR_MAX
+} audio_codec_error_e;
+
+#define AUDIO_CODEC_ERR(type) (-1 - (int)(type))
+
+/*
+ * 计数器, 每个句柄一份, 每种格式的编码和解码各有一份全局的累计
+ */
+typedef struct
+{
+    unsigned long long frames_in;       // 编码: 输入的pcm帧数; 解码: 输入的包数
+    unsigned long long frames_out;      // 编码: 输出的包数; 解码: 输出的pcm帧数, 包括补偿的
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long concealed;       // 丢包补偿的帧数
+    unsigned long long errors[AUDIO_CODEC_ERROR_MAX];
+} audio_codec_counters_t;
+
+/*
+ * 编解码器的操作表, 每种格式一个, 按aenc_format_e注册
+ * 除init/deinit外, 不支持的操作可以为NULL
+ */
+typedef struct
+{
+    const char *name;
+    aenc_format_e format;
+    //  打开编解码器, 设置codec->handle/frame_size/packet_size_max
+    int (*init)(audio_codec_t *codec);
+    //  编码一帧, pcm_len等于frame_size; 只有最后一帧可以更短, 由编码器决定补零或丢弃. 返回输出长度, 0表示编码器缓存了数据
+    int (*encode)(audio_codec_t *codec, unsigned char *pcm, int pcm_len, unsigned char *out, int out_size);
+    //  可选, 一次编码frame_count个整帧, 输出首尾相连, 每包长度写到packet_len. 返回输出总长度
+    int (*encode_batch)(audio_codec_t *codec, unsigned char *pcm, int frame_count, unsigned char *out, int out_size, int *packet_len);
+    //  解码一包, 返回pcm字节数
+    int (*decode)(audio_codec_t *codec, unsigned char *in, int in_len, unsigned char *pcm, int pcm_size);
+    //  可选, 丢包时生成一帧补偿pcm, 返回pcm字节数
+    int (*conceal)(audio_codec_t *codec, unsigned char *pcm, int pcm_size);
+    //  取出编码器里缓存的数据, 返回输出长度, 0表示已取完
+    int (*flush)(audio_codec_t *codec, unsigned char *out, int out_size);
+    //  清空内部状态, 句柄可以给下一条流复用
+    int (*reset)(audio_codec_t *codec);
+    //  编码: 每帧输入的pcm字节数; 解码: 每包最多解出的pcm字节数
+    int (*get_frame_size)(audio_codec_t *codec);
+    //  编解码引入的延迟, 单位每声道采样数
+    int (*get_delay)(audio_codec_t *codec);
+    void (*deinit)(audio_codec_t *codec);
+} audio_codec_ops_t;
+
+struct audio_codec
+{
+    const audio_codec_ops_t *ops;
+    audio_codec_mode_e mode;
+    audio_param_t audio_param;
+    codec_handle handle;    // 具体编解码器的句柄, g711a/pcm没有
+    int frame_size;         // 见get_frame_size
+    int packet_size_max;    // 编码时每帧输出的最大字节数
+    audio_arena_t *scratch; // 可选, 编解码库每帧的临时内存, 打开时分配, 关闭时释放
+    audio_codec_counters_t counters;    // 用原子操作更新, 其他线程可以随时读
+};
+
+extern const audio_codec_ops_t pcm_codec_ops;
+extern const audio_codec_ops_t aac_codec_ops;
+extern const audio_codec_ops_t g711a_codec_ops;
+extern const audio_codec_ops_t opus_codec_ops;
+
+/*
+ * 注册(或替换)某种格式的操作表
+ * @param[in]
+ *      ops             操作表, ops->format决定注册位置
+ * @retval
+ *      0               成功
+ *      <0              失败
+ */
+int audio_codec_register(const audio_codec_ops_t *ops);
+/*
+ * 按格式查找操作表
+ * @param[in]
+ *      format          格式
+ * @retval
+ *      操作表, 没有注册时返回NULL
+ */
+const audio_codec_ops_t *audio_codec_find(aenc_format_e format);
+/*
+ * 打开编解码器
+ * @param[in]
+ *      format          格式
+ *      mode            编码或解码
+ *      audio_param     pcm端的音频参数
+ * @retval
+ *      audio_codec_t   编解码器
+ *      NULL            失败
+ */
+audio_codec_t *audio_codec_open(aenc_format_e format, audio_codec_mode_e mode, audio_param_t audio_param);
+/*
+ * 编码一帧, 见audio_codec_ops_t.encode
+ * @retval
+ *      >=0             输出长度
+ *      <0              失败, 见audio_codec_error_e
+ */
+int audio_codec_encode(audio_codec_t *codec, unsigned char *pcm, int pcm_len, unsigned char *out, int out_size);
+/*
+ * 一次编码多个整帧, 编码器没有encode_batch时逐帧调用encode
+ * @param[out]
+ *      packet_len      每包长度, 至少frame_count个元素
+ * @retval
+ *      >=0             输出总长度
+ *      <0              失败
+ */
+int audio_codec_encode_batch(audio_codec_t *codec, unsigned char *pcm, int frame_count, unsigned char *out, int out_size, int *packet_len);
+/*
+ * 解码一包
+ * @retval
+ *      >=0             pcm字节数
+ *      <0              失败, 见audio_codec_error_e
+ */
+int audio_codec_decode(audio_codec_t *codec, unsigned char *in, int in_len, unsigned char *pcm, int pcm_size);
+/*
+ * 丢包补偿一帧
+ * @retval
+ *      >0              pcm字节数
+ *      <=0             不支持或失败
+ */
+int audio_codec_conceal(audio_codec_t *codec, unsigned char *pcm, int pcm_size);
+/*
+ * 取出编码器缓存的数据, 需要循环调用直到返回0
+ * @retval
+ *      >0              输出长度
+ *      0               已取完
+ *      <0              失败
+ */
+int audio_codec_flush(audio_codec_t *codec, unsigned char *out, int out_size);
+/*
+ * 重置编解码器, 参数不变, 句柄的计数器清零
+ * @retval
+ *      0               成功
+ *      <0              失败
+ */
+int audio_codec_reset(audio_codec_t *codec);
+/*
+ * 编码: 每帧输入的pcm字节数; 解码: 每包最多解出的pcm字节数
+ */
+int audio_codec_get_frame_size(audio_codec_t *codec);
+/*
+ * 编解码延迟, 单位每声道采样数
+ */
+int audio_codec_get_delay(audio_codec_t *codec);
+/*
+ * 关闭编解码器
+ */
+void audio_codec_close(audio_codec_t *codec);
+/*
+ * 取句柄的计数器
+ * @param[in]
+ *      codec           编解码器
+ * @param[out]
+ *      counters        计数器
+ * @retval
+ *      0               成功
+ *      <0              参数错误
+ */
+int audio_codec_get_counters(audio_codec_t *codec, audio_codec_counters_t *counters);
+/*
+ * 取全局计数器, 所有句柄的累计, 句柄重置或关闭后不清零
+ * @param[in]
+ *      format          格式
+ *      mode            编码或解码
+ * @param[out]
+ *      counters        计数器
+ * @retval
+ *      0               成功
+ *      <0              参数错误
+ */
+int audio_codec_get_global_counters(aenc_format_e format, audio_codec_mode_e mode, audio_codec_counters_t *counters);
+/*
+ * 输出有过调用的全局计数器
+ * @param[in]
+ *      fp              输出文件
+ *      json            0: 每行一个计数器 "opus.decode.frames_in 100"; 1: json
+ */
+void audio_codec_dump_counters(FILE *fp, int json);
+const char *audio_codec_error_name(audio_codec_error_e error);
+#endif
+
+#if 1   //  守护进程
+/*
+ * 协议: 每条消息8字节头(类型1字节, 保留3字节, 负载长度4字节大端) + 负载, 负载最多AUDIO_DAEMON_PAYLOAD_MAX.
+ * 一个连接上可以先后进行多个会话: OPEN, 若干DATA, END; 服务端对每个END回完剩下的DATA后回END.
+ * 会话出错时服务端回ERROR并结束会话, 连接保留
+ */
+#define AUDIO_DAEMON_HEADER_SIZE 8
+#define AUDIO_DAEMON_OPEN_SIZE 12
+#define AUDIO_DAEMON_PAYLOAD_MAX (64 * 1024)
+
+typedef enum
+{
+    AUDIO_DAEMON_MSG_OPEN = 1,      // 客户端: 源格式1字节, 目标格式1字节, 声道数1字节, 位数1字节, 采样率4字节, fps2字节, 保留2字节
+    AUDIO_DAEMON_MSG_DATA,          // 客户端: 源数据, aac一个ADTS帧, opus一包, pcm/g711a任意整帧; 服务端: 目标格式的一包
+    AUDIO_DAEMON_MSG_END,           // 客户端: 源数据结束; 服务端: 会话的输出结束
+    AUDIO_DAEMON_MSG_ERROR          // 服务端: 负载是错误信息
+} audio_daemon_msg_e;
+
+/*
+ * 生成消息头
+ * @param[in]
+ *      type            消息类型
+ *      len             负载长度
+ * @param[out]
+ *      buf             AUDIO_DAEMON_HEADER_SIZE字节
+ */
+void audio_daemon_header(unsigned char *buf, audio_daemon_msg_e type, int len);
+/*
+ * 生成OPEN的负载
+ * @param[in]
+ *      audio_param     源参数, format为源格式, bit_depth只支持16
+ *      to_format       目标格式
+ * @param[out]
+ *      buf             AUDIO_DAEMON_OPEN_SIZE字节
+ * @retval
+ *      负载长度
+ */
+int audio_daemon_open_payload(unsigned char *buf, audio_param_t audio_param, aenc_format_e to_format);
+/*
+ * 在unix socket上提供转码服务, 单线程epoll, 编解码器句柄用完放回池里给下一个参数相同的会话复用.
+ * 调用audio_daemon_stop(可以在信号处理函数里)后返回
+ * @param[in]
+ *      socket_path     socket路径, 已存在时先删除
+ *      max_conns       最多同时连接数
+ * @retval
+ *      0               正常停止
+ *      <0              失败
+ */
+int audio_daemon_run(const char *socket_path, int max_conns);
+/*
+ * 让audio_daemon_run返回, 可以在信号处理函数里调用
+ */
+void audio_daemon_stop(void);
+#endif
+
+#if 1   //  RTP
+/*
+ * RTP负载格式, 不分配内存, 状态都在调用者的audio_rtp_t里.
+ * 打包不拷贝负载: 头写进audio_rtp_packet_t, 负载用iovec指向调用者的帧, 直接sendmsg/sendmmsg;
+ * 解包给出指向收包缓存的帧视图, 只有被分片的帧要在frag里拼起来
+ */
+#define AUDIO_RTP_HEADER_SIZE 12
+#define AUDIO_RTP_HEADER_MAX 64         // RTP头 + 负载头(AU头, LATM长度)
+#define AUDIO_RTP_MTU_DEFAULT 1400      // 默认的RTP包最大字节数, 不含IP/UDP头
+#define AUDIO_RTP_FRAG_MAX 8192         // 拼分片的缓存, 够aac 8声道最大的帧
+#define AUDIO_RTP_SDP_MAX 512
+
+typedef enum
+{
+    AUDIO_RTP_PCMA = 0,             // RFC 3551, 8k单声道时静态PT 8
+    AUDIO_RTP_OPUS,                 // RFC 7587, 一包一个opus包, 时钟固定48000
+    AUDIO_RTP_AAC_HBR,              // RFC 3640 mpeg4-generic AAC-hbr, 每个AU一个16位AU头(13位长度, 3位序号)
+    AUDIO_RTP_AAC_LATM,             // RFC 6416 MP4A-LATM, cpresent=0, 配置在SDP里
+    AUDIO_RTP_PAYLOAD_MAX
+} audio_rtp_payload_e;
+
+typedef struct
+{
+    audio_rtp_payload_e payload;
+    int payload_type;               // 7位PT
+    int clock_rate;
+    int samplerate;                 // 编解码器的采样率, 打包时采样数按它换算成时钟
+    int channels;
+    int mtu;
+    unsigned int ssrc;
+    //  发送
+    unsigned short seq;             // 下一包的序号
+    unsigned int timestamp_base;
+    unsigned long long samples;     // 已发送的每声道采样数, 时间戳按它算, 没有累计误差
+    int talkspurt;                  // 下一包是一段话的开始, 置marker
+    //  接收
+    int started;
+    unsigned short expect_seq;
+    unsigned int frag_timestamp;
+    int frag_len;                   // frag里已拼的字节数, -1为丢了前面的分片, 等下一帧
+    int frag_size;                  // aac-hbr: AU头里的整帧长度
+    unsigned long long received;
+    unsigned long long lost;        // 按序号缺的包
+    unsigned long long dropped;     // 格式错误或PT/SSRC不对的包
+    unsigned char frag[AUDIO_RTP_FRAG_MAX];
+} audio_rtp_t;
+
+typedef struct
+{
+    unsigned char header[AUDIO_RTP_HEADER_MAX];
+    struct iovec iov[2];            // 头和负载, iov[1]指向调用者的帧, 发送前帧不能释放
+    int iov_count;
+    int len;                        // 整包字节数
+} audio_rtp_packet_t;
+
+typedef struct
+{
+    const unsigned char *data;      // 指向收到的包或rtp->frag, 下一次解包前有效
+    int len;
+    unsigned int timestamp;
+    int marker;
+} audio_rtp_frame_t;
+
+/*
+ * 初始化发送或接收的状态
+ * @param[in]
+ *      rtp             状态
+ *      payload         负载格式
+ *      payload_type    PT, <0时用默认值: 8k单声道PCMA为8, 其他为96
+ *      audio_param     编解码器参数, pcma只支持8位A-law
+ *      ssrc            发送时的SSRC; 接收时为0表示用第一包的
+ *      mtu             RTP包最大字节数, <=0时用AUDIO_RTP_MTU_DEFAULT
+ * @retval
+ *      0               成功
+ *      <0              参数错误
+ */
+int audio_rtp_init(audio_rtp_t *rtp, audio_rtp_payload_e payload, int payload_type, audio_param_t audio_param,
+                   unsigned int ssrc, int mtu);
+/*
+ * 把一帧打成一个或多个RTP包. aac带ADTS头时跳过头只发AU, 超过mtu时按RFC 3640/6416分片;
+ * pcma按整采样切成多包; opus不能分片, 超过mtu返回错误
+ * @param[in]
+ *      rtp             状态
+ *      frame           编码器输出的一帧
+ *      len             帧长
+ *      samples         帧的每声道采样数, 按编解码器的采样率
+ *      max             packets的个数
+ * @param[out]
+ *      packets         包, 负载指向frame
+ * @retval
+ *      >=0             包数
+ *      <0              失败
+ */
+int audio_rtp_packetize(audio_rtp_t *rtp, const unsigned char *frame, int len, int samples, audio_rtp_packet_t *packets, int max);
+/*
+ * 跳过samples个采样不发送(DTX, 静音), 下一包的时间戳跟着跳, 并置marker表示一段话的开始
+ */
+void audio_rtp_skip(audio_rtp_t *rtp, int samples);
+/*
+ * 解一个RTP包, 给出里面完整的帧. aac-hbr一包可以有多个AU, LATM一包可以有多个audioMuxElement.
+ * 分片在rtp->frag里拼, 拼完的那一包才给出帧; 丢了分片时整帧丢掉
+ * @param[in]
+ *      rtp             状态
+ *      packet          收到的包, 帧视图指向这里, 解下一包之前不能改
+ *      len             包长
+ *      max             frames的个数
+ * @param[out]
+ *      frames          帧视图
+ * @retval
+ *      >=0             帧数, 分片没拼完时为0
+ *      <0              包格式错误或者不是这个流的包
+ */
+int audio_rtp_depacketize(audio_rtp_t *rtp, const unsigned char *packet, int len, audio_rtp_frame_t *frames, int max);
+/*
+ * 生成SDP的m=audio段, aac带上AudioSpecificConfig/StreamMuxConfig
+ * @retval
+ *      >0              长度
+ *      <0              缓存不够
+ */
+int audio_rtp_sdp(audio_rtp_t *rtp, int port, char *buf, int size);
+const char *audio_rtp_payload_name(audio_rtp_payload_e payload);
+#endif
+
+#if 1   //  流水线
+typedef struct
+{
+    int slots;
+    int slot_size;
+    unsigned long long pushed;          // 放入的槽数
+    unsigned long long full_waits;      // 生产者因为环满而睡眠的次数(反压)
+    double full_wait_seconds;
+    unsigned long long empty_waits;     // 消费者因为环空而睡眠的次数
+    double empty_wait_seconds;
+    int occupancy_max;                  // 放入后的最大占用槽数
+    double occupancy_avg;               // 放入后的平均占用槽数
+} audio_ring_stats_t;
+
+typedef struct
+{
+    const char *name;
+    double seconds;                     // 线程的总耗时
+    double wait_in_seconds;             // 等上游的时间
+    double wait_out_seconds;            // 被下游反压的时间
+    audio_ring_stats_t out;             // 输出环, 最后一级没有
+} audio_stage_stats_t;
+
+/*
+ * 流水线的一级, 在自己的线程里运行
+ * @param[in]
+ *      arg             audio_pipeline_add_stage传入的参数
+ *      in              上一级的输出环, 第一级为NULL
+ *      out             输出环, 最后一级为NULL; 返回0后由流水线关闭
+ * @retval
+ *      0               成功
+ *      其他            失败, 流水线叫停所有环
+ */
+typedef int (*audio_stage_func)(void *arg, audio_ring_t *in, audio_ring_t *out);
+
+/*
+ * 创建单生产者单消费者的无锁环, 槽在创建时分配好, 收发时不拷贝也不分配
+ * @param[in]
+ *      slots           槽数, 向上取2的幂
+ *      slot_size       每个槽的字节数, 槽按缓存行对齐
+ * @retval
+ *      audio_ring_t    环
+ *      NULL            失败
+ */
+audio_ring_t *audio_ring_create(int slots, int slot_size);
+/*
+ * 获取每个槽的字节数
+ * @param[in]
+ *      ring            环
+ */
+int audio_ring_slot_size(audio_ring_t *ring);
+/*
+ * 生产者: 取下一个空槽, 环满时阻塞(反压)
+ * @param[in]
+ *      ring            环
+ * @retval
+ *      非NULL          槽, 写好后audio_ring_commit
+ *      NULL            环已叫停
+ */
+unsigned char *audio_ring_acquire(audio_ring_t *ring);
+/*
+ * 生产者: 提交audio_ring_acquire取到的槽
+ * @param[in]
+ *      ring            环
+ *      len             槽里数据的长度
+ *      tag             随槽传递的值, 例如时间戳
+ */
+void audio_ring_commit(audio_ring_t *ring, int len, unsigned int tag);
+/*
+ * 消费者: 取最早的槽, 环空时阻塞
+ * @param[in]
+ *      ring            环
+ * @param[out]
+ *      data            槽里的数据, audio_ring_release之前有效
+ *      tag             提交时的tag, 可以为NULL
+ * @retval
+ *      >=0             数据长度
+ *      -1              环已关闭且取完
+ *      -2              环已叫停
+ */
+int audio_ring_peek(audio_ring_t *ring, unsigned char **data, unsigned int *tag);
+/*
+ * 消费者: 归还audio_ring_peek取到的槽
+ * @param[in]
+ *      ring            环
+ */
+void audio_ring_release(audio_ring_t *ring);
+/*
+ * 生产者: 不再放入, 消费者取完后audio_ring_peek返回-1
+ * @param[in]
+ *      ring            环
+ */
+void audio_ring_close(audio_ring_t *ring);
+/*
+ * 叫停, 两端阻塞的调用都立即返回
+ * @param[in]
+ *      ring            环
+ */
+void audio_ring_abort(audio_ring_t *ring);
+/*
+ * 获取统计, 两端线程结束后读取才准确
+ * @param[in]
+ *      ring            环
+ * @param[out]
+ *      stats           统计
+ */
+void audio_ring_get_stats(audio_ring_t *ring, audio_ring_stats_t *stats);
+/*
+ * 销毁环
+ * @param[in]
+ *      ring            环
+ */
+void audio_ring_destroy(audio_ring_t *ring);
+
+/*
+ * 创建空的流水线, 每一级一个线程, 相邻两级之间一个环
+ * @retval
+ *      audio_pipeline_t    流水线
+ *      NULL                失败
+ */
+audio_pipeline_t *audio_pipeline_create(void);
+/*
+ * 在末尾加一级
+ * @param[in]
+ *      pipeline        流水线
+ *      name            名字, 用于统计
+ *      func            这一级的处理函数
+ *      arg             func的参数
+ *      out_slots       输出环的槽数, 最后一级为0
+ *      out_slot_size   输出环每个槽的字节数
+ * @retval
+ *      0               成功
+ *      <0              失败
+ */
+int audio_pipeline_add_stage(audio_pipeline_t *pipeline, const char *name, audio_stage_func func, void *arg,
+                             int out_slots, int out_slot_size);
+/*
+ * 启动所有级并等待结束
+ * @param[in]
+ *      pipeline        流水线
+ * @retval
+ *      0               所有级都成功
+ *      其他            最先失败的级的返回值
+ */
+int audio_pipeline_run(audio_pipeline_t *pipeline);
+/*
+ * 获取每一级的统计, audio_pipeline_run返回后调用
+ * @param[in]
+ *      pipeline        流水线
+ *      count           stats的个数
+ * @param[out]
+ *      stats           每级的统计
+ * @retval
+ *      >=0             级数
+ */
+int audio_pipeline_get_stats(audio_pipeline_t *pipeline, audio_stage_stats_t *stats, int count);
+/*
+ * 销毁流水线和其中的环
+ * @param[in]
+ *      pipeline        流水线
+ */
+void audio_pipeline_destroy(audio_pipeline_t *pipeline);
+#endif
+
+#if 1   //  延迟统计
+/*
+ * 按编解码器和阶段统计每帧耗时, 直方图是对数线性分桶(每个2的幂分32档, 误差约3%), 无锁, 多线程可以同时记录.
+ * 关闭时(默认)每个埋点只多读一次audio_trace_enabled
+ */
+typedef enum
+{
+    AUDIO_TRACE_ENCODE = 0,     // audio_codec_encode/encode_batch, 按帧
+    AUDIO_TRACE_DECODE,         // audio_codec_decode/conceal, 按包
+    AUDIO_TRACE_PARSE,          // 从输入里切出一包
+    AUDIO_TRACE_WRITE,          // 写出一次
+    AUDIO_TRACE_STAGE_MAX
+} audio_trace_stage_e;
+
+typedef struct
+{
+    unsigned long long count;
+    unsigned long long min_ns;
+    unsigned long long max_ns;
+    double mean_ns;
+    unsigned long long p50_ns;  // 分位数取所在桶的上界
+    unsigned long long p90_ns;
+    unsigned long long p99_ns;
+    unsigned long long p999_ns;
+} audio_trace_summary_t;
+
+extern int audio_trace_enabled;
+
+/*
+ * 打开或关闭统计, 不清空已有数据
+ */
+void audio_trace_enable(int enable);
+/*
+ * 单调时钟, 纳秒
+ */
+unsigned long long audio_trace_now(void);
+/*
+ * 埋点用这两个宏, 关闭时不取时间也不调用函数:
+ *      start = AUDIO_TRACE_START();
+ *      ...
+ *      AUDIO_TRACE_STOP(AUDIO_TRACE_ENCODE, format, start, 1);
+ */
+#define AUDIO_TRACE_START() (audio_trace_enabled ? audio_trace_now() : 0)
+#define AUDIO_TRACE_STOP(stage, format, start, count)          \
+    do                                                         \
+    {                                                          \
+        if ((start) != 0)                                      \
+        {                                                      \
+            audio_trace_stop((stage), (format), (start), (count)); \
+        }                                                      \
+    } while (0)
+/*
+ * 结束计时并记录, start为0(开始时统计是关闭的)时不记录
+ * @param[in]
+ *      stage           阶段
+ *      format          编解码器或流的格式
+ *      start           AUDIO_TRACE_START的返回值
+ *      count           这段时间处理的帧数, 按平均值记count次
+ */
+void audio_trace_stop(audio_trace_stage_e stage, aenc_format_e format, unsigned long long start, int count);
+/*
+ * 直接记录一个耗时
+ * @param[in]
+ *      stage           阶段
+ *      format          格式
+ *      ns              耗时
+ *      count           次数
+ */
+void audio_trace_record(audio_trace_stage_e stage, aenc_format_e format, unsigned long long ns, int count);
+/*
+ * 取一个直方图的汇总, 记录同时进行时结果是近似的
+ * @param[in]
+ *      stage           阶段
+ *      format          格式
+ * @param[out]
+ *      summary         汇总
+ * @retval
+ *      0               成功
+ *      <0              参数错误
+ */
+int audio_trace_get(audio_trace_stage_e stage, aenc_format_e format, audio_trace_summary_t *summary);
+/*
+ * 输出所有非空的直方图
+ * @param[in]
+ *      fp              输出文件
+ *      json            0: 文本表格; 1: json
+ */
+void audio_trace_dump(FILE *fp, int json);
+/*
+ * 清空所有直方图
+ */
+void audio_trace_reset(void);
+const char *audio_trace_stage_name(audio_trace_stage_e stage);
 #endif
 
 #ifdef __cplusplus
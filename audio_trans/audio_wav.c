@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_trans.h"
+
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_FLOAT 0x0003
+#define WAV_FORMAT_ALAW 0x0006
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+#define WAV_SIZE_UNKNOWN 0xFFFFFFFFu    // 流式写入时没有回填的长度; RF64里表示看ds64
+#define WAV_DS64_SIZE 28                // riff长度8 + data长度8 + 采样数8 + 表长度4
+#define WAV_FMT_EXTENSIBLE_SIZE 40
+#define WAV_HEADER_MAX (16 * 1024 * 1024) // data块之前的内容最多这么长
+
+//  KSDATAFORMAT_SUBTYPE_xxx除了前2字节的格式号以外都相同
+static const unsigned char wav_guid_tail[14] = {
+    0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+//  声道数对应的默认声道位置, 5.1按L R C LFE Ls Rs
+static const unsigned int wav_channel_masks[AUDIO_CHANNELS_MAX + 1] = {
+    0, 0x4, 0x3, 0x7, 0x33, 0x37, 0x3F, 0x13F, 0x63F};
+
+static unsigned int wav_le16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int wav_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static long long wav_le64(const unsigned char *p)
+{
+    return (long long)((unsigned long long)wav_le32(p) | ((unsigned long long)wav_le32(p + 4) << 32));
+}
+
+static unsigned char *wav_put16(unsigned char *p, unsigned int v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    return p + 2;
+}
+
+static unsigned char *wav_put32(unsigned char *p, unsigned int v)
+{
+    p = wav_put16(p, v & 0xFFFF);
+    return wav_put16(p, v >> 16);
+}
+
+static unsigned char *wav_put64(unsigned char *p, unsigned long long v)
+{
+    p = wav_put32(p, (unsigned int)v);
+    return wav_put32(p, (unsigned int)(v >> 32));
+}
+
+static unsigned char *wav_put_id(unsigned char *p, const char *id)
+{
+    memcpy(p, id, 4);
+    return p + 4;
+}
+
+/*
+ * fmt块的格式号和位数转成编码格式和采样格式.
+ * 32位容器里的24位有效位是高位对齐的, 按s32处理
+ */
+static int wav_fmt_to_param(unsigned int tag, int bits, audio_wav_info_t *info)
+{
+    info->audio_param.format = AENC_FORMAT_PCM;
+    if (tag == WAV_FORMAT_ALAW && bits == 8)
+    {
+        info->audio_param.format = AENC_FORMAT_G711A;
+        info->sample_format = AUDIO_SAMPLE_S16;
+        return 0;
+    }
+    if (tag == WAV_FORMAT_FLOAT && bits == 32)
+    {
+        info->sample_format = AUDIO_SAMPLE_F32;
+        return 0;
+    }
+    if (tag != WAV_FORMAT_PCM)
+    {
+        return -1;
+    }
+    switch (bits)
+    {
+    case 16:
+        info->sample_format = AUDIO_SAMPLE_S16;
+        return 0;
+    case 24:
+        info->sample_format = AUDIO_SAMPLE_S24;
+        return 0;
+    case 32:
+        info->sample_format = AUDIO_SAMPLE_S32;
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+static int wav_parse_fmt(const unsigned char *p, unsigned int size, audio_wav_info_t *info)
+{
+    unsigned int tag = 0;
+    int bits = 0;
+    int block_align = 0;
+
+    if (size < 16)
+    {
+        return -1;
+    }
+    tag = wav_le16(p);
+    info->audio_param.channels = wav_le16(p + 2);
+    info->audio_param.samplerate = wav_le32(p + 4);
+    block_align = wav_le16(p + 12);
+    bits = wav_le16(p + 14);
+    if (tag == WAV_FORMAT_EXTENSIBLE)
+    {
+        if (size < WAV_FMT_EXTENSIBLE_SIZE || memcmp(p + 26, wav_guid_tail, sizeof(wav_guid_tail)) != 0)
+        {
+            return -1;
+        }
+        info->channel_mask = wav_le32(p + 20);
+        tag = wav_le16(p + 24);
+    }
+
+    if (info->audio_param.channels <= 0 || info->audio_param.channels > AUDIO_CHANNELS_MAX ||
+        info->audio_param.samplerate <= 0 || block_align != info->audio_param.channels * bits / 8 ||
+        wav_fmt_to_param(tag, bits, info) != 0)
+    {
+        fprintf(stderr, "[%s] unsupported wav: format=0x%x, channels=%d, samplerate=%d, bits=%d\n",
+                __func__, tag, info->audio_param.channels, info->audio_param.samplerate, bits);
+        return -1;
+    }
+    info->audio_param.bit_depth = bits;
+    info->block_align = block_align;
+
+    return 0;
+}
+
+#if 1   //  wav封装
+int audio_wav_parse_next(audio_wav_parser_t *parser, const unsigned char *buf, size_t len, size_t *consumed, audio_wav_info_t *info)
+{
+    size_t pos = 0;
+    size_t n = 0;
+    unsigned int size = 0;
+
+    if (parser == NULL || (buf == NULL && len > 0) || consumed == NULL || info == NULL)
+    {
+        return -1;
+    }
+    *consumed = 0;
+    if (parser->offset == 0)
+    {
+        if (len < 12)
+        {
+            return 12;
+        }
+        parser->rf64 = memcmp(buf, "RF64", 4) == 0 || memcmp(buf, "BW64", 4) == 0;
+        if ((memcmp(buf, "RIFF", 4) != 0 && !parser->rf64) || memcmp(buf + 8, "WAVE", 4) != 0)
+        {
+            return -1;
+        }
+        memset(info, 0, sizeof(audio_wav_info_t));
+        parser->ds64_data_size = -1;
+        parser->offset = 12;
+        pos = 12;
+    }
+
+    //  块按顺序排列, RF64的ds64必须在最前面; fmt和data之间可能有LIST等其他块
+    while (1)
+    {
+        //  不解析的块(LIST, bext, JUNK等)边读边跳过, 不用整块放进视图
+        if (parser->skip > 0)
+        {
+            n = len - pos < (size_t)parser->skip ? len - pos : (size_t)parser->skip;
+            pos += n;
+            parser->offset += n;
+            parser->skip -= n;
+            if (parser->skip > 0)
+            {
+                *consumed = pos;
+                return 1;
+            }
+        }
+        if (parser->offset + 8 > WAV_HEADER_MAX)
+        {
+            fprintf(stderr, "[%s] no data chunk in the first %d bytes\n", __func__, WAV_HEADER_MAX);
+            return -1;
+        }
+        if (pos + 8 > len)
+        {
+            *consumed = pos;
+            return 8;
+        }
+        size = wav_le32(buf + pos + 4);
+
+        if (memcmp(buf + pos, "data", 4) == 0)
+        {
+            if (!parser->have_fmt)
+            {
+                fprintf(stderr, "[%s] wav data before fmt\n", __func__);
+                return -1;
+            }
+            info->data_offset = parser->offset + 8;
+            info->data_size = size == WAV_SIZE_UNKNOWN ? (parser->rf64 ? parser->ds64_data_size : -1) : (long long)size;
+            *consumed = pos + 8;
+            parser->offset += 8;
+            return 0;
+        }
+        //  只有fmt和ds64要整块在视图里
+        if (memcmp(buf + pos, "fmt ", 4) == 0 || memcmp(buf + pos, "ds64", 4) == 0)
+        {
+            if (size > WAV_HEADER_MAX)
+            {
+                return -1;
+            }
+            if (pos + 8 + size > len)
+            {
+                *consumed = pos;
+                return (int)(8 + size);
+            }
+            if (buf[pos] == 'f')
+            {
+                if (wav_parse_fmt(buf + pos + 8, size, info) != 0)
+                {
+                    return -1;
+                }
+                parser->have_fmt = 1;
+            }
+            else if (size >= 16)
+            {
+                parser->ds64_data_size = wav_le64(buf + pos + 16);
+            }
+            pos += 8 + size;
+            parser->offset += 8 + size;
+            parser->skip = size & 1;
+            continue;
+        }
+        //  块长是奇数时后面有一个填充字节
+        parser->skip = 8 + (long long)size + (size & 1);
+        if (parser->offset + parser->skip + 8 > WAV_HEADER_MAX)
+        {
+            fprintf(stderr, "[%s] no data chunk in the first %d bytes\n", __func__, WAV_HEADER_MAX);
+            return -1;
+        }
+    }
+}
+
+int audio_wav_parse(const unsigned char *buf, size_t len, audio_wav_info_t *info)
+{
+    int ret = 0;
+    size_t consumed = 0;
+    audio_wav_parser_t parser;
+
+    if (buf == NULL || info == NULL)
+    {
+        return -1;
+    }
+    //  整个头都在buf里, 一次就能解析完; 不够时换算成从文件开头算的长度
+    memset(&parser, 0, sizeof(audio_wav_parser_t));
+    ret = audio_wav_parse_next(&parser, buf, len, &consumed, info);
+    if (ret > 0)
+    {
+        ret = (int)(parser.offset + parser.skip + (parser.skip > 0 ? 8 : ret));
+    }
+    return ret;
+}
+
+int audio_wav_header(unsigned char *buf, int size, audio_param_t audio_param, audio_sample_format_e sample_format, long long data_size)
+{
+    int bits = 0;
+    int tag = WAV_FORMAT_PCM;
+    int fmt_size = 16;
+    int header_size = 0;
+    int block_align = 0;
+    int rf64 = 0;
+    unsigned long long riff_size = 0;
+    unsigned char *p = buf;
+
+    if (audio_param.format == AENC_FORMAT_G711A)
+    {
+        tag = WAV_FORMAT_ALAW;
+        bits = 8;
+    }
+    else if (audio_param.format == AENC_FORMAT_PCM && sample_format != AUDIO_SAMPLE_S24_32 && audio_sample_size(sample_format) > 0)
+    {
+        tag = sample_format == AUDIO_SAMPLE_F32 ? WAV_FORMAT_FLOAT : WAV_FORMAT_PCM;
+        bits = audio_sample_size(sample_format) * 8;
+    }
+    if (buf == NULL || bits == 0 || audio_param.channels <= 0 || audio_param.channels > AUDIO_CHANNELS_MAX || audio_param.samplerate <= 0)
+    {
+        fprintf(stderr, "[%s] format=%d, sample_format=%d, channels=%d, err param\n",
+                __func__, audio_param.format, sample_format, audio_param.channels);
+        return -1;
+    }
+
+    //  多声道和高位深按规范用EXTENSIBLE, 其余用最简单的fmt兼容老软件
+    if (audio_param.channels > 2 || (tag == WAV_FORMAT_PCM && bits > 16))
+    {
+        fmt_size = WAV_FMT_EXTENSIBLE_SIZE;
+    }
+    else if (tag != WAV_FORMAT_PCM)
+    {
+        fmt_size = 18;
+    }
+    //  头的长度只和格式有关, 写完数据后可以原地回填
+    header_size = 12 + 8 + WAV_DS64_SIZE + 8 + fmt_size + 8;
+    if (size < header_size)
+    {
+        return -1;
+    }
+    block_align = audio_param.channels * bits / 8;
+
+    riff_size = data_size < 0 ? WAV_SIZE_UNKNOWN : header_size - 8 + (unsigned long long)data_size + (data_size & 1);
+    rf64 = data_size >= 0 && riff_size >= WAV_SIZE_UNKNOWN;
+
+    memset(buf, 0, header_size);
+    p = wav_put_id(p, rf64 ? "RF64" : "RIFF");
+    p = wav_put32(p, rf64 ? WAV_SIZE_UNKNOWN : (unsigned int)riff_size);
+    p = wav_put_id(p, "WAVE");
+
+    //  4GB以内用JUNK占住ds64的位置, 超过时改写成RF64
+    p = wav_put_id(p, rf64 ? "ds64" : "JUNK");
+    p = wav_put32(p, WAV_DS64_SIZE);
+    if (rf64)
+    {
+        wav_put64(p, riff_size);
+        wav_put64(p + 8, data_size);
+        wav_put64(p + 16, data_size / block_align);
+    }
+    p += WAV_DS64_SIZE;
+
+    p = wav_put_id(p, "fmt ");
+    p = wav_put32(p, fmt_size);
+    p = wav_put16(p, fmt_size == WAV_FMT_EXTENSIBLE_SIZE ? WAV_FORMAT_EXTENSIBLE : tag);
+    p = wav_put16(p, audio_param.channels);
+    p = wav_put32(p, audio_param.samplerate);
+    p = wav_put32(p, audio_param.samplerate * block_align);
+    p = wav_put16(p, block_align);
+    p = wav_put16(p, bits);
+    if (fmt_size > 16)
+    {
+        p = wav_put16(p, fmt_size - 18);
+    }
+    if (fmt_size == WAV_FMT_EXTENSIBLE_SIZE)
+    {
+        p = wav_put16(p, bits);
+        p = wav_put32(p, wav_channel_masks[audio_param.channels]);
+        p = wav_put16(p, tag);
+        memcpy(p, wav_guid_tail, sizeof(wav_guid_tail));
+        p += sizeof(wav_guid_tail);
+    }
+
+    p = wav_put_id(p, "data");
+    wav_put32(p, (data_size < 0 || rf64) ? WAV_SIZE_UNKNOWN : (unsigned int)data_size);
+
+    return header_size;
+}
+#endif
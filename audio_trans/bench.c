@@ -0,0 +1,1172 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <sys/resource.h>
+
+#include "audio_trans.h"
+#include "audio_alloc.h"
+
+#define BENCH_LIST_MAX 16           // 每个列表参数最多的个数
+#define BENCH_CLIPS_MAX 64
+#define BENCH_SECONDS 10            // 合成信号的默认时长
+#define BENCH_CLIP_RATE 16000       // 裸pcm片段按audio_trans的默认参数: 16k单声道s16
+#define BENCH_CLIP_DIR "../audio_test"
+#define BENCH_PATH_MAX 512
+#define BENCH_BASELINE_MAX 4096     // 对比结果最多的用例数
+#define BENCH_MIX_OFFSET 997        // 混音的第i路输入从合成信号的i*997个采样处开始, 各路不相关
+#define BENCH_MIX_DROP 7            // 混音的每路每7帧有一帧为NULL(丢包, DTX)
+#define BENCH_MIX_MUTE 4            // 混音的每4路有1路静音(不说话的听众)
+
+typedef struct
+{
+    char name[BENCH_PATH_MAX];      // 合成信号名或片段文件名
+    int samplerate;
+    int channels;
+    short *pcm;
+    long frames;                    // 每声道的采样数
+} bench_source_t;
+
+typedef struct
+{
+    const char *codec;
+    const char *direction;
+    const char *source;
+    int samplerate;
+    int channels;
+    int fps;
+    int frame_samples;
+    long frames;
+    double audio_seconds;
+    double seconds;
+    double xrt;
+    double ns_per_frame;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+    double allocs_per_frame;
+    long long bytes;                // 编码: 输出字节数; 解码: 输出pcm字节数
+    long peak_rss_kb;
+    double speedup;                 // 和--baseline里同一用例的ns/frame之比, 0为没有对比
+} bench_result_t;
+
+typedef struct
+{
+    char key[BENCH_PATH_MAX];       // codec/direction/source/samplerate/channels/fps
+    double ns_per_frame;
+} bench_baseline_t;
+
+typedef struct
+{
+    int inputs;
+    int speakers_max;
+    audio_mix_clip_e clip;
+    int samplerate;
+    int fps;
+    int frame_samples;
+    long frames;
+    double ns_per_frame;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+    double allocs_per_frame;
+    int verified;                   // 饱和模式: 1为mix和minus都和标量求和一致, 0为不一致; 软削波不对比, 为-1
+} bench_mix_result_t;
+
+static int bench_rates[BENCH_LIST_MAX] = {8000, 16000, 48000};
+static int bench_rate_count = 3;
+static int bench_channels[BENCH_LIST_MAX] = {1, 2};
+static int bench_channel_count = 2;
+static int bench_fps[BENCH_LIST_MAX] = {50};
+static int bench_fps_count = 1;
+static int bench_codecs[BENCH_LIST_MAX];
+static int bench_codec_count = 0;
+static int bench_mix_inputs[BENCH_LIST_MAX] = {3, 10, 50};
+static int bench_mix_input_count = 3;
+static int bench_mix_speakers[BENCH_LIST_MAX] = {0, 3};
+static int bench_mix_speaker_count = 2;
+static int bench_seconds = BENCH_SECONDS;
+static const char *bench_signals = "tone,noise";
+static const char *bench_clip_dir = BENCH_CLIP_DIR;
+static bench_baseline_t *bench_baselines = NULL;
+static int bench_baseline_count = 0;
+//  每个编解码器编码/解码的加速比, 取对数求和, 最后按几何平均报告
+static double bench_speedup_log[AENC_FORMAT_MAX][2];
+static int bench_speedup_count[AENC_FORMAT_MAX][2];
+
+#if 1   //  分配计数
+//  make bench ALLOC_GUARD=1时audio_alloc.c替换了malloc系列, 按线程计数, 共享库里的编解码器也算在内; bench是单线程.
+//  默认编译不计数, 结果里allocs_per_frame为-1
+#if defined(AUDIO_ALLOC_GUARD) && defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCS 1
+#else
+#define BENCH_COUNT_ALLOCS 0
+#endif
+#endif
+
+static unsigned long long bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long bench_peak_rss_kb(void)
+{
+    struct rusage usage;
+
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+}
+
+static int bench_cmp_ns(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * 按每帧耗时算分位数, 会打乱ns的顺序
+ */
+static void bench_latency(unsigned long long *ns, long count, bench_result_t *result)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    qsort(ns, count, sizeof(unsigned long long), bench_cmp_ns);
+    result->p50_ns = ns[count / 2];
+    result->p99_ns = ns[(count * 99) / 100 < count ? (count * 99) / 100 : count - 1];
+    result->max_ns = ns[count - 1];
+}
+
+static int bench_parse_list(const char *arg, int *list, int min)
+{
+    int count = 0;
+    char *end = NULL;
+
+    while (*arg != '\0' && count < BENCH_LIST_MAX)
+    {
+        list[count] = strtol(arg, &end, 10);
+        if (end == arg || list[count] < min)
+        {
+            return -1;
+        }
+        count++;
+        arg = *end == ',' ? end + 1 : end;
+    }
+
+    return count;
+}
+
+static int bench_parse_codecs(const char *arg)
+{
+    int format = 0;
+    char name[32];
+    const audio_codec_ops_t *ops = NULL;
+
+    bench_codec_count = 0;
+    while (*arg != '\0' && bench_codec_count < BENCH_LIST_MAX)
+    {
+        sscanf(arg, "%31[^,]", name);
+        for (format = 0; format < AENC_FORMAT_MAX; format++)
+        {
+            ops = audio_codec_find(format);
+            if (ops != NULL && strcmp(ops->name, name) == 0)
+            {
+                break;
+            }
+        }
+        if (format == AENC_FORMAT_MAX)
+        {
+            return -1;
+        }
+        bench_codecs[bench_codec_count++] = format;
+        arg += strlen(name);
+        arg += *arg == ',';
+    }
+
+    return bench_codec_count;
+}
+
+#if 1   //  输入信号
+/*
+ * 合成信号: tone是几个不相干的正弦叠加, noise是白噪声, 都是确定的, 每次结果可比
+ */
+static int bench_synth(bench_source_t *source, const char *signal, int samplerate, int channels, int seconds)
+{
+    long i = 0;
+    int ch = 0;
+    double v = 0;
+    unsigned int seed = 1;
+    static const double freqs[] = {220.0, 445.0, 1013.0, 3120.0};
+
+    memset(source, 0, sizeof(bench_source_t));
+    snprintf(source->name, sizeof(source->name), "%s", signal);
+    source->samplerate = samplerate;
+    source->channels = channels;
+    source->frames = (long)samplerate * seconds;
+    source->pcm = (short *)malloc(sizeof(short) * source->frames * channels);
+    if (source->pcm == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < source->frames; i++)
+    {
+        for (ch = 0; ch < channels; ch++)
+        {
+            if (strcmp(signal, "noise") == 0)
+            {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                v = ((int)(seed >> 16) - 32768) / 32768.0 * 0.5;
+            }
+            else
+            {
+                v = 0.2 * sin(2 * M_PI * freqs[0] * i / samplerate + ch) + 0.15 * sin(2 * M_PI * freqs[1] * i / samplerate) +
+                    0.1 * sin(2 * M_PI * freqs[2] * i / samplerate) + 0.05 * sin(2 * M_PI * freqs[3] * i / samplerate);
+            }
+            source->pcm[i * channels + ch] = (short)lrint(v * 32767);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * 读片段: wav按头里的参数转成s16, 裸pcm按16k单声道s16
+ */
+static int bench_load_clip(bench_source_t *source, const char *path, const char *name)
+{
+    int ret = -1;
+    long size = 0;
+    long samples = 0;
+    FILE *fp = NULL;
+    unsigned char *data = NULL;
+    audio_wav_info_t wav;
+
+    memset(source, 0, sizeof(bench_source_t));
+    snprintf(source->name, sizeof(source->name), "%s", name);
+    fp = fopen(path, "rb");
+    if (fp == NULL || fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        goto END;
+    }
+    data = (unsigned char *)malloc(size);
+    if (data == NULL || fread(data, 1, size, fp) != (size_t)size)
+    {
+        goto END;
+    }
+
+    if (audio_wav_parse(data, size, &wav) == 0)
+    {
+        if (wav.audio_param.format != AENC_FORMAT_PCM)
+        {
+            goto END;
+        }
+        if (wav.data_size < 0 || wav.data_offset + wav.data_size > size)
+        {
+            wav.data_size = size - wav.data_offset;
+        }
+        source->samplerate = wav.audio_param.samplerate;
+        source->channels = wav.audio_param.channels;
+        samples = wav.data_size / audio_sample_size(wav.sample_format);
+        source->pcm = (short *)malloc(sizeof(short) * samples);
+        if (source->pcm == NULL ||
+            audio_sample_convert(data + wav.data_offset, wav.sample_format, source->pcm, AUDIO_SAMPLE_S16, samples, NULL) != 0)
+        {
+            goto END;
+        }
+    }
+    else
+    {
+        source->samplerate = BENCH_CLIP_RATE;
+        source->channels = 1;
+        samples = size / sizeof(short);
+        source->pcm = (short *)malloc(sizeof(short) * samples);
+        if (source->pcm == NULL)
+        {
+            goto END;
+        }
+        memcpy(source->pcm, data, samples * sizeof(short));
+    }
+    source->frames = samples / source->channels;
+    ret = source->frames > 0 ? 0 : -1;
+
+END:
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    free(data);
+    if (ret != 0)
+    {
+        free(source->pcm);
+        source->pcm = NULL;
+    }
+    return ret;
+}
+
+static int bench_has_suffix(const char *name, const char *suffix)
+{
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+
+    return len > suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+static int bench_load_clips(bench_source_t *clips)
+{
+    int count = 0;
+    DIR *dir = NULL;
+    struct dirent *entry = NULL;
+    char path[BENCH_PATH_MAX * 2];
+
+    if (bench_clip_dir == NULL || bench_clip_dir[0] == '\0')
+    {
+        return 0;
+    }
+    dir = opendir(bench_clip_dir);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "no clips in %s\n", bench_clip_dir);
+        return 0;
+    }
+    while ((entry = readdir(dir)) != NULL && count < BENCH_CLIPS_MAX)
+    {
+        if (!bench_has_suffix(entry->d_name, ".pcm") && !bench_has_suffix(entry->d_name, ".wav"))
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", bench_clip_dir, entry->d_name);
+        if (bench_load_clip(&clips[count], path, entry->d_name) == 0)
+        {
+            count++;
+        }
+        else
+        {
+            fprintf(stderr, "skip clip %s\n", path);
+        }
+    }
+    closedir(dir);
+
+    return count;
+}
+#endif
+
+#if 1   //  对比
+static void bench_key(char *key, const char *codec, const char *direction, const char *source, int samplerate, int channels, int fps)
+{
+    snprintf(key, BENCH_PATH_MAX, "%s/%s/%s/%d/%d/%d", codec, direction, source, samplerate, channels, fps);
+}
+
+/*
+ * 从一行结果里取字段, 只认本程序输出的格式: "key": "string" 或 "key": number
+ */
+static int bench_json_field(const char *line, const char *key, char *value, int size)
+{
+    int i = 0;
+    char pattern[64];
+    const char *p = NULL;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    p = strstr(line, pattern);
+    if (p == NULL)
+    {
+        return -1;
+    }
+    p += strlen(pattern);
+    if (*p == '"')
+    {
+        for (p++; *p != '"' && *p != '\0' && i < size - 1; p++)
+        {
+            value[i++] = *p;
+        }
+    }
+    else
+    {
+        for (; *p != ',' && *p != '}' && *p != '\0' && i < size - 1; p++)
+        {
+            value[i++] = *p;
+        }
+    }
+    value[i] = '\0';
+
+    return 0;
+}
+
+static int bench_load_baseline(const char *path)
+{
+    int i = 0;
+    FILE *fp = NULL;
+    char line[2048];
+    char field[6][BENCH_PATH_MAX / 4];
+    char ns[32];
+    static const char *keys[6] = {"codec", "direction", "source", "samplerate", "channels", "fps"};
+
+    fp = fopen(path, "r");
+    bench_baselines = (bench_baseline_t *)calloc(BENCH_BASELINE_MAX, sizeof(bench_baseline_t));
+    if (fp == NULL || bench_baselines == NULL)
+    {
+        fprintf(stderr, "cannot read %s\n", path);
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL && bench_baseline_count < BENCH_BASELINE_MAX)
+    {
+        for (i = 0; i < 6; i++)
+        {
+            if (bench_json_field(line, keys[i], field[i], sizeof(field[i])) != 0)
+            {
+                break;
+            }
+        }
+        if (i < 6 || bench_json_field(line, "ns_per_frame", ns, sizeof(ns)) != 0)
+        {
+            continue;
+        }
+        bench_key(bench_baselines[bench_baseline_count].key, field[0], field[1], field[2], atoi(field[3]), atoi(field[4]), atoi(field[5]));
+        bench_baselines[bench_baseline_count++].ns_per_frame = atof(ns);
+    }
+    fclose(fp);
+
+    return bench_baseline_count > 0 ? 0 : -1;
+}
+
+//  找到同一用例时算加速比, 按编解码器和方向累计
+static void bench_compare(bench_result_t *result, aenc_format_e format)
+{
+    int i = 0;
+    int mode = strcmp(result->direction, "encode") == 0 ? 0 : 1;
+    char key[BENCH_PATH_MAX];
+
+    bench_key(key, result->codec, result->direction, result->source, result->samplerate, result->channels, result->fps);
+    for (i = 0; i < bench_baseline_count; i++)
+    {
+        if (strcmp(bench_baselines[i].key, key) == 0 && bench_baselines[i].ns_per_frame > 0 && result->ns_per_frame > 0)
+        {
+            result->speedup = bench_baselines[i].ns_per_frame / result->ns_per_frame;
+            bench_speedup_log[format][mode] += log(result->speedup);
+            bench_speedup_count[format][mode]++;
+            return;
+        }
+    }
+}
+
+static void bench_report_speedup(FILE *fp)
+{
+    int format = 0;
+    int mode = 0;
+    int first = 1;
+    double speedup = 0;
+
+    fprintf(fp, ",\n  \"speedup\": {");
+    fprintf(stderr, "speedup vs baseline (geometric mean of ns/frame ratios):\n");
+    for (format = 0; format < AENC_FORMAT_MAX; format++)
+    {
+        for (mode = 0; mode < 2; mode++)
+        {
+            if (bench_speedup_count[format][mode] == 0)
+            {
+                continue;
+            }
+            speedup = exp(bench_speedup_log[format][mode] / bench_speedup_count[format][mode]);
+            fprintf(fp, "%s\"%s.%s\": %.3f", first ? "" : ", ", audio_codec_find(format)->name, mode == 0 ? "encode" : "decode", speedup);
+            fprintf(stderr, "\t%-6s %s %.2fx (%d cases)\n", audio_codec_find(format)->name, mode == 0 ? "encode" : "decode",
+                    speedup, bench_speedup_count[format][mode]);
+            first = 0;
+        }
+    }
+    fprintf(fp, "}");
+}
+#endif
+
+#if 1   //  测量
+/*
+ * 逐帧编码整个源, 包首尾相连存进packets, 每包长度存进packet_len, 再逐包解码.
+ * 分配计数只算循环里的, 不算打开编解码器和准备缓存
+ */
+static int bench_codec(aenc_format_e format, bench_source_t *source, int fps, bench_result_t *enc, bench_result_t *dec)
+{
+    int ret = -1;
+    int len = 0;
+    long i = 0;
+    long frame_count = 0;
+    long packet_count = 0;
+    int frame_bytes = 0;
+    int pcm_size = 0;
+    size_t offset = 0;
+    size_t packets_size = 0;
+    unsigned long long allocs = 0;
+    unsigned long long start = 0;
+    unsigned long long t = 0;
+    unsigned long long *ns = NULL;
+    unsigned char *packets = NULL;
+    unsigned char *pcm_out = NULL;
+    int *packet_len = NULL;
+    audio_param_t audio_param;
+    audio_codec_t *encoder = NULL;
+    audio_codec_t *decoder = NULL;
+
+    memset(&audio_param, 0, sizeof(audio_param_t));
+    audio_param.format = format;
+    audio_param.samplerate = source->samplerate;
+    audio_param.channels = source->channels;
+    audio_param.bit_depth = 16;
+    audio_param.fps = fps;
+    if (source->samplerate % fps != 0)
+    {
+        return 1;
+    }
+
+    encoder = audio_codec_open(format, AUDIO_CODEC_ENCODER, audio_param);
+    decoder = audio_codec_open(format, AUDIO_CODEC_DECODER, audio_param);
+    if (encoder == NULL || decoder == NULL)
+    {
+        ret = 1;
+        goto END;
+    }
+    frame_bytes = audio_codec_get_frame_size(encoder);
+    pcm_size = audio_codec_get_frame_size(decoder);
+    frame_count = source->frames * source->channels * (long)sizeof(short) / frame_bytes;
+    packets_size = (size_t)(frame_count + 8) * encoder->packet_size_max;
+    packets = (unsigned char *)malloc(packets_size);
+    packet_len = (int *)malloc(sizeof(int) * (frame_count + 8));
+    ns = (unsigned long long *)malloc(sizeof(unsigned long long) * (frame_count + 8));
+    pcm_out = (unsigned char *)malloc(pcm_size > frame_bytes * 4 ? pcm_size : frame_bytes * 4);
+    if (packets == NULL || packet_len == NULL || ns == NULL || pcm_out == NULL || frame_count <= 0)
+    {
+        goto END;
+    }
+
+    //  编码
+    allocs = audio_alloc_count();
+    start = bench_now_ns();
+    for (i = 0; i < frame_count; i++)
+    {
+        t = bench_now_ns();
+        len = audio_codec_encode(encoder, (unsigned char *)source->pcm + i * frame_bytes, frame_bytes,
+                                 packets + offset, packets_size - offset);
+        ns[i] = bench_now_ns() - t;
+        if (len < 0)
+        {
+            goto END;
+        }
+        if (len > 0)
+        {
+            packet_len[packet_count++] = len;
+            offset += len;
+        }
+    }
+    while (packets_size - offset >= (size_t)encoder->packet_size_max &&
+           (len = audio_codec_flush(encoder, packets + offset, packets_size - offset)) > 0)
+    {
+        packet_len[packet_count++] = len;
+        offset += len;
+    }
+    enc->seconds = (bench_now_ns() - start) / 1e9;
+    enc->allocs_per_frame = BENCH_COUNT_ALLOCS ? (double)(audio_alloc_count() - allocs) / frame_count : -1;
+    enc->frames = frame_count;
+    enc->bytes = offset;
+    bench_latency(ns, frame_count, enc);
+
+    //  解码刚编出来的包
+    offset = 0;
+    allocs = audio_alloc_count();
+    start = bench_now_ns();
+    for (i = 0; i < packet_count; i++)
+    {
+        t = bench_now_ns();
+        len = audio_codec_decode(decoder, packets + offset, packet_len[i], pcm_out, pcm_size);
+        ns[i] = bench_now_ns() - t;
+        if (len < 0)
+        {
+            goto END;
+        }
+        dec->bytes += len;
+        offset += packet_len[i];
+    }
+    dec->seconds = (bench_now_ns() - start) / 1e9;
+    dec->allocs_per_frame = BENCH_COUNT_ALLOCS && packet_count > 0 ? (double)(audio_alloc_count() - allocs) / packet_count : -1;
+    dec->frames = packet_count;
+    bench_latency(ns, packet_count, dec);
+
+    enc->frame_samples = dec->frame_samples = frame_bytes / (source->channels * sizeof(short));
+    ret = 0;
+
+END:
+    audio_codec_close(encoder);
+    audio_codec_close(decoder);
+    free(packets);
+    free(packet_len);
+    free(ns);
+    free(pcm_out);
+    return ret;
+}
+
+static void bench_finish(bench_result_t *result, const char *codec, const char *direction, bench_source_t *source, int fps)
+{
+    result->codec = codec;
+    result->direction = direction;
+    result->source = source->name;
+    result->samplerate = source->samplerate;
+    result->channels = source->channels;
+    result->fps = fps;
+    result->audio_seconds = (double)result->frames * result->frame_samples / source->samplerate;
+    result->xrt = result->seconds > 0 ? result->audio_seconds / result->seconds : 0;
+    result->ns_per_frame = result->frames > 0 ? result->seconds * 1e9 / result->frames : 0;
+    result->peak_rss_kb = bench_peak_rss_kb();
+}
+
+static void bench_print(FILE *fp, bench_result_t *result, int first)
+{
+    fprintf(fp, "%s    {\"codec\": \"%s\", \"direction\": \"%s\", \"source\": \"%s\", \"samplerate\": %d, \"channels\": %d, "
+                "\"fps\": %d, \"frame_samples\": %d, \"frames\": %ld, \"audio_seconds\": %.3f, \"seconds\": %.6f, "
+                "\"xrt\": %.2f, \"ns_per_frame\": %.0f, \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"max_ns\": %.0f, "
+                "\"allocs_per_frame\": %.3f, \"bytes\": %lld, \"peak_rss_kb\": %ld",
+            first ? "" : ",\n", result->codec, result->direction, result->source, result->samplerate, result->channels,
+            result->fps, result->frame_samples, result->frames, result->audio_seconds, result->seconds,
+            result->xrt, result->ns_per_frame, result->p50_ns, result->p99_ns, result->max_ns,
+            result->allocs_per_frame, result->bytes, result->peak_rss_kb);
+    if (result->speedup > 0)
+    {
+        fprintf(fp, ", \"speedup\": %.3f", result->speedup);
+    }
+    fprintf(fp, "}");
+}
+
+/*
+ * 一个源在每个编解码器和帧长下测编码和解码, 编解码器不支持的参数跳过
+ */
+static int bench_source(FILE *fp, bench_source_t *source, int *count)
+{
+    int c = 0;
+    int f = 0;
+    int ret = 0;
+    const char *name = NULL;
+    bench_result_t enc;
+    bench_result_t dec;
+
+    for (c = 0; c < bench_codec_count; c++)
+    {
+        name = audio_codec_find(bench_codecs[c])->name;
+        for (f = 0; f < bench_fps_count; f++)
+        {
+            memset(&enc, 0, sizeof(bench_result_t));
+            memset(&dec, 0, sizeof(bench_result_t));
+            ret = bench_codec(bench_codecs[c], source, bench_fps[f], &enc, &dec);
+            if (ret > 0)
+            {
+                fprintf(stderr, "skip %s %s %dHz %dch fps=%d: not supported\n",
+                        name, source->name, source->samplerate, source->channels, bench_fps[f]);
+                continue;
+            }
+            if (ret < 0)
+            {
+                fprintf(stderr, "%s %s %dHz %dch fps=%d failed\n", name, source->name, source->samplerate, source->channels, bench_fps[f]);
+                return -1;
+            }
+            bench_finish(&enc, name, "encode", source, bench_fps[f]);
+            bench_finish(&dec, name, "decode", source, bench_fps[f]);
+            bench_compare(&enc, bench_codecs[c]);
+            bench_compare(&dec, bench_codecs[c]);
+            bench_print(fp, &enc, (*count)++ == 0);
+            bench_print(fp, &dec, (*count)++ == 0);
+            fprintf(stderr, "%-6s %-10s %5dHz %dch fps=%-3d encode %8.1fx p99 %7.0fns, decode %8.1fx p99 %7.0fns\n",
+                    name, source->name, source->samplerate, source->channels, bench_fps[f],
+                    enc.xrt, enc.p99_ns, dec.xrt, dec.p99_ns);
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#if 1   //  混音
+static short bench_mix_saturate(int v)
+{
+    return v > 32767 ? 32767 : (v < -32768 ? -32768 : (short)v);
+}
+
+static float bench_mix_clamp(float v)
+{
+    return v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+}
+
+/*
+ * 按这一帧选中的说话人用标量重算饱和混音: mix是说话人之和, 说话人的minus减去自己, 其他人的minus就是mix
+ */
+static int bench_mix_check(audio_mixer_t *mixer, const short *const *in, int inputs, int samples, const short *mix,
+                           short *const *minus, int *speakers)
+{
+    int i = 0;
+    int k = 0;
+    int sum = 0;
+    int count = audio_mixer_get_speakers(mixer, speakers, inputs);
+
+    for (k = 0; k < samples; k++)
+    {
+        for (i = 0, sum = 0; i < count; i++)
+        {
+            sum += in[speakers[i]][k];
+        }
+        if (mix[k] != bench_mix_saturate(sum))
+        {
+            return -1;
+        }
+        for (i = 0; i < inputs; i++)
+        {
+            if (minus[i][k] != (audio_mixer_is_speaker(mixer, i) ? bench_mix_saturate(sum - in[i][k]) : mix[k]))
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * 同bench_mix_check, 按audio_mixer_get_speakers的顺序累加, 和库里的加法顺序一致, 结果应该逐位相同
+ */
+static int bench_mix_check_float(audio_mixer_t *mixer, const float *const *in, int inputs, int samples, const float *mix,
+                                 float *const *minus, int *speakers)
+{
+    int i = 0;
+    int k = 0;
+    float sum = 0;
+    int count = audio_mixer_get_speakers(mixer, speakers, inputs);
+
+    for (k = 0; k < samples; k++)
+    {
+        for (i = 0, sum = 0; i < count; i++)
+        {
+            sum = i == 0 ? in[speakers[i]][k] : sum + in[speakers[i]][k];
+        }
+        if (mix[k] != bench_mix_clamp(sum))
+        {
+            return -1;
+        }
+        for (i = 0; i < inputs; i++)
+        {
+            if (minus[i][k] != (audio_mixer_is_speaker(mixer, i) ? bench_mix_clamp(sum - in[i][k]) : mix[k]))
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * 会议混音: 每路输入是同一个单声道合成信号错开BENCH_MIX_OFFSET的倍数, 每BENCH_MIX_MUTE路有一路静音,
+ * 每路每BENCH_MIX_DROP帧有一帧为NULL. 只计audio_mixer_mix的耗时. 饱和模式下另用一个混音器跑浮点接口,
+ * 每帧的mix和所有minus都和标量结果对比
+ * @retval
+ *      0               成功
+ *      >0              参数不支持, 跳过
+ *      <0              失败
+ */
+static int bench_mix(bench_source_t *source, int fps, int inputs, int speakers_max, audio_mix_clip_e clip, bench_mix_result_t *result)
+{
+    int ret = -1;
+    int i = 0;
+    int k = 0;
+    int samples = source->samplerate / fps;
+    int check = clip == AUDIO_MIX_SATURATE;
+    long f = 0;
+    long pos = 0;
+    long frame_count = source->frames / samples;
+    unsigned long long t = 0;
+    unsigned long long allocs = 0;
+    unsigned long long *ns = NULL;
+    short *silence = NULL;
+    short *mix = NULL;
+    short *out = NULL;
+    float *in_buf = NULL;
+    float *mix_f = NULL;
+    float *out_f = NULL;
+    int *speakers = NULL;
+    const short *in[AUDIO_MIX_INPUTS_MAX];
+    const float *in_f[AUDIO_MIX_INPUTS_MAX];
+    short *minus[AUDIO_MIX_INPUTS_MAX];
+    float *minus_f[AUDIO_MIX_INPUTS_MAX];
+    audio_mixer_t *mixer = NULL;
+    audio_mixer_t *mixer_f = NULL;
+
+    if (source->channels != 1 || source->samplerate % fps != 0 || inputs > AUDIO_MIX_INPUTS_MAX || source->frames <= samples)
+    {
+        return 1;
+    }
+    mixer = audio_mixer_create(inputs, samples, speakers_max, clip);
+    mixer_f = audio_mixer_create(inputs, samples, speakers_max, clip);
+    ns = (unsigned long long *)malloc(sizeof(unsigned long long) * frame_count);
+    silence = (short *)calloc(samples, sizeof(short));
+    mix = (short *)malloc(sizeof(short) * samples);
+    out = (short *)malloc(sizeof(short) * samples * inputs);
+    in_buf = (float *)malloc(sizeof(float) * samples * inputs);
+    mix_f = (float *)malloc(sizeof(float) * samples);
+    out_f = (float *)malloc(sizeof(float) * samples * inputs);
+    speakers = (int *)malloc(sizeof(int) * inputs);
+    if (mixer == NULL || mixer_f == NULL || ns == NULL || silence == NULL || mix == NULL || out == NULL ||
+        in_buf == NULL || mix_f == NULL || out_f == NULL || speakers == NULL)
+    {
+        goto END;
+    }
+    for (i = 0; i < inputs; i++)
+    {
+        minus[i] = out + (size_t)i * samples;
+        minus_f[i] = out_f + (size_t)i * samples;
+    }
+
+    result->verified = check ? 1 : -1;
+    allocs = audio_alloc_count();
+    for (f = 0; f < frame_count; f++)
+    {
+        for (i = 0; i < inputs; i++)
+        {
+            pos = (f * samples + (long)i * BENCH_MIX_OFFSET) % (source->frames - samples);
+            in[i] = i % BENCH_MIX_MUTE == BENCH_MIX_MUTE - 1 ? silence : source->pcm + pos;
+            in[i] = (f + i) % BENCH_MIX_DROP == 0 ? NULL : in[i];
+        }
+        t = bench_now_ns();
+        if (audio_mixer_mix(mixer, in, inputs, samples, mix, minus) < 0)
+        {
+            goto END;
+        }
+        ns[f] = bench_now_ns() - t;
+        if (!check || result->verified != 1)
+        {
+            continue;
+        }
+
+        //  浮点接口用同样的输入, 说话人按各自的能量选
+        for (i = 0; i < inputs; i++)
+        {
+            in_f[i] = in[i] != NULL ? in_buf + (size_t)i * samples : NULL;
+            for (k = 0; in[i] != NULL && k < samples; k++)
+            {
+                in_buf[(size_t)i * samples + k] = in[i][k] / 32768.0f;
+            }
+        }
+        if (audio_mixer_mix_float(mixer_f, in_f, inputs, samples, mix_f, minus_f) < 0)
+        {
+            goto END;
+        }
+        //  两个混音器选的说话人可能因为舍入不同, 各自按自己选的人对比
+        if (bench_mix_check(mixer, in, inputs, samples, mix, minus, speakers) != 0 ||
+            bench_mix_check_float(mixer_f, in_f, inputs, samples, mix_f, minus_f, speakers) != 0)
+        {
+            fprintf(stderr, "mix %d inputs, %d speakers: frame %ld differs from the scalar sum\n", inputs, speakers_max, f);
+            result->verified = 0;
+        }
+    }
+    result->allocs_per_frame = BENCH_COUNT_ALLOCS ? (double)(audio_alloc_count() - allocs) / frame_count : -1;
+    for (f = 0; f < frame_count; f++)
+    {
+        result->ns_per_frame += ns[f];
+    }
+    result->ns_per_frame /= frame_count;
+    result->inputs = inputs;
+    result->speakers_max = speakers_max;
+    result->clip = clip;
+    result->samplerate = source->samplerate;
+    result->fps = fps;
+    result->frame_samples = samples;
+    result->frames = frame_count;
+    //  按每帧耗时算分位数
+    qsort(ns, frame_count, sizeof(unsigned long long), bench_cmp_ns);
+    result->p50_ns = ns[frame_count / 2];
+    result->p99_ns = ns[(frame_count * 99) / 100 < frame_count ? (frame_count * 99) / 100 : frame_count - 1];
+    result->max_ns = ns[frame_count - 1];
+    ret = 0;
+
+END:
+    audio_mixer_destroy(mixer);
+    audio_mixer_destroy(mixer_f);
+    free(ns);
+    free(silence);
+    free(mix);
+    free(out);
+    free(in_buf);
+    free(mix_f);
+    free(out_f);
+    free(speakers);
+    return ret;
+}
+
+static void bench_print_mix(FILE *fp, bench_mix_result_t *result, int first)
+{
+    fprintf(fp, "%s    {\"inputs\": %d, \"speakers_max\": %d, \"clip\": \"%s\", \"samplerate\": %d, \"fps\": %d, "
+                "\"frame_samples\": %d, \"frames\": %ld, \"ns_per_frame\": %.0f, \"ns_per_input\": %.1f, "
+                "\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"max_ns\": %.0f, \"allocs_per_frame\": %.3f, \"verified\": %d}",
+            first ? "" : ",\n", result->inputs, result->speakers_max, result->clip == AUDIO_MIX_SATURATE ? "saturate" : "soft",
+            result->samplerate, result->fps, result->frame_samples, result->frames, result->ns_per_frame,
+            result->ns_per_frame / result->inputs, result->p50_ns, result->p99_ns, result->max_ns,
+            result->allocs_per_frame, result->verified);
+}
+
+/*
+ * 每个采样率、帧长、输入数、说话人数和削波方式一个用例, 用单声道tone信号
+ * @retval
+ *      0               成功, 对比都一致
+ *      <0              失败或者和标量结果不一致
+ */
+static int bench_mixes(FILE *fp)
+{
+    int r = 0;
+    int f = 0;
+    int n = 0;
+    int s = 0;
+    int c = 0;
+    int ret = 0;
+    int count = 0;
+    bench_source_t source;
+    bench_mix_result_t result;
+
+    fprintf(fp, ",\n  \"mix\": [\n");
+    for (r = 0; ret >= 0 && r < bench_rate_count && bench_mix_input_count > 0; r++)
+    {
+        if (bench_synth(&source, "tone", bench_rates[r], 1, bench_seconds) != 0)
+        {
+            ret = -1;
+            break;
+        }
+        for (f = 0; ret >= 0 && f < bench_fps_count; f++)
+        {
+            for (n = 0; ret >= 0 && n < bench_mix_input_count; n++)
+            {
+                for (s = 0; ret >= 0 && s < bench_mix_speaker_count; s++)
+                {
+                    for (c = AUDIO_MIX_SATURATE; ret >= 0 && c <= AUDIO_MIX_SOFT_CLIP; c++)
+                    {
+                        memset(&result, 0, sizeof(bench_mix_result_t));
+                        ret = bench_mix(&source, bench_fps[f], bench_mix_inputs[n], bench_mix_speakers[s], c, &result);
+                        if (ret > 0)
+                        {
+                            ret = 0;
+                            continue;
+                        }
+                        if (ret < 0)
+                        {
+                            fprintf(stderr, "mix %d inputs %dHz fps=%d failed\n", bench_mix_inputs[n], bench_rates[r], bench_fps[f]);
+                            break;
+                        }
+                        bench_print_mix(fp, &result, count++ == 0);
+                        fprintf(stderr, "mix    %3d inputs %2d speakers %-8s %5dHz fps=%-3d %8.0fns/frame p99 %7.0fns%s\n",
+                                result.inputs, result.speakers_max, c == AUDIO_MIX_SATURATE ? "saturate" : "soft",
+                                result.samplerate, result.fps, result.ns_per_frame, result.p99_ns,
+                                result.verified == 0 ? " MISMATCH" : (result.verified == 1 ? " verified" : ""));
+                        if (result.verified == 0)
+                        {
+                            ret = -1;
+                        }
+                    }
+                }
+            }
+        }
+        free(source.pcm);
+    }
+    fprintf(fp, "\n  ]");
+
+    return ret;
+}
+#endif
+
+static void bench_usage(const char *cmd)
+{
+    printf("usage: %s [-o result.json] [options]\n", cmd);
+    printf("\t -o FILE: write the json result to FILE (default stdout)\n");
+    printf("\t --codecs LIST: codecs to measure, e.g. opus,aac (default all)\n");
+    printf("\t --rates LIST: synthetic signal samplerates (default 8000,16000,48000)\n");
+    printf("\t --channels LIST: synthetic signal channels (default 1,2)\n");
+    printf("\t --fps LIST: frames per second, the frame size is samplerate/fps; aac always uses 1024 samples (default 50)\n");
+    printf("\t --seconds N: synthetic signal length (default %d)\n", BENCH_SECONDS);
+    printf("\t --signals LIST: tone,noise; empty for none\n");
+    printf("\t --baseline FILE: an earlier result, e.g. of another build; adds per case and per codec speedups\n");
+    printf("\t --clips DIR: also measure the .pcm (16k mono s16) and .wav clips in DIR, empty for none (default %s)\n", BENCH_CLIP_DIR);
+    printf("\t --mix-inputs LIST: conference mixer input counts, at each rate and fps, saturate and soft clip;\n"
+           "\t                    saturate results are checked against a scalar sum, empty for none (default 3,10,50)\n");
+    printf("\t --mix-speakers LIST: mixer speakers_max, 0 mixes every input (default 0,3)\n");
+}
+
+enum
+{
+    OPT_CODECS = 0x100,
+    OPT_RATES,
+    OPT_CHANNELS,
+    OPT_FPS,
+    OPT_SECONDS,
+    OPT_SIGNALS,
+    OPT_CLIPS,
+    OPT_BASELINE,
+    OPT_MIX_INPUTS,
+    OPT_MIX_SPEAKERS
+};
+
+int main(int argc, char **argv)
+{
+    int i = 0;
+    int r = 0;
+    int ch = 0;
+    int opt = 0;
+    int ret = 0;
+    int count = 0;
+    int clip_count = 0;
+    FILE *fp = stdout;
+    char signal[32];
+    const char *p = NULL;
+    bench_source_t source;
+    bench_source_t *clips = NULL;
+    time_t now = time(NULL);
+    struct option long_options[] = {
+        {"output", required_argument, NULL, 'o'},
+        {"codecs", required_argument, NULL, OPT_CODECS},
+        {"rates", required_argument, NULL, OPT_RATES},
+        {"channels", required_argument, NULL, OPT_CHANNELS},
+        {"fps", required_argument, NULL, OPT_FPS},
+        {"seconds", required_argument, NULL, OPT_SECONDS},
+        {"signals", required_argument, NULL, OPT_SIGNALS},
+        {"clips", required_argument, NULL, OPT_CLIPS},
+        {"baseline", required_argument, NULL, OPT_BASELINE},
+        {"mix-inputs", required_argument, NULL, OPT_MIX_INPUTS},
+        {"mix-speakers", required_argument, NULL, OPT_MIX_SPEAKERS},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+
+    for (i = 0; i < AENC_FORMAT_MAX; i++)
+    {
+        if (audio_codec_find(i) != NULL)
+        {
+            bench_codecs[bench_codec_count++] = i;
+        }
+    }
+
+    while ((opt = getopt_long(argc, argv, "o:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'o':
+            fp = fopen(optarg, "w");
+            if (fp == NULL)
+            {
+                fprintf(stderr, "cannot open %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_CODECS:
+            ret = bench_parse_codecs(optarg);
+            break;
+        case OPT_RATES:
+            ret = bench_rate_count = bench_parse_list(optarg, bench_rates, 1);
+            break;
+        case OPT_CHANNELS:
+            ret = bench_channel_count = bench_parse_list(optarg, bench_channels, 1);
+            break;
+        case OPT_FPS:
+            ret = bench_fps_count = bench_parse_list(optarg, bench_fps, 1);
+            break;
+        case OPT_SECONDS:
+            ret = bench_seconds = atoi(optarg);
+            break;
+        case OPT_SIGNALS:
+            bench_signals = optarg;
+            break;
+        case OPT_CLIPS:
+            bench_clip_dir = optarg;
+            break;
+        case OPT_BASELINE:
+            ret = bench_load_baseline(optarg) == 0;
+            break;
+        case OPT_MIX_INPUTS:
+            ret = bench_mix_input_count = bench_parse_list(optarg, bench_mix_inputs, 1);
+            ret = optarg[0] == '\0' ? 1 : ret;
+            break;
+        case OPT_MIX_SPEAKERS:
+            ret = bench_mix_speaker_count = bench_parse_list(optarg, bench_mix_speakers, 0);
+            break;
+        case 'h':
+            bench_usage(argv[0]);
+            return 0;
+
+        default:
+            bench_usage(argv[0]);
+            return -1;
+        }
+        if (ret <= 0 && opt != OPT_SIGNALS && opt != OPT_CLIPS && opt != 'o')
+        {
+            fprintf(stderr, "%s, err param!!!\n", optarg);
+            return -1;
+        }
+    }
+
+    fprintf(fp, "{\n  \"version\": 1,\n  \"time\": %ld,\n  \"count_allocs\": %d,\n  \"results\": [\n",
+            (long)now, BENCH_COUNT_ALLOCS);
+
+    //  合成信号: 每个采样率和声道数一份
+    for (p = bench_signals; ret >= 0 && *p != '\0'; p += strlen(signal), p += *p == ',')
+    {
+        sscanf(p, "%31[^,]", signal);
+        for (r = 0; ret >= 0 && r < bench_rate_count; r++)
+        {
+            for (ch = 0; ret >= 0 && ch < bench_channel_count; ch++)
+            {
+                if (bench_channels[ch] > AUDIO_CHANNELS_MAX || bench_synth(&source, signal, bench_rates[r], bench_channels[ch], bench_seconds) != 0)
+                {
+                    ret = -1;
+                    break;
+                }
+                ret = bench_source(fp, &source, &count);
+                free(source.pcm);
+            }
+        }
+    }
+
+    //  片段: 按自己的采样率和声道数
+    clips = (bench_source_t *)calloc(BENCH_CLIPS_MAX, sizeof(bench_source_t));
+    if (clips != NULL && ret >= 0)
+    {
+        clip_count = bench_load_clips(clips);
+    }
+    for (i = 0; i < clip_count; i++)
+    {
+        if (ret >= 0)
+        {
+            ret = bench_source(fp, &clips[i], &count);
+        }
+        free(clips[i].pcm);
+    }
+    free(clips);
+
+    fprintf(fp, "\n  ]");
+    if (ret >= 0 && bench_mixes(fp) != 0)
+    {
+        ret = -1;
+    }
+    fprintf(fp, ",\n  \"peak_rss_kb\": %ld", bench_peak_rss_kb());
+    if (bench_baseline_count > 0)
+    {
+        bench_report_speedup(fp);
+    }
+    fprintf(fp, "\n}\n");
+    free(bench_baselines);
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+
+    return ret < 0 ? -1 : 0;
+}
@@ -53,7 +53,7 @@ int g711a_encode(char *pcm_data, int pcm_len, char *g711a_data, int g711a_len)
     if (g711a_len * 2 < pcm_len)
     {
         fprintf(stderr, "The g711a_data do not have enough space!");
-        return -1;
+        return AUDIO_CODEC_ERR(AUDIO_CODEC_ERROR_BUFFER_TOO_SMALL);
     }
 
     for (i = 0; i < count; i++)
@@ -102,7 +102,7 @@ int g711a_decode(char *g711a_data, int g711a_len, char *pcm_buf, int pcm_len)
     if (g711a_len * 2 > pcm_len)
     {
         fprintf(stderr, "The pcm_buf do not have enough space!\n");
-        return -1;
+        return AUDIO_CODEC_ERR(AUDIO_CODEC_ERROR_BUFFER_TOO_SMALL);
     }
 
     for (i = 0; i < g711a_len; i++)
@@ -114,4 +114,44 @@ int g711a_decode(char *g711a_data, int g711a_len, char *pcm_buf, int pcm_len)
     return j;
 }
 
-#endif
\ No newline at end of file
+#endif
+
+#if 1   //  统一的编解码接口
+#define G711A_FRAME_MS 20
+
+static int g711a_codec_init(audio_codec_t *codec)
+{
+    int fps = codec->audio_param.fps > 0 ? codec->audio_param.fps : 1000 / G711A_FRAME_MS;
+    int channels = codec->audio_param.channels > 0 ? codec->audio_param.channels : 1;
+
+    //  g711a逐个采样编码, 一帧按fps划分只是为了和其他编码器一致
+    codec->frame_size = codec->audio_param.samplerate / fps * channels * sizeof(short);
+    codec->packet_size_max = codec->frame_size / sizeof(short);
+    codec->handle = NULL;
+    return codec->frame_size > 0 ? 0 : -1;
+}
+
+static int g711a_codec_encode(audio_codec_t *codec, unsigned char *pcm, int pcm_len, unsigned char *out, int out_size)
+{
+    return g711a_encode((char *)pcm, pcm_len, (char *)out, out_size);
+}
+
+static int g711a_codec_decode(audio_codec_t *codec, unsigned char *in, int in_len, unsigned char *pcm, int pcm_size)
+{
+    return g711a_decode((char *)in, in_len, (char *)pcm, pcm_size);
+}
+
+static int g711a_codec_get_frame_size(audio_codec_t *codec)
+{
+    return codec->frame_size;
+}
+
+const audio_codec_ops_t g711a_codec_ops = {
+    .name = "g711a",
+    .format = AENC_FORMAT_G711A,
+    .init = g711a_codec_init,
+    .encode = g711a_codec_encode,
+    .decode = g711a_codec_decode,
+    .get_frame_size = g711a_codec_get_frame_size,
+};
+#endif
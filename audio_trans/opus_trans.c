@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "audio_trans.h"
 
@@ -8,19 +9,60 @@
 
 #define FEC_ENABLE 0
 
-#if 1   //  opus编码
-codec_handle opus_encode_init(audio_param_t audio_param)
+#define OPUS_PACKET_MAX 4000          // 单包最大长度(120ms帧)
+#define OPUS_PARALLEL_OVERLAP_FRAMES 3 // 分段编码时lookahead之外额外预热的帧数
+#define OPUS_CHECK_BATCH 50            // 连续性检查每批解码的包数
+#define OPUS_DTX_PACKET_MAX 2          // DTX期间编码器只输出1~2字节的包
+
+//  句柄的内存来源, 决定deinit时怎么释放
+typedef enum
 {
-    int err = 0;
-    int frame_size = 0;
-    unsigned int variable_duration = 0;
-    OpusEncoder *encoder = NULL;
+    OPUS_MEM_HEAP = 0,  // opus_xxx_init, malloc
+    OPUS_MEM_CALLER,    // opus_xxx_init_buf, 调用者自己管理
+    OPUS_MEM_SLAB       // opus_xxx_init_slab, 还给slab
+} opus_mem_e;
+
+typedef struct
+{
+    OpusEncoder *encoder;
+    int samplerate;
+    int channels;
+    int frame_size;     // 每帧每声道的采样数
+    int frame_bytes;    // 每帧pcm的字节数
+    opus_mem_e mem;
+    audio_slab_t *slab;
+    opus_encode_stats_t stats;
+} opus_enc_t;
+
+typedef struct
+{
+    OpusDecoder *decoder;
+    int samplerate;
+    int channels;
+    int frame_size;
+    opus_mem_e mem;
+    audio_slab_t *slab;
+} opus_dec_t;
+
+//  句柄头部之后紧跟opus状态, 按16字节对齐
+#define OPUS_CTX_SIZE(type) ((sizeof(type) + 15) & ~(size_t)15)
 
-    if (audio_param.fps <= 0 || audio_param.samplerate % 8000 != 0)
+#if 1   //  opus编码
+static int opus_encode_check_param(audio_param_t audio_param)
+{
+    if (audio_param.fps <= 0 || audio_param.samplerate % 8000 != 0 ||
+        audio_param.channels < 1 || audio_param.channels > 2)
     {
         fprintf(stderr, "fps=%d???\nsamplerate=%d???\n", audio_param.fps, audio_param.samplerate);
-        return NULL;
+        return -1;
     }
+    return 0;
+}
+
+static void opus_encode_setup(opus_enc_t *enc, OpusEncoder *encoder, audio_param_t audio_param)
+{
+    int frame_size = 0;
+    unsigned int variable_duration = 0;
 
     frame_size = audio_param.samplerate / audio_param.fps;
     if (frame_size == audio_param.samplerate / 400)
@@ -42,18 +84,6 @@ codec_handle opus_encode_init(audio_param_t audio_param)
     else
         variable_duration = OPUS_FRAMESIZE_120_MS;
 
-    /*
-     * OPUS_APPLICATION_VOIP 视频会议
-     * OPUS_APPLICATION_AUDIO 高保真
-     * OPUS_APPLICATION_RESTRICTED_LOWDELAY 低延迟，但是效果差
-     */
-    encoder = opus_encoder_create(audio_param.samplerate, audio_param.channels, OPUS_APPLICATION_VOIP, &err);
-    if (err != OPUS_OK)
-    {
-        fprintf(stderr, "Cannot create encoder: %s\n", opus_strerror(err));
-        return NULL;
-    }
-
     /*
      * OPUS_SIGNAL_VOICE 语音
      * OPUS_SIGNAL_MUSIC 音乐
@@ -71,51 +101,265 @@ codec_handle opus_encode_init(audio_param_t audio_param)
     opus_encoder_ctl(encoder, OPUS_SET_EXPERT_FRAME_DURATION(variable_duration)); // 帧持续时间
     opus_encoder_ctl(encoder, OPUS_SET_APPLICATION(OPUS_APPLICATION_VOIP));       //同编码器创建参数
 
-    return encoder;
+    enc->encoder = encoder;
+    enc->samplerate = audio_param.samplerate;
+    enc->channels = audio_param.channels;
+    enc->frame_size = frame_size;
+    enc->frame_bytes = frame_size * audio_param.channels * sizeof(opus_int16);
+    enc->mem = OPUS_MEM_HEAP;
+    enc->slab = NULL;
+    memset(&enc->stats, 0, sizeof(enc->stats));
+}
+
+static void opus_encode_count(opus_enc_t *enc, int opus_len)
+{
+    enc->stats.packets++;
+    enc->stats.bytes += opus_len;
+    if (opus_len <= OPUS_DTX_PACKET_MAX)
+    {
+        enc->stats.dtx_packets++;
+    }
+}
+
+codec_handle opus_encode_init(audio_param_t audio_param)
+{
+    int err = 0;
+    OpusEncoder *encoder = NULL;
+    opus_enc_t *enc = NULL;
+
+    if (opus_encode_check_param(audio_param) != 0)
+    {
+        return NULL;
+    }
+
+    /*
+     * OPUS_APPLICATION_VOIP 视频会议
+     * OPUS_APPLICATION_AUDIO 高保真
+     * OPUS_APPLICATION_RESTRICTED_LOWDELAY 低延迟，但是效果差
+     */
+    encoder = opus_encoder_create(audio_param.samplerate, audio_param.channels, OPUS_APPLICATION_VOIP, &err);
+    if (err != OPUS_OK)
+    {
+        fprintf(stderr, "Cannot create encoder: %s\n", opus_strerror(err));
+        return NULL;
+    }
+
+    enc = (opus_enc_t *)malloc(sizeof(opus_enc_t));
+    if (enc == NULL)
+    {
+        opus_encoder_destroy(encoder);
+        return NULL;
+    }
+    opus_encode_setup(enc, encoder, audio_param);
+
+    return enc;
+}
+
+int opus_encode_get_size(audio_param_t audio_param)
+{
+    int size = 0;
+
+    if (audio_param.channels < 1 || audio_param.channels > 2)
+    {
+        return -1;
+    }
+    size = opus_encoder_get_size(audio_param.channels);
+    if (size <= 0)
+    {
+        return -1;
+    }
+    return OPUS_CTX_SIZE(opus_enc_t) + size;
+}
+
+codec_handle opus_encode_init_buf(audio_param_t audio_param, void *buf, int buf_size)
+{
+    int err = 0;
+    OpusEncoder *encoder = NULL;
+    opus_enc_t *enc = NULL;
+
+    if (buf == NULL || opus_encode_check_param(audio_param) != 0)
+    {
+        return NULL;
+    }
+    if (buf_size < opus_encode_get_size(audio_param))
+    {
+        fprintf(stderr, "[%s] buf_size=%d, need %d\n", __func__, buf_size, opus_encode_get_size(audio_param));
+        return NULL;
+    }
+
+    enc = (opus_enc_t *)buf;
+    encoder = (OpusEncoder *)((unsigned char *)buf + OPUS_CTX_SIZE(opus_enc_t));
+    err = opus_encoder_init(encoder, audio_param.samplerate, audio_param.channels, OPUS_APPLICATION_VOIP);
+    if (err != OPUS_OK)
+    {
+        fprintf(stderr, "Cannot init encoder: %s\n", opus_strerror(err));
+        return NULL;
+    }
+    opus_encode_setup(enc, encoder, audio_param);
+    enc->mem = OPUS_MEM_CALLER;
+
+    return enc;
+}
+
+codec_handle opus_encode_init_slab(audio_param_t audio_param, audio_slab_t *slab)
+{
+    void *buf = NULL;
+    opus_enc_t *enc = NULL;
+
+    buf = audio_slab_alloc(slab);
+    if (buf == NULL)
+    {
+        fprintf(stderr, "[%s] slab is full\n", __func__);
+        return NULL;
+    }
+    enc = (opus_enc_t *)opus_encode_init_buf(audio_param, buf, audio_slab_slot_size(slab));
+    if (enc == NULL)
+    {
+        audio_slab_free(slab, buf);
+        return NULL;
+    }
+    enc->mem = OPUS_MEM_SLAB;
+    enc->slab = slab;
+
+    return enc;
 }
 
 int opus_encode_frame(codec_handle handle, unsigned char *input_buf, unsigned long input_len, unsigned char *output_buf, int output_buf_size)
 {
     opus_int32 opus_data_len = 0;
-    OpusEncoder *encoder = NULL;
+    opus_enc_t *enc = NULL;
 
-    encoder = (OpusEncoder *)handle;
+    enc = (opus_enc_t *)handle;
 
-    if ((encoder == NULL) || input_buf == NULL || input_len == 0)
+    if ((enc == NULL) || input_buf == NULL || input_len != enc->frame_bytes)
     {
         fprintf(stderr, "opus encode param err\n");
         return -1;
     }
 
-    opus_data_len = opus_encode(encoder, (opus_int16 *)input_buf, input_len, output_buf, output_buf_size);
+    //  opus_encode的frame_size是每声道的采样数, 不是字节数
+    opus_data_len = opus_encode(enc->encoder, (opus_int16 *)input_buf, enc->frame_size, output_buf, output_buf_size);
     if (opus_data_len < 0)
     {
         fprintf(stderr, "opus encode return len=%d, err!!\n", opus_data_len);
-        return -1;
+        return opus_data_len;
     }
 
     // printf("pcm_len:%d, opus_len:%d\n", input_len, opus_data_len);
+    opus_encode_count(enc, opus_data_len);
 
     return opus_data_len;
 }
 
+int opus_encode_frames(codec_handle handle, unsigned char *input_buf, unsigned long input_len, int frame_count,
+                       unsigned char *output_buf, int output_buf_size, int *packet_len)
+{
+    int i = 0;
+    int offset = 0;
+    opus_int32 opus_data_len = 0;
+    opus_enc_t *enc = NULL;
+
+    enc = (opus_enc_t *)handle;
+
+    //  帧的几何参数只在这里检查一次
+    if ((enc == NULL) || input_buf == NULL || output_buf == NULL || packet_len == NULL || frame_count <= 0 ||
+        input_len != (unsigned long)frame_count * enc->frame_bytes)
+    {
+        fprintf(stderr, "opus encode param err\n");
+        return -1;
+    }
+
+    for (i = 0; i < frame_count; i++)
+    {
+        opus_data_len = opus_encode(enc->encoder, (opus_int16 *)(input_buf + (size_t)i * enc->frame_bytes), enc->frame_size,
+                                    output_buf + offset, output_buf_size - offset);
+        if (opus_data_len < 0)
+        {
+            fprintf(stderr, "opus encode frame %d return len=%d, err!!\n", i, opus_data_len);
+            return -1;
+        }
+        packet_len[i] = opus_data_len;
+        offset += opus_data_len;
+        opus_encode_count(enc, opus_data_len);
+    }
+
+    return offset;
+}
+
+int opus_encode_set_dtx(codec_handle handle, int enable)
+{
+    opus_enc_t *enc = (opus_enc_t *)handle;
+
+    if (enc == NULL)
+    {
+        return -1;
+    }
+    if (opus_encoder_ctl(enc->encoder, OPUS_SET_DTX(enable ? 1 : 0)) != OPUS_OK)
+    {
+        fprintf(stderr, "[%s] set dtx=%d failed\n", __func__, enable);
+        return -1;
+    }
+    return 0;
+}
+
+int opus_encode_get_stats(codec_handle handle, opus_encode_stats_t *stats)
+{
+    opus_enc_t *enc = (opus_enc_t *)handle;
+
+    if (enc == NULL || stats == NULL)
+    {
+        return -1;
+    }
+    memcpy(stats, &enc->stats, sizeof(opus_encode_stats_t));
+    return 0;
+}
+
+int opus_packet_is_dtx(int packet_len)
+{
+    return packet_len > 0 && packet_len <= OPUS_DTX_PACKET_MAX;
+}
+
 void opus_encode_deinit(codec_handle handle)
 {
-    OpusEncoder *encoder = NULL;
+    opus_enc_t *enc = NULL;
 
-    encoder = (OpusEncoder *)handle;
-    if (encoder)
+    enc = (opus_enc_t *)handle;
+    if (enc == NULL)
     {
-        opus_encoder_destroy(encoder);
+        return;
+    }
+    switch (enc->mem)
+    {
+    case OPUS_MEM_HEAP:
+        opus_encoder_destroy(enc->encoder);
+        free(enc);
+        break;
+    case OPUS_MEM_SLAB:
+        audio_slab_free(enc->slab, enc);
+        break;
+
+    default:
+        break;
     }
 }
 #endif
 
 #if 1   // opus解码
+static void opus_decode_setup(opus_dec_t *dec, OpusDecoder *decoder, audio_param_t audio_param)
+{
+    dec->decoder = decoder;
+    dec->samplerate = audio_param.samplerate;
+    dec->channels = audio_param.channels;
+    dec->frame_size = audio_param.fps > 0 ? audio_param.samplerate / audio_param.fps : audio_param.samplerate / 50;
+    dec->mem = OPUS_MEM_HEAP;
+    dec->slab = NULL;
+}
+
 codec_handle opus_decode_init(audio_param_t audio_param)
 {
     int err = 0;
     OpusDecoder *decoder = NULL;
+    opus_dec_t *dec = NULL;
 
     decoder = opus_decoder_create(audio_param.samplerate, audio_param.channels, &err);
     if (err != OPUS_OK)
@@ -124,35 +368,615 @@ codec_handle opus_decode_init(audio_param_t audio_param)
         return NULL;
     }
 
-    return decoder;
+    dec = (opus_dec_t *)malloc(sizeof(opus_dec_t));
+    if (dec == NULL)
+    {
+        opus_decoder_destroy(decoder);
+        return NULL;
+    }
+    opus_decode_setup(dec, decoder, audio_param);
+
+    return dec;
+}
+
+int opus_decode_get_size(audio_param_t audio_param)
+{
+    int size = 0;
+
+    if (audio_param.channels < 1 || audio_param.channels > 2)
+    {
+        return -1;
+    }
+    size = opus_decoder_get_size(audio_param.channels);
+    if (size <= 0)
+    {
+        return -1;
+    }
+    return OPUS_CTX_SIZE(opus_dec_t) + size;
+}
+
+codec_handle opus_decode_init_buf(audio_param_t audio_param, void *buf, int buf_size)
+{
+    int err = 0;
+    OpusDecoder *decoder = NULL;
+    opus_dec_t *dec = NULL;
+
+    if (buf == NULL || buf_size < opus_decode_get_size(audio_param))
+    {
+        fprintf(stderr, "[%s] buf_size=%d, need %d\n", __func__, buf_size, opus_decode_get_size(audio_param));
+        return NULL;
+    }
+
+    dec = (opus_dec_t *)buf;
+    decoder = (OpusDecoder *)((unsigned char *)buf + OPUS_CTX_SIZE(opus_dec_t));
+    err = opus_decoder_init(decoder, audio_param.samplerate, audio_param.channels);
+    if (err != OPUS_OK)
+    {
+        fprintf(stderr, "Cannot init decoder: %s\n", opus_strerror(err));
+        return NULL;
+    }
+    opus_decode_setup(dec, decoder, audio_param);
+    dec->mem = OPUS_MEM_CALLER;
+
+    return dec;
+}
+
+codec_handle opus_decode_init_slab(audio_param_t audio_param, audio_slab_t *slab)
+{
+    void *buf = NULL;
+    opus_dec_t *dec = NULL;
+
+    buf = audio_slab_alloc(slab);
+    if (buf == NULL)
+    {
+        fprintf(stderr, "[%s] slab is full\n", __func__);
+        return NULL;
+    }
+    dec = (opus_dec_t *)opus_decode_init_buf(audio_param, buf, audio_slab_slot_size(slab));
+    if (dec == NULL)
+    {
+        audio_slab_free(slab, buf);
+        return NULL;
+    }
+    dec->mem = OPUS_MEM_SLAB;
+    dec->slab = slab;
+
+    return dec;
 }
 
 int opus_decode_frame(codec_handle handle, unsigned char *input_buf, unsigned long input_len, opus_int16 *output_buf, int output_buf_size)
 {
     opus_int32 pcm_data_len = 0;
-    OpusDecoder *decoder = NULL;
+    opus_dec_t *dec = NULL;
 
-    decoder = (OpusDecoder *)handle;
+    dec = (opus_dec_t *)handle;
 
-    if ((decoder == NULL) || input_buf == NULL || input_len == 0)
+    if ((dec == NULL) || input_buf == NULL || input_len == 0)
     {
         fprintf(stderr, "opus decode param err\n");
         return -1;
     }
 
-    pcm_data_len = opus_decode(decoder, input_buf, input_len, output_buf, output_buf_size, FEC_ENABLE);
+    pcm_data_len = opus_decode(dec->decoder, input_buf, input_len, output_buf, output_buf_size, FEC_ENABLE);
 
     return pcm_data_len;
 }
 
+int opus_decode_frames(codec_handle handle, unsigned char *input_buf, int *packet_len, int frame_count,
+                       opus_int16 *output_buf, int output_buf_size, int *sample_count)
+{
+    int i = 0;
+    int samples = 0;
+    int decoded = 0;
+    size_t offset = 0;
+    opus_dec_t *dec = NULL;
+
+    dec = (opus_dec_t *)handle;
+
+    if ((dec == NULL) || input_buf == NULL || packet_len == NULL || output_buf == NULL || frame_count <= 0 ||
+        output_buf_size < frame_count * dec->frame_size)
+    {
+        fprintf(stderr, "opus decode param err\n");
+        return -1;
+    }
+
+    for (i = 0; i < frame_count; i++)
+    {
+        if (packet_len[i] <= 0)
+        {
+            fprintf(stderr, "opus decode frame %d len=%d, err!!\n", i, packet_len[i]);
+            return -1;
+        }
+        samples = opus_decode(dec->decoder, input_buf + offset, packet_len[i],
+                              output_buf + (size_t)decoded * dec->channels, output_buf_size - decoded, FEC_ENABLE);
+        if (samples < 0)
+        {
+            fprintf(stderr, "opus decode frame %d return %d, err!!\n", i, samples);
+            return -1;
+        }
+        if (sample_count != NULL)
+        {
+            sample_count[i] = samples;
+        }
+        decoded += samples;
+        offset += packet_len[i];
+    }
+
+    return decoded;
+}
+
+int opus_decode_lost(codec_handle handle, opus_int16 *output_buf, int output_buf_size)
+{
+    opus_dec_t *dec = (opus_dec_t *)handle;
+
+    if (dec == NULL || output_buf == NULL || output_buf_size < dec->frame_size)
+    {
+        fprintf(stderr, "opus decode param err\n");
+        return -1;
+    }
+
+    //  没有数据时解码器按丢包处理, DTX之后输出的是舒适噪声
+    return opus_decode(dec->decoder, NULL, 0, output_buf, dec->frame_size, 0);
+}
+
 void opus_decode_deinit(codec_handle handle)
 {
-    OpusDecoder *decoder = NULL;
+    opus_dec_t *dec = NULL;
 
-    decoder = (OpusDecoder *)handle;
-    if (decoder)
+    dec = (opus_dec_t *)handle;
+    if (dec == NULL)
     {
-        opus_decoder_destroy(decoder);
+        return;
+    }
+    switch (dec->mem)
+    {
+    case OPUS_MEM_HEAP:
+        opus_decoder_destroy(dec->decoder);
+        free(dec);
+        break;
+    case OPUS_MEM_SLAB:
+        audio_slab_free(dec->slab, dec);
+        break;
+
+    default:
+        break;
     }
 }
-#endif
\ No newline at end of file
+#endif
+
+#if 1   //  opus分段并行编码
+typedef struct
+{
+    audio_param_t audio_param;
+    const unsigned char *pcm_buf;   // 整段pcm起始
+    int frame_size;                 // 每帧每声道的采样数
+    int frame_bytes;                // 每帧字节数
+    int frame_total;                // 整段pcm的帧数(最后一帧补零)
+    unsigned long pcm_len;
+    int first_frame;                // 本段第一帧
+    int frame_count;                // 本段帧数
+    unsigned char *data;            // 本段输出包
+    size_t data_len;
+    size_t data_cap;
+    int *packet_len;
+    int ret;
+} opus_segment_t;
+
+/* 取第index帧, 超出pcm末尾的部分补零 */
+static const unsigned char *opus_segment_frame(opus_segment_t *seg, int index, unsigned char *pad_buf)
+{
+    unsigned long offset = (unsigned long)index * seg->frame_bytes;
+
+    if (offset + seg->frame_bytes <= seg->pcm_len)
+    {
+        return seg->pcm_buf + offset;
+    }
+
+    memset(pad_buf, 0, seg->frame_bytes);
+    if (offset < seg->pcm_len)
+    {
+        memcpy(pad_buf, seg->pcm_buf + offset, seg->pcm_len - offset);
+    }
+    return pad_buf;
+}
+
+static void *opus_segment_encode(void *arg)
+{
+    int i = 0;
+    int lookahead = 0;
+    int warm_frames = 0;
+    int opus_len = 0;
+    unsigned char *pad_buf = NULL;
+    unsigned char *tmp = NULL;
+    unsigned char packet[OPUS_PACKET_MAX];
+    opus_segment_t *seg = (opus_segment_t *)arg;
+    codec_handle handle = NULL;
+
+    seg->ret = -1;
+    handle = opus_encode_init(seg->audio_param);
+    if (handle == NULL)
+    {
+        return NULL;
+    }
+    pad_buf = (unsigned char *)malloc(seg->frame_bytes);
+    seg->packet_len = (int *)malloc(sizeof(int) * (seg->frame_count > 0 ? seg->frame_count : 1));
+    if (pad_buf == NULL || seg->packet_len == NULL)
+    {
+        goto END;
+    }
+
+    /*
+     * 预热: 从本段起点往前回退lookahead加若干帧, 编码但丢弃输出,
+     * 使编码器的延迟线和预测状态与串行编码时接近, 拼接处不出现突变
+     */
+    if (seg->first_frame > 0)
+    {
+        opus_encoder_ctl(((opus_enc_t *)handle)->encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+        warm_frames = (lookahead + seg->frame_size - 1) / seg->frame_size + OPUS_PARALLEL_OVERLAP_FRAMES;
+        if (warm_frames > seg->first_frame)
+        {
+            warm_frames = seg->first_frame;
+        }
+    }
+    for (i = seg->first_frame - warm_frames; i < seg->first_frame; i++)
+    {
+        if (opus_encode_frame(handle, (unsigned char *)opus_segment_frame(seg, i, pad_buf), seg->frame_bytes, packet, sizeof(packet)) < 0)
+        {
+            goto END;
+        }
+    }
+
+    for (i = 0; i < seg->frame_count; i++)
+    {
+        opus_len = opus_encode_frame(handle, (unsigned char *)opus_segment_frame(seg, seg->first_frame + i, pad_buf),
+                                     seg->frame_bytes, packet, sizeof(packet));
+        if (opus_len < 0)
+        {
+            goto END;
+        }
+        if (seg->data_len + opus_len > seg->data_cap)
+        {
+            seg->data_cap = (seg->data_cap + opus_len) * 2;
+            tmp = (unsigned char *)realloc(seg->data, seg->data_cap);
+            if (tmp == NULL)
+            {
+                goto END;
+            }
+            seg->data = tmp;
+        }
+        memcpy(seg->data + seg->data_len, packet, opus_len);
+        seg->data_len += opus_len;
+        seg->packet_len[i] = opus_len;
+    }
+    seg->ret = 0;
+
+END:
+    free(pad_buf);
+    opus_encode_deinit(handle);
+    return NULL;
+}
+
+int opus_encode_parallel(audio_param_t audio_param, unsigned char *pcm_buf, unsigned long pcm_len, int threads, opus_packets_t *packets)
+{
+    int i = 0;
+    int ret = -1;
+    int frame_size = 0;
+    int frame_bytes = 0;
+    int frame_total = 0;
+    int frame_per_seg = 0;
+    size_t data_len = 0;
+    opus_segment_t *segs = NULL;
+    pthread_t *tids = NULL;
+    char *started = NULL;
+
+    if (pcm_buf == NULL || packets == NULL || audio_param.fps <= 0 || audio_param.channels <= 0)
+    {
+        fprintf(stderr, "[%s] param err\n", __func__);
+        return -1;
+    }
+    memset(packets, 0, sizeof(opus_packets_t));
+
+    frame_size = audio_param.samplerate / audio_param.fps;
+    frame_bytes = frame_size * audio_param.channels * sizeof(opus_int16);
+    frame_total = (pcm_len + frame_bytes - 1) / frame_bytes;
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if (threads > frame_total)
+    {
+        threads = frame_total > 0 ? frame_total : 1;
+    }
+    frame_per_seg = (frame_total + threads - 1) / threads;
+
+    segs = (opus_segment_t *)calloc(threads, sizeof(opus_segment_t));
+    tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    started = (char *)calloc(threads, sizeof(char));
+    if (segs == NULL || tids == NULL || started == NULL)
+    {
+        goto END;
+    }
+
+    for (i = 0; i < threads; i++)
+    {
+        segs[i].audio_param = audio_param;
+        segs[i].pcm_buf = pcm_buf;
+        segs[i].pcm_len = pcm_len;
+        segs[i].frame_size = frame_size;
+        segs[i].frame_bytes = frame_bytes;
+        segs[i].frame_total = frame_total;
+        segs[i].first_frame = i * frame_per_seg;
+        segs[i].frame_count = frame_total - segs[i].first_frame;
+        if (segs[i].frame_count > frame_per_seg)
+        {
+            segs[i].frame_count = frame_per_seg;
+        }
+        if (segs[i].frame_count < 0)
+        {
+            segs[i].frame_count = 0;
+        }
+        if (pthread_create(&tids[i], NULL, opus_segment_encode, &segs[i]) != 0)
+        {
+            fprintf(stderr, "[%s] cannot create thread %d\n", __func__, i);
+            goto END;
+        }
+        started[i] = 1;
+    }
+
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(tids[i], NULL);
+        started[i] = 0;
+        if (segs[i].ret != 0)
+        {
+            fprintf(stderr, "[%s] segment %d encode failed\n", __func__, i);
+            goto END;
+        }
+        data_len += segs[i].data_len;
+    }
+
+    /* 各段的包按顺序首尾相连 */
+    packets->data = (unsigned char *)malloc(data_len > 0 ? data_len : 1);
+    packets->packet_len = (int *)malloc(sizeof(int) * (frame_total > 0 ? frame_total : 1));
+    if (packets->data == NULL || packets->packet_len == NULL)
+    {
+        opus_packets_free(packets);
+        goto END;
+    }
+    for (i = 0; i < threads; i++)
+    {
+        memcpy(packets->data + packets->data_len, segs[i].data, segs[i].data_len);
+        memcpy(packets->packet_len + packets->packet_count, segs[i].packet_len, sizeof(int) * segs[i].frame_count);
+        packets->data_len += segs[i].data_len;
+        packets->packet_count += segs[i].frame_count;
+    }
+    ret = packets->packet_count;
+
+END:
+    for (i = 0; segs != NULL && i < threads; i++)
+    {
+        if (started != NULL && started[i])
+        {
+            pthread_join(tids[i], NULL);
+        }
+        free(segs[i].data);
+        free(segs[i].packet_len);
+    }
+    free(started);
+    free(tids);
+    free(segs);
+    return ret;
+}
+
+int opus_packets_check(audio_param_t audio_param, opus_packets_t *packets)
+{
+    int i = 0;
+    int n = 0;
+    int bad = 0;
+    int first = 0;
+    int frame_size = 0;
+    size_t offset = 0;
+    int sample_count[OPUS_CHECK_BATCH];
+    opus_int16 *pcm_buf = NULL;
+    codec_handle handle = NULL;
+
+    if (packets == NULL || audio_param.fps <= 0)
+    {
+        return -1;
+    }
+
+    frame_size = audio_param.samplerate / audio_param.fps;
+    handle = opus_decode_init(audio_param);
+    if (handle == NULL)
+    {
+        return -1;
+    }
+    pcm_buf = (opus_int16 *)malloc(sizeof(opus_int16) * frame_size * audio_param.channels * OPUS_CHECK_BATCH);
+    if (pcm_buf == NULL)
+    {
+        opus_decode_deinit(handle);
+        return -1;
+    }
+
+    /* 用一个解码器顺序解完整条流, 每包必须解出且恰好一帧 */
+    for (first = 0; first < packets->packet_count; first += n)
+    {
+        n = packets->packet_count - first;
+        if (n > OPUS_CHECK_BATCH)
+        {
+            n = OPUS_CHECK_BATCH;
+        }
+        if (opus_decode_frames(handle, packets->data + offset, packets->packet_len + first, n,
+                               pcm_buf, frame_size * OPUS_CHECK_BATCH, sample_count) < 0)
+        {
+            bad += n;
+            break;
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (sample_count[i] != frame_size)
+            {
+                fprintf(stderr, "[%s] packet %d: len=%d, decoded %d samples, expect %d\n",
+                        __func__, first + i, packets->packet_len[first + i], sample_count[i], frame_size);
+                bad++;
+            }
+            offset += packets->packet_len[first + i];
+        }
+    }
+
+    free(pcm_buf);
+    opus_decode_deinit(handle);
+    return bad;
+}
+
+void opus_packets_free(opus_packets_t *packets)
+{
+    if (packets != NULL)
+    {
+        free(packets->data);
+        free(packets->packet_len);
+        memset(packets, 0, sizeof(opus_packets_t));
+    }
+}
+#endif
+
+#if 1   //  统一的编解码接口
+#define OPUS_PCM_FRAME_MS_MAX 120   // opus一包最长120ms
+
+static int opus_codec_init(audio_codec_t *codec)
+{
+    audio_param_t audio_param = codec->audio_param;
+
+    if (codec->mode == AUDIO_CODEC_ENCODER)
+    {
+        codec->handle = opus_encode_init(audio_param);
+        if (codec->handle == NULL)
+        {
+            return -1;
+        }
+        codec->frame_size = ((opus_enc_t *)codec->handle)->frame_bytes;
+        codec->packet_size_max = OPUS_PACKET_MAX;
+        //  最后一帧补零用
+        codec->scratch = audio_arena_create(codec->frame_size);
+        if (codec->scratch == NULL)
+        {
+            opus_encode_deinit(codec->handle);
+            codec->handle = NULL;
+            return -1;
+        }
+        return 0;
+    }
+
+    codec->handle = opus_decode_init(audio_param);
+    if (codec->handle == NULL)
+    {
+        return -1;
+    }
+    codec->frame_size = audio_param.samplerate / 1000 * OPUS_PCM_FRAME_MS_MAX * audio_param.channels * sizeof(opus_int16);
+    return 0;
+}
+
+static int opus_codec_encode(audio_codec_t *codec, unsigned char *pcm, int pcm_len, unsigned char *out, int out_size)
+{
+    int ret = 0;
+    size_t mark = 0;
+    unsigned char *pad_buf = NULL;
+
+    if (pcm_len >= codec->frame_size)
+    {
+        return opus_encode_frame(codec->handle, pcm, codec->frame_size, out, out_size);
+    }
+
+    //  最后不足一帧的部分补零, 补零的缓存打开时就留好了
+    mark = audio_arena_mark(codec->scratch);
+    pad_buf = (unsigned char *)audio_arena_alloc(codec->scratch, codec->frame_size);
+    if (pad_buf == NULL)
+    {
+        return -1;
+    }
+    memcpy(pad_buf, pcm, pcm_len);
+    memset(pad_buf + pcm_len, 0, codec->frame_size - pcm_len);
+    ret = opus_encode_frame(codec->handle, pad_buf, codec->frame_size, out, out_size);
+    audio_arena_release(codec->scratch, mark);
+    return ret;
+}
+
+static int opus_codec_encode_batch(audio_codec_t *codec, unsigned char *pcm, int frame_count, unsigned char *out, int out_size, int *packet_len)
+{
+    return opus_encode_frames(codec->handle, pcm, (unsigned long)frame_count * codec->frame_size, frame_count,
+                              out, out_size, packet_len);
+}
+
+static int opus_codec_decode(audio_codec_t *codec, unsigned char *in, int in_len, unsigned char *pcm, int pcm_size)
+{
+    int samples = 0;
+    int sample_bytes = codec->audio_param.channels * sizeof(opus_int16);
+
+    samples = opus_decode_frame(codec->handle, in, in_len, (opus_int16 *)pcm, pcm_size / sample_bytes);
+    return samples < 0 ? samples : samples * sample_bytes;
+}
+
+static int opus_codec_conceal(audio_codec_t *codec, unsigned char *pcm, int pcm_size)
+{
+    int samples = 0;
+    int sample_bytes = codec->audio_param.channels * sizeof(opus_int16);
+
+    samples = opus_decode_lost(codec->handle, (opus_int16 *)pcm, pcm_size / sample_bytes);
+    return samples < 0 ? samples : samples * sample_bytes;
+}
+
+static int opus_codec_reset(audio_codec_t *codec)
+{
+    if (codec->mode == AUDIO_CODEC_ENCODER)
+    {
+        opus_enc_t *enc = (opus_enc_t *)codec->handle;
+        memset(&enc->stats, 0, sizeof(enc->stats));
+        return opus_encoder_ctl(enc->encoder, OPUS_RESET_STATE) == OPUS_OK ? 0 : -1;
+    }
+    return opus_decoder_ctl(((opus_dec_t *)codec->handle)->decoder, OPUS_RESET_STATE) == OPUS_OK ? 0 : -1;
+}
+
+static int opus_codec_get_frame_size(audio_codec_t *codec)
+{
+    return codec->frame_size;
+}
+
+static int opus_codec_get_delay(audio_codec_t *codec)
+{
+    int lookahead = 0;
+
+    if (codec->mode != AUDIO_CODEC_ENCODER)
+    {
+        return 0;
+    }
+    opus_encoder_ctl(((opus_enc_t *)codec->handle)->encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+    return lookahead;
+}
+
+static void opus_codec_deinit(audio_codec_t *codec)
+{
+    if (codec->mode == AUDIO_CODEC_ENCODER)
+    {
+        opus_encode_deinit(codec->handle);
+    }
+    else
+    {
+        opus_decode_deinit(codec->handle);
+    }
+    codec->handle = NULL;
+}
+
+const audio_codec_ops_t opus_codec_ops = {
+    .name = "opus",
+    .format = AENC_FORMAT_OPUS,
+    .init = opus_codec_init,
+    .encode = opus_codec_encode,
+    .encode_batch = opus_codec_encode_batch,
+    .decode = opus_codec_decode,
+    .conceal = opus_codec_conceal,
+    .reset = opus_codec_reset,
+    .get_frame_size = opus_codec_get_frame_size,
+    .get_delay = opus_codec_get_delay,
+    .deinit = opus_codec_deinit,
+};
+#endif
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_trans.h"
+
+struct pcm_fifo
+{
+    unsigned char *buf;
+    int capacity;
+    int head;   // 读位置
+    int size;   // 当前数据量
+};
+
+#if 1   //  pcm重组帧队列
+pcm_fifo_t *pcm_fifo_create(int capacity)
+{
+    pcm_fifo_t *fifo = NULL;
+
+    if (capacity <= 0)
+    {
+        fprintf(stderr, "[%s] capacity=%d, err param\n", __func__, capacity);
+        return NULL;
+    }
+
+    fifo = (pcm_fifo_t *)calloc(1, sizeof(pcm_fifo_t));
+    if (fifo == NULL)
+    {
+        return NULL;
+    }
+    fifo->buf = (unsigned char *)malloc(capacity);
+    if (fifo->buf == NULL)
+    {
+        free(fifo);
+        return NULL;
+    }
+    fifo->capacity = capacity;
+
+    return fifo;
+}
+
+int pcm_fifo_write(pcm_fifo_t *fifo, const unsigned char *buf, int len)
+{
+    int tail = 0;
+    int first = 0;
+
+    if (fifo == NULL || buf == NULL || len < 0)
+    {
+        return -1;
+    }
+    if (len > fifo->capacity - fifo->size)
+    {
+        len = fifo->capacity - fifo->size;
+    }
+
+    tail = (fifo->head + fifo->size) % fifo->capacity;
+    first = fifo->capacity - tail;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(fifo->buf + tail, buf, first);
+    memcpy(fifo->buf, buf + first, len - first);
+    fifo->size += len;
+
+    return len;
+}
+
+int pcm_fifo_read(pcm_fifo_t *fifo, unsigned char *buf, int len)
+{
+    int first = 0;
+
+    if (fifo == NULL || buf == NULL || len < 0)
+    {
+        return -1;
+    }
+    //  只按整块取, 不够一块时不取
+    if (len > fifo->size)
+    {
+        return 0;
+    }
+
+    first = fifo->capacity - fifo->head;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(buf, fifo->buf + fifo->head, first);
+    memcpy(buf + first, fifo->buf, len - first);
+    fifo->head = (fifo->head + len) % fifo->capacity;
+    fifo->size -= len;
+
+    return len;
+}
+
+int pcm_fifo_size(pcm_fifo_t *fifo)
+{
+    return fifo != NULL ? fifo->size : 0;
+}
+
+int pcm_fifo_space(pcm_fifo_t *fifo)
+{
+    return fifo != NULL ? fifo->capacity - fifo->size : 0;
+}
+
+void pcm_fifo_reset(pcm_fifo_t *fifo)
+{
+    if (fifo != NULL)
+    {
+        fifo->head = 0;
+        fifo->size = 0;
+    }
+}
+
+void pcm_fifo_destroy(pcm_fifo_t *fifo)
+{
+    if (fifo != NULL)
+    {
+        free(fifo->buf);
+        free(fifo);
+    }
+}
+#endif
@@ -0,0 +1,32 @@
+#!/bin/sh
+# pgo训练: 用插桩版本把每个编解码方向都跑一遍, 输入是audio_test的片段和合成信号
+# usage: pgo_train.sh audio_trans audio_bench work_dir
+set -e
+
+TRANS=$1
+BENCH=$2
+WORK=$3
+CLIPS=../audio_test
+FORMATS="pcm g711a aac opus"
+
+export LD_LIBRARY_PATH=../thirdparty/lib${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}
+
+# 编解码核心: 所有编解码器, 8k/16k/48k, 单/双声道, 两种帧长, 合成信号和片段
+$BENCH --seconds 3 --fps 50,100 -o $WORK/train_bench.json 2>/dev/null
+
+# 转码路径: 解析, 流水线, 输出, 每个源格式到每个目标格式
+for from in $FORMATS; do
+    for to in $FORMATS; do
+        [ $from = pcm ] && [ $to = pcm ] && continue
+        $TRANS -i $CLIPS/test.$from -o $WORK/train.$to --from $from --to $to >/dev/null
+    done
+done
+
+# 重采样, 声道转换, 采样格式转换和wav, 批量模式
+$TRANS -i $CLIPS/test.pcm -o $WORK/train.wav --out-rate 48000 --out-channels 2 --out-sample f32 --dither >/dev/null
+$TRANS -i $WORK/train.wav -o $WORK/train.opus --quality high >/dev/null
+$TRANS -i $CLIPS/test.pcm -o $WORK/train.aac --out-rate 44100 --quality fast >/dev/null
+$TRANS -i $CLIPS/test.pcm -o $WORK/train.opus -j 4 --dtx drop >/dev/null
+$TRANS --batch $CLIPS --to opus -o $WORK >/dev/null
+
+rm -f $WORK/train.* $WORK/test.*
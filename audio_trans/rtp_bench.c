@@ -0,0 +1,651 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "audio_trans.h"
+
+#define RTP_BENCH_SECONDS 10        // 合成信号的时长, 循环发送直到RTP_BENCH_PACKETS
+#define RTP_BENCH_PACKETS 200000    // 每种负载经过回环UDP的包数
+#define RTP_BENCH_BATCH 32          // 每次sendmmsg/recvmmsg的包数
+#define RTP_BENCH_BATCH_MAX 256
+#define RTP_BENCH_PACKETS_PER_FRAME 64 // 一帧最多打成的包数, 小mtu时pcma和aac分片
+#define RTP_BENCH_RECV_SIZE 2048
+#define RTP_BENCH_AAC_SAMPLES 1024  // aac lc每帧每声道的采样数
+
+typedef struct
+{
+    audio_rtp_payload_e payload;
+    unsigned char *data;            // 编码后的帧首尾相连
+    int *offset;
+    int *len;
+    int *samples;
+    long count;
+} rtp_bench_frames_t;
+
+typedef struct
+{
+    const char *payload;
+    int samplerate;
+    int channels;
+    int fps;
+    int mtu;
+    long frames;
+    long packets;
+    double packetize_ns;            // 每包
+    double depacketize_ns;
+    double pps;                     // 回环UDP每秒收发的包数, 墙上时间
+    double pps_per_core;            // 按进程cpu时间算, 收发在同一个线程
+    double copy_pps_per_core;       // 发送时把头和负载拷成一整包, 收到后再把帧拷出来
+    unsigned long long lost;
+    int verified;                   // 解出的帧和编码输出逐字节相同
+} rtp_bench_result_t;
+
+static int rtp_bench_rate = 16000;
+static int rtp_bench_channels = 1;
+static int rtp_bench_fps = 50;
+static int rtp_bench_mtu = AUDIO_RTP_MTU_DEFAULT;
+static int rtp_bench_batch = RTP_BENCH_BATCH;
+static long rtp_bench_packets = RTP_BENCH_PACKETS;
+static const char *rtp_bench_payloads = "pcma,opus,aac-hbr,aac-latm";
+
+static unsigned long long rtp_bench_now_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static aenc_format_e rtp_bench_format(audio_rtp_payload_e payload)
+{
+    if (payload == AUDIO_RTP_PCMA)
+    {
+        return AENC_FORMAT_G711A;
+    }
+    return payload == AUDIO_RTP_OPUS ? AENC_FORMAT_OPUS : AENC_FORMAT_AAC;
+}
+
+static void rtp_bench_frames_free(rtp_bench_frames_t *frames)
+{
+    free(frames->data);
+    free(frames->offset);
+    free(frames->len);
+    free(frames->samples);
+    memset(frames, 0, sizeof(rtp_bench_frames_t));
+}
+
+/*
+ * 编码几个正弦叠加的信号, 测的是打包和收发, 编码不计时
+ */
+static int rtp_bench_encode(audio_rtp_payload_e payload, rtp_bench_frames_t *frames)
+{
+    int ret = -1;
+    int len = 0;
+    int ch = 0;
+    long i = 0;
+    long total = 0;
+    long frame_count = 0;
+    size_t size = 0;
+    size_t used = 0;
+    short *pcm = NULL;
+    audio_param_t audio_param;
+    audio_codec_t *encoder = NULL;
+
+    memset(frames, 0, sizeof(rtp_bench_frames_t));
+    memset(&audio_param, 0, sizeof(audio_param_t));
+    frames->payload = payload;
+    audio_param.format = rtp_bench_format(payload);
+    audio_param.samplerate = rtp_bench_rate;
+    audio_param.channels = rtp_bench_channels;
+    audio_param.bit_depth = 16;
+    audio_param.fps = rtp_bench_fps;
+    encoder = audio_codec_open(audio_param.format, AUDIO_CODEC_ENCODER, audio_param);
+    if (encoder == NULL)
+    {
+        return -1;
+    }
+
+    total = (long)rtp_bench_rate * RTP_BENCH_SECONDS;
+    pcm = (short *)malloc(sizeof(short) * total * rtp_bench_channels);
+    frame_count = total * rtp_bench_channels * (long)sizeof(short) / encoder->frame_size + 8;
+    size = (size_t)frame_count * encoder->packet_size_max;
+    frames->data = (unsigned char *)malloc(size);
+    frames->offset = (int *)malloc(sizeof(int) * frame_count);
+    frames->len = (int *)malloc(sizeof(int) * frame_count);
+    frames->samples = (int *)malloc(sizeof(int) * frame_count);
+    if (pcm == NULL || frames->data == NULL || frames->offset == NULL || frames->len == NULL || frames->samples == NULL)
+    {
+        goto END;
+    }
+    for (i = 0; i < total; i++)
+    {
+        for (ch = 0; ch < rtp_bench_channels; ch++)
+        {
+            pcm[i * rtp_bench_channels + ch] = (short)lrint(32767 * (0.3 * sin(2 * M_PI * 440.0 * i / rtp_bench_rate + ch) +
+                                                                      0.1 * sin(2 * M_PI * 2750.0 * i / rtp_bench_rate)));
+        }
+    }
+
+    for (i = 0; (i + 1) * encoder->frame_size <= total * rtp_bench_channels * (long)sizeof(short) || len > 0; i++)
+    {
+        if ((i + 1) * encoder->frame_size <= total * rtp_bench_channels * (long)sizeof(short))
+        {
+            len = audio_codec_encode(encoder, (unsigned char *)pcm + i * encoder->frame_size, encoder->frame_size,
+                                     frames->data + used, size - used);
+        }
+        else
+        {
+            len = audio_codec_flush(encoder, frames->data + used, size - used);
+        }
+        if (len < 0 || frames->count >= frame_count || size - used < (size_t)encoder->packet_size_max)
+        {
+            goto END;
+        }
+        if (len > 0)
+        {
+            frames->offset[frames->count] = used;
+            frames->len[frames->count] = len;
+            frames->samples[frames->count] = payload == AUDIO_RTP_AAC_HBR || payload == AUDIO_RTP_AAC_LATM
+                                                 ? RTP_BENCH_AAC_SAMPLES
+                                                 : encoder->frame_size / (int)sizeof(short) / rtp_bench_channels;
+            frames->count++;
+            used += len;
+        }
+    }
+    ret = frames->count > 0 ? 0 : -1;
+
+END:
+    free(pcm);
+    audio_codec_close(encoder);
+    if (ret != 0)
+    {
+        rtp_bench_frames_free(frames);
+    }
+    return ret;
+}
+
+/*
+ * 解出的帧和编码输出比较, aac去掉ADTS头
+ */
+static int rtp_bench_same(rtp_bench_frames_t *frames, long index, const audio_rtp_frame_t *frame)
+{
+    const unsigned char *data = frames->data + frames->offset[index];
+    int len = frames->len[index];
+    int skip = 0;
+
+    if (frames->payload == AUDIO_RTP_AAC_HBR || frames->payload == AUDIO_RTP_AAC_LATM)
+    {
+        skip = (data[1] & 0x01) ? 7 : 9;
+    }
+    return frame->len == len - skip && memcmp(frame->data, data + skip, frame->len) == 0;
+}
+
+static int rtp_bench_init(rtp_bench_frames_t *frames, audio_rtp_t *tx, audio_rtp_t *rx)
+{
+    audio_param_t audio_param;
+
+    memset(&audio_param, 0, sizeof(audio_param_t));
+    audio_param.samplerate = rtp_bench_rate;
+    audio_param.channels = rtp_bench_channels;
+    if (audio_rtp_init(tx, frames->payload, -1, audio_param, 0x12345678, rtp_bench_mtu) != 0 ||
+        audio_rtp_init(rx, frames->payload, -1, audio_param, 0, rtp_bench_mtu) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * 不经过socket: 打包计时, 拼成整包后解包计时并核对每一帧
+ */
+static int rtp_bench_codec(rtp_bench_frames_t *frames, rtp_bench_result_t *result, audio_rtp_t *tx, audio_rtp_t *rx)
+{
+    int ret = -1;
+    int n = 0;
+    int k = 0;
+    int got = 0;
+    long i = 0;
+    long count = 0;
+    long checked = 0;
+    long packets_max = 0;
+    unsigned long long start = 0;
+    unsigned char *wire = NULL;
+    int *wire_len = NULL;
+    audio_rtp_packet_t packets[RTP_BENCH_PACKETS_PER_FRAME];
+    audio_rtp_frame_t views[RTP_BENCH_PACKETS_PER_FRAME];
+
+    for (i = 0; i < frames->count; i++)
+    {
+        packets_max += frames->len[i] / (rtp_bench_mtu - AUDIO_RTP_HEADER_MAX) + 1;
+    }
+    wire = (unsigned char *)malloc((size_t)packets_max * RTP_BENCH_RECV_SIZE);
+    wire_len = (int *)malloc(sizeof(int) * packets_max);
+    if (wire == NULL || wire_len == NULL || rtp_bench_init(frames, tx, rx) != 0)
+    {
+        goto END;
+    }
+
+    start = rtp_bench_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < frames->count; i++)
+    {
+        n = audio_rtp_packetize(tx, frames->data + frames->offset[i], frames->len[i], frames->samples[i], packets,
+                                RTP_BENCH_PACKETS_PER_FRAME);
+        if (n < 0)
+        {
+            goto END;
+        }
+        count += n;
+    }
+    result->packetize_ns = count > 0 ? (double)(rtp_bench_now_ns(CLOCK_MONOTONIC) - start) / count : 0;
+
+    //  再打一遍存成整包, 不计时
+    if (rtp_bench_init(frames, tx, rx) != 0)
+    {
+        goto END;
+    }
+    count = 0;
+    for (i = 0; i < frames->count; i++)
+    {
+        n = audio_rtp_packetize(tx, frames->data + frames->offset[i], frames->len[i], frames->samples[i], packets,
+                                RTP_BENCH_PACKETS_PER_FRAME);
+        for (k = 0; k < n; k++, count++)
+        {
+            memcpy(wire + count * RTP_BENCH_RECV_SIZE, packets[k].iov[0].iov_base, packets[k].iov[0].iov_len);
+            memcpy(wire + count * RTP_BENCH_RECV_SIZE + packets[k].iov[0].iov_len, packets[k].iov[1].iov_base, packets[k].iov[1].iov_len);
+            wire_len[count] = packets[k].len;
+        }
+    }
+
+    start = rtp_bench_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < count; i++)
+    {
+        got = audio_rtp_depacketize(rx, wire + i * RTP_BENCH_RECV_SIZE, wire_len[i], views, RTP_BENCH_PACKETS_PER_FRAME);
+        if (got < 0)
+        {
+            goto END;
+        }
+    }
+    result->depacketize_ns = count > 0 ? (double)(rtp_bench_now_ns(CLOCK_MONOTONIC) - start) / count : 0;
+
+    //  核对: pcma被切成多包时每包是一段采样, 接起来和整个编码输出比较(帧在data里首尾相连)
+    if (rtp_bench_init(frames, tx, rx) != 0)
+    {
+        goto END;
+    }
+    result->verified = 1;
+    for (i = 0, k = 0; i < count; i++)
+    {
+        got = audio_rtp_depacketize(rx, wire + i * RTP_BENCH_RECV_SIZE, wire_len[i], views, RTP_BENCH_PACKETS_PER_FRAME);
+        for (n = 0; n < got; n++)
+        {
+            if (frames->payload == AUDIO_RTP_PCMA)
+            {
+                result->verified &= checked + views[n].len <= frames->offset[frames->count - 1] + frames->len[frames->count - 1] &&
+                                    memcmp(views[n].data, frames->data + checked, views[n].len) == 0;
+                checked += views[n].len;
+            }
+            else if (k < frames->count)
+            {
+                result->verified &= rtp_bench_same(frames, k++, &views[n]);
+                checked++;
+            }
+        }
+    }
+    result->verified &= frames->payload == AUDIO_RTP_PCMA ? checked == frames->offset[frames->count - 1] + frames->len[frames->count - 1]
+                                                          : checked == frames->count;
+    result->frames = frames->count;
+    ret = 0;
+
+END:
+    free(wire);
+    free(wire_len);
+    return ret;
+}
+
+static int rtp_bench_sockets(int *tx_fd, int *rx_fd)
+{
+    int size = 4 * 1024 * 1024;
+    socklen_t len = sizeof(struct sockaddr_in);
+    struct sockaddr_in addr;
+
+    *tx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    *rx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (*tx_fd < 0 || *rx_fd < 0)
+    {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(*rx_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (bind(*rx_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || getsockname(*rx_fd, (struct sockaddr *)&addr, &len) != 0 ||
+        connect(*tx_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * 回环UDP: 一批帧打包后sendmmsg, 再recvmmsg收回来解包, 收发在同一个线程, 包数除以cpu时间就是每核的包率.
+ * copy为1时模拟拷贝两次的RTP层: 发送前把头和负载拷成一整包, 解出的帧再拷出来
+ */
+static int rtp_bench_udp(rtp_bench_frames_t *frames, rtp_bench_result_t *result, audio_rtp_t *tx, audio_rtp_t *rx, int copy)
+{
+    int ret = -1;
+    int i = 0;
+    int n = 0;
+    int k = 0;
+    int sent = 0;
+    int got = 0;
+    int tx_fd = -1;
+    int rx_fd = -1;
+    int batch_packets = 0;
+    long frame = 0;
+    long packets = 0;
+    unsigned long long wall = 0;
+    unsigned long long cpu = 0;
+    unsigned char *send_buf = NULL;
+    unsigned char *recv_buf = NULL;
+    unsigned char *copy_buf = NULL;
+    audio_rtp_packet_t *out = NULL;
+    struct mmsghdr *send_msgs = NULL;
+    struct mmsghdr *recv_msgs = NULL;
+    struct iovec *send_iov = NULL;
+    struct iovec *recv_iov = NULL;
+    audio_rtp_frame_t views[RTP_BENCH_PACKETS_PER_FRAME];
+    int max = rtp_bench_batch * RTP_BENCH_PACKETS_PER_FRAME;
+
+    out = (audio_rtp_packet_t *)malloc(sizeof(audio_rtp_packet_t) * max);
+    send_msgs = (struct mmsghdr *)calloc(max, sizeof(struct mmsghdr));
+    recv_msgs = (struct mmsghdr *)calloc(max, sizeof(struct mmsghdr));
+    send_iov = (struct iovec *)calloc(max, sizeof(struct iovec));
+    recv_iov = (struct iovec *)calloc(max, sizeof(struct iovec));
+    send_buf = (unsigned char *)malloc((size_t)max * RTP_BENCH_RECV_SIZE);
+    recv_buf = (unsigned char *)malloc((size_t)max * RTP_BENCH_RECV_SIZE);
+    copy_buf = (unsigned char *)malloc(AUDIO_RTP_FRAG_MAX);
+    if (out == NULL || send_msgs == NULL || recv_msgs == NULL || send_iov == NULL || recv_iov == NULL || send_buf == NULL ||
+        recv_buf == NULL || copy_buf == NULL || rtp_bench_sockets(&tx_fd, &rx_fd) != 0 || rtp_bench_init(frames, tx, rx) != 0)
+    {
+        goto END;
+    }
+    for (i = 0; i < max; i++)
+    {
+        recv_iov[i].iov_base = recv_buf + (size_t)i * RTP_BENCH_RECV_SIZE;
+        recv_iov[i].iov_len = RTP_BENCH_RECV_SIZE;
+        recv_msgs[i].msg_hdr.msg_iov = &recv_iov[i];
+        recv_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    wall = rtp_bench_now_ns(CLOCK_MONOTONIC);
+    cpu = rtp_bench_now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    while (packets < rtp_bench_packets)
+    {
+        //  一批帧打包, 零拷贝时每包两段iovec直接发
+        batch_packets = 0;
+        for (i = 0; i < rtp_bench_batch; i++, frame++)
+        {
+            k = frame % frames->count;
+            n = audio_rtp_packetize(tx, frames->data + frames->offset[k], frames->len[k], frames->samples[k], out + batch_packets,
+                                    max - batch_packets);
+            if (n < 0)
+            {
+                goto END;
+            }
+            batch_packets += n;
+            if (max - batch_packets < RTP_BENCH_PACKETS_PER_FRAME)
+            {
+                break;
+            }
+        }
+        for (i = 0; i < batch_packets; i++)
+        {
+            if (copy)
+            {
+                memcpy(send_buf + (size_t)i * RTP_BENCH_RECV_SIZE, out[i].iov[0].iov_base, out[i].iov[0].iov_len);
+                memcpy(send_buf + (size_t)i * RTP_BENCH_RECV_SIZE + out[i].iov[0].iov_len, out[i].iov[1].iov_base, out[i].iov[1].iov_len);
+                send_iov[i].iov_base = send_buf + (size_t)i * RTP_BENCH_RECV_SIZE;
+                send_iov[i].iov_len = out[i].len;
+                send_msgs[i].msg_hdr.msg_iov = &send_iov[i];
+                send_msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            else
+            {
+                send_msgs[i].msg_hdr.msg_iov = out[i].iov;
+                send_msgs[i].msg_hdr.msg_iovlen = out[i].iov_count;
+            }
+        }
+        for (sent = 0; sent < batch_packets; sent += n)
+        {
+            n = sendmmsg(tx_fd, send_msgs + sent, batch_packets - sent, 0);
+            if (n <= 0)
+            {
+                goto END;
+            }
+        }
+
+        //  回环上sendmmsg返回时包已经在接收队列里
+        for (got = 0; got < batch_packets; got += n)
+        {
+            n = recvmmsg(rx_fd, recv_msgs, batch_packets - got, 0, NULL);
+            if (n <= 0)
+            {
+                goto END;
+            }
+            for (i = 0; i < n; i++)
+            {
+                k = audio_rtp_depacketize(rx, recv_buf + (size_t)i * RTP_BENCH_RECV_SIZE, recv_msgs[i].msg_len, views,
+                                          RTP_BENCH_PACKETS_PER_FRAME);
+                while (copy && k-- > 0)
+                {
+                    memcpy(copy_buf, views[k].data, views[k].len);
+                }
+            }
+        }
+        packets += batch_packets;
+    }
+    cpu = rtp_bench_now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    wall = rtp_bench_now_ns(CLOCK_MONOTONIC) - wall;
+
+    if (copy)
+    {
+        result->copy_pps_per_core = cpu > 0 ? packets * 1e9 / cpu : 0;
+    }
+    else
+    {
+        result->packets = packets;
+        result->pps = wall > 0 ? packets * 1e9 / wall : 0;
+        result->pps_per_core = cpu > 0 ? packets * 1e9 / cpu : 0;
+        result->lost = rx->lost;
+    }
+    ret = 0;
+
+END:
+    if (tx_fd >= 0)
+    {
+        close(tx_fd);
+    }
+    if (rx_fd >= 0)
+    {
+        close(rx_fd);
+    }
+    free(out);
+    free(send_msgs);
+    free(recv_msgs);
+    free(send_iov);
+    free(recv_iov);
+    free(send_buf);
+    free(recv_buf);
+    free(copy_buf);
+    return ret;
+}
+
+static void rtp_bench_print(FILE *fp, rtp_bench_result_t *result, int first)
+{
+    fprintf(fp, "%s    {\"payload\": \"%s\", \"samplerate\": %d, \"channels\": %d, \"fps\": %d, \"mtu\": %d, \"batch\": %d, "
+                "\"frames\": %ld, \"packets\": %ld, \"packetize_ns\": %.1f, \"depacketize_ns\": %.1f, \"pps\": %.0f, "
+                "\"pps_per_core\": %.0f, \"copy_pps_per_core\": %.0f, \"lost\": %llu, \"verified\": %d}",
+            first ? "" : ",\n", result->payload, result->samplerate, result->channels, result->fps, result->mtu, rtp_bench_batch,
+            result->frames, result->packets, result->packetize_ns, result->depacketize_ns, result->pps,
+            result->pps_per_core, result->copy_pps_per_core, result->lost, result->verified);
+}
+
+static void rtp_bench_usage(const char *cmd)
+{
+    printf("usage: %s [-o result.json] [options]\n", cmd);
+    printf("\t -o FILE: write the json result to FILE (default stdout)\n");
+    printf("\t --payloads LIST: pcma,opus,aac-hbr,aac-latm (default all)\n");
+    printf("\t --rate N: samplerate of the encoded signal (default 16000)\n");
+    printf("\t --channels N: channels (default 1)\n");
+    printf("\t --fps N: frames per second of pcma and opus (default 50)\n");
+    printf("\t --mtu N: largest rtp packet (default %d)\n", AUDIO_RTP_MTU_DEFAULT);
+    printf("\t --batch N: packets per sendmmsg/recvmmsg (default %d)\n", RTP_BENCH_BATCH);
+    printf("\t --packets N: packets through the loopback udp socket per payload (default %d)\n", RTP_BENCH_PACKETS);
+}
+
+enum
+{
+    OPT_PAYLOADS = 0x100,
+    OPT_RATE,
+    OPT_CHANNELS,
+    OPT_FPS,
+    OPT_MTU,
+    OPT_BATCH,
+    OPT_PACKETS
+};
+
+int main(int argc, char **argv)
+{
+    int i = 0;
+    int opt = 0;
+    int ret = 0;
+    int count = 0;
+    int failed = 0;
+    FILE *fp = stdout;
+    char name[32];
+    const char *p = NULL;
+    static audio_rtp_t tx;
+    static audio_rtp_t rx;
+    rtp_bench_frames_t frames;
+    rtp_bench_result_t result;
+    struct option long_options[] = {
+        {"output", required_argument, NULL, 'o'},
+        {"payloads", required_argument, NULL, OPT_PAYLOADS},
+        {"rate", required_argument, NULL, OPT_RATE},
+        {"channels", required_argument, NULL, OPT_CHANNELS},
+        {"fps", required_argument, NULL, OPT_FPS},
+        {"mtu", required_argument, NULL, OPT_MTU},
+        {"batch", required_argument, NULL, OPT_BATCH},
+        {"packets", required_argument, NULL, OPT_PACKETS},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+
+    while ((opt = getopt_long(argc, argv, "o:h", long_options, NULL)) != -1)
+    {
+        ret = 1;
+        switch (opt)
+        {
+        case 'o':
+            fp = fopen(optarg, "w");
+            if (fp == NULL)
+            {
+                fprintf(stderr, "cannot open %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_PAYLOADS:
+            rtp_bench_payloads = optarg;
+            break;
+        case OPT_RATE:
+            ret = rtp_bench_rate = atoi(optarg);
+            break;
+        case OPT_CHANNELS:
+            ret = rtp_bench_channels = atoi(optarg);
+            ret = ret <= AUDIO_CHANNELS_MAX ? ret : -1;
+            break;
+        case OPT_FPS:
+            ret = rtp_bench_fps = atoi(optarg);
+            break;
+        case OPT_MTU:
+            ret = rtp_bench_mtu = atoi(optarg);
+            ret = ret > AUDIO_RTP_HEADER_MAX && ret <= RTP_BENCH_RECV_SIZE ? ret : -1;
+            break;
+        case OPT_BATCH:
+            ret = rtp_bench_batch = atoi(optarg);
+            ret = ret <= RTP_BENCH_BATCH_MAX ? ret : -1;
+            break;
+        case OPT_PACKETS:
+            ret = atoi(optarg);
+            rtp_bench_packets = ret;
+            break;
+        case 'h':
+            rtp_bench_usage(argv[0]);
+            return 0;
+
+        default:
+            rtp_bench_usage(argv[0]);
+            return -1;
+        }
+        if (ret <= 0)
+        {
+            fprintf(stderr, "%s, err param!!!\n", optarg);
+            return -1;
+        }
+    }
+
+    fprintf(fp, "{\n  \"version\": 1,\n  \"time\": %ld,\n  \"results\": [\n", (long)time(NULL));
+    for (p = rtp_bench_payloads; ret >= 0 && *p != '\0'; p += strlen(name), p += *p == ',')
+    {
+        sscanf(p, "%31[^,]", name);
+        for (i = 0; i < AUDIO_RTP_PAYLOAD_MAX && strcmp(audio_rtp_payload_name(i), name) != 0; i++)
+        {
+        }
+        if (i == AUDIO_RTP_PAYLOAD_MAX)
+        {
+            fprintf(stderr, "payload=%s, err param!!!\n", name);
+            ret = -1;
+            break;
+        }
+        if (rtp_bench_encode(i, &frames) != 0)
+        {
+            ret = -1;
+            break;
+        }
+
+        memset(&result, 0, sizeof(result));
+        result.payload = audio_rtp_payload_name(i);
+        result.samplerate = rtp_bench_rate;
+        result.channels = rtp_bench_channels;
+        result.fps = rtp_bench_fps;
+        result.mtu = rtp_bench_mtu;
+        if (rtp_bench_codec(&frames, &result, &tx, &rx) != 0 || rtp_bench_udp(&frames, &result, &tx, &rx, 0) != 0 ||
+            rtp_bench_udp(&frames, &result, &tx, &rx, 1) != 0)
+        {
+            fprintf(stderr, "%s: benchmark failed\n", name);
+            failed = 1;
+        }
+        else
+        {
+            rtp_bench_print(fp, &result, count++ == 0);
+            fprintf(stderr, "%-8s %5dHz %dch packetize %6.1fns depacketize %6.1fns udp %9.0f pps/core (copying %9.0f) lost %llu%s\n",
+                    result.payload, result.samplerate, result.channels, result.packetize_ns, result.depacketize_ns,
+                    result.pps_per_core, result.copy_pps_per_core, result.lost, result.verified ? "" : " NOT VERIFIED");
+        }
+        rtp_bench_frames_free(&frames);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+
+    return ret < 0 || failed ? -1 : 0;
+}
@@ -4,27 +4,89 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include "audio_trans.h"
+#include "audio_alloc.h"
 
 #define AUDIO_CODEC_PCM "pcm"
+#define AUDIO_FILE_WAV "wav"
 #define AUDIO_CODEC_G711A "g711a"
 #define AUDIO_CODEC_AAC "aac"
 #define AUDIO_CODEC_OPUS "opus"
 
 #define OUT_FILE_PREFIX "out"
 #define OUT_FILE_PCM OUT_FILE_PREFIX ".pcm"
+#define OUT_FILE_WAV OUT_FILE_PREFIX ".wav"
 #define OUT_FILE_G711A OUT_FILE_PREFIX ".g711a"
 #define OUT_FILE_AAC OUT_FILE_PREFIX ".aac"
 #define OUT_FILE_OPUS OUT_FILE_PREFIX ".opus"
 
 #define FRAME_SIZE_MAX 10240
+#define SINK_BATCH_BYTES 32000   // 编码端每批最多编码的pcm字节数, 16k单声道下50帧opus
+#define G711A_BATCH_SAMPLES 1024 // g711a每次解码的字节数
+#define PCM_READ_CHUNK 4096      // pcm源文件每次读取的字节数
+#define DAEMON_MAX_CONNS 256      // 守护进程默认的最多连接数
+#define PIPELINE_SLOTS 64         // 流水线每个环的槽数
+#define PROBE_SIZE 4096          // 探测格式时读取的文件头长度
+#define STREAM_WINDOW_MIN 16384  // 流式输入的最小窗口, 至少放得下两个最大的ADTS帧
+#define STREAM_PATH "-"          // 输入/输出文件名为-时读stdin/写stdout
+#define CONVERT_CHUNK_FRAMES 1024 // 每次转换声道/重采样的输入帧数
+#define RESAMPLE_IN_RATE_MIN AUDIO_SAMPLERATE_8000 // 重采样的输出缓存按这个输入采样率留, 更低时每块少送
+#define BATCH_STRAGGLER_FACTOR 4 // 批量转码时耗时超过中位数几倍算慢文件
+#define BATCH_STRAGGLER_SHOW 5   // 报告里列出最慢的文件数
+#define CONCEAL_MAX_MS 1000      // opus时间戳跳变最多补偿的时长, 超过的按重新同步处理
 
 #define SUPPORT_IMI 1
 
+typedef enum
+{
+    OPUS_DTX_OFF = 0,
+    OPUS_DTX_KEEP,  // 打开DTX, DTX包照常写入
+    OPUS_DTX_DROP   // 打开DTX, DTX包不写入, 解码时按时间戳补齐
+} opus_dtx_e;
+
+typedef enum
+{
+    LOUDNESS_OFF = 0,
+    LOUDNESS_AGC,       // 一遍: 编码前过AGC和限幅
+    LOUDNESS_NORMALIZE  // 两遍: 先解码量出整体响度, 再按固定增益转码, 响度写到旁路文件
+} loudness_mode_e;
+
+static int opus_threads = 1; // >1时pcm2opus分段并行编码
+static opus_dtx_e opus_dtx = OPUS_DTX_OFF;
+static int stream_flush = 0;       // 每写一帧就fflush, 实时场景用
+static int stream_buffer_size = 0; // 流式输入窗口和输出stdio缓存大小, 0为默认
+static FILE *info_fp = NULL;       // 统计信息输出, 输出到stdout时改为stderr
+static audio_input_mode_e input_mode = AUDIO_INPUT_AUTO;
+static audio_output_mode_e output_mode = AUDIO_OUTPUT_AUTO;
+static int out_samplerate = 0;     // 编码器的采样率, 0为和源相同
+static int out_channels = 0;       // 编码器的声道数, 0为和源相同
+static audio_resample_quality_e resample_quality = AUDIO_RESAMPLE_MEDIUM;
+static int in_sample_format = -1;  // 源pcm的采样格式, -1为按bit_depth
+static int out_sample_format = -1; // 输出pcm的采样格式, -1为和源相同
+static int sample_dither = 0;      // 降位数时加TPDF抖动
+static int out_wav = 0;            // 输出pcm时写wav头
+static int use_pipeline = 1;       // 单文件转码时读、编解码、写各用一个线程
+static int pipeline_stats = 0;     // 结束时打印流水线每级的耗时和环的占用
+static int trace_json = -1;        // 每帧耗时直方图: -1不统计, 0文本, 1json; 退出时和收到SIGUSR1时输出到stderr
+static int counters_json = -1;     // 编解码计数器: -1不输出, 0文本, 1json; 输出时机同上
+static loudness_mode_e loudness_mode = LOUDNESS_OFF;
+static audio_agc_param_t agc_param;  // 目标响度、增益范围和峰值上限, adaptive按loudness_mode
+static char *loudness_sidecar = NULL; // 响度的旁路文件, 两遍归一化时默认是输出文件名加.loudness.json
+
 #ifdef SUPPORT_IMI
 static opus_uint32
-char_to_int(unsigned char ch[4])
+char_to_int(const unsigned char ch[4])
 {
     return ((opus_uint32)ch[0] << 24) | ((opus_uint32)ch[1] << 16) | ((opus_uint32)ch[2] << 8) | (opus_uint32)ch[3];
 }
@@ -37,35 +99,10 @@ static void int_to_char(opus_uint32 i, unsigned char ch[4])
 }
 #endif
 
-ssize_t get_file_content(char *file_name, uint8_t **out_buf)
-{
-    int fd;
-    size_t file_size;
-    ssize_t read_size;
-
-    fd = open(file_name, O_RDONLY);
-    if (fd < 0)
-    {
-        fprintf(stderr, "Cannot open %s!\n", file_name);
-        return -1;
-    }
-
-    file_size = lseek(fd, 0, SEEK_END);
-    lseek(fd, 0, SEEK_SET);
-    *out_buf = (uint8_t *)malloc(sizeof(uint8_t) * file_size);
-
-    read_size = read(fd, *out_buf, file_size);
-    if (read_size != file_size)
-    {
-        fprintf(stderr, "Have not get all connect from %s!\n", file_name);
-        return -1;
-    }
-
-    close(fd);
-    return read_size;
-}
-
-int get_one_ADTS_frame(unsigned char *buffer, size_t buf_size, unsigned char *data, size_t *data_size)
+/*
+ * 找到下一个完整的ADTS帧, *data指向buffer里帧的开头(跳过了前面的无效数据), 不拷贝
+ */
+int get_one_ADTS_frame(unsigned char *buffer, size_t buf_size, unsigned char **data, size_t *data_size)
 {
     size_t size = 0;
 
@@ -97,535 +134,3321 @@ int get_one_ADTS_frame(unsigned char *buffer, size_t buf_size, unsigned char *da
         return -3;
     }
 
-    memcpy(data, buffer, size);
+    *data = buffer;
     *data_size = size;
 
     return 0;
 }
 
-int pcm2aac(audio_param_t audio_param, char *src_filename)
+/*
+ * IMI头: 4字节包长 + 4字节时间戳(包的第一个采样的序号, 大端)
+ * 旧文件的时间戳全是0, 解码时时间戳不大于期望值就按顺序处理
+ */
+static void write_opus_packet(audio_output_t *out, unsigned char *opus_buf, int opus_buf_len, opus_uint32 timestamp)
+{
+#ifdef SUPPORT_IMI
+    unsigned char ch[8];
+    int_to_char(opus_buf_len, ch);
+    int_to_char(timestamp, ch + 4);
+    audio_output_write(out, ch, sizeof(ch));
+#else
+    audio_output_write(out, &opus_buf_len, sizeof(int));
+#endif
+    audio_output_write(out, opus_buf, opus_buf_len);
+}
+
+/*
+ * 打开输出文件, -为stdout
+ */
+static audio_output_t *output_open(char *dst_filename)
 {
-    codec_handle aenc_handle = NULL;
-    unsigned long input_len = 0;
-    unsigned long output_len_max = 0;
-    FILE *fp_read = NULL;
-    FILE *fp_write = NULL;
-    short *read_buf = NULL; // bit_depth=16, so use short
-    unsigned char *aac_buf = NULL;
-    int aac_out_len = 0;
+    if (strcmp(dst_filename, STREAM_PATH) == 0)
+    {
+        return audio_output_open_fd(STDOUT_FILENO, output_mode, stream_buffer_size);
+    }
+    return audio_output_open(dst_filename, output_mode, stream_buffer_size);
+}
 
-    aenc_handle = aac_encode_init(audio_param, &input_len, &output_len_max);
-    // printf("aenc input len=%lu, max out len=%lu\n", input_len, output_len_max);
+/*
+ * 两个路径是不是同一个文件, 按设备号和inode比, ./x和硬链接也算; 不存在或者是stdin/stdout时不算
+ */
+static int same_file(const char *src_filename, const char *dst_filename)
+{
+    struct stat src_st, dst_st;
 
-    fp_read = fopen(src_filename, "r");
-    if (fp_read == NULL)
+    if (strcmp(src_filename, STREAM_PATH) == 0 || strcmp(dst_filename, STREAM_PATH) == 0)
     {
-        fprintf(stderr, "cannot open %s\n", src_filename);
-        return -1;
+        return 0;
     }
-    fp_write = fopen(OUT_FILE_AAC, "w");
-    if (fp_write == NULL)
+    if (stat(src_filename, &src_st) != 0 || stat(dst_filename, &dst_st) != 0)
     {
-        fprintf(stderr, "cannot open %s\n", OUT_FILE_AAC);
-        return -1;
+        return 0;
+    }
+    return src_st.st_dev == dst_st.st_dev && src_st.st_ino == dst_st.st_ino;
+}
+
+static const char *out_file_name(aenc_format_e format)
+{
+    switch (format)
+    {
+    case AENC_FORMAT_G711A:
+        return OUT_FILE_G711A;
+    case AENC_FORMAT_AAC:
+        return OUT_FILE_AAC;
+    case AENC_FORMAT_OPUS:
+        return OUT_FILE_OPUS;
+
+    default:
+        return out_wav ? OUT_FILE_WAV : OUT_FILE_PCM;
     }
+}
 
-    aac_buf = (unsigned char *)malloc(output_len_max);
-    read_buf = (short *)malloc(input_len * sizeof(short));
-    memset(read_buf, 0, input_len * sizeof(short));
-    while (fread(read_buf, sizeof(short), input_len, fp_read) == input_len)
+static int samplerate_is_valid(int samplerate)
+{
+    switch (samplerate)
     {
-        aac_out_len = aac_encode_frame(aenc_handle, (unsigned char *)read_buf, input_len, aac_buf, output_len_max);
-        // printf("aac_out_len=%d\n", aac_out_len);
-        if (aac_out_len <= 0)
-        {
-            continue;
-        }
-        fwrite(aac_buf, 1, aac_out_len, fp_write);
-        memset(read_buf, 0, input_len * sizeof(short));
+    case AUDIO_SAMPLERATE_8000:
+    case AUDIO_SAMPLERATE_11025:
+    case AUDIO_SAMPLERATE_12000:
+    case AUDIO_SAMPLERATE_16000:
+    case AUDIO_SAMPLERATE_22050:
+    case AUDIO_SAMPLERATE_24000:
+    case AUDIO_SAMPLERATE_32000:
+    case AUDIO_SAMPLERATE_44100:
+    case AUDIO_SAMPLERATE_48000:
+        return 1;
+
+    default:
+        return 0;
     }
-    fp_read = NULL;
-    // printf("aenc ok!!!!\n");
+}
 
-    free(aac_buf);
-    free(read_buf);
-    if (fp_write != NULL)
+/*
+ * 编码器的参数: 和源相同, 指定了--out-rate/--out-channels时换成目标采样率/声道数
+ */
+static audio_param_t encoder_param(audio_param_t audio_param)
+{
+    if (out_samplerate > 0)
     {
-        fclose(fp_write);
+        audio_param.samplerate = out_samplerate;
     }
-    if (fp_read != NULL)
+    if (out_channels > 0)
     {
-        fclose(fp_read);
+        audio_param.channels = out_channels;
     }
-
-    acc_encode_deinit(aenc_handle);
-
-    return 0;
+    return audio_param;
 }
 
-int aac2pcm(audio_param_t audio_param, char *src_filename)
+static const char *sample_format_names[AUDIO_SAMPLE_FORMAT_MAX] = {
+    [AUDIO_SAMPLE_S16] = "s16",
+    [AUDIO_SAMPLE_S24] = "s24",
+    [AUDIO_SAMPLE_S24_32] = "s24_32",
+    [AUDIO_SAMPLE_S32] = "s32",
+    [AUDIO_SAMPLE_F32] = "f32",
+};
+
+static int sample_format_parse(const char *name)
 {
-    int ret = 0;
-    codec_handle adec_handle = NULL;
-    uint8_t *aac_buf = NULL;
-    ssize_t aac_buf_len = 0;
-    unsigned char frame[FRAME_SIZE_MAX] = {0};
-    unsigned long frame_len = 0;
-    unsigned char *input_data = NULL;
-    size_t input_data_len = 0;
-    unsigned char pcm_buf[FRAME_SIZE_MAX] = {0};
-    int pcm_len = 0;
-    FILE *fp_write = NULL;
+    int i = 0;
 
-    fp_write = fopen(OUT_FILE_PCM, "w");
-    if (fp_write == NULL)
+    for (i = 0; i < AUDIO_SAMPLE_FORMAT_MAX; i++)
     {
-        fprintf(stderr, "cannot open %s\n", OUT_FILE_PCM);
-        return -1;
+        if (strcmp(name, sample_format_names[i]) == 0)
+        {
+            return i;
+        }
     }
+    return -1;
+}
 
-    aac_buf_len = get_file_content(src_filename, &aac_buf);
-    if (aac_buf_len <= 0)
+/*
+ * 源的采样格式: 压缩格式解码出来都是s16, pcm没有指定--sample时按bit_depth
+ */
+static audio_sample_format_e source_sample_format(audio_param_t audio_param)
+{
+    if (audio_param.format != AENC_FORMAT_PCM)
     {
-        fprintf(stderr, "cannot read %s\n", src_filename);
-        return -1;
+        return AUDIO_SAMPLE_S16;
     }
-
-    ret = get_one_ADTS_frame(aac_buf, aac_buf_len, frame, &frame_len);
-    if (ret < 0)
+    if (in_sample_format >= 0)
     {
-        fprintf(stderr, "cannot find adts frame. ret=%d\n", ret);
-        return -1;
+        return in_sample_format;
     }
-
-    adec_handle = aac_decode_init(audio_param, frame, frame_len);
-    if (adec_handle == NULL)
+    switch (audio_param.bit_depth)
     {
-        fprintf(stderr, "aac_decode_init err\n");
-        return -1;
+    case 24:
+        return AUDIO_SAMPLE_S24;
+    case 32:
+        return AUDIO_SAMPLE_S32;
+
+    default:
+        return AUDIO_SAMPLE_S16;
     }
+}
 
-    input_data = aac_buf;
-    input_data_len = aac_buf_len;
-    while (get_one_ADTS_frame(input_data, input_data_len, frame, &frame_len) == 0)
+/*
+ * 编码器要的采样格式: 编码器都用s16, 输出pcm时按--out-sample, 没指定就和源相同
+ */
+static audio_sample_format_e target_sample_format(aenc_format_e to_format, audio_sample_format_e in_sample)
+{
+    if (to_format != AENC_FORMAT_PCM)
     {
-        pcm_len = aac_decode_frame(adec_handle, audio_param, frame, frame_len, pcm_buf, sizeof(pcm_buf));
-        if (pcm_len > 0)
-        {
-            // printf("pcm len=%d\n", pcm_len);
-            fwrite(pcm_buf, 1, pcm_len, fp_write);
-        }
-        input_data_len -= frame_len;
-        input_data += frame_len;
+        return AUDIO_SAMPLE_S16;
+    }
+    if (out_sample_format >= 0)
+    {
+        return out_sample_format;
     }
-    // printf("decode aac ok!!!\n");
-    fclose(fp_write);
-    free(aac_buf);
+    return in_sample;
+}
 
-    acc_decode_deinit(adec_handle);
+/*
+ * 源和编码器的采样率、声道数、采样格式都相同, 不需要转换
+ */
+static int same_pcm_layout(audio_param_t audio_param, aenc_format_e to_format)
+{
+    audio_param_t enc_param = encoder_param(audio_param);
 
-    return 0;
+    return enc_param.samplerate == audio_param.samplerate && enc_param.channels == audio_param.channels &&
+           source_sample_format(audio_param) == target_sample_format(to_format, source_sample_format(audio_param));
 }
 
-int pcm2g711a(char *src_filename)
+/*
+ * 编码端: 解码器(或pcm文件)输出任意长度的pcm, 经pcm_fifo重新分成编码器需要的帧长,
+ * 编码后写入输出文件. 整个转码过程只在内存里缓存几帧, 和文件长度无关
+ */
+typedef struct
 {
-    int ret = 0;
-    int pcm_len = 0;
-    unsigned char *pcm_buf = NULL;
-    int g711a_len = 0;
-    unsigned char *g711a_buf = NULL;
-    FILE *fp = NULL;
+    aenc_format_e format;
+    audio_param_t audio_param;
+    audio_output_t *out;
+    audio_codec_t *codec;
+    pcm_fifo_t *fifo;
+    int frame_bytes;            // 编码器每帧需要的pcm字节数
+    int batch_frames;           // 每次最多编码的帧数
+    unsigned char *frame_buf;   // batch_frames帧pcm
+    unsigned char *out_buf;     // 编码输出
+    int out_buf_size;
+    int *packet_len;
+    opus_uint32 timestamp;      // opus: 下一包的时间戳
+    unsigned char pending[FRAME_SIZE_MAX]; // opus: 暂存的DTX包, 流的最后一包必须写入
+    int pending_len;
+    opus_uint32 pending_timestamp;
+    unsigned long dropped;
+    unsigned long long pcm_bytes; // 当前文件写入的pcm字节数, 用于统计音频时长
+    audio_sample_format_e in_sample;  // 送进来的pcm的采样格式
+    audio_sample_format_e out_sample; // 编码器要的采样格式, 只有输出pcm时不是s16
+    unsigned char *in_conv_buf;       // 源格式->s16(不转声道和采样率时直接转成out_sample)
+    unsigned char *out_conv_buf;      // s16->out_sample
+    unsigned int dither_seed;
+    int wav;                          // 输出wav: 开始时写占位的头, 结束时回填长度
+    long long data_bytes;             // 当前文件写入的编码数据字节数
+    int used;                   // 编码器编过文件, 下一个文件前要reset
+    int in_samplerate;          // 送进来的pcm的采样率, 和编码器不同时先重采样
+    int in_channels;            // 送进来的pcm的声道数, 和编码器不同时先转声道
+    float mix_matrix[AUDIO_CHANNELS_MAX * AUDIO_CHANNELS_MAX];
+    short *mix_buf;
+    audio_resampler_t *resampler;
+    short *resample_buf;
+    int resample_buf_frames;
+    int resample_chunk_frames;  // 重采样时每块的输入帧数, 输出要放得下resample_buf
+    audio_ring_t *ring;         // 流水线: 编码输出交给写线程, 不直接写文件
+    audio_arena_t *arena;       // frame_buf, out_buf, packet_len和转换缓存, 按帧长一次分配
+    audio_agc_t *agc;           // 响度: 编码前的AGC和限幅
+    audio_loudness_t *meter;    // 响度: 编码器收到的(AGC之后的)响度
+    short *agc_buf;
+    int agc_buf_frames;
+    int measure_only;           // 两遍归一化的第一遍: 只量响度, 不编码
+} encode_sink_t;
+
+static void encode_sink_release(encode_sink_t *sink)
+{
+    audio_codec_close(sink->codec);
+    audio_output_close(sink->out);
+    pcm_fifo_destroy(sink->fifo);
+    audio_resampler_destroy(sink->resampler);
+    audio_agc_destroy(sink->agc);
+    audio_loudness_destroy(sink->meter);
+    audio_arena_destroy(sink->arena);
+    memset(sink, 0, sizeof(encode_sink_t));
+}
 
-    pcm_len = get_file_content(src_filename, &pcm_buf);
+/*
+ * 按编码器的参数生成wav头, data_size为-1时是占位用的
+ */
+static int encode_sink_wav_header(encode_sink_t *sink, long long data_size, unsigned char *header)
+{
+    audio_param_t audio_param = sink->audio_param;
 
-    g711a_len = (pcm_len + 1) / 2;
-    g711a_buf = (unsigned char *)malloc(g711a_len);
-    ret = g711a_encode(pcm_buf, pcm_len, g711a_buf, g711a_len);
-    if (ret < 0)
+    audio_param.format = sink->format;
+    return audio_wav_header(header, AUDIO_WAV_HEADER_MAX, audio_param, sink->out_sample, data_size);
+}
+
+/*
+ * 只创建编码器和缓存, 不打开输出文件. 批量转码时每个线程init一次,
+ * 之后每个文件begin/end, 编码器用reset复用.
+ * audio_param是编码器的参数, in_sample是送进来的pcm的采样格式, 输出pcm时默认也用它
+ */
+int encode_sink_init(encode_sink_t *sink, aenc_format_e format, audio_param_t audio_param, audio_sample_format_e in_sample)
+{
+    size_t arena_size = 0;
+    unsigned char wav_header[AUDIO_WAV_HEADER_MAX];
+    audio_agc_param_t param = agc_param;
+
+    memset(sink, 0, sizeof(encode_sink_t));
+    sink->format = format;
+    sink->pending_len = -1;
+    sink->in_samplerate = audio_param.samplerate;
+    sink->in_channels = audio_param.channels;
+    sink->in_sample = in_sample;
+    sink->out_sample = target_sample_format(format, in_sample);
+    audio_param.bit_depth = audio_sample_size(sink->out_sample) * 8;
+    sink->audio_param = audio_param;
+    sink->wav = out_wav && format == AENC_FORMAT_PCM;
+    if (sink->wav && encode_sink_wav_header(sink, -1, wav_header) < 0)
     {
-        return ret;
+        goto ERR;
     }
 
-    fp = fopen(OUT_FILE_G711A, "w");
-    if (fp == NULL)
+    sink->codec = audio_codec_open(format, AUDIO_CODEC_ENCODER, audio_param);
+    if (sink->codec == NULL)
     {
-        fprintf(stderr, "open %s failed!!!\n", OUT_FILE_G711A);
-        return -1;
+        goto ERR;
+    }
+    if (format == AENC_FORMAT_OPUS && opus_dtx != OPUS_DTX_OFF && opus_encode_set_dtx(sink->codec->handle, 1) != 0)
+    {
+        goto ERR;
+    }
+
+    //  一帧的字节数只算一次; 小帧攒成一批再编码, 减少调用次数
+    sink->frame_bytes = audio_codec_get_frame_size(sink->codec);
+    sink->batch_frames = SINK_BATCH_BYTES / sink->frame_bytes;
+    if (sink->batch_frames < 1)
+    {
+        sink->batch_frames = 1;
+    }
+    sink->out_buf_size = sink->batch_frames * sink->codec->packet_size_max;
+
+    //  响度处理按编码器的采样率和声道数, AGC每次处理一块转换缓存
+    if (loudness_mode != LOUDNESS_OFF)
+    {
+        param.adaptive = loudness_mode == LOUDNESS_AGC;
+        sink->agc = audio_agc_create(audio_param.samplerate, audio_param.channels, &param);
+        sink->meter = audio_loudness_create(audio_param.samplerate, audio_param.channels);
+        if (sink->agc == NULL || sink->meter == NULL)
+        {
+            goto ERR;
+        }
+        sink->agc_buf_frames = audio_agc_get_out_size(sink->agc, CONVERT_CHUNK_FRAMES);
     }
-    fwrite(g711a_buf, sizeof(unsigned char), g711a_len, fp);
-    fclose(fp);
 
-    free(g711a_buf);
-    free(pcm_buf);
+    //  会话里的缓存一次分配: 转换缓存一块最多CONVERT_CHUNK_FRAMES帧, 输入格式可能在set_input时才定, 都留出来.
+    //  重采样的输出按最低的输入采样率留, 和audio_resampler_get_out_size的算法一样. 每块按64字节对齐, 各多留64字节
+    sink->resample_buf_frames = (int)(((long long)CONVERT_CHUNK_FRAMES * audio_param.samplerate + RESAMPLE_IN_RATE_MIN - 1) /
+                                      RESAMPLE_IN_RATE_MIN) + 2;
+    arena_size = (size_t)sink->frame_bytes * sink->batch_frames + sink->out_buf_size + sizeof(int) * sink->batch_frames +
+                 sizeof(int) * CONVERT_CHUNK_FRAMES * AUDIO_CHANNELS_MAX * 2 +
+                 sizeof(short) * CONVERT_CHUNK_FRAMES * sink->audio_param.channels +
+                 sizeof(short) * sink->resample_buf_frames * sink->audio_param.channels +
+                 sizeof(short) * sink->agc_buf_frames * sink->audio_param.channels + 64 * 8;
+    sink->arena = audio_arena_create(arena_size);
+    sink->fifo = pcm_fifo_create(sink->frame_bytes * sink->batch_frames * 2);
+    if (sink->arena == NULL || sink->fifo == NULL)
+    {
+        goto ERR;
+    }
+    sink->frame_buf = (unsigned char *)audio_arena_alloc(sink->arena, sink->frame_bytes * sink->batch_frames);
+    sink->out_buf = (unsigned char *)audio_arena_alloc(sink->arena, sink->out_buf_size);
+    sink->packet_len = (int *)audio_arena_alloc(sink->arena, sizeof(int) * sink->batch_frames);
+    //  采样格式不同时才需要转换缓存
+    if (sink->in_sample != sink->out_sample || sink->in_sample != AUDIO_SAMPLE_S16)
+    {
+        sink->in_conv_buf = (unsigned char *)audio_arena_alloc(sink->arena, sizeof(int) * CONVERT_CHUNK_FRAMES * AUDIO_CHANNELS_MAX);
+    }
+    if (sink->out_sample != AUDIO_SAMPLE_S16)
+    {
+        sink->out_conv_buf = (unsigned char *)audio_arena_alloc(sink->arena, sizeof(int) * CONVERT_CHUNK_FRAMES * AUDIO_CHANNELS_MAX);
+    }
+    if (sink->agc != NULL)
+    {
+        sink->agc_buf = (short *)audio_arena_alloc(sink->arena, sizeof(short) * sink->agc_buf_frames * sink->audio_param.channels);
+    }
 
     return 0;
+
+ERR:
+    encode_sink_release(sink);
+    return -1;
 }
 
-int g711a2pcm(char *src_filename)
+/*
+ * 开始一个新的输出文件, 第一个文件之后的编码器和队列都要清掉上一个文件的状态
+ */
+int encode_sink_begin(encode_sink_t *sink, char *dst_filename)
 {
-    int ret = 0;
-    int pcm_len = 0;
-    unsigned char *pcm_buf = NULL;
-    int g711a_len = 0;
-    unsigned char *g711a_buf = NULL;
-    FILE *fp = NULL;
+    int header_len = 0;
+    unsigned char wav_header[AUDIO_WAV_HEADER_MAX];
 
-    g711a_len = get_file_content(src_filename, &g711a_buf);
-
-    pcm_len = g711a_len * 2;
-    pcm_buf = (unsigned char *)malloc(pcm_len);
-    ret = g711a_decode(g711a_buf, g711a_len, pcm_buf, pcm_len);
-    if (ret < 0)
+    if (sink->used)
     {
-        return ret;
+        pcm_fifo_reset(sink->fifo);
+        audio_resampler_reset(sink->resampler);
+        audio_agc_reset(sink->agc);
+        audio_loudness_reset(sink->meter);
+        if (audio_codec_reset(sink->codec) != 0)
+        {
+            fprintf(stderr, "[%s] reset encoder failed\n", __func__);
+            return -1;
+        }
     }
-
-    fp = fopen(OUT_FILE_PCM, "w");
-    if (fp == NULL)
+    sink->timestamp = 0;
+    sink->pending_len = -1;
+    sink->dropped = 0;
+    sink->pcm_bytes = 0;
+    sink->dither_seed = 1;
+    sink->data_bytes = 0;
+    sink->used = 1;
+
+    //  大缓存提高吞吐; 逐帧flush时缓存大小无所谓
+    sink->out = output_open(dst_filename);
+    if (sink->out == NULL)
     {
-        fprintf(stderr, "Open %s failed!!!\n", OUT_FILE_PCM);
         return -1;
     }
-    fwrite(pcm_buf, sizeof(unsigned char), pcm_len, fp);
-    free(pcm_buf);
-    free(g711a_buf);
-    fclose(fp);
+    if (sink->wav)
+    {
+        header_len = encode_sink_wav_header(sink, -1, wav_header);
+        audio_output_write(sink->out, wav_header, header_len);
+    }
 
     return 0;
 }
 
-int pcm2opus(audio_param_t audio_param, char *src_filename)
+/*
+ * 设置送进来的pcm的采样率、声道数和采样格式, 和编码器不同时自动插入格式转换、声道转换和重采样, 要在写入数据之前设置
+ */
+int encode_sink_set_input(encode_sink_t *sink, int samplerate, int channels, audio_sample_format_e sample_format)
 {
-    FILE *fp = NULL;
-    uint8_t *opus_buf = NULL;
-    int opus_buf_len = 0;
-    int decode_offset = 0;
-    int pcm_len = 0;
-    unsigned char *pcm_buf = NULL;
-    codec_handle handle = NULL;
+    sink->in_sample = sample_format;
+    if (sink->in_conv_buf == NULL && (sample_format != sink->out_sample || sample_format != AUDIO_SAMPLE_S16))
+    {
+        sink->in_conv_buf = (unsigned char *)audio_arena_alloc(sink->arena, sizeof(int) * CONVERT_CHUNK_FRAMES * AUDIO_CHANNELS_MAX);
+        if (sink->in_conv_buf == NULL)
+        {
+            return -1;
+        }
+    }
 
-    pcm_len = get_file_content(src_filename, &pcm_buf);
+    if (channels != sink->in_channels)
+    {
+        sink->in_channels = channels;
+        if (channels != sink->audio_param.channels)
+        {
+            if (audio_channel_matrix_default(channels, sink->audio_param.channels, sink->mix_matrix) != 0)
+            {
+                return -1;
+            }
+            if (sink->mix_buf == NULL)
+            {
+                sink->mix_buf = (short *)audio_arena_alloc(sink->arena, sizeof(short) * CONVERT_CHUNK_FRAMES * sink->audio_param.channels);
+                if (sink->mix_buf == NULL)
+                {
+                    return -1;
+                }
+            }
+        }
+    }
 
-    fp = fopen(OUT_FILE_OPUS, "w");
-    if (fp == NULL)
+    if (samplerate == sink->in_samplerate)
     {
-        fprintf(stderr, "Open %s failed!!!\n", OUT_FILE_OPUS);
-        return -1;
+        return 0;
+    }
+    audio_resampler_destroy(sink->resampler);
+    sink->resampler = NULL;
+    sink->in_samplerate = samplerate;
+    if (samplerate == sink->audio_param.samplerate)
+    {
+        return 0;
     }
 
-    handle = opus_encode_init(audio_param);
-    if (handle == NULL)
+    sink->resampler = audio_resampler_create(samplerate, sink->audio_param.samplerate, sink->audio_param.channels, resample_quality);
+    if (sink->resampler == NULL)
     {
-        fprintf(stderr, "opus encode init failed!!!\n");
         return -1;
     }
-
-    opus_buf = (uint8_t *)malloc(sizeof(uint8_t) * FRAME_SIZE_MAX);
-    while (1)
+    //  输出缓存在init时按帧长留在arena里, 第一次重采样时才切出来. 输入采样率低于RESAMPLE_IN_RATE_MIN时
+    //  一块输入的输出放不下, 每块少送一些; flush时补的0比一块输入少, 放得下
+    sink->resample_chunk_frames = CONVERT_CHUNK_FRAMES;
+    if (audio_resampler_get_out_size(sink->resampler, CONVERT_CHUNK_FRAMES) > sink->resample_buf_frames)
     {
-        opus_buf_len = opus_encode_frame(handle, pcm_buf + decode_offset,
-                                         audio_param.samplerate / audio_param.fps * sizeof(opus_int16),
-                                         opus_buf, FRAME_SIZE_MAX);
-#ifdef SUPPORT_IMI
-        unsigned char ch[4];
-        int_to_char(opus_buf_len, ch);
-        fwrite(ch, sizeof(unsigned char), 4, fp);
-        memset(ch, 0, 4);
-        fwrite(ch, sizeof(unsigned char), 4, fp);
-#else
-        fwrite(&opus_buf_len, sizeof(int), 1, fp);
-#endif
-        fwrite(opus_buf, sizeof(uint8_t), opus_buf_len, fp);
-        decode_offset += audio_param.samplerate / audio_param.fps * sizeof(opus_int16);
-
-        if (decode_offset >= pcm_len)
+        sink->resample_chunk_frames = (int)((long long)(sink->resample_buf_frames - 2) * samplerate / sink->audio_param.samplerate);
+    }
+    if (sink->resample_chunk_frames < 1)
+    {
+        return -1;
+    }
+    if (sink->resample_buf == NULL)
+    {
+        sink->resample_buf = (short *)audio_arena_alloc(sink->arena, sizeof(short) * sink->resample_buf_frames * sink->audio_param.channels);
+        if (sink->resample_buf == NULL)
         {
-            break;
+            return -1;
         }
     }
 
-    fclose(fp);
-    free(opus_buf);
-    free(pcm_buf);
-    opus_encode_deinit(handle);
-
     return 0;
 }
 
-int opus2pcm(audio_param_t audio_param, char *src_filename)
+int encode_sink_open(encode_sink_t *sink, aenc_format_e format, audio_param_t audio_param, audio_sample_format_e in_sample,
+                     char *dst_filename)
 {
+    if (encode_sink_init(sink, format, audio_param, in_sample) != 0)
+    {
+        return -1;
+    }
+    if (encode_sink_begin(sink, dst_filename) != 0)
+    {
+        encode_sink_release(sink);
+        return -1;
+    }
 
-    FILE *fp = NULL;
-    codec_handle handle = NULL;
-    opus_int16 *pcm_buf = NULL;
-    int pcm_buf_len = 0;
-    int decode_offset = 0;
-    int frame_len = 0;
-    int opus_len = 0;
-    unsigned char *opus_buf = NULL;
+    return 0;
+}
 
-    opus_len = get_file_content(src_filename, &opus_buf);
+/*
+ * 把一包写到输出文件, opus加包头和时间戳; 流水线里在写线程调用
+ */
+static void encode_sink_output(encode_sink_t *sink, unsigned char *packet, int len)
+{
+    unsigned long long start = AUDIO_TRACE_START();
 
-    fp = fopen(OUT_FILE_PCM, "w");
-    if (fp == NULL)
+    if (sink->format != AENC_FORMAT_OPUS)
     {
-        fprintf(stderr, "Open %s failed!!!\n", OUT_FILE_PCM);
-        return -1;
+        audio_output_write(sink->out, packet, len);
+        sink->data_bytes += len;
+        if (stream_flush)
+        {
+            audio_output_flush(sink->out);
+        }
+        goto END;
     }
 
-    handle = opus_decode_init(audio_param);
-    if (handle == NULL)
+    //  暂存的DTX包后面还有包, 说明它不是最后一包, 可以丢弃
+    if (sink->pending_len >= 0)
     {
-        fprintf(stderr, "opus decode init failed!!!\n");
-        return -1;
+        sink->dropped++;
+        sink->pending_len = -1;
     }
 
-    pcm_buf = (opus_int16 *)malloc(sizeof(opus_int16) * FRAME_SIZE_MAX);
-    while (1)
+    if (opus_dtx == OPUS_DTX_DROP && opus_packet_is_dtx(len))
     {
-#ifdef SUPPORT_IMI
-        unsigned char ch[4];
-        memcpy(ch, opus_buf + decode_offset, 4);
-        frame_len = char_to_int(ch);
-        decode_offset += 8;
-#else
-        memcpy(&frame_len, opus_buf + decode_offset, sizeof(int));
-        decode_offset += sizeof(int);
-#endif
-        pcm_buf_len = opus_decode_frame(handle, opus_buf + decode_offset, frame_len, pcm_buf, FRAME_SIZE_MAX);
-        fwrite(pcm_buf, sizeof(opus_int16), pcm_buf_len, fp);
-        decode_offset += frame_len;
-
-        if (decode_offset >= opus_len)
+        memcpy(sink->pending, packet, len);
+        sink->pending_len = len;
+        sink->pending_timestamp = sink->timestamp;
+    }
+    else
+    {
+        write_opus_packet(sink->out, packet, len, sink->timestamp);
+        if (stream_flush)
         {
-            break;
+            audio_output_flush(sink->out);
         }
     }
+    sink->timestamp += sink->audio_param.samplerate / sink->audio_param.fps;
 
-    fclose(fp);
-    free(pcm_buf);
-    free(opus_buf);
-    opus_decode_deinit(handle);
+END:
+    AUDIO_TRACE_STOP(AUDIO_TRACE_WRITE, sink->format, start, 1);
 }
 
-void printf_usage(char *cmd)
+/*
+ * 编码出一包. 流水线里拷进环的槽, 槽比包小时只有不分包的格式可以拆开
+ */
+static int encode_sink_put(encode_sink_t *sink, unsigned char *packet, int len)
 {
-    printf("usage: %s [src_audio_file] [to_format]\n", cmd);
-    printf("\t src_audio_file: which file you want to codec?\n");
-    printf("\t to_format: pcm g711a aac opus\n");
-}
+    int n = 0;
+    unsigned char *slot = NULL;
 
-aenc_format_e find_audio_format(char *format)
-{
-    // printf("[%s] format=%s, len=%lu\n", __func__, format, strlen(format));
-    if (strncmp(format, AUDIO_CODEC_PCM, strlen(AUDIO_CODEC_PCM) + 1) == 0)
-    {
-        return AENC_FORMAT_PCM;
-    }
-    else if (strncmp(format, AUDIO_CODEC_G711A, strlen(AUDIO_CODEC_G711A) + 1) == 0)
-    {
-        return AENC_FORMAT_G711A;
-    }
-    else if (strncmp(format, AUDIO_CODEC_AAC, strlen(AUDIO_CODEC_AAC) + 1) == 0)
+    if (sink->ring == NULL)
     {
-        return AENC_FORMAT_AAC;
+        encode_sink_output(sink, packet, len);
+        return 0;
     }
-    else if (strncmp(format, AUDIO_CODEC_OPUS, strlen(AUDIO_CODEC_OPUS) + 1) == 0)
+    if (sink->format == AENC_FORMAT_OPUS && len > audio_ring_slot_size(sink->ring))
     {
-        return AENC_FORMAT_OPUS;
+        return -1;
     }
-    else
+    while (len > 0)
     {
-        fprintf(stderr, "%s: Do not support this format!!!\n", format);
-        return -1;
+        slot = audio_ring_acquire(sink->ring);
+        if (slot == NULL)
+        {
+            return -1;
+        }
+        n = len < audio_ring_slot_size(sink->ring) ? len : audio_ring_slot_size(sink->ring);
+        memcpy(slot, packet, n);
+        audio_ring_commit(sink->ring, n, 0);
+        packet += n;
+        len -= n;
     }
+
+    return 0;
 }
 
-int pcm2other(char *src_filename, audio_param_t audio_param, aenc_format_e to_format)
+static int encode_sink_drain(encode_sink_t *sink)
 {
+    int i = 0;
     int ret = 0;
-    switch (to_format)
+    int offset = 0;
+    int frame_count = 0;
+
+    while (pcm_fifo_size(sink->fifo) >= sink->frame_bytes)
     {
-    case AENC_FORMAT_PCM:
-        fprintf(stderr, "pcm no need translete to pcm\n");
-        return -1;
-    case AENC_FORMAT_G711A:
-        ret = pcm2g711a(src_filename);
-        break;
-    case AENC_FORMAT_AAC:
-        ret = pcm2aac(audio_param, src_filename);
-        break;
-    case AENC_FORMAT_OPUS:
-        ret = pcm2opus(audio_param, src_filename);
-        break;
+        frame_count = pcm_fifo_size(sink->fifo) / sink->frame_bytes;
+        if (frame_count > sink->batch_frames)
+        {
+            frame_count = sink->batch_frames;
+        }
+        pcm_fifo_read(sink->fifo, sink->frame_buf, frame_count * sink->frame_bytes);
 
-    default:
-        break;
+        ret = audio_codec_encode_batch(sink->codec, sink->frame_buf, frame_count, sink->out_buf, sink->out_buf_size, sink->packet_len);
+        if (ret < 0)
+        {
+            return -1;
+        }
+        offset = 0;
+        for (i = 0; i < frame_count; i++)
+        {
+            //  aac编码器开始时会缓存几帧, 没有输出
+            if (sink->packet_len[i] > 0 && encode_sink_put(sink, sink->out_buf + offset, sink->packet_len[i]) != 0)
+            {
+                return -1;
+            }
+            offset += sink->packet_len[i];
+        }
     }
 
-    return ret;
+    return 0;
 }
 
-int other2pcm(char *src_filename, audio_param_t audio_param, aenc_format_e from_format)
+static int encode_sink_push(encode_sink_t *sink, unsigned char *pcm, int pcm_len)
 {
-    int ret = 0;
-    switch (from_format)
-    {
-    case AENC_FORMAT_PCM:
-        fprintf(stderr, "pcm no need translete to pcm\n");
-        return -1;
-    case AENC_FORMAT_G711A:
-        ret = g711a2pcm(src_filename);
-        break;
-    case AENC_FORMAT_AAC:
-        ret = aac2pcm(audio_param, src_filename);
-        break;
-    case AENC_FORMAT_OPUS:
-        ret = opus2pcm(audio_param, src_filename);
-        break;
+    int written = 0;
 
-    default:
-        break;
+    while (pcm_len > 0)
+    {
+        written = pcm_fifo_write(sink->fifo, pcm, pcm_len);
+        if (written < 0 || encode_sink_drain(sink) != 0)
+        {
+            return -1;
+        }
+        pcm += written;
+        pcm_len -= written;
     }
 
-    return ret;
+    return 0;
 }
 
-int main(int argc, char **argv)
+/*
+ * 推入处理完的s16, 编码器要别的采样格式时分块转换
+ */
+static int encode_sink_push_out(encode_sink_t *sink, short *pcm, int frames)
 {
-    int ret = 0;
-    audio_param_t audio_param;
-    aenc_format_e to_format = AENC_FORMAT_NONE;
-    char stdin_get[512] = {0};
-    char src_format[16] = {0};
+    int n = 0;
+    int channels = sink->audio_param.channels;
+    int out_size = audio_sample_size(sink->out_sample);
 
-    if (argc < 3)
+    if (sink->out_sample == AUDIO_SAMPLE_S16)
+    {
+        return encode_sink_push(sink, (unsigned char *)pcm, frames * channels * sizeof(short));
+    }
+
+    while (frames > 0)
+    {
+        n = frames > CONVERT_CHUNK_FRAMES ? CONVERT_CHUNK_FRAMES : frames;
+        audio_sample_convert(pcm, AUDIO_SAMPLE_S16, sink->out_conv_buf, sink->out_sample, n * channels, NULL);
+        if (encode_sink_push(sink, sink->out_conv_buf, n * channels * out_size) != 0)
+        {
+            return -1;
+        }
+        pcm += n * channels;
+        frames -= n;
+    }
+
+    return 0;
+}
+
+/*
+ * 推入转完声道和采样率的s16. 响度处理在所有转换之后、编码之前: 分块过AGC, 再量编码器收到的响度
+ */
+static int encode_sink_push_s16(encode_sink_t *sink, short *pcm, int frames)
+{
+    int n = 0;
+    int out = 0;
+
+    if (sink->meter == NULL)
+    {
+        return encode_sink_push_out(sink, pcm, frames);
+    }
+    if (sink->measure_only)
+    {
+        return audio_loudness_process(sink->meter, pcm, frames);
+    }
+
+    while (frames > 0)
+    {
+        n = frames > CONVERT_CHUNK_FRAMES ? CONVERT_CHUNK_FRAMES : frames;
+        out = audio_agc_process(sink->agc, pcm, n, sink->agc_buf, sink->agc_buf_frames);
+        if (out < 0 || audio_loudness_process(sink->meter, sink->agc_buf, out) != 0 ||
+            encode_sink_push_out(sink, sink->agc_buf, out) != 0)
+        {
+            return -1;
+        }
+        pcm += n * sink->audio_param.channels;
+        frames -= n;
+    }
+
+    return 0;
+}
+
+int encode_sink_write(encode_sink_t *sink, unsigned char *pcm, int pcm_len)
+{
+    int in_frames = 0;
+    int frames = 0;
+    int in_frame_bytes = sink->in_channels * audio_sample_size(sink->in_sample);
+    int convert = sink->resampler != NULL || sink->in_channels != sink->audio_param.channels || sink->meter != NULL;
+    unsigned int *dither = sample_dither ? &sink->dither_seed : NULL;
+    short *chunk = NULL;
+
+    sink->pcm_bytes += pcm_len;
+    if (!convert && sink->in_sample == sink->out_sample)
+    {
+        return encode_sink_push(sink, pcm, pcm_len);
+    }
+
+    while (pcm_len >= in_frame_bytes)
+    {
+        in_frames = pcm_len / in_frame_bytes;
+        if (in_frames > CONVERT_CHUNK_FRAMES)
+        {
+            in_frames = CONVERT_CHUNK_FRAMES;
+        }
+        if (sink->resampler != NULL && in_frames > sink->resample_chunk_frames)
+        {
+            in_frames = sink->resample_chunk_frames;
+        }
+        chunk = (short *)pcm;
+        frames = in_frames;
+
+        //  只转采样格式时直接转成编码器要的格式, 不经过s16, 高位深之间的转换不丢精度
+        if (!convert)
+        {
+            audio_sample_convert(pcm, sink->in_sample, sink->in_conv_buf, sink->out_sample, frames * sink->in_channels, dither);
+            if (encode_sink_push(sink, sink->in_conv_buf, frames * sink->in_channels * audio_sample_size(sink->out_sample)) != 0)
+            {
+                return -1;
+            }
+            pcm += in_frames * in_frame_bytes;
+            pcm_len -= in_frames * in_frame_bytes;
+            continue;
+        }
+        if (sink->in_sample != AUDIO_SAMPLE_S16)
+        {
+            audio_sample_convert(pcm, sink->in_sample, sink->in_conv_buf, AUDIO_SAMPLE_S16, frames * sink->in_channels, dither);
+            chunk = (short *)sink->in_conv_buf;
+        }
+
+        //  先转声道再重采样, 重采样器按编码器的声道数创建
+        if (sink->in_channels != sink->audio_param.channels)
+        {
+            audio_channel_mix(chunk, sink->in_channels, frames, sink->mix_matrix, sink->audio_param.channels, sink->mix_buf);
+            chunk = sink->mix_buf;
+        }
+        if (sink->resampler != NULL)
+        {
+            frames = audio_resampler_process(sink->resampler, chunk, frames, sink->resample_buf, sink->resample_buf_frames);
+            chunk = sink->resample_buf;
+        }
+        if (frames < 0 || encode_sink_push_s16(sink, chunk, frames) != 0)
+        {
+            return -1;
+        }
+        pcm += in_frames * in_frame_bytes;
+        pcm_len -= in_frames * in_frame_bytes;
+    }
+
+    return 0;
+}
+
+/*
+ * wav的data块补齐到偶数长度; 输出能seek时回到开头按真实长度重写头, 管道里的头保持未知长度
+ */
+static int encode_sink_wav_finish(encode_sink_t *sink)
+{
+    int header_len = 0;
+    long long end = 0;
+    unsigned char wav_header[AUDIO_WAV_HEADER_MAX];
+
+    unsigned char pad = 0;
+
+    if (sink->data_bytes & 1)
+    {
+        audio_output_write(sink->out, &pad, 1);
+    }
+    header_len = encode_sink_wav_header(sink, sink->data_bytes, wav_header);
+    end = audio_output_tell(sink->out);
+    if (end != header_len + sink->data_bytes + (sink->data_bytes & 1))
+    {
+        return 0;
+    }
+    if (audio_output_pwrite(sink->out, wav_header, header_len, 0) != 0)
+    {
+        fprintf(stderr, "[%s] rewrite wav header failed\n", __func__);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * 编完当前文件的尾巴, 不足一帧的部分和编码器里缓存的帧
+ */
+static int encode_sink_flush(encode_sink_t *sink)
+{
+    int ret = 0;
+    int tail_len = 0;
+
+    if (sink->resampler != NULL)
+    {
+        ret = audio_resampler_flush(sink->resampler, sink->resample_buf, sink->resample_buf_frames);
+        if (ret > 0 && encode_sink_push_s16(sink, sink->resample_buf, ret) != 0)
+        {
+            return -1;
+        }
+        ret = 0;
+    }
+    //  AGC里前瞻的几毫秒
+    if (sink->agc != NULL && !sink->measure_only)
+    {
+        ret = audio_agc_flush(sink->agc, sink->agc_buf, sink->agc_buf_frames);
+        if (ret < 0 || audio_loudness_process(sink->meter, sink->agc_buf, ret) != 0 ||
+            encode_sink_push_out(sink, sink->agc_buf, ret) != 0)
+        {
+            return -1;
+        }
+        ret = 0;
+    }
+
+    //  不足一帧的尾巴交给编码器, 由编码器决定补零还是丢弃
+    tail_len = pcm_fifo_size(sink->fifo);
+    if (tail_len > 0)
+    {
+        pcm_fifo_read(sink->fifo, sink->frame_buf, tail_len);
+        ret = audio_codec_encode(sink->codec, sink->frame_buf, tail_len, sink->out_buf, sink->out_buf_size);
+        if (ret > 0 && encode_sink_put(sink, sink->out_buf, ret) != 0)
+        {
+            return -1;
+        }
+    }
+    while ((ret = audio_codec_flush(sink->codec, sink->out_buf, sink->out_buf_size)) > 0)
+    {
+        if (encode_sink_put(sink, sink->out_buf, ret) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return ret < 0 ? -1 : 0;
+}
+
+/*
+ * 写完暂存的包和wav头, 关闭输出文件
+ */
+static int encode_sink_finish(encode_sink_t *sink)
+{
+    int ret = 0;
+    opus_encode_stats_t stats;
+
+    if (sink->format == AENC_FORMAT_OPUS)
+    {
+        if (sink->pending_len >= 0)
+        {
+            write_opus_packet(sink->out, sink->pending, sink->pending_len, sink->pending_timestamp);
+        }
+        if (opus_dtx != OPUS_DTX_OFF && opus_encode_get_stats(sink->codec->handle, &stats) == 0)
+        {
+            fprintf(info_fp, "opus stats: packets=%lu, dtx=%lu, suppressed=%lu, written=%lu, bytes=%llu\n",
+                   stats.packets, stats.dtx_packets, sink->dropped, stats.packets - sink->dropped, stats.bytes);
+        }
+    }
+
+    if (sink->wav && encode_sink_wav_finish(sink) != 0)
+    {
+        ret = -1;
+    }
+    if (audio_output_close(sink->out) != 0)
+    {
+        ret = -1;
+    }
+    sink->out = NULL;
+
+    return ret;
+}
+
+/*
+ * 编完当前文件的尾巴并关闭输出文件, 编码器保留给下一个文件
+ */
+int encode_sink_end(encode_sink_t *sink)
+{
+    int ret = 0;
+
+    ret = encode_sink_flush(sink);
+    if (encode_sink_finish(sink) != 0)
+    {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int encode_sink_close(encode_sink_t *sink)
+{
+    int ret = 0;
+
+    ret = encode_sink_end(sink);
+    encode_sink_release(sink);
+
+    return ret;
+}
+
+/*
+ * 解码端: 按源格式的封装取出一包, ADTS/IMI/裸数据
+ * 包直接指向audio_input的视图, 下一次取包之前有效
+ * @retval
+ *      >0              包长度, *packet指向包
+ *      0               文件结束
+ */
+/*
+ * 输入是wav时解析头, 是wav时输入消费到data块开头
+ * @retval
+ *      1               是wav, info有效
+ *      0               不是wav
+ *      <0              头不完整或格式不支持
+ */
+static int wav_read_header(audio_input_t *input, audio_wav_info_t *info)
+{
+    int need = 0;
+    ssize_t len = 0;
+    size_t consumed = 0;
+    unsigned char *data = NULL;
+    audio_container_e container = AUDIO_CONTAINER_UNKNOWN;
+    audio_wav_parser_t parser;
+
+    len = audio_input_peek(input, 12, &data);
+    if (len < 12 || audio_probe(data, 12, NULL, &container) != 0 || container != AUDIO_CONTAINER_WAV)
+    {
+        return 0;
+    }
+    //  data块之前的LIST等块可能比read的窗口大, 边解析边消费
+    memset(&parser, 0, sizeof(audio_wav_parser_t));
+    while ((need = audio_wav_parse_next(&parser, data, len, &consumed, info)) > 0)
+    {
+        audio_input_consume(input, consumed);
+        if ((len = audio_input_peek(input, need, &data)) < need)
+        {
+            fprintf(stderr, "[%s] wav header truncated\n", __func__);
+            return -1;
+        }
+    }
+    if (need < 0)
+    {
+        return -1;
+    }
+    audio_input_consume(input, consumed);
+
+    return 1;
+}
+
+typedef struct
+{
+    aenc_format_e format;
+    audio_input_t *input;
+    int chunk_size;             // pcm/g711a: 每次取的字节数
+    int frame_unit;             // pcm/g711a: 一帧(所有声道各一个采样)的字节数
+    long long remain;           // pcm/g711a: 还没读的数据长度, -1为读到文件结束(wav的data块后面可能还有别的块)
+    opus_uint32 timestamp;      // opus: 当前包的时间戳
+} packet_reader_t;
+
+static int packet_reader_parse(packet_reader_t *reader, unsigned char **packet)
+{
+    int frame_len = 0;
+    int header_len = 0;
+    size_t adts_len = 0;
+    ssize_t more = 0;
+    unsigned char *data = NULL;
+    ssize_t left = audio_input_peek(reader->input, 1, &data);
+
+    if (left <= 0)
+    {
+        return 0;
+    }
+
+    switch (reader->format)
+    {
+    case AENC_FORMAT_AAC:
+        while (get_one_ADTS_frame(data, left, packet, &adts_len) != 0)
+        {
+            //  视图里不够一整帧, 再要一些, 输入结束或窗口已满就放弃
+            more = audio_input_peek(reader->input, left + 1, &data);
+            if (more <= left)
+            {
+                return 0;
+            }
+            left = more;
+        }
+        audio_input_consume(reader->input, (*packet - data) + adts_len);
+        return adts_len;
+    case AENC_FORMAT_OPUS:
+#ifdef SUPPORT_IMI
+        header_len = 8;
+        if (audio_input_peek(reader->input, header_len, &data) < header_len)
+        {
+            return 0;
+        }
+        frame_len = char_to_int(data);
+        reader->timestamp = char_to_int(data + 4);
+#else
+        header_len = sizeof(int);
+        if (audio_input_peek(reader->input, header_len, &data) < header_len)
+        {
+            return 0;
+        }
+        memcpy(&frame_len, data, sizeof(int));
+#endif
+        if (frame_len <= 0 || frame_len > FRAME_SIZE_MAX ||
+            audio_input_peek(reader->input, header_len + frame_len, &data) < header_len + frame_len)
+        {
+            return 0;
+        }
+        *packet = data + header_len;
+        audio_input_consume(reader->input, header_len + frame_len);
+        return frame_len;
+
+    default:
+        //  只取整帧, 声道转换不会把一帧拆开; 输入结束时的半帧原样交出去
+        if (left < reader->frame_unit)
+        {
+            left = audio_input_peek(reader->input, reader->frame_unit, &data);
+        }
+        frame_len = left < reader->chunk_size ? left : reader->chunk_size;
+        if (reader->remain >= 0 && frame_len > reader->remain)
+        {
+            frame_len = (int)reader->remain;
+        }
+        if (frame_len > reader->frame_unit)
+        {
+            frame_len -= frame_len % reader->frame_unit;
+        }
+        if (reader->remain >= 0)
+        {
+            reader->remain -= frame_len;
+        }
+        *packet = data;
+        audio_input_consume(reader->input, frame_len);
+        return frame_len;
+    }
+}
+
+//  切出下一包, 返回包长, 0为没有了
+static int packet_reader_next(packet_reader_t *reader, unsigned char **packet)
+{
+    int len = 0;
+    unsigned long long start = AUDIO_TRACE_START();
+
+    len = packet_reader_parse(reader, packet);
+    if (len > 0)
+    {
+        AUDIO_TRACE_STOP(AUDIO_TRACE_PARSE, reader->format, start, 1);
+    }
+    return len;
+}
+
+typedef struct
+{
+    packet_reader_t reader;
+    audio_param_t audio_param;          // 源参数, wav按头里的
+    audio_sample_format_e sample_format;
+    audio_codec_t *codec;
+    int own_codec;                      // 解码器是这里打开的, 关闭时释放
+    unsigned char *pcm_buf;
+    int pcm_size;
+    opus_uint32 next_timestamp;         // opus: 下一包应有的时间戳
+    int timestamp_valid;                // 第一包到了之后next_timestamp才有效
+    unsigned long concealed;
+    unsigned long resynced;
+} decode_source_t;
+
+static void decode_source_close(decode_source_t *source)
+{
+    if (source->concealed > 0)
+    {
+        fprintf(info_fp, "opus stats: %lu suppressed frames reconstructed\n", source->concealed);
+    }
+    if (source->resynced > 0)
+    {
+        fprintf(info_fp, "opus stats: %lu timestamp jumps resynced\n", source->resynced);
+    }
+    if (source->own_codec)
+    {
+        audio_codec_close(source->codec);
+    }
+    free(source->pcm_buf);
+    audio_input_close(source->reader.input);
+    memset(source, 0, sizeof(decode_source_t));
+}
+
+/*
+ * 打开源文件和解码器, 设置sink的输入参数.
+ * decoder为NULL时在这里打开解码器, 否则用调用者的(批量转码时每个线程复用)
+ */
+static int decode_source_open(decode_source_t *source, char *src_filename, audio_param_t audio_param, audio_codec_t *decoder,
+                              encode_sink_t *sink)
+{
+    int ret = 0;
+    int window_size = 0;
+    packet_reader_t *reader = &source->reader;
+    audio_wav_info_t wav;
+
+    //  普通文件默认mmap; stdin只能用固定窗口read
+    memset(source, 0, sizeof(decode_source_t));
+    source->sample_format = source_sample_format(audio_param);
+    reader->format = audio_param.format;
+    reader->remain = -1;
+    if (stream_buffer_size > 0)
+    {
+        window_size = stream_buffer_size > STREAM_WINDOW_MIN ? stream_buffer_size : STREAM_WINDOW_MIN;
+    }
+    if (strcmp(src_filename, STREAM_PATH) == 0)
+    {
+        reader->input = audio_input_open_fd(STDIN_FILENO, AUDIO_INPUT_READ, window_size > 0 ? window_size : STREAM_WINDOW_MIN);
+    }
+    else
+    {
+        reader->input = audio_input_open(src_filename, input_mode, window_size);
+    }
+    if (reader->input == NULL)
+    {
+        fprintf(stderr, "cannot read %s\n", src_filename);
+        return -1;
+    }
+
+    //  wav按头里的参数解码, 采样数据直接从输入视图里取, 只读data块
+    if (audio_param.format == AENC_FORMAT_PCM || audio_param.format == AENC_FORMAT_G711A)
+    {
+        ret = wav_read_header(reader->input, &wav);
+        if (ret < 0 || (ret > 0 && wav.audio_param.format != audio_param.format))
+        {
+            fprintf(stderr, "%s: unsupported wav\n", src_filename);
+            goto ERR;
+        }
+        if (ret > 0)
+        {
+            audio_param.samplerate = wav.audio_param.samplerate;
+            audio_param.channels = wav.audio_param.channels;
+            audio_param.bit_depth = wav.audio_param.bit_depth;
+            source->sample_format = wav.sample_format;
+            reader->remain = wav.data_size;
+        }
+    }
+    source->audio_param = audio_param;
+    if (encode_sink_set_input(sink, audio_param.samplerate, audio_param.channels, source->sample_format) != 0)
+    {
+        goto ERR;
+    }
+
+    source->own_codec = decoder == NULL;
+    source->codec = decoder != NULL ? decoder : audio_codec_open(audio_param.format, AUDIO_CODEC_DECODER, audio_param);
+    if (source->codec == NULL)
+    {
+        goto ERR;
+    }
+    //  裸数据按一帧解码后的大小取, g711a一字节解出两字节
+    reader->chunk_size = audio_param.format == AENC_FORMAT_G711A ? G711A_BATCH_SAMPLES : PCM_READ_CHUNK;
+    reader->frame_unit = audio_param.channels * (audio_param.format == AENC_FORMAT_G711A ? 1 : audio_param.bit_depth / 8);
+    source->pcm_size = audio_codec_get_frame_size(source->codec);
+    if (source->pcm_size < reader->chunk_size * 2)
+    {
+        source->pcm_size = reader->chunk_size * 2;
+    }
+    source->pcm_buf = (unsigned char *)malloc(source->pcm_size);
+    if (source->pcm_buf == NULL)
+    {
+        goto ERR;
+    }
+
+    return 0;
+
+ERR:
+    decode_source_close(source);
+    return -1;
+}
+
+/*
+ * 解码一包写入sink, timestamp是opus包的时间戳
+ */
+static int decode_source_packet(decode_source_t *source, encode_sink_t *sink, unsigned char *packet, int packet_len,
+                                opus_uint32 timestamp)
+{
+    int ret = 0;
+    int pcm_len = 0;
+    int32_t gap = 0;
+    audio_codec_t *codec = source->codec;
+    int channels = source->audio_param.channels;
+
+    //  时间戳从第一包开始算, 不要求从0开始
+    if (source->reader.format == AENC_FORMAT_OPUS && !source->timestamp_valid)
+    {
+        source->next_timestamp = timestamp;
+        source->timestamp_valid = 1;
+    }
+    //  时间戳跳变说明中间的DTX包被丢弃了, 用丢包补偿填上.
+    //  跳变超过CONCEAL_MAX_MS或者往回跳的按流重新同步处理, 不补; 旧文件时间戳全是0, 按顺序处理
+    gap = source->reader.format == AENC_FORMAT_OPUS && timestamp != 0 ? (int32_t)(timestamp - source->next_timestamp) : 0;
+    if (gap < 0 || gap > (int32_t)(source->audio_param.samplerate / 1000 * CONCEAL_MAX_MS))
+    {
+        source->next_timestamp = timestamp;
+        source->resynced++;
+        gap = 0;
+    }
+    while (ret == 0 && gap > 0 && (int32_t)(timestamp - source->next_timestamp) > 0)
+    {
+        pcm_len = audio_codec_conceal(codec, source->pcm_buf, source->pcm_size);
+        if (pcm_len <= 0)
+        {
+            break;
+        }
+        ret = encode_sink_write(sink, source->pcm_buf, pcm_len);
+        source->next_timestamp += pcm_len / (channels * sizeof(opus_int16));
+        source->concealed++;
+    }
+
+    pcm_len = audio_codec_decode(codec, packet, packet_len, source->pcm_buf, source->pcm_size);
+    //  aac按ADTS头里的真实采样率输出
+    if (codec->audio_param.samplerate != sink->in_samplerate &&
+        encode_sink_set_input(sink, codec->audio_param.samplerate, channels, source->sample_format) != 0)
+    {
+        ret = -1;
+    }
+    if (pcm_len > 0 && ret == 0)
+    {
+        ret = encode_sink_write(sink, source->pcm_buf, pcm_len);
+        source->next_timestamp += pcm_len / (channels * sizeof(opus_int16));
+    }
+
+    return ret;
+}
+
+/*
+ * --alloc-guard检查编码线程第一包之后不再分配内存. faac每帧都在库里malloc/free, 编aac时检查不了, 直接拒绝
+ */
+static int alloc_guard_check(aenc_format_e to_format)
+{
+    if (to_format == AENC_FORMAT_AAC)
+    {
+        fprintf(stderr, "--alloc-guard cannot check aac encoding: faac allocates in every frame\n");
+        return -1;
+    }
+    return 0;
+}
+
+int decode2sink(char *src_filename, audio_param_t audio_param, audio_codec_t *decoder, encode_sink_t *sink)
+{
+    int ret = 0;
+    int packet_len = 0;
+    unsigned char *packet = NULL;
+    decode_source_t source;
+
+    if (decode_source_open(&source, src_filename, audio_param, decoder, sink) != 0)
+    {
+        return -1;
+    }
+    //  第一包时解码器和输出都初始化好了, 之后每包不再分配内存
+    while (ret == 0 && (packet_len = packet_reader_next(&source.reader, &packet)) > 0)
+    {
+        ret = decode_source_packet(&source, sink, packet, packet_len, source.reader.timestamp);
+        audio_alloc_steady(1);
+    }
+    audio_alloc_steady(0);
+    decode_source_close(&source);
+
+    return ret;
+}
+
+#if 1   //  响度
+/*
+ * 两遍归一化的第一遍: 只解码, 按编码器的采样率和声道数量响度, 和第二遍编码器收到的一致
+ */
+static int loudness_measure(char *src_filename, audio_param_t audio_param, audio_sample_format_e in_sample,
+                            audio_loudness_info_t *info)
+{
+    int ret = 0;
+    encode_sink_t sink;
+
+    if (encode_sink_init(&sink, AENC_FORMAT_PCM, encoder_param(audio_param), in_sample) != 0)
+    {
+        return -1;
+    }
+    sink.measure_only = 1;
+    ret = decode2sink(src_filename, audio_param, NULL, &sink);
+    if (ret == 0 && (encode_sink_flush(&sink) != 0 || audio_loudness_get(sink.meter, info) != 0))
+    {
+        ret = -1;
+    }
+    encode_sink_release(&sink);
+
+    return ret;
+}
+
+/*
+ * 第二遍的固定增益: 目标减整体响度, 不超过--max-gain; 整段都在绝对门限以下(静音)时不放大
+ */
+static double loudness_gain(audio_loudness_info_t *info)
+{
+    double gain = agc_param.target - info->integrated;
+
+    if (info->integrated <= AUDIO_LOUDNESS_FLOOR)
+    {
+        return 0;
+    }
+    return gain > agc_param.max_gain ? agc_param.max_gain : (gain < -agc_param.max_gain ? -agc_param.max_gain : gain);
+}
+
+static void loudness_print_info(FILE *fp, const char *name, audio_loudness_info_t *info, int last)
+{
+    fprintf(fp, "  \"%s\": {\"integrated_lufs\": %.2f, \"range_lu\": %.2f, \"max_momentary_lufs\": %.2f, "
+                "\"max_short_term_lufs\": %.2f, \"sample_peak_dbfs\": %.2f, \"seconds\": %.3f}%s\n",
+            name, info->integrated, info->range, info->max_momentary, info->max_short_term, info->peak, info->seconds,
+            last ? "" : ",");
+}
+
+/*
+ * 文件转完后报告响度: fp不为NULL时打印一行, sidecar不为NULL时写旁路json.
+ * in为NULL时是一遍AGC, 输入响度取AGC自己量的
+ */
+static int loudness_report(encode_sink_t *sink, audio_loudness_info_t *in, double gain, const char *sidecar, FILE *fp)
+{
+    FILE *out_fp = NULL;
+    audio_loudness_info_t agc_in;
+    audio_loudness_info_t out;
+
+    if (in == NULL)
+    {
+        if (audio_agc_get_loudness(sink->agc, &agc_in) != 0)
+        {
+            return -1;
+        }
+        in = &agc_in;
+    }
+    if (audio_loudness_get(sink->meter, &out) != 0)
+    {
+        return -1;
+    }
+    if (fp != NULL)
+    {
+        fprintf(fp, "loudness: input %.1f LUFS, LRA %.1f LU, peak %.1f dBFS -> output %.1f LUFS, LRA %.1f LU, peak %.1f dBFS",
+                in->integrated, in->range, in->peak, out.integrated, out.range, out.peak);
+        if (loudness_mode == LOUDNESS_NORMALIZE)
+        {
+            fprintf(fp, ", gain %+.1f dB", gain);
+        }
+        fprintf(fp, "\n");
+    }
+    if (sidecar == NULL)
+    {
+        return 0;
+    }
+
+    out_fp = fopen(sidecar, "w");
+    if (out_fp == NULL)
+    {
+        fprintf(stderr, "cannot write %s\n", sidecar);
+        return -1;
+    }
+    fprintf(out_fp, "{\n  \"mode\": \"%s\",\n  \"target_lufs\": %.1f,\n  \"ceiling_dbfs\": %.1f,\n",
+            loudness_mode == LOUDNESS_NORMALIZE ? "normalize" : "agc", agc_param.target, agc_param.ceiling);
+    if (loudness_mode == LOUDNESS_NORMALIZE)
+    {
+        fprintf(out_fp, "  \"gain_db\": %.2f,\n", gain);
+    }
+    loudness_print_info(out_fp, "input", in, 0);
+    loudness_print_info(out_fp, "output", &out, 1);
+    fprintf(out_fp, "}\n");
+
+    return fclose(out_fp) == 0 ? 0 : -1;
+}
+#endif
+
+#if 1   //  读/编解码/写三个线程的流水线
+typedef struct
+{
+    decode_source_t source;
+    encode_sink_t *sink;
+} pipeline_job_t;
+
+/*
+ * 读线程: 按包拷进环的槽, 视图在下一次取包后就失效了
+ */
+static int pipeline_read(void *arg, audio_ring_t *in, audio_ring_t *out)
+{
+    int len = 0;
+    unsigned char *packet = NULL;
+    unsigned char *slot = NULL;
+    pipeline_job_t *job = (pipeline_job_t *)arg;
+
+    (void)in;
+    while ((len = packet_reader_next(&job->source.reader, &packet)) > 0)
+    {
+        slot = audio_ring_acquire(out);
+        if (slot == NULL || len > audio_ring_slot_size(out))
+        {
+            return -1;
+        }
+        memcpy(slot, packet, len);
+        audio_ring_commit(out, len, job->source.reader.timestamp);
+        audio_alloc_steady(1);
+    }
+    audio_alloc_steady(0);
+
+    return 0;
+}
+
+/*
+ * 编解码线程: 解码, 转格式, 编码, 编出的包放进写线程的环
+ */
+static int pipeline_codec(void *arg, audio_ring_t *in, audio_ring_t *out)
+{
+    int ret = 0;
+    int len = 0;
+    unsigned int timestamp = 0;
+    unsigned char *packet = NULL;
+    pipeline_job_t *job = (pipeline_job_t *)arg;
+
+    job->sink->ring = out;
+    while ((len = audio_ring_peek(in, &packet, &timestamp)) >= 0)
+    {
+        ret = decode_source_packet(&job->source, job->sink, packet, len, timestamp);
+        audio_ring_release(in);
+        if (ret != 0)
+        {
+            audio_alloc_steady(0);
+            return -1;
+        }
+        audio_alloc_steady(1);
+    }
+    audio_alloc_steady(0);
+    if (len != -1)
+    {
+        return -1;
+    }
+
+    return encode_sink_flush(job->sink);
+}
+
+static int pipeline_write(void *arg, audio_ring_t *in, audio_ring_t *out)
+{
+    int len = 0;
+    unsigned char *packet = NULL;
+    pipeline_job_t *job = (pipeline_job_t *)arg;
+
+    (void)out;
+    while ((len = audio_ring_peek(in, &packet, NULL)) >= 0)
+    {
+        encode_sink_output(job->sink, packet, len);
+        audio_ring_release(in);
+        audio_alloc_steady(1);
+    }
+    audio_alloc_steady(0);
+
+    return len == -1 ? 0 : -1;
+}
+
+static void pipeline_report(audio_pipeline_t *pipeline)
+{
+    int i = 0;
+    int count = 0;
+    audio_stage_stats_t stats[AUDIO_PIPELINE_STAGES_MAX];
+
+    count = audio_pipeline_get_stats(pipeline, stats, AUDIO_PIPELINE_STAGES_MAX);
+    fprintf(info_fp, "pipeline:\n");
+    for (i = 0; i < count; i++)
+    {
+        fprintf(info_fp, "  %-6s %.3fs, busy %.3fs, wait input %.3fs, backpressure %.3fs",
+                stats[i].name, stats[i].seconds, stats[i].seconds - stats[i].wait_in_seconds - stats[i].wait_out_seconds,
+                stats[i].wait_in_seconds, stats[i].wait_out_seconds);
+        if (stats[i].out.slots > 0)
+        {
+            fprintf(info_fp, ", out ring %llu slots passed, occupancy avg %.1f max %d/%d, full %llu, empty %llu",
+                    stats[i].out.pushed, stats[i].out.occupancy_avg, stats[i].out.occupancy_max, stats[i].out.slots,
+                    stats[i].out.full_waits, stats[i].out.empty_waits);
+        }
+        fprintf(info_fp, "\n");
+    }
+}
+
+/*
+ * 和decode2sink + encode_sink_end结果相同, 读文件、编解码、写文件各用一个线程
+ */
+int pipeline2sink(char *src_filename, audio_param_t audio_param, encode_sink_t *sink)
+{
+    int ret = 0;
+    pipeline_job_t job;
+    audio_pipeline_t *pipeline = NULL;
+
+    memset(&job, 0, sizeof(pipeline_job_t));
+    job.sink = sink;
+    if (decode_source_open(&job.source, src_filename, audio_param, NULL, sink) != 0)
+    {
+        return -1;
+    }
+
+    pipeline = audio_pipeline_create();
+    if (pipeline == NULL ||
+        audio_pipeline_add_stage(pipeline, "read", pipeline_read, &job, PIPELINE_SLOTS, FRAME_SIZE_MAX) != 0 ||
+        audio_pipeline_add_stage(pipeline, "codec", pipeline_codec, &job, PIPELINE_SLOTS, sink->codec->packet_size_max) != 0 ||
+        audio_pipeline_add_stage(pipeline, "write", pipeline_write, &job, 0, 0) != 0)
+    {
+        ret = -1;
+        goto END;
+    }
+    ret = audio_pipeline_run(pipeline);
+    if (pipeline_stats)
+    {
+        pipeline_report(pipeline);
+    }
+
+END:
+    sink->ring = NULL;
+    audio_pipeline_destroy(pipeline);
+    decode_source_close(&job.source);
+    if (encode_sink_finish(sink) != 0)
+    {
+        ret = -1;
+    }
+
+    return ret;
+}
+#endif
+
+int pcm2opus_parallel(audio_param_t audio_param, char *src_filename, char *dst_filename, int threads)
+{
+    int i = 0;
+    int ret = 0;
+    audio_output_t *out = NULL;
+    ssize_t pcm_len = 0;
+    unsigned char *pcm_buf = NULL;
+    size_t offset = 0;
+    opus_packets_t packets;
+    audio_input_t *input = NULL;
+
+    //  分段编码要随机访问整个文件, 直接用mmap的视图
+    input = audio_input_open(src_filename, AUDIO_INPUT_MMAP, 0);
+    pcm_len = audio_input_peek(input, audio_input_size(input), &pcm_buf);
+    if (pcm_len <= 0)
+    {
+        fprintf(stderr, "cannot read %s\n", src_filename);
+        audio_input_close(input);
+        return -1;
+    }
+
+    ret = opus_encode_parallel(audio_param, pcm_buf, pcm_len, threads, &packets);
+    audio_input_close(input);
+    if (ret < 0)
+    {
+        fprintf(stderr, "opus parallel encode failed!!!\n");
+        return -1;
+    }
+
+    ret = opus_packets_check(audio_param, &packets);
+    if (ret != 0)
+    {
+        fprintf(stderr, "opus stream continuity check failed, ret=%d\n", ret);
+        opus_packets_free(&packets);
+        return -1;
+    }
+
+    out = output_open(dst_filename);
+    if (out == NULL)
+    {
+        fprintf(stderr, "Open %s failed!!!\n", dst_filename);
+        opus_packets_free(&packets);
+        return -1;
+    }
+    for (i = 0; i < packets.packet_count; i++)
+    {
+        write_opus_packet(out, packets.data + offset, packets.packet_len[i],
+                          (opus_uint32)i * (audio_param.samplerate / audio_param.fps));
+        offset += packets.packet_len[i];
+    }
+
+    ret = audio_output_close(out);
+    opus_packets_free(&packets);
+
+    return ret;
+}
+
+void printf_usage(char *cmd)
+{
+    printf("usage: %s [options] [src_audio_file] [to_format]\n", cmd);
+    printf("       %s -i src_file -o dst_file [--from fmt] [--to fmt] [--rate N] [--channels N] [--fps N] [--bits N]\n", cmd);
+    printf("\t src_audio_file: which file you want to codec?\n");
+    printf("\t to_format: pcm g711a aac opus wav\n");
+    printf("options:\n");
+    printf("\t -i, --input FILE: source file\n");
+    printf("\t -o, --output FILE: output file (default %s.<to_format>)\n", OUT_FILE_PREFIX);
+    printf("\t --from FORMAT: source format, probed from the file header when omitted (raw pcm/g711a by extension)\n");
+    printf("\t --to FORMAT: output format, taken from the output extension when omitted\n");
+    printf("\t                wav is pcm with a header; wav input is detected and its header param is used\n");
+    printf("\t --rate N, --channels N, --fps N, --bits N: source audio param (default 16000, 1, 50, 16)\n");
+    printf("\t -j, --jobs N: encode opus in N parallel segments\n");
+    printf("\t --dtx keep|drop: enable opus DTX, keep or drop the 1~2 byte DTX packets\n");
+    printf("\t --batch DIR|LIST: translate every file in DIR, or every path in LIST (one per line, - for stdin),\n");
+    printf("\t                   -o is the output dir (default .), the source format is probed per file\n");
+    printf("\t --workers N: batch worker threads (default online cpus)\n");
+    printf("\t -i - / -o -: read stdin (needs --from) / write stdout, frame by frame\n");
+    printf("\t --flush: flush the output after every frame, for live streams\n");
+    printf("\t --buffer N: output buffer and input window size in bytes, larger for throughput\n");
+    printf("\t --out-rate N: output samplerate, resampled when it differs from the source (aac uses the rate in its header)\n");
+    printf("\t --quality fast|medium|high: resampler quality (default medium)\n");
+    printf("\t --out-channels N: output channels, downmixed (5.1 by ITU-R BS.775) or duplicated when it differs from the source\n");
+    printf("\t --sample s16|s24|s24_32|s32|f32: source pcm sample format (default by --bits, s24 is packed 3 bytes)\n");
+    printf("\t --out-sample FORMAT: output pcm sample format (default same as the source pcm, s16 for other sources)\n");
+    printf("\t --dither: add TPDF dither when reducing the bit depth\n");
+    printf("\t --io mmap|read: how to read the input file (default mmap, read in chunks for pipes)\n");
+    printf("\t --out-io stdio|uring|direct: how to write the output file (default uring for files, stdio for pipes),\n");
+    printf("\t                               direct is uring with O_DIRECT, bypassing the page cache\n");
+    printf("\t --pipeline on|off|stats: read, codec and write on three threads (default on), stats prints per stage time and ring occupancy\n");
+    printf("\t --trace text|json: per frame encode/decode/parse/write latency histograms per codec, printed to stderr\n");
+    printf("\t                    at exit and on SIGUSR1\n");
+    printf("\t --counters text|json: per codec frames/bytes in and out, concealed frames and errors by type, printed like --trace\n");
+    printf("\t --alloc-guard: abort on any heap allocation after the first packet of a file (debug the allocation free hot path),\n");
+    printf("\t                only in a build with make ALLOC_GUARD=1, not for aac targets (faac allocates in every frame)\n");
+    printf("\t --loudness agc|normalize: level the loudness before encoding. agc: one pass automatic gain and peak limiter;\n");
+    printf("\t                           normalize: measure the integrated loudness (EBU R128) in a decode only pass, then\n");
+    printf("\t                           transcode once with a fixed gain and the limiter, writes <output>.loudness.json\n");
+    printf("\t --target LUFS: target loudness (default -23), --max-gain DB: gain limit (default 20)\n");
+    printf("\t --ceiling DBFS: limiter sample peak ceiling (default -1)\n");
+    printf("\t --loudness-sidecar FILE: write the input/output loudness json to FILE (also for agc)\n");
+    printf("\t --daemon SOCKET: serve transcode sessions on a unix socket with pooled codec handles, until SIGINT/SIGTERM\n");
+    printf("\t --max-conns N: daemon connection limit (default %d)\n", DAEMON_MAX_CONNS);
+    printf("\t --connect SOCKET: translate -i to -o through a running daemon (16bit, no resample/channel/sample conversion)\n");
+    printf("without -i/-o/--from/--to/--rate/--channels/--fps/--bits the source param is asked on stdin\n");
+}
+
+aenc_format_e find_audio_format(char *format)
+{
+    // printf("[%s] format=%s, len=%lu\n", __func__, format, strlen(format));
+    if (strncmp(format, AUDIO_CODEC_PCM, strlen(AUDIO_CODEC_PCM) + 1) == 0 ||
+        strncmp(format, AUDIO_FILE_WAV, strlen(AUDIO_FILE_WAV) + 1) == 0)
+    {
+        return AENC_FORMAT_PCM;
+    }
+    else if (strncmp(format, AUDIO_CODEC_G711A, strlen(AUDIO_CODEC_G711A) + 1) == 0)
+    {
+        return AENC_FORMAT_G711A;
+    }
+    else if (strncmp(format, AUDIO_CODEC_AAC, strlen(AUDIO_CODEC_AAC) + 1) == 0)
+    {
+        return AENC_FORMAT_AAC;
+    }
+    else if (strncmp(format, AUDIO_CODEC_OPUS, strlen(AUDIO_CODEC_OPUS) + 1) == 0)
+    {
+        return AENC_FORMAT_OPUS;
+    }
+    else
+    {
+        fprintf(stderr, "%s: Do not support this format!!!\n", format);
+        return -1;
+    }
+}
+
+static int is_wav_name(const char *filename)
+{
+    const char *ext = strrchr(filename, '.');
+
+    return ext != NULL && strchr(ext, '/') == NULL && strcmp(ext + 1, AUDIO_FILE_WAV) == 0;
+}
+
+/*
+ * 按扩展名判断格式, 扩展名就是格式名, 例如a.g711a, .wav按pcm
+ * @retval
+ *      格式, 没有扩展名或不认识时返回-1
+ */
+static int format_from_extension(char *filename)
+{
+    char *ext = strrchr(filename, '.');
+
+    if (ext == NULL || strchr(ext, '/') != NULL)
+    {
+        return -1;
+    }
+    ext++;
+    if (strcmp(ext, AUDIO_CODEC_PCM) == 0 || strcmp(ext, AUDIO_FILE_WAV) == 0 || strcmp(ext, AUDIO_CODEC_G711A) == 0 ||
+        strcmp(ext, AUDIO_CODEC_AAC) == 0 || strcmp(ext, AUDIO_CODEC_OPUS) == 0)
+    {
+        return find_audio_format(ext);
+    }
+    return -1;
+}
+
+/*
+ * 探测源文件格式: 先看文件头, 裸数据再看扩展名, 都不行按pcm处理.
+ * wav从头里取采样率、声道数和位数填到audio_param, 采样格式填到sample_format(可以为NULL)
+ */
+static int probe_src_format(char *src_filename, audio_param_t *audio_param, audio_container_e *container, int *sample_format)
+{
+    FILE *fp = NULL;
+    unsigned char probe_buf[PROBE_SIZE];
+    int probe_len = 0;
+    int ext_format = -1;
+    int ret = 0;
+    audio_input_t *input = NULL;
+    audio_wav_info_t wav;
+
+    fp = fopen(src_filename, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", src_filename);
+        return -1;
+    }
+    probe_len = fread(probe_buf, 1, sizeof(probe_buf), fp);
+    fclose(fp);
+
+    *container = AUDIO_CONTAINER_UNKNOWN;
+    if (audio_probe(probe_buf, probe_len, &audio_param->format, container) == 0)
+    {
+        switch (*container)
+        {
+        case AUDIO_CONTAINER_WAV:
+            //  头可能比探测的数据长(前面有LIST等块), 用输入视图解析
+            input = audio_input_open(src_filename, AUDIO_INPUT_AUTO, 0);
+            ret = input == NULL ? -1 : wav_read_header(input, &wav);
+            audio_input_close(input);
+            if (ret <= 0)
+            {
+                fprintf(stderr, "%s: unsupported wav\n", src_filename);
+                return -1;
+            }
+            audio_param->format = wav.audio_param.format;
+            audio_param->samplerate = wav.audio_param.samplerate;
+            audio_param->channels = wav.audio_param.channels;
+            audio_param->bit_depth = wav.audio_param.bit_depth;
+            if (sample_format != NULL)
+            {
+                *sample_format = wav.sample_format;
+            }
+            return 0;
+        case AUDIO_CONTAINER_OGG:
+            fprintf(stderr, "%s: ogg opus input is not supported, only IMI opus\n", src_filename);
+            return -1;
+
+        default:
+            return 0;
+        }
+    }
+
+    ext_format = format_from_extension(src_filename);
+    audio_param->format = ext_format < 0 ? AENC_FORMAT_PCM : ext_format;
+    return 0;
+}
+
+/*
+ * 批量转码: 目录或文件列表里的文件由固定数量的线程领取,
+ * 每个线程只创建一次编码器和各源格式的解码器, 文件之间reset复用
+ */
+typedef struct
+{
+    char *src;
+    char *dst;              // 启动线程前定好, NULL为不转(算失败)
+    int ret;
+    double seconds;         // 转码耗时
+    double audio_seconds;   // 解码出的音频时长
+} batch_item_t;
+
+typedef struct
+{
+    batch_item_t *items;
+    int count;
+    int next;               // 下一个待领取的文件, 各线程原子递增
+    char *out_dir;
+    int from;               // 源格式, <0时逐个文件探测
+    aenc_format_e to_format;
+    audio_param_t audio_param;
+} batch_job_t;
+
+static double elapsed_seconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int batch_add(batch_item_t **items, int *count, int *size, const char *src)
+{
+    batch_item_t *tmp = NULL;
+
+    if (*count == *size)
+    {
+        *size = *size == 0 ? 1024 : *size * 2;
+        tmp = (batch_item_t *)realloc(*items, sizeof(batch_item_t) * (*size));
+        if (tmp == NULL)
+        {
+            return -1;
+        }
+        *items = tmp;
+    }
+    memset(&(*items)[*count], 0, sizeof(batch_item_t));
+    (*items)[*count].src = strdup(src);
+    (*items)[*count].ret = -1;
+    if ((*items)[*count].src == NULL)
+    {
+        return -1;
+    }
+    (*count)++;
+
+    return 0;
+}
+
+static int batch_cmp_src(const void *a, const void *b)
+{
+    return strcmp(((const batch_item_t *)a)->src, ((const batch_item_t *)b)->src);
+}
+
+/*
+ * path是目录时取目录下的普通文件(不递归, 跳过隐藏文件), 否则按文件列表读取, 一行一个路径, "-"为stdin
+ * @retval
+ *      文件数, 出错返回-1
+ */
+static int batch_collect(char *path, batch_item_t **items)
+{
+    int count = 0;
+    int size = 0;
+    char file[4096];
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len = 0;
+    struct stat st;
+    DIR *dir = NULL;
+    FILE *fp = NULL;
+    struct dirent *entry = NULL;
+
+    *items = NULL;
+    if (strcmp(path, "-") != 0 && stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        dir = opendir(path);
+        if (dir == NULL)
+        {
+            fprintf(stderr, "cannot open dir %s\n", path);
+            return -1;
+        }
+        while ((entry = readdir(dir)) != NULL)
+        {
+            if (entry->d_name[0] == '.')
+            {
+                continue;
+            }
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            if (stat(file, &st) != 0 || !S_ISREG(st.st_mode))
+            {
+                continue;
+            }
+            if (batch_add(items, &count, &size, file) != 0)
+            {
+                goto ERR;
+            }
+        }
+        closedir(dir);
+        dir = NULL;
+        //  readdir的顺序不固定, 排序后每次运行的输出顺序一致
+        qsort(*items, count, sizeof(batch_item_t), batch_cmp_src);
+        return count;
+    }
+
+    fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "cannot open list %s\n", path);
+        return -1;
+    }
+    while ((len = getline(&line, &line_size, fp)) > 0)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        {
+            line[--len] = 0;
+        }
+        if (len == 0)
+        {
+            continue;
+        }
+        if (batch_add(items, &count, &size, line) != 0)
+        {
+            goto ERR;
+        }
+    }
+    free(line);
+    if (fp != stdin)
+    {
+        fclose(fp);
+    }
+    return count;
+
+ERR:
+    fprintf(stderr, "[%s] out of memory\n", __func__);
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+    if (fp != NULL && fp != stdin)
+    {
+        fclose(fp);
+    }
+    free(line);
+    while (count > 0)
+    {
+        free((*items)[--count].src);
+    }
+    free(*items);
+    *items = NULL;
+    return -1;
+}
+
+/*
+ * 输出文件: out_dir/源文件名去掉扩展名.目标格式, keep_ext时保留源文件的扩展名
+ */
+static void batch_out_name(batch_job_t *job, char *src, int keep_ext, char *dst, int dst_size)
+{
+    char *name = strrchr(src, '/');
+    char *ext = NULL;
+    int name_len = 0;
+
+    name = name == NULL ? src : name + 1;
+    ext = strrchr(name, '.');
+    name_len = (keep_ext || ext == NULL || ext == name) ? (int)strlen(name) : (int)(ext - name);
+    snprintf(dst, dst_size, "%s/%.*s.%s", job->out_dir, name_len, name,
+             out_wav && job->to_format == AENC_FORMAT_PCM ? AUDIO_FILE_WAV : audio_codec_find(job->to_format)->name);
+}
+
+static int batch_cmp_dst(const void *a, const void *b)
+{
+    return strcmp((*(batch_item_t *const *)a)->dst, (*(batch_item_t *const *)b)->dst);
+}
+
+typedef struct
+{
+    dev_t dev;
+    ino_t ino;
+} batch_file_id_t;
+
+static int batch_cmp_file_id(const void *a, const void *b)
+{
+    const batch_file_id_t *fa = (const batch_file_id_t *)a;
+    const batch_file_id_t *fb = (const batch_file_id_t *)b;
+
+    if (fa->dev != fb->dev)
+    {
+        return fa->dev < fb->dev ? -1 : 1;
+    }
+    return fa->ino < fb->ino ? -1 : (fa->ino > fb->ino ? 1 : 0);
+}
+
+/*
+ * 启动线程前一次定好所有输出文件名, 线程之间不会写同一个文件, 也不会写到任何一个源文件上:
+ * 去掉扩展名后重名的(test.pcm和test.aac)都保留源扩展名(test.pcm.opus, test.aac.opus),
+ * 这样还重名的, 或者按设备号和inode是某个源文件的, 不转, 算失败
+ * @retval
+ *      不转的文件数, 出错返回-1
+ */
+static int batch_plan(batch_job_t *job)
+{
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    int skipped = 0;
+    int id_count = 0;
+    char dst[4096 + 64];
+    struct stat st;
+    batch_file_id_t id;
+    batch_file_id_t *ids = NULL;
+    batch_item_t **sorted = NULL;
+    batch_item_t *prev = NULL;
+
+    sorted = (batch_item_t **)malloc(sizeof(batch_item_t *) * job->count);
+    ids = (batch_file_id_t *)malloc(sizeof(batch_file_id_t) * job->count);
+    if (sorted == NULL || ids == NULL)
+    {
+        goto ERR;
+    }
+    for (i = 0; i < job->count; i++)
+    {
+        batch_out_name(job, job->items[i].src, 0, dst, sizeof(dst));
+        job->items[i].dst = strdup(dst);
+        if (job->items[i].dst == NULL)
+        {
+            goto ERR;
+        }
+        sorted[i] = &job->items[i];
+        if (stat(job->items[i].src, &st) == 0)
+        {
+            ids[id_count].dev = st.st_dev;
+            ids[id_count].ino = st.st_ino;
+            id_count++;
+        }
+    }
+
+    //  去掉扩展名后重名的一组都改成保留扩展名
+    qsort(sorted, job->count, sizeof(batch_item_t *), batch_cmp_dst);
+    for (i = 0; i < job->count; i = j)
+    {
+        j = i + 1;
+        while (j < job->count && strcmp(sorted[j]->dst, sorted[i]->dst) == 0)
+        {
+            j++;
+        }
+        for (k = i; j - i > 1 && k < j; k++)
+        {
+            batch_out_name(job, sorted[k]->src, 1, dst, sizeof(dst));
+            free(sorted[k]->dst);
+            sorted[k]->dst = strdup(dst);
+            if (sorted[k]->dst == NULL)
+            {
+                goto ERR;
+            }
+        }
+    }
+
+    //  保留扩展名后还重名的(列表里同一个文件写了两次, 或者不同目录下的同名文件), 只转第一个
+    qsort(sorted, job->count, sizeof(batch_item_t *), batch_cmp_dst);
+    qsort(ids, id_count, sizeof(batch_file_id_t), batch_cmp_file_id);
+    for (i = 0; i < job->count; i++)
+    {
+        if (prev != NULL && strcmp(sorted[i]->dst, prev->dst) == 0)
+        {
+            fprintf(stderr, "%s: output %s is also the output of %s\n", sorted[i]->src, sorted[i]->dst, prev->src);
+        }
+        else if (stat(sorted[i]->dst, &st) == 0 &&
+                 (id.dev = st.st_dev, id.ino = st.st_ino,
+                  bsearch(&id, ids, id_count, sizeof(batch_file_id_t), batch_cmp_file_id) != NULL))
+        {
+            fprintf(stderr, "%s: output %s would overwrite a source\n", sorted[i]->src, sorted[i]->dst);
+        }
+        else
+        {
+            prev = sorted[i];
+            continue;
+        }
+        free(sorted[i]->dst);
+        sorted[i]->dst = NULL;
+        skipped++;
+    }
+
+    free(ids);
+    free(sorted);
+    return skipped;
+
+ERR:
+    fprintf(stderr, "[%s] out of memory\n", __func__);
+    free(ids);
+    free(sorted);
+    return -1;
+}
+
+static int batch_transcode_one(batch_job_t *job, batch_item_t *item, encode_sink_t *sink, audio_codec_t **decoder)
+{
+    int ret = 0;
+    char *dst = item->dst;
+    audio_param_t audio_param = job->audio_param;
+    audio_param_t enc_param;
+    audio_container_e container = AUDIO_CONTAINER_UNKNOWN;
+    int sample_format = source_sample_format(job->audio_param);
+    double gain = 0;
+    char sidecar[4096 + 16];
+    audio_loudness_info_t in_info;
+
+    if (dst == NULL)
+    {
+        return -1;
+    }
+    if (job->from >= 0)
+    {
+        audio_param.format = job->from;
+    }
+    else if (probe_src_format(item->src, &audio_param, &container, &sample_format) != 0)
+    {
+        return -1;
+    }
+    if (audio_param.format == AENC_FORMAT_PCM && job->to_format == AENC_FORMAT_PCM && same_pcm_layout(audio_param, job->to_format) &&
+        container != AUDIO_CONTAINER_WAV && !out_wav && loudness_mode == LOUDNESS_OFF)
+    {
+        fprintf(stderr, "%s: pcm no need translete to pcm\n", item->src);
+        return -1;
+    }
+
+    //  wav的参数每个文件可能不同, 编码器的参数跟着变时重建
+    enc_param = encoder_param(audio_param);
+    if (enc_param.samplerate != sink->audio_param.samplerate || enc_param.channels != sink->audio_param.channels ||
+        target_sample_format(job->to_format, sample_format) != sink->out_sample)
+    {
+        encode_sink_release(sink);
+        if (encode_sink_init(sink, job->to_format, enc_param, sample_format) != 0)
+        {
+            return -1;
+        }
+    }
+
+    //  每种源格式的解码器第一次用到时创建, 之后reset复用
+    if (decoder[audio_param.format] == NULL)
+    {
+        decoder[audio_param.format] = audio_codec_open(audio_param.format, AUDIO_CODEC_DECODER, audio_param);
+        if (decoder[audio_param.format] == NULL)
+        {
+            return -1;
+        }
+    }
+    else if (audio_codec_reset(decoder[audio_param.format]) != 0)
+    {
+        return -1;
+    }
+
+    if (loudness_mode == LOUDNESS_NORMALIZE)
+    {
+        if (loudness_measure(item->src, audio_param, sample_format, &in_info) != 0)
+        {
+            return -1;
+        }
+        gain = loudness_gain(&in_info);
+    }
+
+    if (encode_sink_begin(sink, dst) != 0)
+    {
+        return -1;
+    }
+    if (loudness_mode == LOUDNESS_NORMALIZE)
+    {
+        audio_agc_set_gain(sink->agc, gain);
+    }
+    ret = decode2sink(item->src, audio_param, decoder[audio_param.format], sink);
+    if (encode_sink_end(sink) != 0)
+    {
+        ret = -1;
+    }
+    if (ret == 0 && sink->pcm_bytes == 0)
+    {
+        fprintf(stderr, "%s: no audio decoded\n", item->src);
+        ret = -1;
+    }
+    //  两遍归一化时每个输出文件旁边一个响度文件
+    if (ret == 0 && loudness_mode == LOUDNESS_NORMALIZE)
+    {
+        snprintf(sidecar, sizeof(sidecar), "%s.loudness.json", dst);
+        ret = loudness_report(sink, &in_info, gain, sidecar, NULL);
+    }
+    item->audio_seconds = (double)sink->pcm_bytes /
+                          (audio_param.samplerate * audio_param.channels * (audio_param.bit_depth / 8));
+
+    return ret;
+}
+
+static void *batch_worker(void *arg)
+{
+    int i = 0;
+    batch_job_t *job = (batch_job_t *)arg;
+    batch_item_t *item = NULL;
+    encode_sink_t sink;
+    audio_codec_t *decoder[AENC_FORMAT_MAX] = {NULL};
+    struct timespec start, end;
+
+    if (encode_sink_init(&sink, job->to_format, encoder_param(job->audio_param), source_sample_format(job->audio_param)) != 0)
+    {
+        fprintf(stderr, "[%s] cannot create encoder\n", __func__);
+        return NULL;
+    }
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count)
+    {
+        item = &job->items[i];
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        item->ret = batch_transcode_one(job, item, &sink, decoder);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        item->seconds = elapsed_seconds(&start, &end);
+        if (item->ret != 0)
+        {
+            fprintf(stderr, "[batch] %s failed\n", item->src);
+        }
+    }
+
+    for (i = 0; i < AENC_FORMAT_MAX; i++)
+    {
+        audio_codec_close(decoder[i]);
+    }
+    encode_sink_release(&sink);
+
+    return NULL;
+}
+
+static int batch_cmp_seconds(const void *a, const void *b)
+{
+    double sa = (*(batch_item_t *const *)a)->seconds;
+    double sb = (*(batch_item_t *const *)b)->seconds;
+
+    return sa < sb ? 1 : (sa > sb ? -1 : 0);
+}
+
+/*
+ * 汇总: 吞吐(files/s, 音频时长/墙钟时间), 单文件耗时分布, 最慢的几个文件
+ */
+static void batch_report(batch_job_t *job, int workers, double wall_seconds)
+{
+    int i = 0;
+    int ok = 0;
+    int slow = 0;
+    double audio_seconds = 0;
+    double median = 0;
+    batch_item_t **sorted = NULL;
+
+    sorted = (batch_item_t **)malloc(sizeof(batch_item_t *) * (job->count + 1));
+    if (sorted == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < job->count; i++)
+    {
+        if (job->items[i].ret == 0)
+        {
+            sorted[ok++] = &job->items[i];
+            audio_seconds += job->items[i].audio_seconds;
+        }
+    }
+    qsort(sorted, ok, sizeof(batch_item_t *), batch_cmp_seconds);
+
+    printf("batch: %d files, %d ok, %d failed, %d workers, %.3f s\n",
+           job->count, ok, job->count - ok, workers, wall_seconds);
+    if (ok == 0 || wall_seconds <= 0)
+    {
+        free(sorted);
+        return;
+    }
+    printf("throughput: %.1f files/s, %.1f s audio, %.1fx realtime\n",
+           ok / wall_seconds, audio_seconds, audio_seconds / wall_seconds);
+
+    //  降序排列, 第k慢的下标为k-1
+    median = sorted[ok / 2]->seconds;
+    printf("per file: p50=%.2f ms, p99=%.2f ms, max=%.2f ms\n",
+           median * 1000, sorted[ok / 100]->seconds * 1000, sorted[0]->seconds * 1000);
+    for (i = 0; i < ok && sorted[i]->seconds > median * BATCH_STRAGGLER_FACTOR; i++)
+    {
+        slow++;
+    }
+    printf("stragglers: %d files slower than %dx p50\n", slow, BATCH_STRAGGLER_FACTOR);
+    for (i = 0; i < ok && i < BATCH_STRAGGLER_SHOW; i++)
+    {
+        printf("\t%.2f ms %.1fx realtime %s\n", sorted[i]->seconds * 1000,
+               sorted[i]->seconds > 0 ? sorted[i]->audio_seconds / sorted[i]->seconds : 0, sorted[i]->src);
+    }
+
+    free(sorted);
+}
+
+int batch_transcode(char *list_path, char *out_dir, int from, audio_param_t audio_param, aenc_format_e to_format, int workers)
+{
+    int i = 0;
+    int ret = 0;
+    int started = 0;
+    batch_job_t job;
+    pthread_t *tids = NULL;
+    struct timespec start, end;
+
+    memset(&job, 0, sizeof(batch_job_t));
+    job.count = batch_collect(list_path, &job.items);
+    if (job.count <= 0)
+    {
+        fprintf(stderr, "%s: no file to translate\n", list_path);
+        return -1;
+    }
+    job.out_dir = out_dir;
+    job.from = from;
+    job.to_format = to_format;
+    job.audio_param = audio_param;
+    if (batch_plan(&job) < 0)
+    {
+        ret = -1;
+        goto END;
+    }
+
+    if (workers > job.count)
+    {
+        workers = job.count;
+    }
+    tids = (pthread_t *)malloc(sizeof(pthread_t) * workers);
+    if (tids == NULL)
+    {
+        ret = -1;
+        goto END;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (started = 0; started < workers; started++)
+    {
+        if (pthread_create(&tids[started], NULL, batch_worker, &job) != 0)
+        {
+            fprintf(stderr, "[%s] pthread_create failed\n", __func__);
+            break;
+        }
+    }
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    batch_report(&job, started, elapsed_seconds(&start, &end));
+    for (i = 0; i < job.count; i++)
+    {
+        if (job.items[i].ret != 0)
+        {
+            ret = -1;
+        }
+    }
+
+END:
+    for (i = 0; i < job.count; i++)
+    {
+        free(job.items[i].src);
+        free(job.items[i].dst);
+    }
+    free(job.items);
+    free(tids);
+
+    return ret;
+}
+
+/*
+ * 兼容旧用法: 在stdin上逐项询问源文件的参数
+ */
+static int prompt_audio_param(audio_param_t *audio_param)
+{
+    char stdin_get[512] = {0};
+    int format = -1;
+
+    printf("Please enter some info about your source audio\n");
+    printf("format(default pcm): ");
+    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
+    {
+        if (stdin_get[0] != '\n')
+        {
+            stdin_get[strlen(stdin_get) - 1] = 0;
+            format = (int)find_audio_format(stdin_get);
+            if (format < 0)
+            {
+                fprintf(stderr, "format=%d, err param!!!\n", format);
+                return -4;
+            }
+            audio_param->format = format;
+        }
+    }
+    printf("bit_depth(default 16): ");
+    memset(stdin_get, 0, sizeof(stdin_get));
+    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
+    {
+        if (stdin_get[0] != '\n')
+        {
+            audio_param->bit_depth = atoi(stdin_get);
+            if (audio_param->bit_depth % sizeof(char) != 0)
+            {
+                fprintf(stderr, "bit_depth=%d, err param!!!\n", audio_param->bit_depth);
+                return -5;
+            }
+        }
+    }
+    printf("channels(default 1): ");
+    memset(stdin_get, 0, sizeof(stdin_get));
+    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
+    {
+        if (stdin_get[0] != '\n')
+        {
+            audio_param->channels = atoi(stdin_get);
+            if (audio_param->channels < 1 || audio_param->channels > AUDIO_CHANNELS_MAX)
+            {
+                fprintf(stderr, "channels=%d, err param!!!\n", audio_param->channels);
+                return -6;
+            }
+        }
+    }
+    printf("samplerate(default 16000): ");
+    memset(stdin_get, 0, sizeof(stdin_get));
+    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
+    {
+        if (stdin_get[0] != '\n')
+        {
+            audio_param->samplerate = atoi(stdin_get);
+            if (!samplerate_is_valid(audio_param->samplerate))
+            {
+                fprintf(stderr, "samplerate=%d, err param!!!\n", audio_param->samplerate);
+                return -7;
+            }
+        }
+    }
+    printf("fps(default 50): ");
+    memset(stdin_get, 0, sizeof(stdin_get));
+    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
+    {
+        if (stdin_get[0] != '\n')
+        {
+            audio_param->fps = atoi(stdin_get);
+            if (audio_param->fps % 25 != 0)
+            {
+                fprintf(stderr, "fps=%d, err param!!!\n", audio_param->fps);
+                return -8;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * 源文件解码后直接在内存里送给目标编码器, 不再经过out.pcm中转
+ */
+int transcode(char *src_filename, char *dst_filename, audio_param_t audio_param, audio_container_e container, aenc_format_e to_format)
+{
+    int ret = 0;
+    encode_sink_t sink;
+    double gain = 0;
+    char sidecar[4096];
+    audio_loudness_info_t in_info;
+
+    int same_layout = same_pcm_layout(audio_param, to_format);
+
+    //  打开输出时会截断, 输出是源文件的话源就没了
+    if (same_file(src_filename, dst_filename))
+    {
+        fprintf(stderr, "%s: output would overwrite the source\n", src_filename);
+        return -1;
+    }
+
+    //  加/去wav头或者换采样格式不算同格式
+    if (audio_param.format == AENC_FORMAT_PCM && to_format == AENC_FORMAT_PCM && same_layout &&
+        container != AUDIO_CONTAINER_WAV && !out_wav && loudness_mode == LOUDNESS_OFF)
+    {
+        fprintf(stderr, "pcm no need translete to pcm\n");
+        return -1;
+    }
+
+    //  DTX依赖连续的静音检测, 分段编码时不支持
+    if (audio_param.format == AENC_FORMAT_PCM && to_format == AENC_FORMAT_OPUS && same_layout && container != AUDIO_CONTAINER_WAV &&
+        opus_threads > 1 && opus_dtx == OPUS_DTX_OFF && strcmp(src_filename, STREAM_PATH) != 0 && loudness_mode == LOUDNESS_OFF)
+    {
+        return pcm2opus_parallel(audio_param, src_filename, dst_filename, opus_threads);
+    }
+
+    //  两遍归一化: 先只解码量出整体响度, 编码只有一遍
+    if (loudness_mode == LOUDNESS_NORMALIZE)
+    {
+        if (strcmp(src_filename, STREAM_PATH) == 0)
+        {
+            fprintf(stderr, "--loudness normalize reads the source twice, use agc for stdin\n");
+            return -1;
+        }
+        if (loudness_measure(src_filename, audio_param, source_sample_format(audio_param), &in_info) != 0)
+        {
+            return -1;
+        }
+        gain = loudness_gain(&in_info);
+    }
+
+    ret = encode_sink_open(&sink, to_format, encoder_param(audio_param), source_sample_format(audio_param), dst_filename);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    if (loudness_mode == LOUDNESS_NORMALIZE)
+    {
+        audio_agc_set_gain(sink.agc, gain);
+    }
+
+    if (use_pipeline)
+    {
+        ret = pipeline2sink(src_filename, audio_param, &sink);
+    }
+    else
+    {
+        ret = decode2sink(src_filename, audio_param, NULL, &sink);
+        if (encode_sink_end(&sink) != 0)
+        {
+            ret = -1;
+        }
+    }
+    //  空文件或者一包都解不出来的不算成功
+    if (ret == 0 && sink.pcm_bytes == 0)
+    {
+        fprintf(stderr, "%s: no audio decoded\n", src_filename);
+        ret = -1;
+    }
+
+    if (ret == 0 && loudness_mode != LOUDNESS_OFF)
+    {
+        if (loudness_sidecar == NULL && loudness_mode == LOUDNESS_NORMALIZE && strcmp(dst_filename, STREAM_PATH) != 0)
+        {
+            snprintf(sidecar, sizeof(sidecar), "%s.loudness.json", dst_filename);
+        }
+        else
+        {
+            snprintf(sidecar, sizeof(sidecar), "%s", loudness_sidecar != NULL ? loudness_sidecar : "");
+        }
+        ret = loudness_report(&sink, loudness_mode == LOUDNESS_NORMALIZE ? &in_info : NULL, gain,
+                              sidecar[0] != '\0' ? sidecar : NULL, info_fp);
+    }
+    encode_sink_release(&sink);
+
+    return ret;
+}
+
+#if 1   //  守护进程的客户端
+typedef struct
+{
+    int fd;
+    audio_output_t *output;
+    aenc_format_e to_format;
+    opus_uint32 timestamp;
+    int timestamp_step;
+    unsigned char out[AUDIO_DAEMON_HEADER_SIZE + AUDIO_DAEMON_PAYLOAD_MAX]; // 正在发送的消息
+    int out_len;
+    int out_sent;
+    unsigned char in[AUDIO_DAEMON_HEADER_SIZE + AUDIO_DAEMON_PAYLOAD_MAX];  // 正在接收的消息
+    int in_len;
+    int done;               // 收到END或ERROR
+    int failed;
+} daemon_client_t;
+
+static void daemon_client_message(daemon_client_t *client, int type, unsigned char *payload, int len)
+{
+    switch (type)
+    {
+    case AUDIO_DAEMON_MSG_DATA:
+        if (client->to_format == AENC_FORMAT_OPUS)
+        {
+            write_opus_packet(client->output, payload, len, client->timestamp);
+            client->timestamp += client->timestamp_step;
+        }
+        else
+        {
+            audio_output_write(client->output, payload, len);
+        }
+        break;
+    case AUDIO_DAEMON_MSG_ERROR:
+        fprintf(stderr, "daemon error: %.*s\n", len, payload);
+        client->failed = 1;
+        client->done = 1;
+        break;
+
+    default:
+        client->done = 1;
+        break;
+    }
+}
+
+/*
+ * 非阻塞收发: 发送时也要及时收回复, 否则守护进程反压后双方都写不出去
+ */
+static int daemon_client_poll(daemon_client_t *client)
+{
+    ssize_t ret = 0;
+    int need = 0;
+    struct pollfd pfd;
+
+    pfd.fd = client->fd;
+    pfd.events = POLLIN | (client->out_sent < client->out_len ? POLLOUT : 0);
+    if (poll(&pfd, 1, -1) < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        need = AUDIO_DAEMON_HEADER_SIZE;
+        if (client->in_len >= AUDIO_DAEMON_HEADER_SIZE)
+        {
+            need += ((unsigned int)client->in[4] << 24) | (client->in[5] << 16) | (client->in[6] << 8) | client->in[7];
+        }
+        if (need > (int)sizeof(client->in))
+        {
+            return -1;
+        }
+        ret = recv(client->fd, client->in + client->in_len, need - client->in_len, MSG_DONTWAIT);
+        if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR))
+        {
+            fprintf(stderr, "daemon closed the connection\n");
+            return -1;
+        }
+        client->in_len += ret > 0 ? ret : 0;
+        //  头收齐后才知道负载长度, 负载为空时头就是整条消息
+        if (client->in_len == AUDIO_DAEMON_HEADER_SIZE)
+        {
+            need = AUDIO_DAEMON_HEADER_SIZE + (int)(((unsigned int)client->in[4] << 24) | (client->in[5] << 16) | (client->in[6] << 8) | client->in[7]);
+        }
+        if (client->in_len == need)
+        {
+            daemon_client_message(client, client->in[0], client->in + AUDIO_DAEMON_HEADER_SIZE, need - AUDIO_DAEMON_HEADER_SIZE);
+            client->in_len = 0;
+        }
+    }
+    if (pfd.revents & POLLOUT)
+    {
+        ret = send(client->fd, client->out + client->out_sent, client->out_len - client->out_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (ret < 0 && errno != EAGAIN && errno != EINTR)
+        {
+            return -1;
+        }
+        client->out_sent += ret > 0 ? ret : 0;
+    }
+    return 0;
+}
+
+/*
+ * 把一条消息交给daemon_client_poll发送, 发完才返回
+ */
+static int daemon_client_send(daemon_client_t *client, audio_daemon_msg_e type, unsigned char *payload, int len)
+{
+    audio_daemon_header(client->out, type, len);
+    memcpy(client->out + AUDIO_DAEMON_HEADER_SIZE, payload, len);
+    client->out_len = AUDIO_DAEMON_HEADER_SIZE + len;
+    client->out_sent = 0;
+    while (client->out_sent < client->out_len && !client->done)
+    {
+        if (daemon_client_poll(client) != 0)
+        {
+            return -1;
+        }
+    }
+    return client->failed ? -1 : 0;
+}
+
+/*
+ * 把源文件按包发给守护进程转码, 收到的包按目标格式写到输出文件
+ */
+int daemon_transcode(char *socket_path, char *src_filename, char *dst_filename, audio_param_t audio_param, aenc_format_e to_format)
+{
+    int ret = 0;
+    int len = 0;
+    unsigned char *packet = NULL;
+    unsigned char open[AUDIO_DAEMON_OPEN_SIZE];
+    struct sockaddr_un addr;
+    audio_wav_info_t wav;
+    packet_reader_t reader;
+    daemon_client_t *client = NULL;
+
+    memset(&reader, 0, sizeof(packet_reader_t));
+    client = (daemon_client_t *)calloc(1, sizeof(daemon_client_t));
+    if (client == NULL)
     {
-        fprintf(stderr, "param err!!!\n");
-        printf_usage(argv[0]);
         return -1;
     }
+    client->fd = -1;
+    client->to_format = to_format;
+    client->timestamp_step = audio_param.samplerate / audio_param.fps;
+
+    reader.format = audio_param.format;
+    reader.remain = -1;
+    reader.input = strcmp(src_filename, STREAM_PATH) == 0 ? audio_input_open_fd(STDIN_FILENO, AUDIO_INPUT_READ, STREAM_WINDOW_MIN)
+                                                         : audio_input_open(src_filename, input_mode, 0);
+    client->output = output_open(dst_filename);
+    if (reader.input == NULL || client->output == NULL)
+    {
+        fprintf(stderr, "cannot open %s or %s\n", src_filename, dst_filename);
+        ret = -1;
+        goto END;
+    }
+    //  守护进程只做编解码, wav头在这里去掉
+    if (audio_param.format == AENC_FORMAT_PCM && wav_read_header(reader.input, &wav) > 0)
+    {
+        if (wav.sample_format != AUDIO_SAMPLE_S16)
+        {
+            fprintf(stderr, "%s: daemon only takes 16bit pcm\n", src_filename);
+            ret = -1;
+            goto END;
+        }
+        audio_param.samplerate = wav.audio_param.samplerate;
+        audio_param.channels = wav.audio_param.channels;
+        client->timestamp_step = audio_param.samplerate / audio_param.fps;
+        reader.remain = wav.data_size;
+    }
+    reader.chunk_size = audio_param.format == AENC_FORMAT_G711A ? G711A_BATCH_SAMPLES : PCM_READ_CHUNK;
+    reader.frame_unit = audio_param.channels * (audio_param.format == AENC_FORMAT_G711A ? 1 : audio_param.bit_depth / 8);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "cannot connect %s: %s\n", socket_path, strerror(errno));
+        ret = -1;
+        goto END;
+    }
+
+    audio_daemon_open_payload(open, audio_param, to_format);
+    ret = daemon_client_send(client, AUDIO_DAEMON_MSG_OPEN, open, sizeof(open));
+    while (ret == 0 && (len = packet_reader_next(&reader, &packet)) > 0)
+    {
+        ret = daemon_client_send(client, AUDIO_DAEMON_MSG_DATA, packet, len);
+    }
+    if (ret == 0)
+    {
+        ret = daemon_client_send(client, AUDIO_DAEMON_MSG_END, NULL, 0);
+    }
+    while (ret == 0 && !client->done)
+    {
+        ret = daemon_client_poll(client);
+    }
+    if (client->failed)
+    {
+        ret = -1;
+    }
 
-    if (access(argv[1], F_OK) != 0)
+END:
+    if (client->fd >= 0)
     {
-        fprintf(stderr, "%s: No such file!!!\n", argv[1]);
-        printf_usage(argv[0]);
-        return -2;
+        close(client->fd);
+    }
+    if (audio_output_close(client->output) != 0)
+    {
+        ret = -1;
+    }
+    audio_input_close(reader.input);
+    free(client);
+    return ret;
+}
+
+static void daemon_signal(int sig)
+{
+    (void)sig;
+    audio_daemon_stop();
+}
+
+/*
+ * 守护进程: SIGINT/SIGTERM退出, 不设SA_RESTART, epoll_wait会被打断
+ */
+int daemon_serve(char *socket_path, int max_conns)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = daemon_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "listening on %s\n", socket_path);
+    return audio_daemon_run(socket_path, max_conns);
+}
+#endif
+
+#if 1   //  耗时统计和计数器
+static void stats_dump(void)
+{
+    if (trace_json >= 0)
+    {
+        audio_trace_dump(stderr, trace_json);
+    }
+    if (counters_json >= 0)
+    {
+        audio_codec_dump_counters(stderr, counters_json);
     }
+}
+
+//  SIGUSR1在所有线程里都屏蔽, 由这个线程同步地等, 不用在信号处理函数里输出
+static void *stats_signal_thread(void *arg)
+{
+    int sig = 0;
+    sigset_t *set = (sigset_t *)arg;
 
-    to_format = find_audio_format(argv[2]);
-    if (to_format < 0)
+    while (sigwait(set, &sig) == 0)
     {
-        fprintf(stderr, "%s: Do not support this format!!!\n", argv[2]);
-        printf_usage(argv[0]);
-        return -3;
+        stats_dump();
+    }
+    return NULL;
+}
+
+/*
+ * 退出时和收到SIGUSR1时输出统计, 要在创建其他线程之前调用, 它们才会继承信号屏蔽
+ */
+static int stats_watch(void)
+{
+    static sigset_t set;
+    pthread_t thread;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0 || pthread_create(&thread, NULL, stats_signal_thread, &set) != 0)
+    {
+        fprintf(stderr, "[%s] cannot watch SIGUSR1\n", __func__);
+        return -1;
     }
+    pthread_detach(thread);
+    atexit(stats_dump);
+    audio_trace_enable(trace_json >= 0);
+
+    return 0;
+}
+#endif
+
+enum
+{
+    OPT_DTX = 0x100,
+    OPT_FROM,
+    OPT_TO,
+    OPT_RATE,
+    OPT_CHANNELS,
+    OPT_FPS,
+    OPT_BITS,
+    OPT_BATCH,
+    OPT_WORKERS,
+    OPT_FLUSH,
+    OPT_BUFFER,
+    OPT_IO,
+    OPT_OUT_IO,
+    OPT_OUT_RATE,
+    OPT_QUALITY,
+    OPT_OUT_CHANNELS,
+    OPT_SAMPLE,
+    OPT_OUT_SAMPLE,
+    OPT_DITHER,
+    OPT_DAEMON,
+    OPT_MAX_CONNS,
+    OPT_CONNECT,
+    OPT_PIPELINE,
+    OPT_TRACE,
+    OPT_COUNTERS,
+    OPT_ALLOC_GUARD,
+    OPT_LOUDNESS,
+    OPT_TARGET,
+    OPT_MAX_GAIN,
+    OPT_CEILING,
+    OPT_LOUDNESS_SIDECAR
+};
 
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    audio_param_t audio_param;
+    int format = -1;             //  aenc_format_e是无符号枚举, 用int才能判断-1
+    int to_format = -1;
+    char *src_filename = NULL;
+    char *dst_filename = NULL;
+    int interactive = 1;
+    int has_from = 0;
+    audio_container_e container = AUDIO_CONTAINER_UNKNOWN;
+    audio_param_t wav_param;
+    char *batch_path = NULL;
+    char *daemon_path = NULL;
+    char *connect_path = NULL;
+    int max_conns = DAEMON_MAX_CONNS;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int alloc_guard = 0;
+    int opt = 0;
+    struct option long_options[] = {
+        {"input", required_argument, NULL, 'i'},
+        {"output", required_argument, NULL, 'o'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"dtx", required_argument, NULL, OPT_DTX},
+        {"from", required_argument, NULL, OPT_FROM},
+        {"to", required_argument, NULL, OPT_TO},
+        {"rate", required_argument, NULL, OPT_RATE},
+        {"channels", required_argument, NULL, OPT_CHANNELS},
+        {"fps", required_argument, NULL, OPT_FPS},
+        {"bits", required_argument, NULL, OPT_BITS},
+        {"batch", required_argument, NULL, OPT_BATCH},
+        {"workers", required_argument, NULL, OPT_WORKERS},
+        {"flush", no_argument, NULL, OPT_FLUSH},
+        {"buffer", required_argument, NULL, OPT_BUFFER},
+        {"io", required_argument, NULL, OPT_IO},
+        {"out-io", required_argument, NULL, OPT_OUT_IO},
+        {"out-rate", required_argument, NULL, OPT_OUT_RATE},
+        {"quality", required_argument, NULL, OPT_QUALITY},
+        {"out-channels", required_argument, NULL, OPT_OUT_CHANNELS},
+        {"sample", required_argument, NULL, OPT_SAMPLE},
+        {"out-sample", required_argument, NULL, OPT_OUT_SAMPLE},
+        {"dither", no_argument, NULL, OPT_DITHER},
+        {"daemon", required_argument, NULL, OPT_DAEMON},
+        {"max-conns", required_argument, NULL, OPT_MAX_CONNS},
+        {"connect", required_argument, NULL, OPT_CONNECT},
+        {"pipeline", required_argument, NULL, OPT_PIPELINE},
+        {"trace", required_argument, NULL, OPT_TRACE},
+        {"counters", required_argument, NULL, OPT_COUNTERS},
+        {"alloc-guard", no_argument, NULL, OPT_ALLOC_GUARD},
+        {"loudness", required_argument, NULL, OPT_LOUDNESS},
+        {"target", required_argument, NULL, OPT_TARGET},
+        {"max-gain", required_argument, NULL, OPT_MAX_GAIN},
+        {"ceiling", required_argument, NULL, OPT_CEILING},
+        {"loudness-sidecar", required_argument, NULL, OPT_LOUDNESS_SIDECAR},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+
+    info_fp = stdout;
+    audio_agc_param_default(&agc_param);
     memset(&audio_param, 0, sizeof(audio_param_t));
     audio_param.format = AENC_FORMAT_PCM;
     audio_param.bit_depth = 16;
     audio_param.channels = 1;
     audio_param.samplerate = AUDIO_SAMPLERATE_16000;
     audio_param.fps = 50;
-    printf("Please enter some info about your source audio\n");
-    printf("format(default pcm): ");
-    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
+
+    while ((opt = getopt_long(argc, argv, "i:o:j:h", long_options, NULL)) != -1)
     {
-        if (stdin_get[0] != '\n')
+        //  -j/--dtx只是编码选项, 其余参数给出后就不再询问stdin
+        if (opt != 'j' && opt != OPT_DTX)
         {
-            stdin_get[strlen(stdin_get) - 1] = 0;
-            audio_param.format = find_audio_format(stdin_get);
-            if (audio_param.format < 0)
+            interactive = 0;
+        }
+        switch (opt)
+        {
+        case 'i':
+            src_filename = optarg;
+            break;
+        case 'o':
+            dst_filename = optarg;
+            break;
+        case 'j':
+            opus_threads = atoi(optarg);
+            if (opus_threads < 1)
+            {
+                fprintf(stderr, "jobs=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_DTX:
+            if (strcmp(optarg, "keep") == 0)
+            {
+                opus_dtx = OPUS_DTX_KEEP;
+            }
+            else if (strcmp(optarg, "drop") == 0)
+            {
+                opus_dtx = OPUS_DTX_DROP;
+            }
+            else
+            {
+                fprintf(stderr, "dtx=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_FROM:
+            format = (int)find_audio_format(optarg);
+            if (format < 0)
             {
-                fprintf(stderr, "format=%d, err param!!!\n", audio_param.format);
                 return -4;
             }
-            memcpy(src_format, stdin_get, strlen(stdin_get) + 1);
-        }
-    }
-    printf("bit_depth(default 16): ");
-    memset(stdin_get, 0, sizeof(stdin_get));
-    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
-    {
-        if (stdin_get[0] != '\n')
-        {
-            audio_param.bit_depth = atoi(stdin_get);
-            if (audio_param.bit_depth % sizeof(char) != 0)
+            audio_param.format = format;
+            has_from = 1;
+            if (strcmp(optarg, AUDIO_FILE_WAV) == 0)
+            {
+                container = AUDIO_CONTAINER_WAV;
+            }
+            break;
+        case OPT_TO:
+            to_format = (int)find_audio_format(optarg);
+            if (to_format < 0)
+            {
+                return -3;
+            }
+            out_wav = strcmp(optarg, AUDIO_FILE_WAV) == 0;
+            break;
+        case OPT_RATE:
+            audio_param.samplerate = atoi(optarg);
+            if (!samplerate_is_valid(audio_param.samplerate))
+            {
+                fprintf(stderr, "samplerate=%s, err param!!!\n", optarg);
+                return -7;
+            }
+            break;
+        case OPT_CHANNELS:
+            audio_param.channels = atoi(optarg);
+            if (audio_param.channels < 1 || audio_param.channels > AUDIO_CHANNELS_MAX)
+            {
+                fprintf(stderr, "channels=%s, err param!!!\n", optarg);
+                return -6;
+            }
+            break;
+        case OPT_FPS:
+            audio_param.fps = atoi(optarg);
+            if (audio_param.fps <= 0 || audio_param.fps % 25 != 0)
+            {
+                fprintf(stderr, "fps=%s, err param!!!\n", optarg);
+                return -8;
+            }
+            break;
+        case OPT_BITS:
+            audio_param.bit_depth = atoi(optarg);
+            if (audio_param.bit_depth != 16 && audio_param.bit_depth != 24 && audio_param.bit_depth != 32)
             {
-                fprintf(stderr, "bit_depth=%d, err param!!!\n", audio_param.bit_depth);
+                fprintf(stderr, "bit_depth=%s, err param!!!\n", optarg);
                 return -5;
             }
-        }
-    }
-    printf("channels(default 1): ");
-    memset(stdin_get, 0, sizeof(stdin_get));
-    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
-    {
-        if (stdin_get[0] != '\n')
-        {
-            audio_param.channels = atoi(stdin_get);
-            if (audio_param.channels != 1 && audio_param.channels != 2)
+            in_sample_format = -1;
+            break;
+        case OPT_BATCH:
+            batch_path = optarg;
+            break;
+        case OPT_WORKERS:
+            workers = atoi(optarg);
+            if (workers < 1)
+            {
+                fprintf(stderr, "workers=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_FLUSH:
+            stream_flush = 1;
+            break;
+        case OPT_BUFFER:
+            stream_buffer_size = atoi(optarg);
+            if (stream_buffer_size <= 0)
+            {
+                fprintf(stderr, "buffer=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_IO:
+            if (strcmp(optarg, "mmap") == 0)
+            {
+                input_mode = AUDIO_INPUT_MMAP;
+            }
+            else if (strcmp(optarg, "read") == 0)
+            {
+                input_mode = AUDIO_INPUT_READ;
+            }
+            else
+            {
+                fprintf(stderr, "io=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_OUT_IO:
+            if (strcmp(optarg, "stdio") == 0)
+            {
+                output_mode = AUDIO_OUTPUT_STDIO;
+            }
+            else if (strcmp(optarg, "uring") == 0)
+            {
+                output_mode = AUDIO_OUTPUT_URING;
+            }
+            else if (strcmp(optarg, "direct") == 0)
+            {
+                output_mode = AUDIO_OUTPUT_DIRECT;
+            }
+            else
+            {
+                fprintf(stderr, "out-io=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_OUT_RATE:
+            out_samplerate = atoi(optarg);
+            if (!samplerate_is_valid(out_samplerate))
+            {
+                fprintf(stderr, "out-rate=%s, err param!!!\n", optarg);
+                return -7;
+            }
+            break;
+        case OPT_OUT_CHANNELS:
+            out_channels = atoi(optarg);
+            if (out_channels < 1 || out_channels > AUDIO_CHANNELS_MAX)
             {
-                fprintf(stderr, "channels=%d, err param!!!\n", audio_param.channels);
+                fprintf(stderr, "out-channels=%s, err param!!!\n", optarg);
                 return -6;
             }
+            break;
+        case OPT_SAMPLE:
+            in_sample_format = sample_format_parse(optarg);
+            if (in_sample_format < 0)
+            {
+                fprintf(stderr, "sample=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            audio_param.bit_depth = audio_sample_size(in_sample_format) * 8;
+            break;
+        case OPT_OUT_SAMPLE:
+            out_sample_format = sample_format_parse(optarg);
+            if (out_sample_format < 0)
+            {
+                fprintf(stderr, "out-sample=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_DITHER:
+            sample_dither = 1;
+            break;
+        case OPT_DAEMON:
+            daemon_path = optarg;
+            break;
+        case OPT_MAX_CONNS:
+            max_conns = atoi(optarg);
+            if (max_conns < 1)
+            {
+                fprintf(stderr, "max-conns=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_CONNECT:
+            connect_path = optarg;
+            break;
+        case OPT_PIPELINE:
+            if (strcmp(optarg, "on") == 0 || strcmp(optarg, "stats") == 0)
+            {
+                use_pipeline = 1;
+                pipeline_stats = optarg[0] == 's';
+            }
+            else if (strcmp(optarg, "off") == 0)
+            {
+                use_pipeline = 0;
+            }
+            else
+            {
+                fprintf(stderr, "pipeline=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_TRACE:
+            if (strcmp(optarg, "text") == 0 || strcmp(optarg, "json") == 0)
+            {
+                trace_json = optarg[0] == 'j';
+            }
+            else
+            {
+                fprintf(stderr, "trace=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_COUNTERS:
+            if (strcmp(optarg, "text") == 0 || strcmp(optarg, "json") == 0)
+            {
+                counters_json = optarg[0] == 'j';
+            }
+            else
+            {
+                fprintf(stderr, "counters=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_ALLOC_GUARD:
+#ifdef AUDIO_ALLOC_GUARD
+            alloc_guard = 1;
+            audio_alloc_guard(1);
+            break;
+#else
+            fprintf(stderr, "--alloc-guard needs a debug build: make ALLOC_GUARD=1\n");
+            return -1;
+#endif
+        case OPT_LOUDNESS:
+            if (strcmp(optarg, "agc") == 0)
+            {
+                loudness_mode = LOUDNESS_AGC;
+            }
+            else if (strcmp(optarg, "normalize") == 0)
+            {
+                loudness_mode = LOUDNESS_NORMALIZE;
+            }
+            else
+            {
+                fprintf(stderr, "loudness=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_TARGET:
+            agc_param.target = atof(optarg);
+            if (agc_param.target >= 0 || agc_param.target <= AUDIO_LOUDNESS_FLOOR)
+            {
+                fprintf(stderr, "target=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_MAX_GAIN:
+            agc_param.max_gain = atof(optarg);
+            if (agc_param.max_gain < 0 || agc_param.max_gain > -AUDIO_LOUDNESS_FLOOR)
+            {
+                fprintf(stderr, "max-gain=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_CEILING:
+            agc_param.ceiling = atof(optarg);
+            if (agc_param.ceiling > 0 || agc_param.ceiling < -20)
+            {
+                fprintf(stderr, "ceiling=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_LOUDNESS_SIDECAR:
+            loudness_sidecar = optarg;
+            break;
+        case OPT_QUALITY:
+            if (strcmp(optarg, "fast") == 0)
+            {
+                resample_quality = AUDIO_RESAMPLE_FAST;
+            }
+            else if (strcmp(optarg, "medium") == 0)
+            {
+                resample_quality = AUDIO_RESAMPLE_MEDIUM;
+            }
+            else if (strcmp(optarg, "high") == 0)
+            {
+                resample_quality = AUDIO_RESAMPLE_HIGH;
+            }
+            else
+            {
+                fprintf(stderr, "quality=%s, err param!!!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'h':
+            printf_usage(argv[0]);
+            return 0;
+
+        default:
+            printf_usage(argv[0]);
+            return -1;
         }
     }
-    printf("samplerate(default 16000): ");
-    memset(stdin_get, 0, sizeof(stdin_get));
-    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
+
+    if ((trace_json >= 0 || counters_json >= 0) && stats_watch() != 0)
     {
-        if (stdin_get[0] != '\n')
+        return -1;
+    }
+
+    if (daemon_path != NULL)
+    {
+        return daemon_serve(daemon_path, max_conns) == 0 ? 0 : -9;
+    }
+
+    //  批量模式: -o是输出目录, 源格式逐个文件探测
+    if (batch_path != NULL)
+    {
+        if (to_format < 0 && optind < argc)
         {
-            audio_param.samplerate = atoi(stdin_get);
-            if (audio_param.samplerate % 8000 != 0)
-            {
-                fprintf(stderr, "samplerate=%d, err param!!!\n", audio_param.samplerate);
-                return -7;
-            }
+            out_wav = strcmp(argv[optind], AUDIO_FILE_WAV) == 0;
+            to_format = (int)find_audio_format(argv[optind++]);
+        }
+        if (to_format < 0)
+        {
+            fprintf(stderr, "batch mode needs --to\n");
+            return -3;
+        }
+        if (alloc_guard && alloc_guard_check(to_format) != 0)
+        {
+            return -1;
         }
+        ret = batch_transcode(batch_path, dst_filename != NULL ? dst_filename : ".", has_from ? (int)audio_param.format : -1,
+                              audio_param, to_format, workers < 1 ? 1 : workers);
+        return ret == 0 ? 0 : -9;
     }
-    printf("fps(default 50): ");
-    memset(stdin_get, 0, sizeof(stdin_get));
-    if (fgets(stdin_get, sizeof(stdin_get), stdin) != NULL)
+
+    //  旧用法: [src_audio_file] [to_format]
+    if (src_filename == NULL && optind < argc)
     {
-        if (stdin_get[0] != '\n')
+        src_filename = argv[optind++];
+    }
+    if (to_format < 0 && optind < argc)
+    {
+        out_wav = strcmp(argv[optind], AUDIO_FILE_WAV) == 0;
+        to_format = (int)find_audio_format(argv[optind++]);
+        if (to_format < 0)
         {
-            audio_param.fps = atoi(stdin_get);
-            if (audio_param.fps % 25 != 0)
-            {
-                fprintf(stderr, "fps=%d, err param!!!\n", audio_param.fps);
-                return -8;
-            }
+            printf_usage(argv[0]);
+            return -3;
         }
     }
+    if (to_format < 0 && dst_filename != NULL)
+    {
+        to_format = format_from_extension(dst_filename);
+    }
+    if (to_format == AENC_FORMAT_PCM && dst_filename != NULL && is_wav_name(dst_filename))
+    {
+        out_wav = 1;
+    }
+
+    if (src_filename == NULL || to_format < 0)
+    {
+        fprintf(stderr, "param err!!!\n");
+        printf_usage(argv[0]);
+        return -1;
+    }
+    if (alloc_guard && alloc_guard_check(to_format) != 0)
+    {
+        return -1;
+    }
 
-    printf("Got param: format=%d, bit_depth=%d, channels=%d, samplerate=%d, fps=%d\n",
-           audio_param.format, audio_param.bit_depth, audio_param.channels, audio_param.samplerate, audio_param.fps);
+    //  stdin没法回退, 不能先探测格式; 也不能再用stdin询问参数
+    if (strcmp(src_filename, STREAM_PATH) == 0 && (interactive || !has_from))
+    {
+        fprintf(stderr, "reading stdin needs -i - and --from\n");
+        return -1;
+    }
+    if (strcmp(src_filename, STREAM_PATH) != 0 && access(src_filename, F_OK) != 0)
+    {
+        fprintf(stderr, "%s: No such file!!!\n", src_filename);
+        printf_usage(argv[0]);
+        return -2;
+    }
 
-    if (audio_param.format == AENC_FORMAT_PCM)
+    if (dst_filename == NULL)
     {
-        ret = pcm2other(argv[1], audio_param, to_format);
+        dst_filename = (char *)out_file_name(to_format);
     }
-    else
+    if (strcmp(dst_filename, STREAM_PATH) == 0)
     {
-        ret = other2pcm(argv[1], audio_param, audio_param.format);
+        info_fp = stderr;
+    }
+
+    //  wav的参数都在头里, 不用再询问
+    wav_param = audio_param;
+    if (interactive && probe_src_format(src_filename, &wav_param, &container, &in_sample_format) == 0 &&
+        container == AUDIO_CONTAINER_WAV)
+    {
+        audio_param = wav_param;
+        interactive = 0;
+        has_from = 1;
+    }
+    if (interactive)
+    {
+        ret = prompt_audio_param(&audio_param);
         if (ret != 0)
         {
-            goto END;
+            return ret;
         }
-        if (to_format != AENC_FORMAT_PCM)
+        printf("Got param: format=%d, bit_depth=%d, channels=%d, samplerate=%d, fps=%d\n",
+               audio_param.format, audio_param.bit_depth, audio_param.channels, audio_param.samplerate, audio_param.fps);
+    }
+    else if (!has_from && probe_src_format(src_filename, &audio_param, &container, &in_sample_format) != 0)
+    {
+        return -4;
+    }
+
+    if (connect_path != NULL)
+    {
+        //  守护进程只收发编解码的包, 重采样/变声道/采样格式/wav输出都不做
+        if (out_wav || (out_samplerate > 0 && out_samplerate != audio_param.samplerate) ||
+            (out_channels > 0 && out_channels != audio_param.channels) ||
+            in_sample_format > AUDIO_SAMPLE_S16 || out_sample_format > AUDIO_SAMPLE_S16 || loudness_mode != LOUDNESS_OFF)
         {
-            ret = pcm2other(OUT_FILE_PCM, audio_param, to_format);
+            fprintf(stderr, "--connect only translates the codec\n");
+            return -1;
         }
+        ret = daemon_transcode(connect_path, src_filename, dst_filename, audio_param, to_format);
+    }
+    else
+    {
+        ret = transcode(src_filename, dst_filename, audio_param, container, to_format);
     }
 
-END:
     if (ret != 0)
     {
-        fprintf(stderr, "cannot translate %s, ret=%d\n", argv[1], ret);
+        fprintf(stderr, "cannot translate %s, ret=%d\n", src_filename, ret);
         return -9;
     }
 
     return ret;
-}
\ No newline at end of file
+}